@@ -14,10 +14,10 @@ function get_distribution_pkg_dependencies () {
 
     case "${DISTRO}" in
     "RHEL7"|"RHEL8"|"CENTOS7"|"CENTOS8"|"FEDORA")
-        pkgs_required="${pkgs_common} gcc-c++"
+        pkgs_required="${pkgs_common} gcc-c++ zlib-devel"
         ;;
     "UBUNTU"|"DEBIAN")
-        pkgs_required="${pkgs_common} g++"
+        pkgs_required="${pkgs_common} g++ zlib1g-dev"
         ;;
     *)
         error "Unknown Linux distribution"
@@ -6,14 +6,19 @@
 
 #include <octf/c/iotrace_plugin.h>
 
+#include <stddef.h>
+#include <stdlib.h>
 #include <atomic>
 #include <chrono>
+#include <new>
 #include <thread>
 #include <vector>
 #include <octf/trace/IOTracePlugin.h>
 #include <octf/utils/Exception.h>
 #include <octf/utils/Log.h>
 #include <octf/cli/Executor.h>
+#include <octf/interface/IRingTraceProducer.h>
+#include <octf/utils/CycleClock.h>
 #include <octf/interface/InterfaceConfigurationImpl.h>
 #include <octf/interface/InterfaceTraceManagementImpl.h>
 #include <octf/interface/InterfaceTraceParsingImpl.h>
@@ -21,23 +26,75 @@
 
 using namespace octf;
 
+/**
+ * IO queue id is kept in SID bits starting from this one, when SIDs are
+ * assigned per IO queue
+ */
+static constexpr uint32_t QUEUE_SID_SHIFT = 48;
+
+static constexpr uint64_t QUEUE_SID_MASK = (1ULL << QUEUE_SID_SHIFT) - 1;
+
+static constexpr size_t CACHE_LINE_SIZE = 64;
+
+/**
+ * @brief Allocator of cache line aligned memory, std::allocator doesn't
+ * honor alignment above the one of max_align_t before C++17
+ */
+template <typename T>
+struct CacheLineAllocator {
+    typedef T value_type;
+
+    CacheLineAllocator() = default;
+
+    template <typename U>
+    CacheLineAllocator(const CacheLineAllocator<U> &) {}
+
+    T *allocate(size_t count) {
+        void *data;
+        if (posix_memalign(&data, CACHE_LINE_SIZE, count * sizeof(T))) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T *>(data);
+    }
+
+    void deallocate(T *data, size_t) {
+        free(data);
+    }
+
+    template <typename U>
+    bool operator==(const CacheLineAllocator<U> &) const {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const CacheLineAllocator<U> &) const {
+        return false;
+    }
+};
+
 class IOTracePluginC : public IOTracePlugin {
 private:
-    struct QueueContext {
+    // Keep contexts of IO queues in separate cache lines
+    struct alignas(CACHE_LINE_SIZE) QueueContext {
         std::atomic_bool traceStopping;
         std::atomic<uint64_t> tracingRefCounter;
+        std::atomic<uint64_t> sid;
     };
 
 public:
     IOTracePluginC(octf_iotrace_plugin_context_t context,
                    const std::string &pluginId,
-                   uint32_t queueCount)
+                   uint32_t queueCount,
+                   octf_iotrace_plugin_sid_scheme sidScheme)
             : IOTracePlugin(pluginId, queueCount)
             , m_context(context)
-            , m_queueContext(queueCount) {
+            , m_queueContext(queueCount)
+            , m_sidScheme(sidScheme)
+            , m_clock() {
         for (auto &queueContext : m_queueContext) {
             queueContext.tracingRefCounter = 0;
             queueContext.traceStopping = true;
+            queueContext.sid = 0;
         }
     }
 
@@ -72,9 +129,7 @@ public:
     }
 
     void push(uint32_t ioQueueId, const void *trace, size_t size) override {
-        if (ioQueueId > getTraceQueueCount()) {
-            ioQueueId %= getTraceQueueCount();
-        }
+        ioQueueId = getQueueIndex(ioQueueId);
 
         auto &queueContext = m_queueContext[ioQueueId];
 
@@ -88,7 +143,115 @@ public:
         queueContext.tracingRefCounter--;
     }
 
+    void push(uint32_t ioQueueId,
+              const void *const *traces,
+              const uint32_t *sizes,
+              uint32_t count) override {
+        ioQueueId = getQueueIndex(ioQueueId);
+
+        auto &queueContext = m_queueContext[ioQueueId];
+
+        queueContext.tracingRefCounter++;
+        if (queueContext.traceStopping) {
+            // Tracing stop was requested
+            queueContext.tracingRefCounter--;
+            return;
+        }
+        IOTracePlugin::push(ioQueueId, traces, sizes, count);
+        queueContext.tracingRefCounter--;
+    }
+
+    int reserve(uint32_t ioQueueId,
+                size_t size,
+                TraceReservation &reservation) override {
+        ioQueueId = getQueueIndex(ioQueueId);
+
+        auto &queueContext = m_queueContext[ioQueueId];
+
+        // The reference is held until the event is committed, so that tracing
+        // is not stopped in the meantime
+        queueContext.tracingRefCounter++;
+        if (queueContext.traceStopping) {
+            // Tracing stop was requested
+            queueContext.tracingRefCounter--;
+            return -EPERM;
+        }
+
+        int result = IOTracePlugin::reserve(ioQueueId, size, reservation);
+        if (result) {
+            queueContext.tracingRefCounter--;
+        }
+
+        return result;
+    }
+
+    void commit(uint32_t ioQueueId,
+                const TraceReservation &reservation) override {
+        ioQueueId = getQueueIndex(ioQueueId);
+
+        IOTracePlugin::commit(ioQueueId, reservation);
+        m_queueContext[ioQueueId].tracingRefCounter--;
+    }
+
+    proto::TraceSidScheme getSidScheme() override {
+        if (m_sidScheme == octf_iotrace_plugin_sid_per_queue) {
+            return proto::TraceSidScheme::SID_PER_QUEUE;
+        }
+
+        return proto::TraceSidScheme::SID_GLOBAL;
+    }
+
+    void getClock(proto::TraceClock *clock) override {
+        clock->set_source(m_clock.getSource());
+        clock->set_frequency(m_clock.getFrequency());
+        clock->set_calibrationcycles(m_clock.getCalibrationCycles());
+        clock->set_calibrationtimestamp(m_clock.getCalibrationTimestamp());
+    }
+
+    /**
+     * @brief Assigns global SID and takes timestamp of the event
+     *
+     * Events are ordered by global SIDs when parsing, so timestamp doesn't
+     * need to be taken in step with SID assignment
+     */
+    inline uint64_t getSid(uint64_t &timestamp) {
+        timestamp = m_clock.now();
+        return __atomic_add_fetch(&m_context->ref_sid, 1, __ATOMIC_SEQ_CST);
+    }
+
+    /**
+     * @brief Assigns SID of IO queue and takes timestamp of the event
+     *
+     * Events of IO queues are merged by timestamps when parsing, so the
+     * timestamp is taken while no other SID of the IO queue is assigned, then
+     * events of higher SIDs never get lower timestamps
+     */
+    inline uint64_t getSid(uint32_t ioQueueId, uint64_t &timestamp) {
+        if (m_sidScheme != octf_iotrace_plugin_sid_per_queue) {
+            return getSid(timestamp);
+        }
+
+        ioQueueId = getQueueIndex(ioQueueId);
+
+        // SID has to be unique within IO queue only, its order against events
+        // of other IO queues is restored from timestamps when parsing
+        auto &queueSid = m_queueContext[ioQueueId].sid;
+        uint64_t sid = queueSid.load(std::memory_order_relaxed);
+        do {
+            timestamp = m_clock.now();
+        } while (!queueSid.compare_exchange_weak(sid, sid + 1,
+                                                 std::memory_order_seq_cst,
+                                                 std::memory_order_relaxed));
+
+        return (static_cast<uint64_t>(ioQueueId) << QUEUE_SID_SHIFT) |
+               ((sid + 1) & QUEUE_SID_MASK);
+    }
+
 private:
+    inline uint32_t getQueueIndex(uint32_t ioQueueId) {
+        return ioQueueId % getTraceQueueCount();
+    }
+
     inline bool isTraceOngoing() const {
         for (const auto &queueContext : m_queueContext) {
             if (queueContext.tracingRefCounter) {
@@ -101,13 +264,34 @@ private:
 
 private:
     octf_iotrace_plugin_context_t m_context;
-    std::vector<QueueContext> m_queueContext;
+    std::vector<QueueContext, CacheLineAllocator<QueueContext>> m_queueContext;
+    const octf_iotrace_plugin_sid_scheme m_sidScheme;
+    CycleClock m_clock;
 };
 
 extern "C" int octf_iotrace_plugin_create(
         const struct octf_iotrace_plugin_cnfg *cnfg,
         octf_iotrace_plugin_context_t *_context) {
+    return octf_iotrace_plugin_create_ext(cnfg, nullptr, _context);
+}
+
+extern "C" int octf_iotrace_plugin_create_ext(
+        const struct octf_iotrace_plugin_cnfg *cnfg,
+        const struct octf_iotrace_plugin_cnfg_ext *cnfg_ext,
+        octf_iotrace_plugin_context_t *_context) {
     IOTracePluginC *plugin = nullptr;
+
+    // Settings which don't fit in extended configuration of the caller are
+    // default
+    auto sidScheme = octf_iotrace_plugin_sid_global;
+    if (cnfg_ext) {
+        size_t size = cnfg_ext->size;
+        if (size >= offsetof(struct octf_iotrace_plugin_cnfg_ext, sid_scheme) +
+                            sizeof(cnfg_ext->sid_scheme)) {
+            sidScheme = cnfg_ext->sid_scheme;
+        }
+    }
+
     auto context = new struct octf_iotrace_plugin_context;
 
     if (nullptr == context) {
@@ -125,7 +309,22 @@ extern "C" int octf_iotrace_plugin_create(
         context->ref_sid = 0;
         context->tracing_active = false;
 
-        plugin = new IOTracePluginC(context, cnfg->id, cnfg->io_queue_count);
+        switch (sidScheme) {
+        case octf_iotrace_plugin_sid_global:
+            break;
+        case octf_iotrace_plugin_sid_per_queue:
+            if (cnfg->io_queue_count > (1ULL << (64 - QUEUE_SID_SHIFT))) {
+                delete context;
+                return -EINVAL;
+            }
+            break;
+        default:
+            delete context;
+            return -EINVAL;
+        }
+
+        plugin = new IOTracePluginC(context, cnfg->id, cnfg->io_queue_count,
+                                    sidScheme);
         if (nullptr == plugin) {
             delete context;
             return -ENOMEM;
@@ -192,14 +391,34 @@ extern "C" void octf_iotrace_plugin_init_trace_header(
         iotrace_event_type type,
         uint32_t size) {
     if (context) {
-        using namespace std::chrono;
-        auto timestamp =
-                high_resolution_clock::now().time_since_epoch().count();
+        auto plugin = static_cast<IOTracePluginC *>(context->plugin);
+
+        if (plugin) {
+            // Under per-queue scheme SID is taken from range of IO queue 0,
+            // so that it doesn't collide with SIDs of any IO queue
+            uint64_t timestamp;
+            uint64_t sid = plugin->getSid(0, timestamp);
+
+            iotrace_event_init_hdr(hdr, type, sid, timestamp, size);
+        }
+    }
+}
+
+extern "C" void octf_iotrace_plugin_init_queue_trace_header(
+        octf_iotrace_plugin_context_t context,
+        uint32_t ioQueue,
+        struct iotrace_event_hdr *hdr,
+        iotrace_event_type type,
+        uint32_t size) {
+    if (context) {
+        auto plugin = static_cast<IOTracePluginC *>(context->plugin);
 
-        uint64_t sid =
-                __atomic_add_fetch(&context->ref_sid, 1, __ATOMIC_SEQ_CST);
+        if (plugin) {
+            uint64_t timestamp;
+            uint64_t sid = plugin->getSid(ioQueue, timestamp);
 
-        iotrace_event_init_hdr(hdr, type, sid, timestamp, size);
+            iotrace_event_init_hdr(hdr, type, sid, timestamp, size);
+        }
     }
 }
 
@@ -217,6 +436,113 @@ extern "C" void octf_iotrace_plugin_push_trace(
     }
 }
 
+extern "C" void octf_iotrace_plugin_push_traces(
+        octf_iotrace_plugin_context_t context,
+        uint32_t ioQueue,
+        const void *const *traces,
+        const uint32_t *sizes,
+        uint32_t count) {
+    if (context) {
+        auto plugin = static_cast<IOTracePluginC *>(context->plugin);
+
+        if (plugin) {
+            plugin->push(ioQueue, traces, sizes, count);
+        }
+    }
+}
+
+extern "C" bool octf_iotrace_plugin_is_sampled(
+        octf_iotrace_plugin_context_t context,
+        iotrace_event_type type,
+        uint32_t dev_id,
+        uint64_t id,
+        uint64_t lba) {
+    if (context) {
+        auto plugin = static_cast<IOTracePluginC *>(context->plugin);
+
+        if (plugin) {
+            return plugin->isSampled(type, dev_id, id, lba);
+        }
+    }
+
+    return true;
+}
+
+extern "C" bool octf_iotrace_plugin_matches_filter(
+        octf_iotrace_plugin_context_t context,
+        iotrace_event_type type,
+        uint32_t dev_id,
+        uint64_t id,
+        uint64_t lba,
+        uint32_t len,
+        uint8_t operation) {
+    if (context) {
+        auto plugin = static_cast<IOTracePluginC *>(context->plugin);
+
+        if (plugin) {
+            return plugin->matchesFilter(type, dev_id, id, lba, len,
+                                         operation);
+        }
+    }
+
+    return true;
+}
+
+extern "C" int octf_iotrace_plugin_reserve_trace(
+        octf_iotrace_plugin_context_t context,
+        uint32_t ioQueue,
+        size_t size,
+        struct octf_iotrace_plugin_reservation *reservation) {
+    if (!context || !context->plugin || !reservation) {
+        return -EINVAL;
+    }
+
+    auto plugin = static_cast<IOTracePluginC *>(context->plugin);
+    TraceReservation traceReservation = {};
+
+    int result = plugin->reserve(ioQueue, size, traceReservation);
+
+    reservation->trace = traceReservation.trace;
+    reservation->io_queue = ioQueue;
+    reservation->ring = traceReservation.ring;
+    reservation->event = traceReservation.event;
+    reservation->sub_ring = traceReservation.subRing;
+
+    return result;
+}
+
+extern "C" void octf_iotrace_plugin_commit_trace(
+        octf_iotrace_plugin_context_t context,
+        const struct octf_iotrace_plugin_reservation *reservation) {
+    if (context && reservation) {
+        auto plugin = static_cast<IOTracePluginC *>(context->plugin);
+
+        if (plugin) {
+            TraceReservation traceReservation = {};
+
+            traceReservation.trace = reservation->trace;
+            traceReservation.ring =
+                    static_cast<octf_trace_t>(reservation->ring);
+            traceReservation.event = reservation->event;
+            traceReservation.subRing = reservation->sub_ring;
+
+            plugin->commit(reservation->io_queue, traceReservation);
+        }
+    }
+}
+
+extern "C" void octf_iotrace_plugin_report_io_latency(
+        octf_iotrace_plugin_context_t context,
+        uint64_t latency_ns) {
+    if (context && context->tracing_active) {
+        auto plugin = static_cast<IOTracePluginC *>(context->plugin);
+
+        if (plugin) {
+            plugin->reportIoLatency(latency_ns);
+        }
+    }
+}
+
 extern "C" int octf_iotrace_plugin_main(const char *app_name,
                                         const char *app_version,
                                         const char *id,
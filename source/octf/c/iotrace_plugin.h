@@ -54,6 +54,28 @@ static inline bool octf_iotrace_plugin_is_tracing_active(
     return plugin->tracing_active;
 }
 
+/**
+ * Scheme of assigning sequence IDs (SIDs) to IO trace events
+ */
+typedef enum {
+    /**
+     * SIDs are taken from one counter shared by all IO queues
+     */
+    octf_iotrace_plugin_sid_global,
+
+    /**
+     * Each IO queue takes SIDs from its own range (IO queue id is kept in the
+     * most significant bits of SID), so submitters on different IO queues
+     * don't contend on one counter. Events of all IO queues are merged in
+     * order of their timestamps when parsing trace and SIDs are assigned anew
+     * in that order.
+     *
+     * @note Trace event headers shall be initialized by
+     * octf_iotrace_plugin_init_queue_trace_header
+     */
+    octf_iotrace_plugin_sid_per_queue,
+} octf_iotrace_plugin_sid_scheme;
+
 /**
  * IO trace plug-in configuration
  */
@@ -69,6 +91,24 @@ struct octf_iotrace_plugin_cnfg {
     uint32_t io_queue_count;
 };
 
+/**
+ * Extended IO trace plug-in configuration, settings added after
+ * octf_iotrace_plugin_cnfg are kept here, so that its layout doesn't change
+ */
+struct octf_iotrace_plugin_cnfg_ext {
+    /**
+     * Size of this structure as known to the caller (sizeof), settings which
+     * don't fit in it take default values
+     */
+    uint32_t size;
+
+    /**
+     * Scheme of assigning sequence IDs to IO trace events, default:
+     * octf_iotrace_plugin_sid_global
+     */
+    octf_iotrace_plugin_sid_scheme sid_scheme;
+};
+
 /**
  * @brief Creates IO tracer plug-in
  *
@@ -82,6 +122,22 @@ struct octf_iotrace_plugin_cnfg {
 int octf_iotrace_plugin_create(const struct octf_iotrace_plugin_cnfg *cnfg,
                                octf_iotrace_plugin_context_t *plugin_context);
 
+/**
+ * @brief Creates IO tracer plug-in with extended configuration
+ *
+ * @param cnfg IO tracer plug-in configuration
+ * @param cnfg_ext Extended configuration, NULL - default settings
+ * @param[out] plugin_context context of IO trace plug-in
+ *
+ * @return operation status
+ * @retval 0 - operation successful
+ * @retval Non-zero - operation failure while creating IO tracer plug-in
+ */
+int octf_iotrace_plugin_create_ext(
+        const struct octf_iotrace_plugin_cnfg *cnfg,
+        const struct octf_iotrace_plugin_cnfg_ext *cnfg_ext,
+        octf_iotrace_plugin_context_t *plugin_context);
+
 /**
  * @brief Destroys IO tracer plug-in
  *
@@ -92,6 +148,11 @@ void octf_iotrace_plugin_destroy(octf_iotrace_plugin_context_t *plugin_context);
 /**
  * @brief Initializes IO trace event header
  *
+ * @note Under per-queue SID scheme the sequence ID is taken from the range of
+ * IO queue 0, so the event shall be stored in IO queue 0. Headers of events
+ * of other IO queues shall be initialized by
+ * octf_iotrace_plugin_init_queue_trace_header.
+ *
  * @param plugin IO tracer plug-in context
  * @param hdr IO trace header to be initialized
  * @param type IO trace event type
@@ -102,6 +163,25 @@ void octf_iotrace_plugin_init_trace_header(
         struct iotrace_event_hdr *hdr,
         iotrace_event_type type,
         uint32_t size);
+
+/**
+ * @brief Initializes header of IO trace event to be stored in given IO queue
+ *
+ * Time stamp is taken from calibrated CPU cycle counter (if available). The
+ * sequence ID is assigned according to the plug-in SID scheme.
+ *
+ * @param plugin IO tracer plug-in context
+ * @param ioQueue IO queue id into which event will be stored
+ * @param hdr IO trace header to be initialized
+ * @param type IO trace event type
+ * @param size entire Size of IO trace event including header
+ */
+void octf_iotrace_plugin_init_queue_trace_header(
+        octf_iotrace_plugin_context_t plugin_context,
+        uint32_t ioQueue,
+        struct iotrace_event_hdr *hdr,
+        iotrace_event_type type,
+        uint32_t size);
 /**
  * @brief Pushes IO trace event
  *
@@ -120,6 +200,169 @@ void octf_iotrace_plugin_push_trace(
         const void *trace,
         size_t size);
 
+/**
+ * @brief Pushes batch of IO trace events
+ *
+ * Space for the batch is reserved at once and the plug-in is referenced once
+ * per batch, so pushing IO trace events completed together in a batch costs
+ * less than pushing them one by one.
+ *
+ * @note Pushed events shall be started with IO trace event header
+ * (struct iotrace_event_hdr).
+ * @note Events defined in iotrace_event.h are serialized only.
+ *
+ * @param plugin IO tracer plug-in context
+ * @param ioQueue IO queue id into which store events
+ * @param traces Array of trace events to be stored
+ * @param sizes Array of sizes of trace events to be stored
+ * @param count Number of trace events to be stored
+ */
+void octf_iotrace_plugin_push_traces(
+        octf_iotrace_plugin_context_t plugin_context,
+        uint32_t ioQueue,
+        const void *const *traces,
+        const uint32_t *sizes,
+        uint32_t count);
+
+/**
+ * @brief Space reserved for IO trace event which is written in place
+ */
+struct octf_iotrace_plugin_reservation {
+    /**
+     * Buffer into which the event shall be written
+     */
+    void *trace;
+
+    /**
+     * IO queue id in which the event is stored
+     */
+    uint32_t io_queue;
+
+    /**
+     * Ring in which the space is reserved, private to IO trace plug-in
+     */
+    void *ring;
+
+    /**
+     * Reserved event handle, private to IO trace plug-in
+     */
+    void *event;
+
+    /**
+     * Sub-ring of the ring in which the space is reserved, private to IO
+     * trace plug-in
+     */
+    uint32_t sub_ring;
+};
+
+/**
+ * @brief Reserves space for IO trace event
+ *
+ * Instead of building the event on its own and pushing it, the caller writes
+ * the event directly into the trace buffer and then commits it. It saves copy
+ * of the event on the submission path.
+ *
+ * @note Each successful reservation shall be committed as soon as possible by
+ * octf_iotrace_plugin_commit_trace. Events reserved later are not consumed
+ * and tracing can't be stopped until it is committed.
+ * @note Reserved event shall be started with IO trace event header
+ * (struct iotrace_event_hdr), see octf_iotrace_plugin_init_trace_header.
+ * @note Filter and sampling are not applied to reserved events, the caller
+ * checks them by octf_iotrace_plugin_matches_filter and
+ * octf_iotrace_plugin_is_sampled before reserving space.
+ *
+ * @param plugin IO tracer plug-in context
+ * @param ioQueue IO queue id into which store event
+ * @param size Size of trace event to be stored
+ * @param[out] reservation Reserved space
+ *
+ * @retval 0 Space reserved, event shall be written into reservation->trace
+ * @retval -EINVAL Invalid plug-in context, IO queue or size
+ * @retval -EPERM Tracing is not active
+ * @retval -ENOSPC No space to store event, event is accounted as lost
+ */
+int octf_iotrace_plugin_reserve_trace(
+        octf_iotrace_plugin_context_t plugin_context,
+        uint32_t ioQueue,
+        size_t size,
+        struct octf_iotrace_plugin_reservation *reservation);
+
+/**
+ * @brief Checks if IO trace event is traced under sampling set at trace start
+ *
+ * Pushed events are checked by the plug-in. The caller writing events into
+ * reserved space checks them on its own, before reserving space.
+ *
+ * @param plugin IO tracer plug-in context
+ * @param type Type of trace event
+ * @param dev_id Device ID of IO
+ * @param id ID of IO, or ID of IO referenced by the event (ref_id)
+ * @param lba Address of IO in sectors
+ *
+ * @retval true Event shall be traced
+ * @retval false Event is sampled out, it shall be neither pushed nor
+ * reserved
+ */
+bool octf_iotrace_plugin_is_sampled(
+        octf_iotrace_plugin_context_t plugin_context,
+        iotrace_event_type type,
+        uint32_t dev_id,
+        uint64_t id,
+        uint64_t lba);
+
+/**
+ * @brief Checks if IO trace event matches filter set at trace start
+ *
+ * Pushed events are checked by the plug-in. The caller writing events into
+ * reserved space checks them on its own, before reserving space.
+ * Completion is filtered out when its IO is, so each IO shall be checked
+ * once.
+ *
+ * @param plugin IO tracer plug-in context
+ * @param type Type of trace event
+ * @param dev_id Device ID of IO
+ * @param id ID of IO, or ID of IO referenced by the event (ref_id)
+ * @param lba Address of IO in sectors
+ * @param len Size of IO in sectors
+ * @param operation Operation of IO (iotrace_event_operation_t enumerator),
+ * ignored for IO completion
+ *
+ * @retval true Event shall be traced
+ * @retval false Event is filtered out, it shall be neither pushed nor
+ * reserved
+ */
+bool octf_iotrace_plugin_matches_filter(
+        octf_iotrace_plugin_context_t plugin_context,
+        iotrace_event_type type,
+        uint32_t dev_id,
+        uint64_t id,
+        uint64_t lba,
+        uint32_t len,
+        uint8_t operation);
+
+/**
+ * @brief Commits IO trace event written into reserved space
+ *
+ * @param plugin IO tracer plug-in context
+ * @param reservation Space reserved by octf_iotrace_plugin_reserve_trace
+ */
+void octf_iotrace_plugin_commit_trace(
+        octf_iotrace_plugin_context_t plugin_context,
+        const struct octf_iotrace_plugin_reservation *reservation);
+
+/**
+ * @brief Reports latency of completed IO
+ *
+ * When tracing runs as flight recorder and the latency exceeds the threshold
+ * given at trace start, snapshot of traces is taken.
+ *
+ * @param plugin IO tracer plug-in context
+ * @param latency_ns IO latency (in nanoseconds)
+ */
+void octf_iotrace_plugin_report_io_latency(
+        octf_iotrace_plugin_context_t plugin_context,
+        uint64_t latency_ns);
+
 /**
  * @brief Main function wrapper for C CLI programs
  *
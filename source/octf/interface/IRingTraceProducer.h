@@ -14,6 +14,32 @@ namespace octf {
 
 constexpr int NO_CPU_AFFINITY = -1;
 
+/**
+ * @brief Space reserved in the ring (circular buffer) for a trace which is
+ * written in place
+ */
+struct TraceReservation {
+    /**
+     * @brief Buffer into which the trace shall be written
+     */
+    void *trace;
+
+    /**
+     * @brief Handle of the ring in which the space is reserved
+     */
+    octf_trace_t ring;
+
+    /**
+     * @brief Handle of the reserved event
+     */
+    octf_trace_event_handle_t event;
+
+    /**
+     * @brief Index of the sub-ring in which the space is reserved
+     */
+    uint32_t subRing;
+};
+
 /**
  * @brief Abstraction of trace producer utilizing ring (circular buffer)
  * structure.
@@ -37,6 +63,42 @@ public:
      */
     virtual octf_trace_hdr_t *getConsumerHeader(void) = 0;
 
+    /**
+     * @brief Returns number of sub-rings backing the trace queue
+     *
+     * A producer may spread its trace queue over a set of sub-rings (e.g. one
+     * per CPU), so that producers running on different CPUs don't contend on
+     * a single ring. Events of all sub-rings are consumed by one job and
+     * serialized into one trace file ordered by sid.
+     */
+    virtual uint32_t getSubRingCount(void) const {
+        return 1;
+    }
+
+    /**
+     * @brief Returns buffer with given sub-ring (circular buffer)
+     */
+    virtual char *getSubRingBuffer(uint32_t subRing) {
+        (void) subRing;
+        return getBuffer();
+    }
+
+    /**
+     * @brief Returns size of given sub-ring (circular buffer)
+     */
+    virtual size_t getSubRingSize(uint32_t subRing) const {
+        (void) subRing;
+        return getSize();
+    }
+
+    /**
+     * @brief Returns buffer with consumer header of given sub-ring
+     */
+    virtual octf_trace_hdr_t *getSubRingConsumerHeader(uint32_t subRing) {
+        (void) subRing;
+        return getConsumerHeader();
+    }
+
     /**
      * @brief Waits until new traces are available or this->stop() is called or
      *         until specified end time.
@@ -60,16 +122,45 @@ public:
      */
     virtual int getCpuAffinity(void) = 0;
 
+    /**
+     * @brief Gets NUMA node on which the ring memory is placed
+     *
+     * Consumer without CPU affinity is run on CPUs of this node.
+     *
+     * @retval -1 no node preference
+     * @retval >= 0 NUMA node
+     */
+    virtual int getNumaNode(void) {
+        return -1;
+    }
+
     /**
      * @brief Initializes ring (circular buffer) of given size
+     *
+     * @param memoryPoolSize Size of the ring, shared by all its sub-rings
+     * @param subRingCount Number of sub-rings the ring is split into, 0 - one
+     * per CPU. It's a hint only, producer may create fewer sub-rings.
      */
-    virtual void initRing(uint32_t memoryPoolSize) = 0;
+    virtual void initRing(uint32_t memoryPoolSize, uint32_t subRingCount) = 0;
 
     /**
      * @brief Deinitializes ring (circular buffer) of given size
+     *
+     * @note Consumers of the ring shall be closed before, so that producers
+     * waiting for free space give up
      */
     virtual void deinitRing() = 0;
 
+    /**
+     * @brief Sets behavior of pushing traces when the ring is full
+     *
+     * @param policy Full ring policy
+     * @param timeoutUs Maximum time of waiting for free space (in
+     * microseconds), used by bounded wait policy only
+     */
+    virtual void setFullPolicy(octf_trace_full_policy_t policy,
+                               uint64_t timeoutUs) = 0;
+
     /**
      * @brief Pushes a given trace to the ring (circular buffer)
      *
@@ -80,6 +171,47 @@ public:
      */
     virtual int pushTrace(const void *trace, const uint32_t traceSize) = 0;
 
+    /**
+     * @brief Pushes a batch of traces to the ring (circular buffer)
+     *
+     * @param traces Array of traces
+     * @param traceSizes Array of trace sizes
+     * @param count Number of traces
+     *
+     * @retval 0 All traces pushed successfully
+     * @retval -EINVAL Trace is invalid
+     * @retval -EPERM Invalid open mode, only producer can push events
+     * @retval -ENOSPC No space in memory pool to store some of events
+     */
+    virtual int pushTraces(const void *const *traces,
+                           const uint32_t *traceSizes,
+                           uint32_t count) = 0;
+
+    /**
+     * @brief Reserves space in the ring (circular buffer) for a trace, which
+     * is then written in place instead of being copied
+     *
+     * @note Each successful reservation shall be committed with
+     * this->commitTrace, the consumer doesn't read past uncommitted traces.
+     *
+     * @param traceSize Size of the trace
+     * @param[out] reservation Reserved space
+     *
+     * @retval 0 Space reserved successfully
+     * @retval -EINVAL Trace or its size is invalid
+     * @retval -ENOSPC No space in memory pool to store event
+     */
+    virtual int reserveTrace(const uint32_t traceSize,
+                             TraceReservation &reservation) = 0;
+
+    /**
+     * @brief Commits trace written into space reserved by this->reserveTrace
+     *
+     * @retval 0 Trace committed successfully
+     * @retval -EINVAL Trace or reservation is invalid
+     */
+    virtual int commitTrace(const TraceReservation &reservation) = 0;
+
     /**
      * @brief Gets the queue id of this producer
      */
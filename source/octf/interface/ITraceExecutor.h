@@ -8,6 +8,7 @@
 
 #include <cstdint>
 #include <octf/interface/ITraceConverter.h>
+#include <octf/proto/traceDefinitions.pb.h>
 
 namespace octf {
 
@@ -53,6 +54,49 @@ public:
      * Google Protocol Buffer is not necessary, returns null
      */
     virtual std::unique_ptr<ITraceConverter> createTraceConverter() = 0;
+    /**
+     * @brief Returns scheme of assigning sequence IDs to trace events by the
+     * traced module, it is recorded in trace summary
+     */
+    virtual proto::TraceSidScheme getSidScheme() {
+        return proto::TraceSidScheme::SID_GLOBAL;
+    }
+    /**
+     * @brief Fills description of clock used by the traced module for
+     * stamping trace events, it is recorded in trace summary
+     */
+    virtual void getClock(proto::TraceClock *clock) {
+        (void) clock;
+    }
+    /**
+     * @brief Sets sampling of IOs by the traced module, called before
+     * this->startTrace. Sampled out events are dropped by the traced module
+     * before they reach trace buffers.
+     *
+     * @param sampling Sampling of IOs
+     * @param rate Events of one in this number of IOs are traced
+     *
+     * @retval True - sampling is set up
+     * @retval False - the traced module doesn't support the sampling
+     */
+    virtual bool setSampling(proto::TraceSampling sampling, uint32_t rate) {
+        (void) rate;
+        return sampling == proto::TraceSampling::SAMPLING_NONE;
+    }
+    /**
+     * @brief Sets filter of IOs applied by the traced module, called before
+     * this->startTrace. Events not matching the filter are dropped by the
+     * traced module before they reach trace buffers.
+     *
+     * @param filter Filter of IOs
+     *
+     * @retval True - filter is set up
+     * @retval False - the traced module doesn't support the filter
+     */
+    virtual bool setFilter(const proto::TraceFilter &filter) {
+        // Empty filter matches all IOs
+        return filter.ByteSizeLong() == 0;
+    }
 };
 
 }  //  namespace octf
@@ -18,7 +18,14 @@ enum class SerializerType {
      * @brief Traces will be serialized to files in directory specified by
      * Storage Analytics configuration file
      */
-    FileSerializer = 0
+    FileSerializer = 0,
+
+    /**
+     * @brief Traces will be written to files in directory specified by
+     * Storage Analytics configuration file in their native format, without
+     * conversion to Google Protocol Buffers
+     */
+    RawFileSerializer = 1
 };
 
 /**
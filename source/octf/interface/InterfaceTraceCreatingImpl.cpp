@@ -32,6 +32,18 @@ void InterfaceTraceCreatingImpl::StartTracing(
         auto maxDuration = request->maxduration();
         auto maxFileSize = request->maxsize();
         auto circBufferSize = request->circbuffersize();
+        auto subRings = request->subrings();
+        auto fullPolicy = getFullPolicy(request->fullpolicy());
+        auto fullTimeout = request->fulltimeout();
+        auto snapshotLatency = request->snapshotlatency();
+        auto snapshotSignal = request->snapshotsignal();
+        auto snapshotInterval = request->snapshotinterval();
+        auto segmentSize = request->segmentsize();
+        auto segmentCount = request->segmentcount();
+        auto conversionThreads = request->conversionthreads();
+        auto sampling = request->sampling();
+        auto samplingRate = request->samplingrate();
+        auto serializerType = getSerializerType(request->format());
         const auto &descriptor = request->descriptor();
         bool validData = true;
         if (!checkIntegerParameters(maxDuration, "maxduration", descriptor)) {
@@ -43,15 +55,84 @@ void InterfaceTraceCreatingImpl::StartTracing(
             validData = false;
             controller->SetFailed("Invalid circular buffer size");
         }
+        if (!checkIntegerParameters(subRings, "subrings", descriptor)) {
+            validData = false;
+            controller->SetFailed("Invalid number of trace buffer sub-rings");
+        }
         if (!checkIntegerParameters(maxFileSize, "maxsize", descriptor)) {
             validData = false;
             controller->SetFailed("Invalid maximum trace file size");
         }
+        if (fullPolicy == octf_trace_full_policy_wait_bounded &&
+            !checkIntegerParameters(fullTimeout, "fulltimeout", descriptor)) {
+            validData = false;
+            controller->SetFailed("Invalid trace buffer full timeout");
+        }
+        if (!checkIntegerParameters(snapshotLatency, "snapshotlatency",
+                                    descriptor)) {
+            validData = false;
+            controller->SetFailed("Invalid snapshot IO latency");
+        }
+        if (!checkIntegerParameters(snapshotSignal, "snapshotsignal",
+                                    descriptor)) {
+            validData = false;
+            controller->SetFailed("Invalid snapshot signal");
+        }
+        if (!checkIntegerParameters(snapshotInterval, "snapshotinterval",
+                                    descriptor)) {
+            validData = false;
+            controller->SetFailed("Invalid snapshot interval");
+        }
+        if (!checkIntegerParameters(segmentSize, "segmentsize", descriptor)) {
+            validData = false;
+            controller->SetFailed("Invalid trace file segment size");
+        }
+        if (!checkIntegerParameters(segmentCount, "segmentcount",
+                                    descriptor)) {
+            validData = false;
+            controller->SetFailed("Invalid trace file segment count");
+        }
+        if (!checkIntegerParameters(conversionThreads, "conversionthreads",
+                                    descriptor)) {
+            validData = false;
+            controller->SetFailed("Invalid number of conversion threads");
+        }
+        if (sampling != proto::TraceSampling::SAMPLING_NONE &&
+            !checkIntegerParameters(samplingRate, "samplingrate",
+                                    descriptor)) {
+            validData = false;
+            controller->SetFailed("Invalid sampling rate");
+        }
+        if (!checkIntegerParameters(request->filterminsize(), "filterminsize",
+                                    descriptor)) {
+            validData = false;
+            controller->SetFailed("Invalid minimum size of traced IOs");
+        }
 
         if (validData) {
+            TraceConfig config;
+            config.maxDuration = maxDuration;
+            config.maxFileSizeMiB = maxFileSize;
+            config.circBufferSizeMiB = circBufferSize;
+            config.subRingCount = subRings;
+            config.serializerType = serializerType;
+            config.compression = request->compress();
+            config.segmentSizeMiB = segmentSize;
+            config.segmentCount = segmentCount;
+            config.conversionThreads = conversionThreads;
+            config.parsedIo = request->parsedio();
+            config.liveStatistics = request->livestatistics();
+            config.sampling = sampling;
+            config.samplingRate = samplingRate;
+            getFilter(*request, config.filter);
+            config.fullPolicy = fullPolicy;
+            config.fullTimeoutUs = fullTimeout;
+            config.snapshotLatencyUs = snapshotLatency;
+            config.snapshotSignal = snapshotSignal;
+            config.snapshotIntervalMs = snapshotInterval;
+
             // TODO (kozlowsk) return error code and status to user here
-            m_traceManager->startJobs(maxDuration, maxFileSize, circBufferSize,
-                                      SerializerType::FileSerializer);
+            m_traceManager->startJobs(config);
         }
 
     } catch (Exception &e) {
@@ -92,12 +173,64 @@ void InterfaceTraceCreatingImpl::GetTraceSummary(
     done->Run();
 }
 
+void InterfaceTraceCreatingImpl::TakeTraceSnapshot(
+        ::google::protobuf::RpcController *controller,
+        const ::octf::proto::Void *request,
+        ::octf::proto::Void *response,
+        ::google::protobuf::Closure *done) {
+    (void) request;
+    (void) response;
+    try {
+        m_traceManager->requestSnapshot();
+    } catch (Exception &e) {
+        controller->SetFailed(e.what());
+    }
+    done->Run();
+}
+
+void InterfaceTraceCreatingImpl::GetLiveStatistics(
+        ::google::protobuf::RpcController *controller,
+        const ::octf::proto::Void *request,
+        ::octf::proto::LiveStatistics *response,
+        ::google::protobuf::Closure *done) {
+    (void) request;
+    try {
+        m_traceManager->getLiveStatistics(response);
+    } catch (Exception &e) {
+        controller->SetFailed(e.what());
+    }
+    done->Run();
+}
+
 int InterfaceTraceCreatingImpl::pushTrace(uint32_t traceQueueId,
                                           const void *trace,
                                           const uint32_t traceSize) {
     return m_traceManager->pushTrace(traceQueueId, trace, traceSize);
 }
 
+int InterfaceTraceCreatingImpl::pushTraces(uint32_t traceQueueId,
+                                           const void *const *traces,
+                                           const uint32_t *traceSizes,
+                                           uint32_t count) {
+    return m_traceManager->pushTraces(traceQueueId, traces, traceSizes, count);
+}
+
+int InterfaceTraceCreatingImpl::reserveTrace(uint32_t traceQueueId,
+                                             const uint32_t traceSize,
+                                             TraceReservation &reservation) {
+    return m_traceManager->reserveTrace(traceQueueId, traceSize, reservation);
+}
+
+int InterfaceTraceCreatingImpl::commitTrace(
+        uint32_t traceQueueId,
+        const TraceReservation &reservation) {
+    return m_traceManager->commitTrace(traceQueueId, reservation);
+}
+
+void InterfaceTraceCreatingImpl::reportIoLatency(uint64_t latencyNs) {
+    m_traceManager->reportIoLatency(latencyNs);
+}
+
 bool InterfaceTraceCreatingImpl::checkIntegerParameters(
         const uint32_t value,
         const std::string &fieldName,
@@ -113,6 +246,89 @@ bool InterfaceTraceCreatingImpl::checkIntegerParameters(
     return (valueInfo.min() <= value) && (value <= valueInfo.max());
 }
 
+octf_trace_full_policy_t InterfaceTraceCreatingImpl::getFullPolicy(
+        proto::TraceFullPolicy policy) {
+    switch (policy) {
+    case proto::TraceFullPolicy::DROP:
+        return octf_trace_full_policy_drop;
+    case proto::TraceFullPolicy::WAIT_BOUNDED:
+        return octf_trace_full_policy_wait_bounded;
+    case proto::TraceFullPolicy::WAIT:
+        return octf_trace_full_policy_wait;
+    case proto::TraceFullPolicy::FLIGHT_RECORDER:
+        return octf_trace_full_policy_overwrite;
+    default:
+        throw Exception("Invalid trace buffer full policy");
+    }
+}
+
+void InterfaceTraceCreatingImpl::getFilter(
+        const proto::StartTraceRequest &request,
+        proto::TraceFilter &filter) {
+    for (const auto &device : request.filterdevice()) {
+        uint64_t id = parseFilterNumber(device, "device ID");
+        if (id > UINT32_MAX) {
+            throw Exception("Invalid device ID '" + device + "'");
+        }
+        filter.add_deviceid(id);
+    }
+
+    for (const auto &operation : request.filteroperation()) {
+        if (operation == "read") {
+            filter.add_operation(proto::trace::IoType::Read);
+        } else if (operation == "write") {
+            filter.add_operation(proto::trace::IoType::Write);
+        } else if (operation == "discard") {
+            filter.add_operation(proto::trace::IoType::Discard);
+        } else {
+            throw Exception("Invalid operation '" + operation + "'");
+        }
+    }
+
+    for (const auto &range : request.filterlba()) {
+        auto pos = range.find('-');
+        if (pos == std::string::npos) {
+            throw Exception("Invalid LBA range '" + range + "'");
+        }
+
+        auto lbaRange = filter.add_lbarange();
+        lbaRange->set_first(parseFilterNumber(range.substr(0, pos), "LBA"));
+        lbaRange->set_last(parseFilterNumber(range.substr(pos + 1), "LBA"));
+        if (lbaRange->first() > lbaRange->last()) {
+            throw Exception("Invalid LBA range '" + range + "'");
+        }
+    }
+
+    filter.set_minsize(request.filterminsize());
+}
+
+uint64_t InterfaceTraceCreatingImpl::parseFilterNumber(
+        const std::string &value,
+        const std::string &name) {
+    if (value.empty() ||
+        value.find_first_not_of("0123456789") != std::string::npos) {
+        throw Exception("Invalid " + name + " '" + value + "'");
+    }
+
+    try {
+        return std::stoull(value);
+    } catch (std::exception &) {
+        throw Exception("Invalid " + name + " '" + value + "'");
+    }
+}
+
+SerializerType InterfaceTraceCreatingImpl::getSerializerType(
+        proto::TraceFormat format) {
+    switch (format) {
+    case proto::TraceFormat::PROTOBUF:
+        return SerializerType::FileSerializer;
+    case proto::TraceFormat::RAW:
+        return SerializerType::RawFileSerializer;
+    default:
+        throw Exception("Invalid trace format");
+    }
+}
+
 void InterfaceTraceCreatingImpl::fillTraceSummary(
         proto::TraceSummary *summary) {
     TracingState state = m_traceManager->getState();
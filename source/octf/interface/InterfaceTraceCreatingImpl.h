@@ -9,12 +9,15 @@
 #include <memory>
 
 #include <octf/interface/ITraceExecutor.h>
+#include <octf/interface/ITraceSerializer.h>
 #include <octf/node/INode.h>
 #include <octf/proto/InterfaceTraceCreating.pb.h>
+#include <octf/trace/trace.h>
 
 namespace octf {
 
 class TraceManager;
+struct TraceReservation;
 
 class InterfaceTraceCreatingImpl : public proto::InterfaceTraceCreating {
 public:
@@ -43,6 +46,18 @@ public:
                                  ::octf::proto::TraceSummary *response,
                                  ::google::protobuf::Closure *done) override;
 
+    virtual void TakeTraceSnapshot(
+            ::google::protobuf::RpcController *controller,
+            const ::octf::proto::Void *request,
+            ::octf::proto::Void *response,
+            ::google::protobuf::Closure *done) override;
+
+    virtual void GetLiveStatistics(
+            ::google::protobuf::RpcController *controller,
+            const ::octf::proto::Void *request,
+            ::octf::proto::LiveStatistics *response,
+            ::google::protobuf::Closure *done) override;
+
     /**
      * @brief Forwards a trace push to the TraceManager
      * @retval 0 - on successful operation.
@@ -53,6 +68,45 @@ public:
                   const void *trace,
                   const uint32_t traceSize);
 
+    /**
+     * @brief Forwards a push of a batch of traces to the TraceManager
+     * @retval 0 - on successful operation.
+     * @retval -EINVAL - if queueId couldn't be found
+     * @retval -ENOSPC - if ran out of space in internal buffer for some of
+     * traces
+     */
+    int pushTraces(uint32_t traceQueueId,
+                   const void *const *traces,
+                   const uint32_t *traceSizes,
+                   uint32_t count);
+
+    /**
+     * @brief Forwards a trace space reservation to the TraceManager
+     * @retval 0 - on successful operation.
+     * @retval -EINVAL - if queueId couldn't be found
+     * @retval -ENOSPC - if ran out of space in internal buffer for trace
+     */
+    int reserveTrace(uint32_t traceQueueId,
+                     const uint32_t traceSize,
+                     TraceReservation &reservation);
+
+    /**
+     * @brief Forwards commit of a trace written into reserved space to the
+     * TraceManager
+     * @retval 0 - on successful operation.
+     * @retval -EINVAL - if queueId couldn't be found or reservation is invalid
+     */
+    int commitTrace(uint32_t traceQueueId,
+                    const TraceReservation &reservation);
+
+    /**
+     * @brief Forwards latency of completed IO to the TraceManager, which
+     * takes flight recorder snapshot if latency exceeds the threshold
+     *
+     * @param latencyNs IO latency (in nanoseconds)
+     */
+    void reportIoLatency(uint64_t latencyNs);
+
 private:
     void fillTraceSummary(proto::TraceSummary *status);
 
@@ -60,6 +114,28 @@ private:
                                 const std::string &fieldName,
                                 const ::google::protobuf::Descriptor *);
 
+    octf_trace_full_policy_t getFullPolicy(proto::TraceFullPolicy policy);
+
+    SerializerType getSerializerType(proto::TraceFormat format);
+
+    /**
+     * @brief Gets filter of IOs from start trace request
+     *
+     * @param request Start trace request
+     * @param[out] filter Filter of IOs
+     */
+    void getFilter(const proto::StartTraceRequest &request,
+                   proto::TraceFilter &filter);
+
+    /**
+     * @brief Parses unsigned number given in filter criteria
+     *
+     * @param value Text to be parsed
+     * @param name Name of the criterion reported in case of error
+     */
+    uint64_t parseFilterNumber(const std::string &value,
+                               const std::string &name);
+
     std::unique_ptr<TraceManager> m_traceManager;
     const NodePath m_ownerNodePath;
 };
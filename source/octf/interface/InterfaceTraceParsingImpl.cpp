@@ -45,15 +45,20 @@ void InterfaceTraceParsingImpl::ParseTrace(
 
     try {
         if (request->raw()) {
+            bool follow = request->follow();
             if (request->format() == proto::OutputFormat::JSON) {
-                IoTraceEventHandlerJsonPrinter handler(request->tracepath());
+                IoTraceEventHandlerJsonPrinter handler(request->tracepath(),
+                                                       follow);
                 handler.processEvents();
             } else if (request->format() == proto::OutputFormat::CSV) {
-                IoTraceEventHandlerCsvPrinter handler(request->tracepath());
+                IoTraceEventHandlerCsvPrinter handler(request->tracepath(),
+                                                      follow);
                 handler.processEvents();
             } else {
                 throw Exception("Invalid output format");
             }
+        } else if (request->follow()) {
+            throw Exception("Only raw trace can be followed");
         } else {
             ParsedIoTraceEventHandlerPrinter handler(request->tracepath(),
                                                      request->format());
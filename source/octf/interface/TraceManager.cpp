@@ -6,10 +6,14 @@
 #include <octf/interface/TraceManager.h>
 
 #include <time.h>
+#include <algorithm>
 #include <iomanip>
 #include <mutex>
 #include <sstream>
 #include <string>
+#include <octf/analytics/statistics/IoStatisticsSet.h>
+#include <octf/interface/internal/ParsedIoBuilder.h>
+#include <octf/interface/internal/TraceConversionPool.h>
 #include <octf/interface/internal/TraceJob.h>
 #include <octf/node/NodeId.h>
 #include <octf/utils/DateTime.h>
@@ -19,10 +23,50 @@
 #include <octf/utils/Log.h>
 #include <octf/utils/ProtoConverter.h>
 #include <octf/utils/ProtobufReaderWriter.h>
+#include <octf/utils/SignalHandler.h>
 #include <octf/utils/SizeConversion.h>
 
 namespace octf {
 
+/**
+ * Period of checking snapshot signal by flight recorder
+ */
+static constexpr std::chrono::milliseconds SNAPSHOT_POLL_PERIOD(100);
+
+/**
+ * Max number of threads of conversion pool, when chosen automatically
+ */
+static constexpr uint32_t MAX_AUTO_CONVERSION_THREADS = 4;
+
+/**
+ * Checks if traces are serialized to files in the trace directory
+ */
+static bool isFileSerializer(SerializerType type) {
+    return type == SerializerType::FileSerializer ||
+           type == SerializerType::RawFileSerializer;
+}
+
+TraceConfig::TraceConfig()
+        : maxDuration(0)
+        , maxFileSizeMiB(0)
+        , circBufferSizeMiB(0)
+        , subRingCount(1)
+        , serializerType(SerializerType::FileSerializer)
+        , compression(false)
+        , segmentSizeMiB(0)
+        , segmentCount(0)
+        , conversionThreads(0)
+        , parsedIo(false)
+        , liveStatistics(false)
+        , sampling(proto::TraceSampling::SAMPLING_NONE)
+        , samplingRate(0)
+        , filter()
+        , fullPolicy(octf_trace_full_policy_drop)
+        , fullTimeoutUs(0)
+        , snapshotLatencyUs(0)
+        , snapshotSignal(0)
+        , snapshotIntervalMs(0) {}
+
 TraceManager::TraceManager(const NodePath &ownerNodePath,
                            ITraceExecutor *executor)
         : m_ownerNodePath(ownerNodePath)
@@ -30,13 +74,20 @@ TraceManager::TraceManager(const NodePath &ownerNodePath,
         , m_thread()
         , m_finish(false)
         , m_state(TracingState::NOT_STARTED)
+        , m_finishing(false)
+        , m_stateMutex()
         , m_traceManagementMutex()
         , m_jobs()
-        , m_maxDuration(0)
-        , m_maxFileSize(0)
+        , m_conversionPool()
+        , m_parsedIoBuilder()
+        , m_config()
         , m_numberOfJobs(executor->getTraceQueueCount())
-        , m_memoryPoolSizeMiB(0)
-        , m_serializerType(SerializerType::FileSerializer)
+        , m_snapshotLatencyNs(0)
+        , m_snapshotRequested(false)
+        , m_snapshotMutex()
+        , m_snapshotTrigger()
+        , m_snapshotSignalCount(0)
+        , m_snapshotCount(0)
         , m_traceDirRelativePath("")
         , m_tags() {}
 
@@ -54,8 +105,30 @@ void TraceManager::joinThread() {
 
 void TraceManager::handleJobs() {
     m_endTime = m_startTime = std::chrono::steady_clock::now();
-    auto endTime = m_startTime + std::chrono::seconds(m_maxDuration);
+    auto endTime = m_startTime + std::chrono::seconds(m_config.maxDuration);
+    int64_t maxFileSize = MiBToBytes(m_config.maxFileSizeMiB);
+    bool flightRecorder = isFlightRecorder();
+    int snapshotSignal = flightRecorder ? m_config.snapshotSignal : 0;
+    bool signalRegistered = false;
+    bool snapshotPending = false;
+    auto snapshotInterval =
+            std::chrono::milliseconds(m_config.snapshotIntervalMs);
+    auto lastSnapshotTime = m_startTime;
+    uint64_t segmentsVersion = 0;
+    std::chrono::milliseconds period = std::chrono::seconds(1);
+
+    if (snapshotSignal) {
+        period = SNAPSHOT_POLL_PERIOD;
+    }
+
     try {
+        if (snapshotSignal) {
+            m_snapshotSignalCount =
+                    SignalHandler::get().getSignalCount(snapshotSignal);
+            SignalHandler::get().registerSignal(snapshotSignal);
+            signalRegistered = true;
+        }
+
         setupJobs();
 
         if (!m_executor->startTrace()) {
@@ -63,15 +136,66 @@ void TraceManager::handleJobs() {
         }
 
         while (!m_finish) {
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+            auto waitPeriod = period;
+            if (snapshotPending) {
+                // Sleep until the end of snapshot hold-off at most
+                auto holdOff = std::chrono::duration_cast<
+                        std::chrono::milliseconds>(
+                        lastSnapshotTime + snapshotInterval -
+                        std::chrono::steady_clock::now());
+                waitPeriod = std::max(std::chrono::milliseconds(1),
+                                      std::min(waitPeriod, holdOff));
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(m_snapshotMutex);
+                m_snapshotTrigger.wait_for(lock, waitPeriod, [this] {
+                    return m_snapshotRequested.load();
+                });
+            }
+
+            if (flightRecorder && isSnapshotRequested(snapshotSignal)) {
+                snapshotPending = true;
+            }
+
+            // Snapshots requested within the interval since the last one are
+            // merged into one taken once the interval elapses
+            if (snapshotPending) {
+                auto now = std::chrono::steady_clock::now();
+                if (!m_snapshotCount ||
+                    now >= lastSnapshotTime + snapshotInterval) {
+                    takeSnapshot();
+                    lastSnapshotTime = now;
+                    snapshotPending = false;
+                }
+            }
+
+            // Keep list of trace file segments in summary up to date, so
+            // that closed segments can be processed while tracing
+            if (m_config.segmentSizeMiB &&
+                segmentsVersion != getSegmentsVersion()) {
+                std::lock_guard<std::recursive_mutex> lock(m_stateMutex);
+                if (m_state == TracingState::RUNNING) {
+                    segmentsVersion = getSegmentsVersion();
+                    setState(TracingState::RUNNING);
+                }
+            }
+
             // TODO (kozlowsk) Should maxfilesize be checked here every x
             // seconds or per job?
-            if (std::chrono::steady_clock::now() > endTime ||
-                getTraceSize() >= m_maxFileSize) {
+            if ((!flightRecorder &&
+                 std::chrono::steady_clock::now() > endTime) ||
+                getTraceSize() >= maxFileSize) {
                 break;
             }
         }
 
+        // Snapshot requested before stop isn't lost, even within hold-off
+        if (flightRecorder &&
+            (snapshotPending || isSnapshotRequested(snapshotSignal))) {
+            takeSnapshot();
+        }
+
         if (!m_executor->stopTrace()) {
             throw Exception("Error sending stop trace request");
         }
@@ -83,6 +207,17 @@ void TraceManager::handleJobs() {
         setState(TracingState::ERROR);
     }
 
+    if (signalRegistered) {
+        try {
+            SignalHandler::get().unregisterSignal(snapshotSignal);
+        } catch (Exception &e) {
+            log::cerr << e.getMessage() << std::endl;
+        }
+    }
+
+    // Finished jobs don't complete tracing until parsed IO is committed
+    m_finishing = true;
+
     for (const auto &job : m_jobs) {
         job->stopJobThread();
     }
@@ -90,6 +225,12 @@ void TraceManager::handleJobs() {
         job->joinThread();
     }
 
+    // Parsed IO has to be ready once the trace is complete
+    if (m_parsedIoBuilder && m_parsedIoBuilder->finish()) {
+        log::verbose << "Parsed IO built while tracing" << std::endl;
+    }
+    m_finishing = false;
+
     log::cout << "Trace collecting has completed" << std::endl;
     updateState();
 }
@@ -124,7 +265,7 @@ void TraceManager::initializeTraceDirectory() {
 void TraceManager::setupJobs() {
     // Split the common circular buffer so each job gets a share of it
     std::size_t jobBufferSize =
-            MiBToBytes(m_memoryPoolSizeMiB) / m_numberOfJobs;
+            MiBToBytes(m_config.circBufferSizeMiB) / m_numberOfJobs;
 
     // TODO(ajrutkow): change ring buffer size to 64 bit across source code
     if (jobBufferSize > std::numeric_limits<uint32_t>::max() ||
@@ -132,6 +273,24 @@ void TraceManager::setupJobs() {
         throw Exception("Incorrect circular buffer size");
     }
 
+    // Traces converted to protocol buffers are converted by a pool of
+    // threads shared by jobs, so one busy queue isn't limited to one CPU
+    if (m_config.serializerType == SerializerType::FileSerializer) {
+        uint32_t threadCount = m_config.conversionThreads;
+        if (!threadCount) {
+            uint32_t cpuCount = std::thread::hardware_concurrency();
+            threadCount = std::min(MAX_AUTO_CONVERSION_THREADS,
+                                   cpuCount ? cpuCount - 1 : 0);
+        }
+
+        if (threadCount) {
+            m_conversionPool = std::unique_ptr<TraceConversionPool>(
+                    new TraceConversionPool(m_executor, threadCount));
+        }
+    }
+
+    setupParsedIoBuilder();
+
     for (uint32_t i = 0; i < m_numberOfJobs; i++) {
         // If one of the constructors throws an exception, the others will
         // be stopped and cleaned up at the end of handleJobs function
@@ -139,8 +298,9 @@ void TraceManager::setupJobs() {
                                  "/" + m_traceDirRelativePath + "/" +
                                  TRACE_FILE_PREFIX + std::to_string(i);
         auto job = std::unique_ptr<TraceJob>(new TraceJob(
-                m_executor, m_maxDuration, i, jobFileName,
-                static_cast<uint32_t>(jobBufferSize), m_serializerType));
+                m_executor, m_config, i, jobFileName,
+                static_cast<uint32_t>(jobBufferSize), m_conversionPool.get(),
+                m_parsedIoBuilder.get()));
         job->startJobThread();
         m_jobs.push_back(std::move(job));
     }
@@ -156,16 +316,59 @@ void TraceManager::setupJobs() {
     log::cout << "Trace collecting has started" << std::endl;
 }
 
-void TraceManager::startJobs(uint32_t maxDuration,
-                             uint64_t maxFileSizeInMiB,
-                             uint32_t circBufferSizeInMiB,
-                             SerializerType serializerType) {
+void TraceManager::setupParsedIoBuilder() {
+    bool extensions = m_config.parsedIo;
+    bool statistics = m_config.liveStatistics;
+
+    // Parsed IO is built of all traces, it doesn't apply if traces are saved
+    // on snapshot only, or the oldest of them are removed
+    if (extensions && (!isFileSerializer(m_config.serializerType) ||
+                       isFlightRecorder() || m_config.segmentCount)) {
+        log::cerr << "Parsed IO can't be built while tracing with given "
+                  << "settings, it's going to be built when trace is parsed"
+                  << std::endl;
+        extensions = false;
+    }
+    if (statistics && isFlightRecorder()) {
+        log::cerr << "Live statistics can't be gathered by flight recorder"
+                  << std::endl;
+        statistics = false;
+    }
+
+    if (!extensions && !statistics) {
+        return;
+    }
+
+    bool sidPerQueue = m_executor->getSidScheme() ==
+                       proto::TraceSidScheme::SID_PER_QUEUE;
+
+    try {
+        m_parsedIoBuilder = std::unique_ptr<ParsedIoBuilder>(
+                new ParsedIoBuilder(m_executor, m_traceDirRelativePath,
+                                    m_numberOfJobs, sidPerQueue, m_tags,
+                                    extensions, statistics));
+    } catch (Exception &e) {
+        log::cerr << e.getMessage() << ", parsed IO is not built while "
+                  << "tracing" << std::endl;
+    }
+}
+
+void TraceManager::startJobs(const TraceConfig &config) {
     std::lock_guard<std::mutex> lock(m_traceManagementMutex);
     auto state = getState();
 
     // If there are still executing jobs, don't do anything
     if (state != TracingState::RUNNING && state != TracingState::INITIALIZING) {
-        if (m_serializerType == SerializerType::FileSerializer) {
+        // Events are sampled out and filtered by the traced module, before
+        // they reach trace buffers
+        if (!m_executor->setSampling(config.sampling, config.samplingRate)) {
+            throw Exception("Sampling is not supported by the traced module.");
+        }
+        if (!m_executor->setFilter(config.filter)) {
+            throw Exception("Filter is not supported by the traced module.");
+        }
+
+        if (isFileSerializer(config.serializerType)) {
             initializeTraceDirectory();
         }
 
@@ -181,10 +384,19 @@ void TraceManager::startJobs(uint32_t maxDuration,
         // would come before handleJobs thread would actually start execution
         setState(TracingState::INITIALIZING);
 
-        m_maxDuration = maxDuration;
-        m_maxFileSize = MiBToBytes(maxFileSizeInMiB);
-        m_memoryPoolSizeMiB = circBufferSizeInMiB;
-        m_serializerType = serializerType;
+        m_config = config;
+        if (!m_config.segmentSizeMiB) {
+            m_config.segmentCount = 0;
+        }
+        if (m_config.sampling == proto::TraceSampling::SAMPLING_NONE) {
+            m_config.samplingRate = 0;
+        }
+        m_snapshotRequested = false;
+        m_snapshotCount = 0;
+        m_snapshotLatencyNs = 0;
+        if (isFlightRecorder()) {
+            m_snapshotLatencyNs = m_config.snapshotLatencyUs * 1000;
+        }
 
         m_thread = std::thread(&TraceManager::handleJobs, this);
     } else {
@@ -203,6 +415,86 @@ void TraceManager::stopJobs() {
 
 void TraceManager::deleteJobs() {
     m_jobs.clear();
+    m_conversionPool.reset();
+    m_parsedIoBuilder.reset();
+}
+
+bool TraceManager::isFlightRecorder() const {
+    return m_config.fullPolicy == octf_trace_full_policy_overwrite;
+}
+
+void TraceManager::requestSnapshot() {
+    std::lock_guard<std::mutex> lock(m_traceManagementMutex);
+
+    if (!isFlightRecorder() || m_state != TracingState::RUNNING) {
+        throw Exception("Flight recorder tracing is not running.");
+    }
+
+    triggerSnapshot();
+}
+
+void TraceManager::reportIoLatency(uint64_t latencyNs) {
+    uint64_t threshold = m_snapshotLatencyNs;
+
+    if (threshold && latencyNs >= threshold &&
+        m_state == TracingState::RUNNING) {
+        triggerSnapshot();
+    }
+}
+
+uint64_t TraceManager::getSnapshotCount() const {
+    return m_snapshotCount;
+}
+
+void TraceManager::getLiveStatistics(proto::LiveStatistics *statistics) {
+    std::lock_guard<std::mutex> lock(m_traceManagementMutex);
+
+    // Statistics of the last trace are kept until the next one is started
+    if (!m_parsedIoBuilder || !m_parsedIoBuilder->isGatheringStatistics()) {
+        throw Exception("Live statistics are not gathered.");
+    }
+    if (m_parsedIoBuilder->isFailed()) {
+        throw Exception("Live statistics couldn't keep up with tracing.");
+    }
+
+    IoStatisticsSet set(0);
+    m_parsedIoBuilder->getStatistics(set);
+
+    set.getIoStatisticsSet(statistics->mutable_statistics());
+    set.getIoLatencyHistogramSet(statistics->mutable_latencyhistogram());
+    set.getIoSizeHistogramSet(statistics->mutable_sizehistogram());
+    set.getQueueDepthHistogramSet(statistics->mutable_queuedepthhistogram());
+}
+
+void TraceManager::triggerSnapshot() {
+    // Pending request covers all following ones
+    if (!m_snapshotRequested.exchange(true)) {
+        std::lock_guard<std::mutex> lock(m_snapshotMutex);
+        m_snapshotTrigger.notify_all();
+    }
+}
+
+bool TraceManager::isSnapshotRequested(int signal) {
+    bool requested = m_snapshotRequested.exchange(false);
+
+    if (signal) {
+        uint64_t signalCount = SignalHandler::get().getSignalCount(signal);
+        if (signalCount != m_snapshotSignalCount) {
+            m_snapshotSignalCount = signalCount;
+            requested = true;
+        }
+    }
+
+    return requested;
+}
+
+void TraceManager::takeSnapshot() {
+    for (const auto &job : m_jobs) {
+        job->requestSnapshot();
+    }
+    m_snapshotCount++;
+
+    log::cout << "Taking trace snapshot" << std::endl;
 }
 
 void TraceManager::fillTraceSummary(proto::TraceSummary *summary,
@@ -217,6 +509,20 @@ void TraceManager::fillTraceSummary(proto::TraceSummary *summary,
     summary->set_droppedevents(getDroppedTraceCount());
     summary->set_queuecount(getQueueCount());
     summary->set_version(getTraceVersion());
+    summary->set_sidscheme(m_executor->getSidScheme());
+    m_executor->getClock(summary->mutable_clock());
+    summary->set_format(m_config.serializerType ==
+                                        SerializerType::RawFileSerializer
+                                ? proto::TraceFormat::RAW
+                                : proto::TraceFormat::PROTOBUF);
+    summary->set_compressed(m_config.compression);
+    summary->set_segmentsize(m_config.segmentSizeMiB);
+    summary->set_sampling(m_config.sampling);
+    summary->set_samplingrate(m_config.samplingRate);
+    summary->mutable_filter()->CopyFrom(m_config.filter);
+    for (const auto &job : m_jobs) {
+        job->getSegments(summary->mutable_segments());
+    }
 
     proto::TraceState tracingState = proto::TraceState::UNDEFINED;
     switch (state) {
@@ -271,6 +577,15 @@ int64_t TraceManager::getTraceSize() const {
     return result;
 }
 
+uint64_t TraceManager::getSegmentsVersion() const {
+    uint64_t result = 0;
+    for (const auto &job : m_jobs) {
+        result += job->getSegmentsVersion();
+    }
+
+    return result;
+}
+
 int32_t TraceManager::getTraceVersion() const {
     if (m_jobs.size() == 0) {
         return -1;
@@ -330,6 +645,8 @@ TracingState TraceManager::getState() {
 }
 
 void TraceManager::updateState() {
+    std::lock_guard<std::recursive_mutex> lock(m_stateMutex);
+
     // If we're currently in running state (i.e. jobs have been successfully
     // spawned), ask for their status and update as required
     if (m_state == TracingState::RUNNING) {
@@ -356,8 +673,9 @@ void TraceManager::updateState() {
             }
         }
 
-        if (foundRunningState) {
-            // If at least one job is still running, return Running state
+        if (foundRunningState || (allFinished && m_finishing)) {
+            // If at least one job is still running, or trace extensions built
+            // of finished jobs are not committed yet, return Running state
             state = TracingState::RUNNING;
         } else if (allFinished && foundErrorState) {
             // If all jobs finished running, but at least one had an error
@@ -373,6 +691,8 @@ void TraceManager::updateState() {
 }
 
 void TraceManager::setState(TracingState state) {
+    std::lock_guard<std::recursive_mutex> lock(m_stateMutex);
+
     if (m_state == TracingState::RUNNING && state != TracingState::RUNNING) {
         m_endTime = std::chrono::steady_clock::now();
     }
@@ -380,7 +700,7 @@ void TraceManager::setState(TracingState state) {
     // Update state
     m_state = state;
 
-    if (m_serializerType == SerializerType::FileSerializer) {
+    if (isFileSerializer(m_config.serializerType)) {
         // Update summary  and serialize to file
         proto::TraceSummary summary;
         fillTraceSummary(&summary, state);
@@ -422,6 +742,33 @@ int TraceManager::pushTrace(uint32_t jobIndex,
     return -EINVAL;
 }
 
+int TraceManager::pushTraces(uint32_t jobIndex,
+                             const void *const *traces,
+                             const uint32_t *traceSizes,
+                             uint32_t count) {
+    if (jobIndex < m_jobs.size()) {
+        return m_jobs[jobIndex]->pushTraces(traces, traceSizes, count);
+    }
+    return -EINVAL;
+}
+
+int TraceManager::reserveTrace(uint32_t jobIndex,
+                               const uint32_t traceSize,
+                               TraceReservation &reservation) {
+    if (jobIndex < m_jobs.size()) {
+        return m_jobs[jobIndex]->reserveTrace(traceSize, reservation);
+    }
+    return -EINVAL;
+}
+
+int TraceManager::commitTrace(uint32_t jobIndex,
+                              const TraceReservation &reservation) {
+    if (jobIndex < m_jobs.size()) {
+        return m_jobs[jobIndex]->commitTrace(reservation);
+    }
+    return -EINVAL;
+}
+
 void TraceManager::addTag(const std::string &name, const std::string &value) {
     m_tags[name] = value;
 }
@@ -7,6 +7,7 @@
 #define SOURCE_OCTF_INTERFACE_TRACEMANAGER_H
 
 #include <atomic>
+#include <condition_variable>
 #include <mutex>
 #include <thread>
 #include <vector>
@@ -19,10 +20,16 @@
 
 namespace octf {
 
+/**
+ * Trace file of queue is named TRACE_FILE_PREFIX<queue>, if it's segmented,
+ * segment files are named TRACE_FILE_PREFIX<queue>.<segment index>
+ */
 static constexpr char TRACE_FILE_PREFIX[] = "octf.trace.";
 static constexpr char SUMMARY_FILE_NAME[] = "octf.summary";
 
 class TraceJob;
+class TraceConversionPool;
+class ParsedIoBuilder;
 
 enum class TracingState {
     UNDEFINED = 0,
@@ -33,6 +40,101 @@ enum class TracingState {
     ERROR
 };
 
+/**
+ * @brief Settings of trace collection
+ */
+struct TraceConfig {
+    TraceConfig();
+
+    /**
+     * @brief Max trace duration time (in seconds)
+     */
+    uint32_t maxDuration;
+    /**
+     * @brief Max size of trace files (in MiB)
+     */
+    uint64_t maxFileSizeMiB;
+    /**
+     * @brief Size of the internal trace buffer (in MiB), divided between
+     * jobs
+     */
+    uint32_t circBufferSizeMiB;
+    /**
+     * @brief Number of sub-rings trace buffer of each job is split into,
+     * 0 - one per CPU
+     */
+    uint32_t subRingCount;
+    /**
+     * @brief Serializer type
+     */
+    SerializerType serializerType;
+    /**
+     * @brief Compress trace files
+     */
+    bool compression;
+    /**
+     * @brief Size of trace file segment (in MiB), 0 - trace files are not
+     * segmented
+     */
+    uint32_t segmentSizeMiB;
+    /**
+     * @brief Max number of segments kept per queue, the oldest ones are
+     * removed, 0 - no limit
+     */
+    uint32_t segmentCount;
+    /**
+     * @brief Number of threads converting traces in addition to jobs'
+     * threads, 0 - chosen automatically
+     */
+    uint32_t conversionThreads;
+    /**
+     * @brief Build parsed IO while tracing, so that it's ready once tracing
+     * stops
+     */
+    bool parsedIo;
+    /**
+     * @brief Gather IO statistics while tracing
+     */
+    bool liveStatistics;
+    /**
+     * @brief Sampling of IOs by the traced module
+     */
+    proto::TraceSampling sampling;
+    /**
+     * @brief Events of one in this number of IOs are traced, used with
+     * sampling only
+     */
+    uint32_t samplingRate;
+    /**
+     * @brief Filter of IOs applied by the traced module
+     */
+    proto::TraceFilter filter;
+    /**
+     * @brief Behavior of trace producers when trace buffer is full
+     */
+    octf_trace_full_policy_t fullPolicy;
+    /**
+     * @brief Max time of waiting for free space in trace buffer (in
+     * microseconds), used by bounded wait policy only
+     */
+    uint64_t fullTimeoutUs;
+    /**
+     * @brief Latency of IO (in microseconds) triggering snapshot, used by
+     * flight recorder (overwrite policy) only, 0 - disabled
+     */
+    uint64_t snapshotLatencyUs;
+    /**
+     * @brief Signal triggering snapshot, used by flight recorder (overwrite
+     * policy) only, 0 - disabled
+     */
+    int snapshotSignal;
+    /**
+     * @brief Minimum time between snapshots (in milliseconds), used by
+     * flight recorder (overwrite policy) only
+     */
+    uint32_t snapshotIntervalMs;
+};
+
 /**
  * @brief Class for management of multiple jobs each of which is collecting
  * traces
@@ -53,17 +155,40 @@ public:
      *
      * @note Once all setup ITraceExecutor::startTrace is called
      *
-     * @param maxDuration Max trace duration time (in seconds)
-     * @param maxFileSizeInMiB Max size of trace file (in MiB)
-     * @param circBufferSizeInMiB Size of the internal trace buffer (in MiB)
-     * @param label User defined label
-     * @param serializerType Serializer Type
-     */
-    void startJobs(uint32_t maxDuration,
-                   uint64_t maxFileSizeInMiB,
-                   uint32_t circBufferSizeInMiB,
-                   SerializerType serializerType);
+     * @param config Settings of trace collection
+     *
+     * @note With overwrite policy tracing runs as flight recorder, traces are
+     * kept in trace buffers and saved on snapshot only. Snapshot is triggered
+     * by requestSnapshot, configured signal or IO latency exceeding the
+     * threshold, no more often than the configured interval. Maximum
+     * duration doesn't apply to flight recorder.
+     */
+    void startJobs(const TraceConfig &config);
     void stopJobs();
+    /**
+     * @brief Requests snapshot of flight recorder, traces kept in trace
+     * buffers are saved to trace files
+     */
+    void requestSnapshot();
+    /**
+     * @brief Reports latency of completed IO, flight recorder snapshot is
+     * triggered if it exceeds the threshold
+     *
+     * @param latencyNs IO latency (in nanoseconds)
+     */
+    void reportIoLatency(uint64_t latencyNs);
+    /**
+     * @brief Gets number of snapshots taken by flight recorder since start of
+     * the last/current trace
+     */
+    uint64_t getSnapshotCount() const;
+    /**
+     * @brief Gets IO statistics of the last/current trace, gathered while
+     * tracing
+     *
+     * @param[out] statistics IO statistics
+     */
+    void getLiveStatistics(proto::LiveStatistics *statistics);
     /**
      * @brief Gets the sum of trace files' sizes (in MiB) from all child jobs
      */
@@ -133,6 +258,36 @@ public:
     int pushTrace(uint32_t jobIndex,
                   const void *trace,
                   const uint32_t traceSize);
+    /**
+     * @brief Pushes a batch of traces to the given job (if found)
+     *
+     * @retval 0 All traces pushed successfully
+     * @retval -EINVAL Trace is invalid
+     * @retval -EPERM Invalid open mode, only producer can push events
+     * @retval -ENOSPC No space in memory pool to store some of events
+     */
+    int pushTraces(uint32_t jobIndex,
+                   const void *const *traces,
+                   const uint32_t *traceSizes,
+                   uint32_t count);
+    /**
+     * @brief Reserves space for a trace in the given job (if found), the
+     * trace is written in place and then committed with this->commitTrace
+     *
+     * @retval 0 Space reserved successfully
+     * @retval -EINVAL Job not found, trace or its size is invalid
+     * @retval -ENOSPC No space in memory pool to store event
+     */
+    int reserveTrace(uint32_t jobIndex,
+                     const uint32_t traceSize,
+                     TraceReservation &reservation);
+    /**
+     * @brief Commits trace written into space reserved by this->reserveTrace
+     *
+     * @retval 0 Trace committed successfully
+     * @retval -EINVAL Job not found, trace or reservation is invalid
+     */
+    int commitTrace(uint32_t jobIndex, const TraceReservation &reservation);
 
 private:
     /**
@@ -145,10 +300,34 @@ private:
      * @brief Creates and starts appropriate number of jobs
      */
     void setupJobs();
+    /**
+     * @brief Creates builder of parsed IO, if parsed IO or live statistics
+     * are requested and apply to trace settings
+     */
+    void setupParsedIoBuilder();
     /**
      * @brief Clears the job container
      */
     void deleteJobs();
+    /**
+     * @brief Checks if tracing runs as flight recorder
+     */
+    bool isFlightRecorder() const;
+    /**
+     * @brief Notifies management thread about snapshot request
+     */
+    void triggerSnapshot();
+    /**
+     * @brief Checks and clears snapshot request (including requests sent by
+     * signal)
+     *
+     * @param signal Signal triggering snapshot, 0 if none
+     */
+    bool isSnapshotRequested(int signal);
+    /**
+     * @brief Requests all jobs to save traces kept in trace buffers
+     */
+    void takeSnapshot();
 
     /**
      * @brief Retrieves parsed protobuf trace version
@@ -162,6 +341,11 @@ private:
      * @brief Gets the sum of trace files' sizes (in bytes) from all child jobs
      */
     int64_t getTraceSize() const;
+    /**
+     * @brief Gets the sum of segments list versions from all child jobs,
+     * changes whenever a segment is created, closed or removed
+     */
+    uint64_t getSegmentsVersion() const;
     /**
      * @brief Node path to owner node
      */
@@ -182,16 +366,35 @@ private:
      * @brief Current state of the trace collection
      */
     std::atomic<TracingState> m_state;
+    /**
+     * @brief Set while jobs are being stopped and trace extensions built of
+     * them are committed, tracing is not complete until then
+     */
+    std::atomic<bool> m_finishing;
+    /**
+     * @brief Mutex serializing tracing state updates and writes of trace
+     * summary, taken by management thread and RPC threads alike
+     */
+    std::recursive_mutex m_stateMutex;
     /**
      * @brief Mutex for synchronous start/stop trace calls
      */
     std::mutex m_traceManagementMutex;
     std::vector<std::unique_ptr<TraceJob>> m_jobs;
     /**
-     * @brief Maximum time duration (in seconds) during which a given job will
-     * execute
+     * @brief Pool of threads converting traces of all jobs, nullptr if
+     * traces are converted by jobs' threads only
+     */
+    std::unique_ptr<TraceConversionPool> m_conversionPool;
+    /**
+     * @brief Builder of parsed IO of all jobs, nullptr if parsed IO isn't
+     * built while tracing
      */
-    uint32_t m_maxDuration;
+    std::unique_ptr<ParsedIoBuilder> m_parsedIoBuilder;
+    /**
+     * @brief Settings of the last/current trace collection
+     */
+    TraceConfig m_config;
     /**
      * @brief Starting moment of trace collection
      */
@@ -200,26 +403,35 @@ private:
      * @brief Ending moment of trace collection
      */
     std::chrono::time_point<std::chrono::steady_clock> m_endTime;
-    /**
-     * @brief Maximum (total sum from all jobs) trace file size (in bytes) in
-     * which traces will be saved, after reaching this value all jobs will stop
-     * executing
-     */
-    int64_t m_maxFileSize;
     /**
      * @brief How many jobs will be spawned when startJobs is called
      */
     uint32_t m_numberOfJobs;
     /**
-     * @brief Memory pool size in MiB, divided between child jobs for their
-     * circular buffers
+     * @brief Latency of IO (in nanoseconds) triggering flight recorder
+     * snapshot, 0 if disabled
+     */
+    std::atomic<uint64_t> m_snapshotLatencyNs;
+    /**
+     * @brief Set when snapshot of flight recorder is requested
+     */
+    std::atomic<bool> m_snapshotRequested;
+    /**
+     * @brief Mutex for m_snapshotTrigger
+     */
+    std::mutex m_snapshotMutex;
+    /**
+     * @brief Wakes up management thread on snapshot request
+     */
+    std::condition_variable m_snapshotTrigger;
+    /**
+     * @brief Number of snapshot signals already handled
      */
-    uint32_t m_memoryPoolSizeMiB;
+    uint64_t m_snapshotSignalCount;
     /**
-     * @brief Describes the type of output for traces (e.g. file,
-     * database)
+     * @brief Number of snapshots taken since start of tracing
      */
-    SerializerType m_serializerType;
+    std::atomic<uint64_t> m_snapshotCount;
     /**
      * @brief The root output directory for traces for a given plugin instance's
      * trace collection as a path relative to the general trace directory.
@@ -1,20 +1,59 @@
 /*
- * Copyright(c) 2012-2018 Intel Corporation
+ * Copyright(c) 2012-2020 Intel Corporation
  * SPDX-License-Identifier: BSD-3-Clause
  */
 
 #include <octf/interface/TraceProducerLocal.h>
 
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/sysinfo.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <thread>
 #include <octf/utils/Exception.h>
+#include <octf/utils/Numa.h>
+#include <octf/utils/SizeConversion.h>
 
 namespace octf {
 
 static constexpr size_t BUFFER_FREE_SPACE_PERCENTAGE_WAKE_UP_TRIGGER = 75;
 
+/**
+ * Consumer checks for traces below the wake up threshold this often
+ */
+static constexpr std::chrono::milliseconds CONSUMER_WAKE_UP_PERIOD(100);
+
+/**
+ * Memory pool is not split into sub-rings smaller than this size (in MiB)
+ */
+static constexpr size_t SUB_RING_MIN_SIZE_MIB = 1;
+
+/**
+ * Sub-ring size is aligned to this value
+ */
+static constexpr size_t SUB_RING_ALIGNMENT = 4096;
+
+/**
+ * Memory pools of at least this size are backed by huge pages if possible
+ */
+static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
 TraceProducerLocal::TraceProducerLocal(uint32_t queueId)
-        : m_traceProducerHandle(nullptr)
-        , m_ringMemoryPool()
-        , m_stop(false)
+        : m_traceProducerHandles()
+        , m_maxSubRingCount(std::max<size_t>(get_nprocs_conf(), 1))
+        , m_subRingCount(1)
+        , m_subRingUsers(new SubRingUsers[m_maxSubRingCount]())
+        , m_ringMemoryPool(nullptr)
+        , m_ringMemoryPoolSize(0)
+        , m_ringMappingSize(0)
+        , m_ringPageSize(0)
+        , m_numaNode(numautils::NO_NUMA_NODE)
+        , m_subRingSize(0)
+        , m_stop(true)
+        , m_consumerWaiting(false)
         , m_ringTriggerSize(0)
         , m_queueId(queueId) {}
 
@@ -22,38 +61,301 @@ TraceProducerLocal::~TraceProducerLocal() {
     deinitRing();
 }
 
-void TraceProducerLocal::initRing(uint32_t memoryPoolSize) {
-    m_ringMemoryPool.resize(memoryPoolSize);
+void TraceProducerLocal::initRing(uint32_t memoryPoolSize,
+                                  uint32_t requestedSubRingCount) {
+    // More sub-rings than CPUs are never used, and sub-rings can't be too
+    // small
+    size_t subRingCount = m_maxSubRingCount;
+    if (requestedSubRingCount) {
+        subRingCount = std::min<size_t>(subRingCount, requestedSubRingCount);
+    }
+    subRingCount = std::min(subRingCount,
+                            memoryPoolSize / MiBToBytes(SUB_RING_MIN_SIZE_MIB));
+    subRingCount = std::max<size_t>(subRingCount, 1);
+
+    m_subRingSize = memoryPoolSize / subRingCount;
+    if (subRingCount > 1) {
+        m_subRingSize -= m_subRingSize % SUB_RING_ALIGNMENT;
+    }
+
+    allocateMemoryPool(memoryPoolSize);
+    placeSubRings(subRingCount);
+
     m_ringTriggerSize =
-            memoryPoolSize * BUFFER_FREE_SPACE_PERCENTAGE_WAKE_UP_TRIGGER / 100;
+            m_subRingSize * BUFFER_FREE_SPACE_PERCENTAGE_WAKE_UP_TRIGGER / 100;
 
-    if (octf_trace_open(m_ringMemoryPool.data(), memoryPoolSize, NULL,
-                        octf_trace_open_mode_producer,
-                        &m_traceProducerHandle)) {
-        throw Exception("Failed to initialize trace producer");
+    for (size_t i = 0; i < subRingCount; i++) {
+        octf_trace_t handle = nullptr;
+
+        if (octf_trace_open(getSubRingBuffer(i), m_subRingSize, NULL,
+                            octf_trace_open_mode_producer, &handle)) {
+            deinitRing();
+            throw Exception("Failed to initialize trace producer");
+        }
+
+        m_traceProducerHandles.push_back(handle);
     }
 
-    // reset stop in case circular buffer is re-initialized
+    // Producers seeing the stop reset see the sub-rings too, reset stop in
+    // case circular buffer is re-initialized
+    m_subRingCount.store(subRingCount, std::memory_order_relaxed);
     m_stop = false;
 }
 
 void TraceProducerLocal::deinitRing() {
-    octf_trace_close(&m_traceProducerHandle);
-    m_ringMemoryPool.clear();
+    // No producer enters sub-rings from now on, the ones which are in them
+    // leave soon, as consumers are closed
+    m_stop = true;
+    waitForProducers();
+
+    for (auto &handle : m_traceProducerHandles) {
+        octf_trace_close(&handle);
+    }
+    m_traceProducerHandles.clear();
+    freeMemoryPool();
+    m_subRingSize = 0;
+    m_numaNode = numautils::NO_NUMA_NODE;
+}
+
+void TraceProducerLocal::allocateMemoryPool(size_t size) {
+    freeMemoryPool();
+
+    void *pool = MAP_FAILED;
+
+    // Rings are accessed at random offsets by all producers, huge pages save
+    // TLB misses. Explicit huge pages need to be reserved by the
+    // administrator, if there are none, transparent huge pages are requested.
+    if (size >= HUGE_PAGE_SIZE) {
+        size_t mappingSize = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE *
+                             HUGE_PAGE_SIZE;
+
+        pool = mmap(NULL, mappingSize, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (MAP_FAILED != pool) {
+            m_ringMappingSize = mappingSize;
+            m_ringPageSize = HUGE_PAGE_SIZE;
+        }
+    }
+
+    if (MAP_FAILED == pool) {
+        pool = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == pool) {
+            throw Exception("Failed to allocate trace memory pool");
+        }
+
+        m_ringMappingSize = size;
+        m_ringPageSize = sysconf(_SC_PAGESIZE);
+
+        if (size >= HUGE_PAGE_SIZE) {
+            // Advisory only, no error if transparent huge pages are disabled
+            madvise(pool, size, MADV_HUGEPAGE);
+        }
+    }
+
+    // Anonymous mapping is zero-filled, pages are not touched until the rings
+    // are placed on NUMA nodes
+    m_ringMemoryPool = static_cast<char *>(pool);
+    m_ringMemoryPoolSize = size;
+}
+
+void TraceProducerLocal::freeMemoryPool() {
+    if (m_ringMemoryPool) {
+        munmap(m_ringMemoryPool, m_ringMappingSize);
+    }
+
+    m_ringMemoryPool = nullptr;
+    m_ringMemoryPoolSize = 0;
+    m_ringMappingSize = 0;
+    m_ringPageSize = 0;
+}
+
+void TraceProducerLocal::placeSubRings(size_t subRingCount) {
+    m_numaNode = numautils::NO_NUMA_NODE;
+
+    if (subRingCount < 2) {
+        placeSingleRing();
+        return;
+    }
+
+    if (m_subRingSize % m_ringPageSize) {
+        // Sub-rings share pages
+        return;
+    }
+
+    // Sub-ring is used by CPUs of index equal to sub-ring index modulo
+    // sub-ring count, place it on the node of the first of them
+    std::map<int, size_t> subRingsPerNode;
+    for (size_t i = 0; i < subRingCount; i++) {
+        int node = numautils::getCpuNode(i);
+        if (numautils::NO_NUMA_NODE == node) {
+            return;
+        }
+
+        subRingsPerNode[node]++;
+    }
+
+    if (subRingsPerNode.size() > 1) {
+        for (size_t i = 0; i < subRingCount; i++) {
+            numautils::setPreferredNode(getSubRingBuffer(i), m_subRingSize,
+                                        numautils::getCpuNode(i));
+        }
+    }
+
+    // The consumer is placed on the node holding most of the sub-rings
+    size_t maxSubRings = 0;
+    for (const auto &node : subRingsPerNode) {
+        if (node.second > maxSubRings) {
+            maxSubRings = node.second;
+            m_numaNode = node.first;
+        }
+    }
+}
+
+void TraceProducerLocal::placeSingleRing() {
+    // Single ring is shared by all CPUs. If tracing is started by a thread
+    // bound to CPUs of one node, producers are most likely bound there too,
+    // otherwise the ring is placed on the node of the CPU starting tracing.
+    cpu_set_t cpuset;
+    std::set<int> nodes;
+    if (!sched_getaffinity(0, sizeof(cpuset), &cpuset)) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &cpuset)) {
+                nodes.insert(numautils::getCpuNode(cpu));
+            }
+        }
+    }
+
+    int node = numautils::NO_NUMA_NODE;
+    if (nodes.size() == 1) {
+        node = *nodes.begin();
+    }
+
+    if (numautils::NO_NUMA_NODE == node) {
+        int cpu = sched_getcpu();
+        if (cpu < 0) {
+            return;
+        }
+
+        node = numautils::getCpuNode(cpu);
+        if (numautils::NO_NUMA_NODE == node) {
+            return;
+        }
+    }
+
+    numautils::setPreferredNode(m_ringMemoryPool, m_ringMappingSize, node);
+    m_numaNode = node;
+}
+
+void TraceProducerLocal::setFullPolicy(octf_trace_full_policy_t policy,
+                                       uint64_t timeoutUs) {
+    for (const auto &handle : m_traceProducerHandles) {
+        if (octf_trace_set_full_policy(handle, policy, timeoutUs)) {
+            throw Exception("Failed to set trace full policy");
+        }
+    }
 }
 
 char *TraceProducerLocal::getBuffer() {
-    return m_ringMemoryPool.data();
+    return m_ringMemoryPool;
 }
 
 size_t TraceProducerLocal::getSize() const {
-    return m_ringMemoryPool.size();
+    return m_ringMemoryPoolSize;
 }
 
 octf_trace_hdr_t *TraceProducerLocal::getConsumerHeader() {
     return nullptr;
 }
 
+uint32_t TraceProducerLocal::getSubRingCount() const {
+    return m_traceProducerHandles.size();
+}
+
+char *TraceProducerLocal::getSubRingBuffer(uint32_t subRing) {
+    return m_ringMemoryPool + subRing * m_subRingSize;
+}
+
+size_t TraceProducerLocal::getSubRingSize(uint32_t subRing) const {
+    (void) subRing;
+    return m_subRingSize;
+}
+
+octf_trace_hdr_t *TraceProducerLocal::getSubRingConsumerHeader(
+        uint32_t subRing) {
+    (void) subRing;
+    return nullptr;
+}
+
+uint32_t TraceProducerLocal::getCurrentSubRing() const {
+    int cpu = sched_getcpu();
+    if (cpu < 0) {
+        return 0;
+    }
+
+    // Sub-ring handles may be being closed, the count is always valid index
+    // of sub-ring users
+    return static_cast<uint32_t>(cpu) %
+           m_subRingCount.load(std::memory_order_relaxed);
+}
+
+bool TraceProducerLocal::enterSubRing(uint32_t subRing) {
+    auto &users = m_subRingUsers[subRing].count;
+
+    // Sequentially consistent, so either the producer sees the stop, or
+    // this->deinitRing sees the producer
+    users.fetch_add(1);
+    if (m_stop.load()) {
+        users.fetch_sub(1, std::memory_order_release);
+        return false;
+    }
+
+    // Sub-ring selected before the ring was re-initialized with fewer
+    // sub-rings
+    if (subRing >= m_subRingCount.load(std::memory_order_relaxed)) {
+        users.fetch_sub(1, std::memory_order_release);
+        return false;
+    }
+
+    return true;
+}
+
+void TraceProducerLocal::leaveSubRing(uint32_t subRing) {
+    m_subRingUsers[subRing].count.fetch_sub(1, std::memory_order_release);
+}
+
+void TraceProducerLocal::waitForProducers() const {
+    // Producer may have selected sub-ring before the ring was re-initialized
+    for (uint32_t i = 0; i < m_maxSubRingCount; i++) {
+        while (m_subRingUsers[i].count.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool TraceProducerLocal::isEmpty() const {
+    for (const auto &handle : m_traceProducerHandles) {
+        if (octf_trace_is_empty(handle) == 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void TraceProducerLocal::wakeUpConsumer(octf_trace_t handle) {
+    // Check the flag first, it's the cheapest one and it's cleared while the
+    // consumer is processing traces
+    if (m_consumerWaiting.load(std::memory_order_relaxed) &&
+        m_ringTriggerSize > octf_trace_get_free_space(handle) &&
+        m_consumerWaiting.exchange(false)) {
+        // The consumer sets the flag with the mutex held, so once the mutex is
+        // taken, the consumer is surely waiting for notification
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_checkTrigger.notify_all();
+    }
+}
+
 void TraceProducerLocal::stop() {
     {
         std::lock_guard<std::mutex> lock(m_mutex);
@@ -65,11 +367,26 @@ void TraceProducerLocal::stop() {
 bool TraceProducerLocal::wait(
         std::chrono::time_point<std::chrono::steady_clock> &endTime) {
     std::unique_lock<std::mutex> lock(m_mutex);
-    if (m_checkTrigger.wait_until(lock, endTime) == std::cv_status::timeout) {
-        return false;
+
+    // Stop may be requested before the caller starts waiting
+    while (!m_stop) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= endTime) {
+            return false;
+        }
+
+        m_consumerWaiting = true;
+        auto status = m_checkTrigger.wait_until(
+                lock, std::min(endTime, now + CONSUMER_WAKE_UP_PERIOD));
+        m_consumerWaiting = false;
+
+        if (status == std::cv_status::no_timeout || !isEmpty()) {
+            // Woken up by producer or some traces are pending
+            return !m_stop;
+        }
     }
 
-    return !m_stop;
+    return false;
 }
 
 int TraceProducerLocal::getCpuAffinity(void) {
@@ -77,28 +394,34 @@ int TraceProducerLocal::getCpuAffinity(void) {
     return NO_CPU_AFFINITY;
 }
 
+int TraceProducerLocal::getNumaNode(void) {
+    return m_numaNode;
+}
+
 int TraceProducerLocal::pushTrace(const void *trace, const uint32_t traceSize) {
     int result = 0;
-    bool stop;
 
-    {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        stop = m_stop;
-    }
+    if (!m_stop.load(std::memory_order_relaxed)) {
+        uint32_t subRing = getCurrentSubRing();
 
-    if (!stop) {
-        if (traceSize > m_ringMemoryPool.size()) {
+        // Sub-rings are accessed only once the producer has entered one
+        if (traceSize > 0 && !enterSubRing(subRing)) {
             result = -ENOSPC;
         } else if (traceSize > 0) {
-            result = octf_trace_push(m_traceProducerHandle, trace, traceSize);
+            octf_trace_t handle = m_traceProducerHandles[subRing];
+
+            if (traceSize > m_subRingSize) {
+                result = -ENOSPC;
+            } else {
+                result = octf_trace_push(handle, trace, traceSize);
+            }
             if (!result) {
                 // Send the processing trigger if the free space in the circular
                 // buffer has reached the threshold
-                if (m_ringTriggerSize >
-                    octf_trace_get_free_space(m_traceProducerHandle)) {
-                    m_checkTrigger.notify_all();
-                }
+                wakeUpConsumer(handle);
             }
+
+            leaveSubRing(subRing);
         }
         // trace size of 0 - we don't do anything with it
     } else {
@@ -108,6 +431,80 @@ int TraceProducerLocal::pushTrace(const void *trace, const uint32_t traceSize) {
     return result;
 }
 
+int TraceProducerLocal::pushTraces(const void *const *traces,
+                                   const uint32_t *traceSizes,
+                                   uint32_t count) {
+    int result = 0;
+
+    if (!m_stop.load(std::memory_order_relaxed)) {
+        // Whole batch goes to one sub-ring
+        uint32_t subRing = getCurrentSubRing();
+
+        if (count > 0 && !enterSubRing(subRing)) {
+            result = -ENOSPC;
+        } else if (count > 0) {
+            octf_trace_t handle = m_traceProducerHandles[subRing];
+
+            result = octf_trace_push_batch(handle, traces, traceSizes, count);
+            if (!result || -ENOSPC == result) {
+                wakeUpConsumer(handle);
+            }
+
+            leaveSubRing(subRing);
+        }
+    } else {
+        result = -ENOSPC;
+    }
+
+    return result;
+}
+
+int TraceProducerLocal::reserveTrace(const uint32_t traceSize,
+                                     TraceReservation &reservation) {
+    reservation.trace = nullptr;
+    reservation.ring = nullptr;
+    reservation.event = nullptr;
+    reservation.subRing = 0;
+
+    if (m_stop.load(std::memory_order_relaxed)) {
+        return -ENOSPC;
+    } else if (0 == traceSize) {
+        return -EINVAL;
+    }
+
+    // The sub-ring is remembered in the reservation, as the caller may be
+    // migrated to another CPU before it commits the trace. The producer
+    // stays in the sub-ring until then.
+    reservation.subRing = getCurrentSubRing();
+    if (!enterSubRing(reservation.subRing)) {
+        return -ENOSPC;
+    } else if (traceSize > m_subRingSize) {
+        leaveSubRing(reservation.subRing);
+        return -ENOSPC;
+    }
+    reservation.ring = m_traceProducerHandles[reservation.subRing];
+
+    int result = octf_trace_get_wr_buffer(reservation.ring, &reservation.event,
+                                          &reservation.trace, traceSize);
+    if (result) {
+        leaveSubRing(reservation.subRing);
+    }
+
+    return result;
+}
+
+int TraceProducerLocal::commitTrace(const TraceReservation &reservation) {
+    int result =
+            octf_trace_commit_wr_buffer(reservation.ring, reservation.event);
+
+    if (!result) {
+        wakeUpConsumer(reservation.ring);
+    }
+    leaveSubRing(reservation.subRing);
+
+    return result;
+}
+
 int32_t TraceProducerLocal::getQueueId() {
     return m_queueId;
 }
@@ -1,5 +1,5 @@
 /*
- * Copyright(c) 2012-2018 Intel Corporation
+ * Copyright(c) 2012-2020 Intel Corporation
  * SPDX-License-Identifier: BSD-3-Clause
  */
 
@@ -8,6 +8,8 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <octf/interface/IRingTraceProducer.h>
 #include <octf/trace/trace.h>
@@ -17,6 +19,20 @@ namespace octf {
 /**
  * @brief Trace producer implementation for the case where trace
  * buffer producer runs in the same process as trace consumer.
+ *
+ * The memory pool may be split into sub-rings, as many as requested and the
+ * pool size allows, and each trace is pushed to the sub-ring of the CPU it is
+ * pushed on (CPU index modulo sub-ring count). A single producer, or producers
+ * pinned to a few CPUs, get a share of the pool only then, so it's a single
+ * ring unless requested otherwise. The pool is backed by huge pages when
+ * possible, and each sub-ring is placed on the NUMA node of its CPUs.
+ *
+ * Pushing traces doesn't take any lock. Producers wake up the consumer only
+ * once a sub-ring fills up to the threshold, traces below the threshold are
+ * picked up by the consumer periodically.
+ *
+ * Producers accessing a sub-ring are counted, so that the ring is unmapped
+ * only after the last of them, possibly waiting for free space, leaves it.
  */
 class TraceProducerLocal : public IRingTraceProducer {
 public:
@@ -29,41 +45,185 @@ public:
 
     octf_trace_hdr_t *getConsumerHeader(void) override;
 
+    uint32_t getSubRingCount(void) const override;
+
+    char *getSubRingBuffer(uint32_t subRing) override;
+
+    size_t getSubRingSize(uint32_t subRing) const override;
+
+    octf_trace_hdr_t *getSubRingConsumerHeader(uint32_t subRing) override;
+
     bool wait(std::chrono::time_point<std::chrono::steady_clock> &endTime)
             override;
 
     void stop(void) override;
 
-    void initRing(uint32_t memoryPoolSize) override;
+    void initRing(uint32_t memoryPoolSize, uint32_t subRingCount) override;
 
     void deinitRing() override;
 
+    void setFullPolicy(octf_trace_full_policy_t policy,
+                       uint64_t timeoutUs) override;
+
     int pushTrace(const void *trace, const uint32_t traceSize) override;
 
+    int pushTraces(const void *const *traces,
+                   const uint32_t *traceSizes,
+                   uint32_t count) override;
+
+    int reserveTrace(const uint32_t traceSize,
+                     TraceReservation &reservation) override;
+
+    int commitTrace(const TraceReservation &reservation) override;
+
     int getCpuAffinity(void) override;
 
+    int getNumaNode(void) override;
+
     int32_t getQueueId() override;
 
 protected:
-    octf_trace_t getTraceProducerHandle() const {
-        return m_traceProducerHandle;
+    octf_trace_t getTraceProducerHandle(uint32_t subRing = 0) const {
+        return m_traceProducerHandles.at(subRing);
     }
 
 private:
     /**
-     * @brief Handle for the producer's trace
+     * @brief Selects sub-ring for the CPU the caller runs on
+     */
+    uint32_t getCurrentSubRing() const;
+
+    /**
+     * @brief Registers producer accessing given sub-ring
+     *
+     * @retval true Producer may access sub-ring until it calls
+     * this->leaveSubRing
+     * @retval false Producing traces is stopped, sub-ring can't be accessed
+     */
+    bool enterSubRing(uint32_t subRing);
+
+    /**
+     * @brief Unregisters producer accessing given sub-ring
+     */
+    void leaveSubRing(uint32_t subRing);
+
+    /**
+     * @brief Waits until no producer accesses any sub-ring
      */
-    octf_trace_t m_traceProducerHandle;
+    void waitForProducers() const;
+
+    /**
+     * @brief Maps memory pool of given size, preferably with huge pages
+     */
+    void allocateMemoryPool(size_t size);
+
+    /**
+     * @brief Unmaps memory pool
+     */
+    void freeMemoryPool();
+
+    /**
+     * @brief Sets NUMA node of each sub-ring memory to the node of the CPU
+     * pushing into it
+     *
+     * @note Has to be called before the memory pool is touched for the first
+     * time
+     */
+    void placeSubRings(size_t subRingCount);
+
+    /**
+     * @brief Sets NUMA node of the ring memory, when it isn't split into
+     * sub-rings, to the node CPUs starting tracing belong to
+     *
+     * @note Has to be called before the memory pool is touched for the first
+     * time
+     */
+    void placeSingleRing();
+
+    /**
+     * @brief Checks if all sub-rings are empty
+     */
+    bool isEmpty() const;
+
+    /**
+     * @brief Wakes up the consumer waiting in this->wait, if the given
+     * sub-ring has filled up to the threshold
+     */
+    void wakeUpConsumer(octf_trace_t handle);
+
+    /**
+     * @brief Number of producers accessing sub-ring, padded to cache line so
+     * that sub-rings don't contend on their counters
+     */
+    struct SubRingUsers {
+        std::atomic<uint32_t> count;
+        char padding[64 - sizeof(std::atomic<uint32_t>)];
+    };
+
+    /**
+     * @brief Handles for the producer's traces, one per sub-ring, accessed by
+     * producers which have entered a sub-ring only
+     */
+    std::vector<octf_trace_t> m_traceProducerHandles;
+
+    /**
+     * @brief Max number of sub-rings, one per CPU
+     */
+    const size_t m_maxSubRingCount;
+
+    /**
+     * @brief Number of sub-rings traces are pushed to, never 0, changed by
+     * this->initRing while producers are stopped
+     */
+    std::atomic<uint32_t> m_subRingCount;
+
+    /**
+     * @brief Producers accessing each of sub-rings, allocated for the max
+     * number of sub-rings at once, so that a producer racing with
+     * this->deinitRing never accesses freed counter
+     */
+    std::unique_ptr<SubRingUsers[]> m_subRingUsers;
 
     /**
      * @brief Memory pool used for ring (circular buffer) and consumer header
      */
-    std::vector<char> m_ringMemoryPool;
+    char *m_ringMemoryPool;
+
+    /**
+     * @brief Size of memory pool
+     */
+    size_t m_ringMemoryPoolSize;
+
+    /**
+     * @brief Size of memory pool mapping, rounded up to page size
+     */
+    size_t m_ringMappingSize;
+
+    /**
+     * @brief Size of pages backing memory pool
+     */
+    size_t m_ringPageSize;
+
+    /**
+     * @brief NUMA node holding most of the sub-rings
+     */
+    int m_numaNode;
+
+    /**
+     * @brief Size of single sub-ring within memory pool
+     */
+    size_t m_subRingSize;
 
     /**
      * @brief Set to true when this->stop is called
      */
-    bool m_stop;
+    std::atomic<bool> m_stop;
+
+    /**
+     * @brief Set when the consumer waits in this->wait and hasn't been woken
+     * up by producers yet
+     */
+    std::atomic<bool> m_consumerWaiting;
 
     /**
      * @brief Notified when thread waiting on traces should be signalled
@@ -71,13 +231,13 @@ private:
     std::condition_variable m_checkTrigger;
 
     /**
-     * @brief When ring free size is below this value,
+     * @brief When sub-ring free size is below this value,
      * user waiting in this->wait will be woken up
      */
     uint32_t m_ringTriggerSize;
 
     /**
-     * @brief Mutex for @m_checkTrigger stop condition
+     * @brief Mutex for @m_checkTrigger stop and wake up conditions
      */
     std::mutex m_mutex;
 
@@ -3,85 +3,79 @@
  * SPDX-License-Identifier: BSD-3-Clause
  */
 
-#include <fcntl.h>
-#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <third_party/safestringlib.h>
-#include <unistd.h>
+#include <zlib.h>
 #include <algorithm>
 #include <iostream>
 #include <octf/interface/internal/FileTraceSerializer.h>
+#include <octf/trace/compressed_trace_file.h>
 #include <octf/utils/Exception.h>
 #include <octf/utils/ProtoConverter.h>
-#include <octf/utils/SizeConversion.h>
 
 namespace octf {
 
-FileTraceSerializer::FileTraceSerializer(const std::string &outputFileName)
-        : m_fd(-1)
-        , m_addr(NULL)
-        , m_dataOffset(0)
-        , m_fileOffset(0)
-        , m_size(0)
-        , m_outputFileName(outputFileName)
-        , m_pageSize(sysconf(_SC_PAGE_SIZE)) {}
+/**
+ * Size of data compressed into one frame of compressed trace file
+ */
+static constexpr size_t COMPRESSION_BLOCK_SIZE = 256 * 1024;
+
+FileTraceSerializer::FileTraceSerializer(const std::string &outputFileName,
+                                         bool compression)
+        : m_outputFileName(outputFileName)
+        , m_writer(outputFileName)
+        , m_compression(compression)
+        , m_block()
+        , m_blockUsed(0) {}
 
 FileTraceSerializer::~FileTraceSerializer() {
     close();
 }
 
 bool FileTraceSerializer::open() {
-    if (m_fd < 0) {
-        int flags = O_CREAT | O_RDWR;
-
-        m_fd = ::open(m_outputFileName.c_str(), flags, S_IRUSR | S_IWUSR);
-        if (m_fd < 0) {
+    if (!m_writer.isOpen()) {
+        if (!m_writer.open()) {
             return false;
         }
+
+        if (m_compression) {
+            writeCompressionHeader();
+        }
     }
     return true;
 }
 
 void FileTraceSerializer::moveDataPointer(uint64_t size) {
-    m_dataOffset += size;
+    m_writer.commit(size);
 }
 
 bool FileTraceSerializer::close() {
     bool success = false;
 
-    if (m_fd >= 0) {
-        success = ::ftruncate(m_fd, m_dataOffset) == 0 ? true : false;
-        if (m_addr) {
-            munmap(m_addr, m_size);
-            m_addr = nullptr;
+    if (m_writer.isOpen()) {
+        if (m_compression) {
+            flushBlock();
         }
 
-        // Change file permission to read only
-        success &= ::fchmod(m_fd, S_IRUSR | S_IRGRP) == 0 ? true : false;
-
-        // Synchronize file to disk
-        success &= ::fsync(m_fd) == 0 ? true : false;
+        // Write remaining data, synchronize file to disk and close it
+        success = m_writer.close();
 
-        // Close file
-        success &= ::close(m_fd) == 0 ? true : false;
-        m_fd = -1;
+        // Change file permission to read only
+        success &= ::chmod(m_outputFileName.c_str(), S_IRUSR | S_IRGRP) == 0
+                           ? true
+                           : false;
     }
 
     return success;
 }
 
 bool FileTraceSerializer::serialize(const void *blob, uint32_t size) {
-    auto buffer = getBuffer(size);
-
-    int64_t destSize = m_size - (m_dataOffset - m_fileOffset);
-    if (destSize < 0) {
-        Exception("File trace serializer buffer error");
-    }
+    auto buffer = getWriteBuffer(size);
 
-    memcpy_s(buffer, destSize, blob, size);
+    memcpy_s(buffer, size, blob, size);
 
-    moveDataPointer(size);
+    commitWrite(size);
 
     return true;
 }
@@ -96,7 +90,7 @@ bool FileTraceSerializer::serialize(const google::protobuf::Message &message) {
 
     auto messageLength = message.ByteSizeLong();
 
-    uint8_t *buffer = getBuffer(protoconverter::MAX_VARINT32_BYTES);
+    uint8_t *buffer = getWriteBuffer(protoconverter::MAX_VARINT32_BYTES);
     if (!buffer) {
         return false;
     }
@@ -104,18 +98,18 @@ bool FileTraceSerializer::serialize(const google::protobuf::Message &message) {
     int bytesWritten = protoconverter::encodeVarint32(
             buffer, protoconverter::MAX_VARINT32_BYTES, messageLength);
     if (bytesWritten > 0) {
-        moveDataPointer(bytesWritten);
+        commitWrite(bytesWritten);
     } else {
         return false;
     }
 
-    buffer = getBuffer(messageLength);
+    buffer = getWriteBuffer(messageLength);
     if (!buffer) {
         return false;
     }
 
     if (message.SerializeToArray(buffer, messageLength)) {
-        moveDataPointer(messageLength);
+        commitWrite(messageLength);
         return true;
     }
 
@@ -123,67 +117,81 @@ bool FileTraceSerializer::serialize(const google::protobuf::Message &message) {
 }
 
 uint8_t *FileTraceSerializer::getBuffer(size_t size) {
-    uint64_t offset = m_dataOffset;
-    if (isRemapNeeded(offset, size)) {
-        // Remap at least 1 MiB, to minimize kernel calls
-        size = std::max(MiBToBytes(1), size);
-        remap(offset, size);
-    }
-
-    offset -= m_fileOffset;
-
-    return static_cast<uint8_t *>(m_addr) + offset;
+    return m_writer.getBuffer(size);
 }
 
-bool FileTraceSerializer::isRemapNeeded(uint64_t offset, uint32_t size) {
-    uint64_t mappedBegin = m_fileOffset;
-    uint64_t mappedEnd = m_fileOffset + m_size - 1;
+uint8_t *FileTraceSerializer::getWriteBuffer(size_t size) {
+    if (!m_compression) {
+        return getBuffer(size);
+    }
 
-    uint64_t begin = offset;
-    uint64_t end = offset + size - 1;
+    if (m_blockUsed + size > m_block.size()) {
+        flushBlock();
 
-    if (!m_addr) {
-        return true;
+        // Data is never split, block grows if it doesn't fit
+        m_block.resize(std::max(COMPRESSION_BLOCK_SIZE, size));
     }
 
-    if (begin < mappedBegin || begin > mappedEnd) {
-        return true;
-    }
+    return m_block.data() + m_blockUsed;
+}
 
-    if (end < mappedBegin || end > mappedEnd) {
-        return true;
+void FileTraceSerializer::commitWrite(size_t size) {
+    if (!m_compression) {
+        moveDataPointer(size);
+        return;
     }
 
-    return false;
+    m_blockUsed += size;
+    if (m_blockUsed >= COMPRESSION_BLOCK_SIZE) {
+        flushBlock();
+    }
 }
 
-void FileTraceSerializer::remap(uint64_t offset, uint32_t size) {
-    int proto = 0;
-    uint64_t pageOffset = offset / m_pageSize;
-    uint64_t pages =
-            (size + m_pageSize - 1 + (offset % m_pageSize)) / m_pageSize;
+void FileTraceSerializer::writeCompressionHeader() {
+    struct octf_compressed_trace_file_hdr hdr = {};
+    hdr.magic = OCTF_COMPRESSED_TRACE_MAGIC;
+    hdr.version = OCTF_COMPRESSED_TRACE_VERSION;
+    hdr.hdr_size = sizeof(hdr);
+    hdr.compression = octf_compression_deflate;
+    hdr.block_size = COMPRESSION_BLOCK_SIZE;
 
-    if (m_addr) {
-        munmap(m_addr, m_size);
-        m_addr = NULL;
-    }
+    memcpy_s(getBuffer(sizeof(hdr)), sizeof(hdr), &hdr, sizeof(hdr));
+    moveDataPointer(sizeof(hdr));
+}
 
-    m_fileOffset = pageOffset * m_pageSize;
-    m_size = pages * m_pageSize;
-    if (posix_fallocate(m_fd, m_fileOffset, m_size)) {
-        throw Exception("Cannot allocate space, file " + m_outputFileName);
+void FileTraceSerializer::flushBlock() {
+    if (!m_blockUsed) {
+        return;
     }
-    proto = PROT_READ | PROT_WRITE;
 
-    m_addr = mmap(NULL, m_size, proto, MAP_SHARED, m_fd, m_fileOffset);
-    if (MAP_FAILED == m_addr) {
-        m_addr = NULL;
-        throw Exception("Cannot map file " + m_outputFileName);
+    struct octf_compressed_trace_frame_hdr hdr = {};
+    hdr.size = m_blockUsed;
+    hdr.checksum = crc32(0, m_block.data(), m_blockUsed);
+
+    uLongf compressedSize = compressBound(m_blockUsed);
+    uint8_t *buffer = getBuffer(sizeof(hdr) + compressedSize);
+
+    // Compress directly into the write buffer, right after frame header
+    int result = compress2(buffer + sizeof(hdr), &compressedSize,
+                           m_block.data(), m_blockUsed, Z_BEST_SPEED);
+    if (Z_OK != result) {
+        throw Exception("Cannot compress trace data, file " +
+                        m_outputFileName);
     }
 
-    if (isRemapNeeded(offset, size)) {
-        throw Exception("Failed to properly map file " + m_outputFileName);
+    if (compressedSize >= m_blockUsed) {
+        // Data doesn't compress, store it as it is
+        memcpy_s(buffer + sizeof(hdr), m_blockUsed, m_block.data(),
+                 m_blockUsed);
+        compressedSize = m_blockUsed;
+        hdr.flags |= octf_compressed_trace_frame_stored;
     }
+    hdr.compressed_size = compressedSize;
+
+    memcpy_s(buffer, sizeof(hdr), &hdr, sizeof(hdr));
+    moveDataPointer(sizeof(hdr) + compressedSize);
+
+    m_blockUsed = 0;
 }
 
 }  // namespace octf
@@ -7,16 +7,30 @@
 #define SOURCE_OCTF_INTERFACE_INTERNAL_FILETRACESERIALIZER_H
 
 #include <string>
+#include <vector>
 #include <octf/interface/ITraceSerializer.h>
+#include <octf/utils/AsyncFileWriter.h>
 
 namespace octf {
 
 /**
- * @brief Class for management of a trace file, including mapping parts of it
+ * @brief Class for management of a trace file
+ *
+ * The file is written in background, so that serializing traces doesn't wait
+ * for the file system (see AsyncFileWriter).
+ *
+ * If compression is enabled, serialized data is collected in blocks, and each
+ * block is compressed into a frame of the file (see
+ * octf/trace/compressed_trace_file.h).
  */
 class FileTraceSerializer : public ITraceSerializer {
 public:
-    FileTraceSerializer(const std::string &outputFileName);
+    /**
+     * @param outputFileName Path to trace file
+     * @param compression Compress trace file
+     */
+    FileTraceSerializer(const std::string &outputFileName,
+                        bool compression = false);
     ~FileTraceSerializer();
 
     bool open() override;
@@ -24,7 +38,7 @@ public:
     bool close() override;
 
     int64_t getDataSize() override {
-        return m_dataOffset;
+        return m_writer.getSize();
     }
 
     bool serialize(const void *blob, uint32_t size) override;
@@ -35,11 +49,8 @@ public:
     bool serialize(const google::protobuf::Message &message) override;
 
 private:
-    bool isRemapNeeded(uint64_t offset, uint32_t size);
-    void remap(uint64_t offset, uint32_t size);
     /**
-     * @brief Returns a buffer of given size from the mapped
-     * file
+     * @brief Returns a buffer of given size to be written to the file
      */
     uint8_t *getBuffer(size_t size);
     /**
@@ -47,32 +58,42 @@ private:
      * given amount
      */
     void moveDataPointer(uint64_t size);
-
     /**
-     * @brief Output file descriptor
+     * @brief Returns a buffer into which data of given size is serialized,
+     * to be written to the file or within the block to be compressed
+     */
+    uint8_t *getWriteBuffer(size_t size);
+    /**
+     * @brief Marks data of given size as serialized into buffer returned by
+     * getWriteBuffer
      */
-    int m_fd;
+    void commitWrite(size_t size);
     /**
-     * @brief Address of the currently mapped part of the output file
+     * @brief Writes header of compressed trace file
      */
-    void *m_addr;
+    void writeCompressionHeader();
     /**
-     * @brief Current offset (within the file) of the data write pointer
+     * @brief Compresses collected block and writes it to the file as a frame
      */
-    int64_t m_dataOffset;
+    void flushBlock();
+
+    const std::string m_outputFileName;
     /**
-     * @brief Current offset (within the file) of the mapped address
+     * @brief Output file writer
      */
-    int64_t m_fileOffset;
+    AsyncFileWriter m_writer;
     /**
-     * @brief Total file size
+     * @brief Set if trace file is compressed
      */
-    int64_t m_size;
-    const std::string m_outputFileName;
+    const bool m_compression;
+    /**
+     * @brief Block of data to be compressed
+     */
+    std::vector<uint8_t> m_block;
     /**
-     * Page size as reported by the system (for mmap purposes)
+     * @brief Size of data collected in the block
      */
-    const uint64_t m_pageSize;
+    size_t m_blockUsed;
 };
 }  // namespace octf
 
@@ -0,0 +1,371 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <octf/interface/internal/ParsedIoBuilder.h>
+
+#include <octf/proto/trace.pb.h>
+#include <octf/trace/internal/TraceExtensionLocal.h>
+#include <octf/trace/iotrace_event.h>
+#include <octf/trace/parser/ParsedIoTraceEventHandlerStatistics.h>
+#include <octf/utils/Exception.h>
+#include <octf/utils/Log.h>
+
+namespace octf {
+
+/**
+ * Version of traces parsed IO is built from
+ */
+static constexpr int32_t PARSED_IO_TRACE_VERSION = 2;
+
+/**
+ * Time after which trace is merged without waiting for traces of other
+ * queues. Trace jobs drain their buffers at least every 100 ms, so by then
+ * any trace preceding it is normally handed over. Traces handed over later,
+ * e.g. by a stalled job, are detected when merged.
+ */
+static constexpr std::chrono::milliseconds MERGE_DELAY(200);
+
+/**
+ * Period of merging traces when no trace is handed over
+ */
+static constexpr std::chrono::milliseconds BUILD_PERIOD(50);
+
+/**
+ * Max size of traces pending, if exceeded the builder gives up
+ */
+static constexpr uint64_t MAX_PENDING_SIZE = 256 * 1024 * 1024;
+
+ParsedIoBuilder::ParsedIoBuilder(
+        ITraceExecutor *executor,
+        const std::string &tracePath,
+        uint32_t queueCount,
+        bool sidPerQueue,
+        const std::map<std::string, std::string> &tags,
+        bool extensions,
+        bool statistics)
+        : NonCopyable()
+        , IParsedIoHandler()
+        , m_sidPerQueue(sidPerQueue)
+        , m_queues(queueCount)
+        , m_lastKey(0, 0)
+        , m_converter(executor->createTraceConverter())
+        , m_fsTree()
+        , m_generator()
+        , m_parsedIoExt()
+        , m_fsTreeExt()
+        , m_statistics()
+        , m_statisticsMutex()
+        , m_pendingSize(0)
+        , m_failed(false)
+        , m_mutex()
+        , m_cv()
+        , m_thread() {
+    if (!m_converter ||
+        m_converter->getTraceVersion() != PARSED_IO_TRACE_VERSION) {
+        throw Exception("Parsed IO can't be built from traces of this source");
+    }
+
+    for (auto &queue : m_queues) {
+        queue.closed = false;
+        queue.next = 0;
+        queue.offset = 0;
+        queue.finished = false;
+    }
+
+    google::protobuf::Map<std::string, std::string> ioTags;
+    for (const auto &tag : tags) {
+        ioTags[tag.first] = tag.second;
+    }
+    m_generator.reset(
+            new trace::v2::ParsedIoGenerator(*this, m_fsTree, ioTags));
+
+    if (extensions) {
+        m_parsedIoExt = std::make_shared<TraceExtensionLocal>(tracePath,
+                                                              ".ParsedIO");
+        m_fsTreeExt = std::make_shared<TraceExtensionLocal>(
+                tracePath, ".FilesystemTree");
+        if (!m_parsedIoExt->isWritable() || !m_fsTreeExt->isWritable()) {
+            throw Exception("Cannot create parsed IO trace extensions");
+        }
+    }
+
+    if (statistics) {
+        m_statistics.reset(new IoStatisticsSet(
+                ParsedIoTraceEventHandlerStatistics::
+                        DEFAULT_LBA_HIT_MAP_RANGE_SIZE));
+    }
+
+    m_thread = std::thread(&ParsedIoBuilder::build, this);
+}
+
+ParsedIoBuilder::~ParsedIoBuilder() {
+    if (m_thread.joinable()) {
+        fail("Tracing aborted");
+        for (uint32_t i = 0; i < m_queues.size(); i++) {
+            closeQueue(i);
+        }
+        m_thread.join();
+    }
+}
+
+void ParsedIoBuilder::addTraces(uint32_t queue,
+                                std::vector<uint8_t> &data,
+                                std::vector<uint32_t> &sizes) {
+    if (m_failed || queue >= m_queues.size() || sizes.empty()) {
+        data.clear();
+        sizes.clear();
+        return;
+    }
+
+    if (m_pendingSize + data.size() > MAX_PENDING_SIZE) {
+        fail("Parsed IO building can't keep up with tracing");
+        data.clear();
+        sizes.clear();
+        return;
+    }
+    m_pendingSize += data.size();
+
+    Chunk chunk;
+    chunk.data.swap(data);
+    chunk.sizes.swap(sizes);
+    chunk.received = std::chrono::steady_clock::now();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queues[queue].incoming.push_back(std::move(chunk));
+    }
+    m_cv.notify_all();
+}
+
+void ParsedIoBuilder::closeQueue(uint32_t queue) {
+    if (queue >= m_queues.size()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queues[queue].closed = true;
+    }
+    m_cv.notify_all();
+}
+
+bool ParsedIoBuilder::isFailed() const {
+    return m_failed;
+}
+
+bool ParsedIoBuilder::isGatheringStatistics() const {
+    return m_statistics != nullptr;
+}
+
+void ParsedIoBuilder::getStatistics(IoStatisticsSet &statistics) const {
+    if (!m_statistics) {
+        throw Exception("IO statistics are not gathered");
+    }
+
+    std::lock_guard<std::mutex> lock(m_statisticsMutex);
+    statistics = *m_statistics;
+}
+
+bool ParsedIoBuilder::finish() {
+    for (uint32_t i = 0; i < m_queues.size(); i++) {
+        closeQueue(i);
+    }
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+
+    if (!m_failed && m_parsedIoExt) {
+        try {
+            m_fsTreeExt->getWriter().commit();
+            m_parsedIoExt->getWriter().commit();
+        } catch (Exception &e) {
+            fail(e.getMessage());
+        }
+    }
+
+    if (m_failed) {
+        // Trace extensions which are not ready get removed
+        m_parsedIoExt.reset();
+        m_fsTreeExt.reset();
+        return false;
+    }
+
+    return true;
+}
+
+void ParsedIoBuilder::handleIO(const proto::trace::ParsedEvent &io) {
+    if (m_parsedIoExt) {
+        m_parsedIoExt->getWriter().write(io.header().sid(), io);
+    }
+
+    if (m_statistics) {
+        std::lock_guard<std::mutex> lock(m_statisticsMutex);
+        m_statistics->count(io);
+    }
+}
+
+void ParsedIoBuilder::handleDeviceDescription(
+        const proto::trace::EventDeviceDescription &devDesc) {
+    if (m_statistics) {
+        std::lock_guard<std::mutex> lock(m_statisticsMutex);
+        m_statistics->addDevice(devDesc);
+    }
+}
+
+void ParsedIoBuilder::build() {
+    try {
+        bool finished = false;
+
+        while (!finished && !m_failed) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait_for(lock, BUILD_PERIOD);
+                finished = takeChunks();
+            }
+
+            mergeTraces(finished);
+
+            // The generator hands IOs over on their completion, limit IOs
+            // queued also when completions are missing, so that statistics
+            // keep on updating
+            if (!m_failed) {
+                m_generator->flushEvents(false);
+            }
+        }
+
+        if (!m_failed) {
+            m_generator->flushEvents(true);
+        }
+    } catch (Exception &e) {
+        fail(e.getMessage());
+    } catch (std::exception &e) {
+        fail(e.what());
+    }
+
+    if (m_failed) {
+        // Release traces, jobs don't hand over more of them
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto &queue : m_queues) {
+            queue.incoming.clear();
+            queue.chunks.clear();
+        }
+    }
+}
+
+bool ParsedIoBuilder::takeChunks() {
+    bool finished = true;
+
+    for (auto &queue : m_queues) {
+        while (!queue.incoming.empty()) {
+            queue.chunks.push_back(std::move(queue.incoming.front()));
+            queue.incoming.pop_front();
+        }
+
+        queue.finished = queue.closed;
+        finished &= queue.finished;
+    }
+
+    return finished;
+}
+
+void ParsedIoBuilder::mergeTraces(bool all) {
+    auto now = std::chrono::steady_clock::now();
+
+    for (;;) {
+        Queue *next = nullptr;
+        std::pair<uint64_t, uint64_t> nextKey;
+        bool othersPending = true;
+
+        for (auto &queue : m_queues) {
+            if (queue.chunks.empty()) {
+                // Traces of open queue may precede the pending ones
+                othersPending &= queue.finished;
+                continue;
+            }
+
+            auto key = getNextKey(queue);
+            if (!next || key < nextKey) {
+                next = &queue;
+                nextKey = key;
+            }
+        }
+
+        if (!next) {
+            break;
+        }
+
+        auto &chunk = next->chunks.front();
+        if (!all && !othersPending && now - chunk.received < MERGE_DELAY) {
+            break;
+        }
+
+        // Trace preceding ones merged already came too late, parsed IO
+        // would be built from traces out of order
+        if (nextKey < m_lastKey) {
+            fail("Traces handed over out of order");
+            break;
+        }
+        m_lastKey = nextKey;
+
+        uint32_t size = chunk.sizes[next->next];
+        addTrace(chunk.data.data() + next->offset, size);
+        next->offset += size;
+        next->next++;
+
+        if (next->next == chunk.sizes.size()) {
+            m_pendingSize -= chunk.data.size();
+            next->chunks.pop_front();
+            next->next = 0;
+            next->offset = 0;
+        }
+    }
+}
+
+std::pair<uint64_t, uint64_t> ParsedIoBuilder::getNextKey(
+        const Queue &queue) const {
+    const auto &chunk = queue.chunks.front();
+    if (chunk.sizes[queue.next] < sizeof(struct iotrace_event_hdr)) {
+        return std::make_pair(0, 0);
+    }
+
+    const auto *hdr = reinterpret_cast<const struct iotrace_event_hdr *>(
+            chunk.data.data() + queue.offset);
+
+    // Queues assigned sequence IDs independently, restore the order of
+    // traces using their timestamps, as trace parser does
+    if (m_sidPerQueue) {
+        return std::make_pair(hdr->timestamp, hdr->sid);
+    }
+
+    return std::make_pair(hdr->sid, 0);
+}
+
+void ParsedIoBuilder::addTrace(const void *trace, uint32_t size) {
+    auto message = m_converter->convertTrace(trace, size);
+    if (!message ||
+        message->GetDescriptor() != proto::trace::Event::descriptor()) {
+        throw Exception("Couldn't convert trace event into parsed IO");
+    }
+    const auto &event = static_cast<const proto::trace::Event &>(*message);
+
+    if (event.has_filesystemfilename()) {
+        // Keep file names, trace parser builds filesystem tree from them
+        if (m_fsTree.addFile(event.filesystemfilename()) && m_fsTreeExt) {
+            m_fsTreeExt->getWriter().write(0, event);
+        }
+    }
+
+    m_generator->addEvent(event);
+}
+
+void ParsedIoBuilder::fail(const std::string &reason) {
+    if (!m_failed.exchange(true)) {
+        log::cerr << reason << ", parsed IO is not built while tracing"
+                  << std::endl;
+    }
+    m_cv.notify_all();
+}
+
+}  // namespace octf
@@ -0,0 +1,244 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SOURCE_OCTF_INTERFACE_INTERNAL_PARSEDIOBUILDER_H
+#define SOURCE_OCTF_INTERFACE_INTERNAL_PARSEDIOBUILDER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <octf/analytics/statistics/IoStatisticsSet.h>
+#include <octf/interface/ITraceConverter.h>
+#include <octf/interface/ITraceExecutor.h>
+#include <octf/trace/ITraceExtension.h>
+#include <octf/trace/parser/v2/FileSystemTree.h>
+#include <octf/trace/parser/v2/ParsedIoGenerator.h>
+#include <octf/utils/NonCopyable.h>
+
+namespace octf {
+
+/**
+ * @brief Builder of parsed IO of trace being captured
+ *
+ * Trace jobs hand over copies of traces they serialize. The builder merges
+ * traces of all queues, converts them and creates parsed IO. The parsed IO
+ * is stored in trace extensions, the same ones which are created when the
+ * trace is parsed for the first time, so it's ready as soon as tracing
+ * stops. IO statistics are gathered from the parsed IO, so they are
+ * available while tracing.
+ *
+ * Queues are merged while tracing, a trace is taken once each of other
+ * queues has a trace pending, or after a while, when any trace preceding it
+ * should have been handed over already.
+ *
+ * If the builder can't keep up with tracing, or a trace preceding merged
+ * ones is handed over late, it gives up, and the parsed IO is created when
+ * the trace is parsed.
+ */
+class ParsedIoBuilder : public NonCopyable,
+                        public trace::v2::IParsedIoHandler {
+public:
+    /**
+     * @param executor Executor creating trace converter
+     * @param tracePath Trace path (relative to trace directory)
+     * @param queueCount Number of trace queues
+     * @param sidPerQueue Set if queues assign sequence ids independently
+     * @param tags Tags to be attached to each parsed IO
+     * @param extensions Store parsed IO in trace extensions
+     * @param statistics Gather IO statistics
+     */
+    ParsedIoBuilder(ITraceExecutor *executor,
+                    const std::string &tracePath,
+                    uint32_t queueCount,
+                    bool sidPerQueue,
+                    const std::map<std::string, std::string> &tags,
+                    bool extensions,
+                    bool statistics);
+    virtual ~ParsedIoBuilder();
+
+    /**
+     * @brief Hands over traces of given queue, in their sid order
+     *
+     * @param queue Queue id
+     * @param data Traces, one after another, moved out to the builder
+     * @param sizes Sizes of traces, moved out to the builder
+     */
+    void addTraces(uint32_t queue,
+                   std::vector<uint8_t> &data,
+                   std::vector<uint32_t> &sizes);
+
+    /**
+     * @brief Marks that no more traces of given queue follow
+     */
+    void closeQueue(uint32_t queue);
+
+    /**
+     * @brief Checks if the builder has given up building parsed IO
+     */
+    bool isFailed() const;
+
+    /**
+     * @brief Checks if IO statistics are gathered
+     */
+    bool isGatheringStatistics() const;
+
+    /**
+     * @brief Copies IO statistics gathered so far
+     *
+     * @param[out] statistics IO statistics
+     */
+    void getStatistics(IoStatisticsSet &statistics) const;
+
+    /**
+     * @brief Waits for traces of closed queues to be processed and commits
+     * trace extensions with parsed IO
+     *
+     * @retval true Parsed IO built
+     * @retval false Parsed IO not built, it's going to be created when the
+     * trace is parsed
+     */
+    bool finish();
+
+    void handleIO(const proto::trace::ParsedEvent &io) override;
+
+    void handleDeviceDescription(
+            const proto::trace::EventDeviceDescription &devDesc) override;
+
+private:
+    /**
+     * @brief Traces handed over at once by one of queues
+     */
+    struct Chunk {
+        std::vector<uint8_t> data;
+        std::vector<uint32_t> sizes;
+        std::chrono::time_point<std::chrono::steady_clock> received;
+    };
+
+    /**
+     * @brief Traces of one queue
+     */
+    struct Queue {
+        /**
+         * @brief Chunks handed over by trace job, guarded by m_mutex
+         */
+        std::deque<Chunk> incoming;
+
+        /**
+         * @brief Set when queue is closed, guarded by m_mutex
+         */
+        bool closed;
+
+        /**
+         * @brief Chunks being merged, used by builder thread only
+         */
+        std::deque<Chunk> chunks;
+
+        /**
+         * @brief Index of the next trace of the first chunk
+         */
+        uint32_t next;
+
+        /**
+         * @brief Offset of the next trace in the first chunk data
+         */
+        uint64_t offset;
+
+        /**
+         * @brief Set once queue is closed and all its chunks are taken by
+         * builder thread
+         */
+        bool finished;
+    };
+
+    /**
+     * @brief Builder thread routine
+     */
+    void build();
+
+    /**
+     * @brief Takes chunks handed over by trace jobs, called under m_mutex
+     *
+     * @retval true All queues finished
+     */
+    bool takeChunks();
+
+    /**
+     * @brief Merges traces of queues, and puts them into parsed IO generator
+     *
+     * @param all Process all traces, otherwise traces which may be preceded
+     * by traces not handed over yet are left pending
+     */
+    void mergeTraces(bool all);
+
+    /**
+     * @brief Returns merge key of the next trace of given queue
+     */
+    std::pair<uint64_t, uint64_t> getNextKey(const Queue &queue) const;
+
+    /**
+     * @brief Converts trace and puts it into parsed IO generator
+     */
+    void addTrace(const void *trace, uint32_t size);
+
+    /**
+     * @brief Gives up building parsed IO
+     */
+    void fail(const std::string &reason);
+
+    const bool m_sidPerQueue;
+    std::vector<Queue> m_queues;
+
+    /**
+     * @brief Merge key of the last trace merged, used by builder thread only
+     */
+    std::pair<uint64_t, uint64_t> m_lastKey;
+
+    std::unique_ptr<ITraceConverter> m_converter;
+    trace::v2::FileSystemTree m_fsTree;
+    std::unique_ptr<trace::v2::ParsedIoGenerator> m_generator;
+    TraceExtensionShRef m_parsedIoExt;
+    TraceExtensionShRef m_fsTreeExt;
+
+    /**
+     * @brief IO statistics, nullptr if they are not gathered
+     */
+    std::unique_ptr<IoStatisticsSet> m_statistics;
+
+    /**
+     * @brief Mutex for m_statistics
+     */
+    mutable std::mutex m_statisticsMutex;
+
+    /**
+     * @brief Total size of traces handed over, but not processed yet
+     */
+    std::atomic<uint64_t> m_pendingSize;
+
+    /**
+     * @brief Set if building of parsed IO failed
+     */
+    std::atomic<bool> m_failed;
+
+    std::mutex m_mutex;
+
+    /**
+     * @brief Notified when traces are handed over or queue is closed
+     */
+    std::condition_variable m_cv;
+
+    std::thread m_thread;
+};
+
+}  // namespace octf
+
+#endif  // SOURCE_OCTF_INTERFACE_INTERNAL_PARSEDIOBUILDER_H
@@ -0,0 +1,82 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <octf/interface/internal/RawFileTraceSerializer.h>
+
+#include <octf/trace/iotrace_event.h>
+#include <octf/trace/raw_trace_file.h>
+
+namespace octf {
+
+RawFileTraceSerializer::RawFileTraceSerializer(
+        const std::string &outputFileName,
+        bool compression)
+        : m_file(outputFileName, compression)
+        , m_headerWritten(false) {}
+
+bool RawFileTraceSerializer::open() {
+    if (!m_file.open()) {
+        return false;
+    }
+
+    if (m_headerWritten) {
+        return true;
+    }
+
+    struct octf_raw_trace_file_hdr hdr = {};
+    hdr.magic = OCTF_RAW_TRACE_MAGIC;
+    hdr.version = OCTF_RAW_TRACE_VERSION;
+    hdr.hdr_size = sizeof(hdr);
+    hdr.event_version_major = IOTRACE_EVENT_VERSION_MAJOR;
+    hdr.event_version_minor = IOTRACE_EVENT_VERSION_MINOR;
+    hdr.record_alignment = OCTF_RAW_TRACE_RECORD_ALIGNMENT;
+
+    m_headerWritten = m_file.serialize(&hdr, sizeof(hdr));
+    return m_headerWritten;
+}
+
+bool RawFileTraceSerializer::close() {
+    return m_file.close();
+}
+
+int64_t RawFileTraceSerializer::getDataSize() {
+    return m_file.getDataSize();
+}
+
+bool RawFileTraceSerializer::serialize(const void *blob, uint32_t size) {
+    static const char padding[OCTF_RAW_TRACE_RECORD_ALIGNMENT] = {};
+
+    struct octf_raw_trace_record_hdr hdr = {};
+    hdr.size = size;
+
+    uint32_t paddingSize = (OCTF_RAW_TRACE_RECORD_ALIGNMENT -
+                            size % OCTF_RAW_TRACE_RECORD_ALIGNMENT) %
+                           OCTF_RAW_TRACE_RECORD_ALIGNMENT;
+
+    if (!m_file.serialize(&hdr, sizeof(hdr)) ||
+        !m_file.serialize(blob, size)) {
+        return false;
+    }
+
+    if (paddingSize) {
+        return m_file.serialize(padding, paddingSize);
+    }
+
+    return true;
+}
+
+bool RawFileTraceSerializer::serialize(
+        const std::shared_ptr<const google::protobuf::Message> &message) {
+    (void) message;
+    return false;
+}
+
+bool RawFileTraceSerializer::serialize(
+        const google::protobuf::Message &message) {
+    (void) message;
+    return false;
+}
+
+}  // namespace octf
@@ -0,0 +1,65 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SOURCE_OCTF_INTERFACE_INTERNAL_RAWFILETRACESERIALIZER_H
+#define SOURCE_OCTF_INTERFACE_INTERNAL_RAWFILETRACESERIALIZER_H
+
+#include <string>
+#include <octf/interface/ITraceSerializer.h>
+#include <octf/interface/internal/FileTraceSerializer.h>
+
+namespace octf {
+
+/**
+ * @brief Serializer writing traces to file in their native format
+ *
+ * Traces are stored as they were pushed to the ring (circular buffer),
+ * without conversion to Google Protocol Buffers. The file layout is described
+ * in octf/trace/raw_trace_file.h.
+ */
+class RawFileTraceSerializer : public ITraceSerializer {
+public:
+    /**
+     * @param outputFileName Path to trace file
+     * @param compression Compress trace file
+     */
+    RawFileTraceSerializer(const std::string &outputFileName,
+                           bool compression = false);
+    virtual ~RawFileTraceSerializer() = default;
+
+    bool open() override;
+
+    bool close() override;
+
+    int64_t getDataSize() override;
+
+    bool serialize(const void *blob, uint32_t size) override;
+
+    /**
+     * @note Not supported, raw trace file keeps native traces only
+     */
+    bool serialize(const std::shared_ptr<const google::protobuf::Message>
+                           &message) override;
+
+    /**
+     * @note Not supported, raw trace file keeps native traces only
+     */
+    bool serialize(const google::protobuf::Message &message) override;
+
+private:
+    /**
+     * @brief Output file
+     */
+    FileTraceSerializer m_file;
+
+    /**
+     * @brief Set once header of raw trace file is written
+     */
+    bool m_headerWritten;
+};
+
+}  // namespace octf
+
+#endif  // SOURCE_OCTF_INTERFACE_INTERNAL_RAWFILETRACESERIALIZER_H
@@ -0,0 +1,148 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <octf/interface/internal/TraceConversionPool.h>
+
+#include <exception>
+#include <octf/utils/Exception.h>
+#include <octf/utils/ProtoConverter.h>
+
+namespace octf {
+
+/**
+ * Estimated size of encoded trace, used for reserving buffer of chunk
+ */
+static constexpr uint32_t ENCODED_TRACE_SIZE_ESTIMATE = 64;
+
+TraceConversionPool::TraceConversionPool(ITraceExecutor *executor,
+                                         uint32_t threadCount)
+        : NonCopyable()
+        , m_converters()
+        , m_threads()
+        , m_tasks()
+        , m_mutex()
+        , m_taskAdded()
+        , m_taskDone()
+        , m_stop(false) {
+    for (uint32_t i = 0; i < threadCount; i++) {
+        m_converters.push_back(executor->createTraceConverter());
+        if (!m_converters.back()) {
+            throw Exception("Cannot create trace converter");
+        }
+    }
+
+    for (uint32_t i = 0; i < threadCount; i++) {
+        m_threads.emplace_back(&TraceConversionPool::run, this, i);
+    }
+}
+
+TraceConversionPool::~TraceConversionPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_taskAdded.notify_all();
+
+    for (auto &thread : m_threads) {
+        thread.join();
+    }
+}
+
+uint32_t TraceConversionPool::getThreadCount() const {
+    return m_threads.size();
+}
+
+void TraceConversionPool::convert(std::vector<TraceConversionChunk> &chunks,
+                                  ITraceConverter &converter) {
+    uint32_t remaining = chunks.size();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (auto &chunk : chunks) {
+        m_tasks.push_back(Task{&chunk, &remaining});
+    }
+    m_taskAdded.notify_all();
+
+    // Convert chunks instead of waiting idle, until all of ours are done
+    while (remaining) {
+        if (m_tasks.empty()) {
+            m_taskDone.wait(lock);
+            continue;
+        }
+
+        Task task = m_tasks.front();
+        m_tasks.pop_front();
+        runTask(task, converter, lock);
+    }
+}
+
+void TraceConversionPool::run(uint32_t index) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;) {
+        m_taskAdded.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+        if (m_tasks.empty()) {
+            break;
+        }
+
+        Task task = m_tasks.front();
+        m_tasks.pop_front();
+        runTask(task, *m_converters[index], lock);
+    }
+}
+
+void TraceConversionPool::runTask(const Task &task,
+                                  ITraceConverter &converter,
+                                  std::unique_lock<std::mutex> &lock) {
+    lock.unlock();
+    convertChunk(converter, *task.chunk);
+    lock.lock();
+
+    (*task.remaining)--;
+    if (!*task.remaining) {
+        m_taskDone.notify_all();
+    }
+}
+
+void TraceConversionPool::convertChunk(ITraceConverter &converter,
+                                       TraceConversionChunk &chunk) {
+    using namespace protoconverter;
+
+    chunk.data.clear();
+    chunk.data.reserve(chunk.count * ENCODED_TRACE_SIZE_ESTIMATE);
+    chunk.encodedSizes.clear();
+    chunk.failed = false;
+
+    try {
+        for (uint32_t i = 0; i < chunk.count; i++) {
+            auto message = converter.convertTrace(chunk.traces[i],
+                                                  chunk.sizes[i]);
+            if (!message) {
+                chunk.failed = true;
+                return;
+            }
+
+            size_t length = message->ByteSizeLong();
+            size_t offset = chunk.data.size();
+            chunk.data.resize(offset + MAX_VARINT32_BYTES + length);
+
+            uint8_t *buffer = chunk.data.data() + offset;
+            int prefixLength =
+                    encodeVarint32(buffer, MAX_VARINT32_BYTES, length);
+            if (prefixLength <= 0) {
+                chunk.failed = true;
+                return;
+            }
+
+            message->SerializeWithCachedSizesToArray(buffer + prefixLength);
+            chunk.data.resize(offset + prefixLength + length);
+            chunk.encodedSizes.push_back(prefixLength + length);
+        }
+    } catch (std::exception &) {
+        // Runs in pool thread, failure is reported by job
+        chunk.failed = true;
+    }
+}
+
+}  // namespace octf
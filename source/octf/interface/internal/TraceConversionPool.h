@@ -0,0 +1,158 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SOURCE_OCTF_INTERFACE_INTERNAL_TRACECONVERSIONPOOL_H
+#define SOURCE_OCTF_INTERFACE_INTERNAL_TRACECONVERSIONPOOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <octf/interface/ITraceConverter.h>
+#include <octf/interface/ITraceExecutor.h>
+#include <octf/utils/NonCopyable.h>
+
+namespace octf {
+
+/**
+ * @brief Traces converted to Google Protocol Buffers and encoded together
+ */
+struct TraceConversionChunk {
+    /**
+     * @brief Traces to be converted
+     */
+    const void *const *traces;
+
+    /**
+     * @brief Sizes of traces to be converted
+     */
+    const uint32_t *sizes;
+
+    /**
+     * @brief Number of traces to be converted
+     */
+    uint32_t count;
+
+    /**
+     * @brief Encoded traces, each of them prefixed with its size (varint
+     * encoded), as serialized to trace file
+     */
+    std::vector<uint8_t> data;
+
+    /**
+     * @brief Size of each encoded trace (including its size prefix)
+     */
+    std::vector<uint32_t> encodedSizes;
+
+    /**
+     * @brief Set if any of traces can't be converted
+     */
+    bool failed;
+};
+
+/**
+ * @brief Pool of threads converting traces to Google Protocol Buffers
+ *
+ * Pool is shared by trace jobs, so that a queue producing most of traces
+ * can use more than one CPU for their conversion. Each thread has its own
+ * converter, converters are not thread safe.
+ */
+class TraceConversionPool : public NonCopyable {
+public:
+    /**
+     * @param executor Executor creating trace converters
+     * @param threadCount Number of threads of the pool
+     */
+    TraceConversionPool(ITraceExecutor *executor, uint32_t threadCount);
+    virtual ~TraceConversionPool();
+
+    /**
+     * @brief Returns number of threads of the pool
+     */
+    uint32_t getThreadCount() const;
+
+    /**
+     * @brief Converts chunks of traces using threads of the pool
+     *
+     * Calling thread takes part in conversion with its own converter, and
+     * returns once all of given chunks are converted.
+     *
+     * @param chunks Chunks to be converted
+     * @param converter Converter of calling thread
+     */
+    void convert(std::vector<TraceConversionChunk> &chunks,
+                 ITraceConverter &converter);
+
+    /**
+     * @brief Converts and encodes traces of chunk
+     *
+     * @param converter Converter to be used
+     * @param chunk Chunk to be converted
+     */
+    static void convertChunk(ITraceConverter &converter,
+                             TraceConversionChunk &chunk);
+
+private:
+    /**
+     * @brief Chunk to be converted, along with counter of chunks not
+     * converted yet of its caller
+     */
+    struct Task {
+        TraceConversionChunk *chunk;
+        uint32_t *remaining;
+    };
+
+    /**
+     * @brief Routine of pool thread
+     *
+     * @param index Index of thread in pool
+     */
+    void run(uint32_t index);
+
+    /**
+     * @brief Converts chunk of task and marks it as converted
+     *
+     * @note m_mutex must be locked by lock, it's unlocked for conversion
+     */
+    void runTask(const Task &task,
+                 ITraceConverter &converter,
+                 std::unique_lock<std::mutex> &lock);
+
+    /**
+     * @brief Converters of pool threads
+     */
+    std::vector<std::unique_ptr<ITraceConverter>> m_converters;
+
+    std::vector<std::thread> m_threads;
+
+    /**
+     * @brief Chunks to be converted
+     */
+    std::deque<Task> m_tasks;
+
+    std::mutex m_mutex;
+
+    /**
+     * @brief Notified when task is added or pool stops
+     */
+    std::condition_variable m_taskAdded;
+
+    /**
+     * @brief Notified when all chunks of any caller are converted
+     */
+    std::condition_variable m_taskDone;
+
+    /**
+     * @brief Set when pool threads shall exit
+     */
+    bool m_stop;
+};
+
+}  // namespace octf
+
+#endif  // SOURCE_OCTF_INTERFACE_INTERNAL_TRACECONVERSIONPOOL_H
@@ -5,77 +5,188 @@
 
 #include <octf/interface/internal/TraceJob.h>
 
+#include <algorithm>
+#include <functional>
+#include <limits>
 #include <mutex>
 #include <string>
 
 #include <octf/interface/internal/FileTraceSerializer.h>
+#include <octf/interface/internal/RawFileTraceSerializer.h>
 #include <octf/trace/iotrace_event.h>
 #include <octf/utils/Exception.h>
+#include <octf/utils/FileOperations.h>
 #include <octf/utils/Log.h>
+#include <octf/utils/Numa.h>
 #include <octf/utils/SizeConversion.h>
 
 namespace octf {
 
+/**
+ * Maximum number of events taken from the circular buffer at once
+ */
+static constexpr uint32_t TRACE_BATCH_SIZE = 256;
+
+/**
+ * Minimum number of traces converted by one thread of conversion pool, fewer
+ * of them are not worth synchronization with the pool
+ */
+static constexpr uint32_t MIN_CONVERSION_CHUNK_SIZE = 64;
+
+static log_sid_t getTraceSid(const void *trace, uint32_t size) {
+    if (size < sizeof(struct iotrace_event_hdr)) {
+        return 0;
+    }
+
+    return static_cast<const struct iotrace_event_hdr *>(trace)->sid;
+}
+
+static uint64_t getTraceTimestamp(const void *trace, uint32_t size) {
+    if (size < sizeof(struct iotrace_event_hdr)) {
+        return 0;
+    }
+
+    return static_cast<const struct iotrace_event_hdr *>(trace)->timestamp;
+}
+
 TraceJob::TraceJob(ITraceExecutor *executor,
-                   uint32_t maxDuration,
+                   const TraceConfig &config,
                    uint32_t queueId,
                    const std::string &outputFileName,
                    uint32_t memoryPoolSize,
-                   SerializerType serializerType)
+                   TraceConversionPool *conversionPool,
+                   ParsedIoBuilder *parsedIoBuilder)
         : NonCopyable()
         , m_thread()
         , m_state(TracingState::NOT_STARTED)
-        , m_maxDuration(maxDuration)
-        , m_traceConsumerHandle(0)
+        , m_maxDuration(config.maxDuration)
+        , m_flightRecorder(config.fullPolicy ==
+                           octf_trace_full_policy_overwrite)
+        , m_snapshotMutex()
+        , m_snapshotTrigger()
+        , m_snapshotRequested(false)
+        , m_stopping(false)
+        , m_traceConsumerHandles()
+        , m_batches()
+        , m_mergeHeap()
+        , m_conversionPool(config.serializerType ==
+                                           SerializerType::FileSerializer
+                                   ? conversionPool
+                                   : nullptr)
+        , m_queuedTraces()
+        , m_queuedSizes()
+        , m_chunks()
+        , m_parsedIoBuilder(parsedIoBuilder)
+        , m_parsedIoData()
+        , m_parsedIoSizes()
         , m_traceCount(0)
         , m_processingTraces(false)
+        , m_convertTraces(config.serializerType !=
+                          SerializerType::RawFileSerializer)
+        , m_outputFileName(outputFileName)
+        , m_serializerType(config.serializerType)
+        , m_compression(config.compression)
+        , m_segmentSize(MiBToBytes(config.segmentSizeMiB))
+        , m_segmentCount(config.segmentCount)
+        , m_segment()
+        , m_segmentClosed(false)
+        , m_segmentsMutex()
+        , m_segments()
+        , m_segmentsSize(0)
+        , m_segmentsVersion(0)
+        , m_serializer()
         , m_executor(executor)
         , m_producer(executor->createProducer(queueId)) {
-    m_producer->initRing(memoryPoolSize);
-
-    int result = octf_trace_open(
-            static_cast<void *>(m_producer->getBuffer()), m_producer->getSize(),
-            m_producer->getConsumerHeader(), octf_trace_open_mode_consumer,
-            &m_traceConsumerHandle);
-
-    if (result) {
+    m_producer->initRing(memoryPoolSize, config.subRingCount);
+    try {
+        m_producer->setFullPolicy(config.fullPolicy, config.fullTimeoutUs);
+    } catch (Exception &) {
         m_producer->deinitRing();
-        throw Exception("Failed to initialize trace buffer for consumer.");
+        throw;
     }
 
     m_converter = m_executor->createTraceConverter();
+    if (!m_converter) {
+        m_conversionPool = nullptr;
+    }
 
-    switch (serializerType) {
-    case SerializerType::FileSerializer:
-        m_serializer = std::unique_ptr<FileTraceSerializer>(
-                new FileTraceSerializer(outputFileName));
-        break;
-    default:
-        octf_trace_close(&m_traceConsumerHandle);
-        m_traceConsumerHandle = nullptr;
-        m_producer->deinitRing();
-        throw Exception("Unknown trace serializer type.");
+    // Take more traces at once if they are converted in parallel, so that
+    // each thread of the pool gets a share of them
+    uint32_t batchSize = TRACE_BATCH_SIZE;
+    if (m_conversionPool) {
+        batchSize *= m_conversionPool->getThreadCount() + 1;
+    }
+
+    for (uint32_t i = 0; i < m_producer->getSubRingCount(); i++) {
+        octf_trace_t handle = nullptr;
+
+        int result = octf_trace_open(
+                static_cast<void *>(m_producer->getSubRingBuffer(i)),
+                m_producer->getSubRingSize(i),
+                m_producer->getSubRingConsumerHeader(i),
+                octf_trace_open_mode_consumer, &handle);
+
+        if (result) {
+            closeConsumers();
+            m_producer->deinitRing();
+            throw Exception("Failed to initialize trace buffer for consumer.");
+        }
+
+        m_traceConsumerHandles.push_back(handle);
+
+        TraceBatch batch = {};
+        batch.traces.resize(batchSize);
+        batch.sizes.resize(batchSize);
+        m_batches.push_back(std::move(batch));
     }
+    m_mergeHeap.reserve(m_batches.size());
 
-    if (!m_serializer->open()) {
-        octf_trace_close(&m_traceConsumerHandle);
-        m_traceConsumerHandle = nullptr;
+    try {
+        openSegment(0);
+    } catch (Exception &) {
+        closeConsumers();
         m_producer->deinitRing();
-        throw Exception("Cannot open file '" + outputFileName + "'");
+        throw;
     }
 }
 
 TraceJob::~TraceJob() {
     stopJobThread();
     joinThread();
-    if (m_traceConsumerHandle) {
-        octf_trace_close(&m_traceConsumerHandle);
-    }
+    closeConsumers();
     m_producer->deinitRing();
 }
 
+void TraceJob::closeConsumers() {
+    for (auto &handle : m_traceConsumerHandles) {
+        octf_trace_close(&handle);
+    }
+    m_traceConsumerHandles.clear();
+}
+
 int64_t TraceJob::getTraceSize() const {
-    return m_serializer->getDataSize();
+    std::lock_guard<std::mutex> lock(m_segmentsMutex);
+
+    int64_t result = m_segmentsSize;
+    if (m_serializer) {
+        result += m_serializer->getDataSize();
+    }
+
+    return result;
+}
+
+void TraceJob::getSegments(
+        google::protobuf::RepeatedPtrField<proto::TraceSegment> *segments)
+        const {
+    std::lock_guard<std::mutex> lock(m_segmentsMutex);
+
+    for (const auto &segment : m_segments) {
+        *segments->Add() = segment;
+    }
+}
+
+uint64_t TraceJob::getSegmentsVersion() const {
+    return m_segmentsVersion;
 }
 
 int64_t TraceJob::getTraceCount() const {
@@ -83,7 +194,12 @@ int64_t TraceJob::getTraceCount() const {
 }
 
 int64_t TraceJob::getDroppedTraceCount() const {
-    return octf_trace_get_lost_count(m_traceConsumerHandle);
+    int64_t result = 0;
+    for (const auto &handle : m_traceConsumerHandles) {
+        result += octf_trace_get_lost_count(handle);
+    }
+
+    return result;
 }
 
 TracingState TraceJob::getState() const {
@@ -108,12 +224,51 @@ void TraceJob::startJobThread() {
             if (result) {
                 throw Exception("Failed to set CPU affinity for job thread");
             }
+        } else {
+            setNumaAffinity();
         }
     }
 }
 
+void TraceJob::setNumaAffinity() {
+    std::vector<uint32_t> cpus;
+    int node = m_producer->getNumaNode();
+    if (!numautils::getNodeCpus(node, cpus)) {
+        return;
+    }
+
+    // Consumer reads the ring memory, keep it on the same node as the ring
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    for (auto cpu : cpus) {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &cpuset);
+        }
+    }
+
+    int result = pthread_setaffinity_np(m_thread.native_handle(),
+                                        sizeof(cpuset), &cpuset);
+    if (result) {
+        log::verbose << "Failed to run job thread on NUMA node " << node
+                     << std::endl;
+    }
+}
+
 void TraceJob::stopJobThread() {
     m_producer->stop();
+    {
+        std::lock_guard<std::mutex> lock(m_snapshotMutex);
+        m_stopping = true;
+    }
+    m_snapshotTrigger.notify_all();
+}
+
+void TraceJob::requestSnapshot() {
+    {
+        std::lock_guard<std::mutex> lock(m_snapshotMutex);
+        m_snapshotRequested = true;
+    }
+    m_snapshotTrigger.notify_all();
 }
 
 void TraceJob::waitForJobInitialization() {
@@ -134,7 +289,11 @@ void TraceJob::doWork() {
                  << m_producer->getQueueId() << std::endl;
 
     try {
-        consumeTraces();
+        if (m_flightRecorder) {
+            recordTraces();
+        } else {
+            consumeTraces();
+        }
         endState = TracingState::COMPLETE;
 
     } catch (Exception &e) {
@@ -145,11 +304,18 @@ void TraceJob::doWork() {
         log::cerr << e.what() << std::endl;
     }
 
+    if (!m_segmentClosed) {
+        closeSegment(true);
+    }
+
+    if (m_parsedIoBuilder) {
+        m_parsedIoBuilder->closeQueue(m_producer->getQueueId());
+    }
+
     {
         std::lock_guard<std::mutex> lock(m_stateMutex);
         m_state = endState;
     }
-    m_serializer->close();
     log::verbose << "Trace collecting has completed of queue "
                  << m_producer->getQueueId() << std::endl;
 }
@@ -158,9 +324,26 @@ int TraceJob::pushTrace(const void *trace, const uint32_t traceSize) {
     return m_producer->pushTrace(trace, traceSize);
 }
 
+int TraceJob::pushTraces(const void *const *traces,
+                         const uint32_t *traceSizes,
+                         uint32_t count) {
+    return m_producer->pushTraces(traces, traceSizes, count);
+}
+
+int TraceJob::reserveTrace(const uint32_t traceSize,
+                           TraceReservation &reservation) {
+    return m_producer->reserveTrace(traceSize, reservation);
+}
+
+int TraceJob::commitTrace(const TraceReservation &reservation) {
+    return m_producer->commitTrace(reservation);
+}
+
 void TraceJob::serialize(const void *data, uint32_t size) {
+    prepareSegment();
+
     bool serialized = false;
-    if (m_converter) {
+    if (m_converter && m_convertTraces) {
         auto protoBuffer = m_converter->convertTrace(data, size);
 
         if (protoBuffer) {
@@ -171,12 +354,221 @@ void TraceJob::serialize(const void *data, uint32_t size) {
     }
 
     if (serialized) {
-        m_traceCount++;
+        onTraceSerialized(data, size);
     } else {
         throw Exception("Failed to serialize trace data");
     }
 }
 
+void TraceJob::addTrace(const void *data, uint32_t size) {
+    if (m_parsedIoBuilder) {
+        auto trace = static_cast<const uint8_t *>(data);
+        m_parsedIoData.insert(m_parsedIoData.end(), trace, trace + size);
+        m_parsedIoSizes.push_back(size);
+    }
+
+    if (m_conversionPool) {
+        m_queuedTraces.push_back(data);
+        m_queuedSizes.push_back(size);
+    } else {
+        this->serialize(data, size);
+    }
+}
+
+void TraceJob::serializeConverted() {
+    uint32_t count = m_queuedTraces.size();
+    if (!count) {
+        return;
+    }
+
+    // Split traces into chunks, one per thread (including job thread)
+    uint32_t chunkCount = (count + MIN_CONVERSION_CHUNK_SIZE - 1) /
+                          MIN_CONVERSION_CHUNK_SIZE;
+    chunkCount = std::min(chunkCount, m_conversionPool->getThreadCount() + 1);
+    uint32_t chunkSize = (count + chunkCount - 1) / chunkCount;
+
+    m_chunks.resize(chunkCount);
+    for (uint32_t i = 0; i < chunkCount; i++) {
+        uint32_t begin = i * chunkSize;
+        auto &chunk = m_chunks[i];
+
+        chunk.traces = m_queuedTraces.data() + begin;
+        chunk.sizes = m_queuedSizes.data() + begin;
+        chunk.count = std::min(chunkSize, count - begin);
+    }
+
+    if (chunkCount > 1) {
+        m_conversionPool->convert(m_chunks, *m_converter);
+    } else {
+        TraceConversionPool::convertChunk(*m_converter, m_chunks.front());
+    }
+
+    // Chunks are serialized in order, so traces stay in sid order
+    for (const auto &chunk : m_chunks) {
+        if (chunk.failed) {
+            throw Exception("Failed to serialize trace data");
+        }
+
+        if (!m_segmentSize) {
+            prepareSegment();
+            if (!m_serializer->serialize(chunk.data.data(),
+                                         chunk.data.size())) {
+                throw Exception("Failed to serialize trace data");
+            }
+            m_traceCount += chunk.count;
+            continue;
+        }
+
+        // Segment may be closed after any of traces
+        const uint8_t *encoded = chunk.data.data();
+        for (uint32_t i = 0; i < chunk.count; i++) {
+            prepareSegment();
+            if (!m_serializer->serialize(encoded, chunk.encodedSizes[i])) {
+                throw Exception("Failed to serialize trace data");
+            }
+            encoded += chunk.encodedSizes[i];
+            onTraceSerialized(chunk.traces[i], chunk.sizes[i]);
+        }
+    }
+
+    m_queuedTraces.clear();
+    m_queuedSizes.clear();
+}
+
+void TraceJob::buildParsedIo() {
+    if (m_parsedIoBuilder && !m_parsedIoSizes.empty()) {
+        m_parsedIoBuilder->addTraces(m_producer->getQueueId(), m_parsedIoData,
+                                     m_parsedIoSizes);
+    }
+}
+
+void TraceJob::prepareSegment() {
+    if (m_segmentClosed) {
+        openSegment(m_segment.index() + 1);
+    }
+}
+
+void TraceJob::onTraceSerialized(const void *data, uint32_t size) {
+    m_traceCount++;
+
+    if (m_segmentSize) {
+        updateSegment(data, size);
+    }
+}
+
+std::string TraceJob::getSegmentFileName(uint32_t index) const {
+    if (!m_segmentSize) {
+        return m_outputFileName;
+    }
+
+    return m_outputFileName + "." + std::to_string(index);
+}
+
+void TraceJob::openSegment(uint32_t index) {
+    std::unique_ptr<ITraceSerializer> serializer;
+    std::string fileName = getSegmentFileName(index);
+
+    // Each segment is a complete trace file (with its own headers), so it
+    // can be decoded without the other ones
+    switch (m_serializerType) {
+    case SerializerType::FileSerializer:
+        serializer = std::unique_ptr<FileTraceSerializer>(
+                new FileTraceSerializer(fileName, m_compression));
+        break;
+    case SerializerType::RawFileSerializer:
+        serializer = std::unique_ptr<RawFileTraceSerializer>(
+                new RawFileTraceSerializer(fileName, m_compression));
+        break;
+    default:
+        throw Exception("Unknown trace serializer type.");
+    }
+
+    if (!serializer->open()) {
+        throw Exception("Cannot open file '" + fileName + "'");
+    }
+
+    m_segment.Clear();
+    m_segment.set_queue(m_producer->getQueueId());
+    m_segment.set_index(index);
+    m_segmentClosed = false;
+
+    std::lock_guard<std::mutex> lock(m_segmentsMutex);
+    m_serializer = std::move(serializer);
+}
+
+void TraceJob::updateSegment(const void *trace, uint32_t size) {
+    uint64_t sid = getTraceSid(trace, size);
+    uint64_t timestamp = getTraceTimestamp(trace, size);
+
+    if (!m_segment.eventcount()) {
+        m_segment.set_firstsid(sid);
+        m_segment.set_firsttimestamp(timestamp);
+
+        // Publish the segment, it's completed once closed
+        {
+            std::lock_guard<std::mutex> lock(m_segmentsMutex);
+            m_segments.push_back(m_segment);
+        }
+        m_segmentsVersion++;
+    }
+
+    m_segment.set_lastsid(sid);
+    m_segment.set_lasttimestamp(timestamp);
+    m_segment.set_eventcount(m_segment.eventcount() + 1);
+
+    if (m_serializer->getDataSize() >= static_cast<int64_t>(m_segmentSize)) {
+        closeSegment(false);
+    }
+}
+
+void TraceJob::closeSegment(bool last) {
+    std::string fileName = getSegmentFileName(m_segment.index());
+    if (!m_serializer->close()) {
+        log::cerr << "Cannot close trace file " << fileName << std::endl;
+    }
+    m_segmentClosed = true;
+
+    if (!m_segmentSize) {
+        return;
+    }
+
+    int64_t size = m_serializer->getDataSize();
+
+    std::vector<std::string> removedFiles;
+    {
+        std::lock_guard<std::mutex> lock(m_segmentsMutex);
+        m_serializer.reset();
+
+        if (m_segment.eventcount()) {
+            m_segment.set_size(size);
+            m_segments.back() = m_segment;
+            m_segmentsSize += size;
+        } else {
+            // No trace in segment, don't keep the file
+            removedFiles.push_back(fileName);
+        }
+
+        // Remove the oldest segments, making room for the next one unless
+        // it's the last segment
+        uint32_t nextCount = last ? 0 : 1;
+        while (m_segmentCount &&
+               m_segments.size() + nextCount > m_segmentCount) {
+            removedFiles.push_back(
+                    getSegmentFileName(m_segments.front().index()));
+            m_segmentsSize -= m_segments.front().size();
+            m_segments.pop_front();
+        }
+    }
+    m_segmentsVersion++;
+
+    for (const auto &removedFile : removedFiles) {
+        if (!fsutils::removeFile(removedFile)) {
+            log::cerr << "Cannot remove trace file segment " << removedFile
+                      << std::endl;
+        }
+    }
+}
+
 void TraceJob::consumeTraces() {
     std::mutex mutex;
     std::unique_lock<std::mutex> lock(mutex);
@@ -192,46 +584,199 @@ void TraceJob::consumeTraces() {
         }
         m_processingTraces = true;
         // If we're woken up (via timeout or outside trigger), try to empty the
-        // circular buffer
-        while (!octf_trace_is_empty(m_traceConsumerHandle)) {
-            octf_trace_event_handle_t eventHandle = {};
-            bool circBufferNotAvailable = false;
-            void *traceBuffer = NULL;
-            uint32_t traceSize = 0;
-
-            int result = octf_trace_get_rd_buffer(m_traceConsumerHandle,
-                                                  &eventHandle, &traceBuffer,
-                                                  &traceSize);
-            switch (result) {
-            case 0:
-                this->serialize(traceBuffer, traceSize);
-                result = octf_trace_release_rd_buffer(m_traceConsumerHandle,
-                                                      eventHandle);
-                if (result) {
-                    throw Exception("Failed to release trace data, error: " +
-                                    std::to_string(result));
-                }
-                break;
-            case -EAGAIN:
-            case -EBUSY:
-                circBufferNotAvailable = true;
-                break;
-            case -EINVAL:
-            case -EPERM:
-            case -EBADF:
-            case -ENOSPC:
-            default:
-                throw Exception("Failed to retrieve trace data, error: " +
-                                std::to_string(result));
+        // circular buffers. We stop when none of them has ready traces, so that
+        // we won't be potentially stuck in the loop and can have tracing
+        // stopped by outside forces/timeout
+        while (fetchTraces()) {
+            serializeTraces();
+            releaseTraces();
+        }
+    } while (!finish);
+}
+
+void TraceJob::recordTraces() {
+    std::unique_lock<std::mutex> lock(m_snapshotMutex);
+
+    // Producers overwrite the oldest traces, so the circular buffer keeps
+    // the latest ones until snapshot is requested. Snapshot requested before
+    // stop is taken before the job stops.
+    for (;;) {
+        m_snapshotTrigger.wait(
+                lock, [this] { return m_snapshotRequested || m_stopping; });
+        if (!m_snapshotRequested) {
+            break;
+        }
+
+        m_snapshotRequested = false;
+        lock.unlock();
+        takeSnapshot();
+        lock.lock();
+    }
+}
+
+void TraceJob::takeSnapshot() {
+    // Producers keep on pushing traces while the snapshot is taken, don't
+    // take more of them than the circular buffer is able to keep
+    uint64_t budget = m_producer->getSize();
+    uint64_t heldBackSize = 0;
+
+    m_processingTraces = true;
+    while (budget && fetchTraces()) {
+        // Traces held back by the previous merge are accounted already
+        budget -= std::min(budget, getFetchedSize() - heldBackSize);
+        serializeTraces();
+        releaseTraces();
+        heldBackSize = getFetchedSize();
+    }
+
+    // Traces held back go to this snapshot too
+    if (getFetchedSize()) {
+        serializeTraces(true);
+        releaseTraces();
+    }
+    m_processingTraces = false;
+}
+
+bool TraceJob::fetchTraces() {
+    bool fetched = false;
+
+    for (uint32_t i = 0; i < m_traceConsumerHandles.size(); i++) {
+        auto &batch = m_batches[i];
+
+        // Traces held back are serialized before the next batch is taken
+        if (batch.next < batch.count) {
+            fetched = true;
+            continue;
+        }
+
+        // Batch is larger if it's shared with conversion pool threads
+        batch.count = batch.traces.size();
+        batch.next = 0;
+
+        int result = octf_trace_get_rd_batch(
+                m_traceConsumerHandles[i], &batch.handle, batch.traces.data(),
+                batch.sizes.data(), &batch.count);
+        switch (result) {
+        case 0:
+            fetched = true;
+            break;
+        case -EAGAIN:
+        case -EBUSY:
+            batch.count = 0;
+            break;
+        case -EINVAL:
+        case -EPERM:
+        case -EBADF:
+        default:
+            throw Exception("Failed to retrieve trace data, error: " +
+                            std::to_string(result));
+        }
+    }
+
+    return fetched;
+}
+
+void TraceJob::serializeTraces(bool flush) {
+    if (m_batches.size() == 1) {
+        auto &batch = m_batches.front();
+        for (uint32_t i = batch.next; i < batch.count; i++) {
+            addTrace(batch.traces[i], batch.sizes[i]);
+        }
+        batch.next = batch.count;
+        if (m_conversionPool) {
+            serializeConverted();
+        }
+        buildParsedIo();
+        return;
+    }
+
+    // Batches of one fetch don't cover the same range of sids, a sub-ring
+    // may get traces of sids lower than the last ones fetched from another
+    // sub-ring yet. Traces up to the lowest of last fetched sids are
+    // serialized only, sub-ring which reached it fetches the next batch then.
+    // Sub-rings which are empty don't bound it, so it's best effort only.
+    uint64_t watermark = std::numeric_limits<uint64_t>::max();
+    if (!flush) {
+        for (const auto &batch : m_batches) {
+            if (batch.next < batch.count) {
+                uint32_t last = batch.count - 1;
+                watermark = std::min<uint64_t>(
+                        watermark,
+                        getTraceSid(batch.traces[last], batch.sizes[last]));
             }
-            if (circBufferNotAvailable) {
-                // We want to break (instead of continue in the switch), so that
-                // we won't be potentially stuck in the inner loop and can have
-                // tracing stopped by outside forces/timeout
-                break;
+        }
+    }
+
+    // Merge batches of sub-rings, each of them is ordered by sid already
+    using Candidate = std::pair<uint64_t, uint32_t>;
+    auto comp = std::greater<Candidate>();
+
+    m_mergeHeap.clear();
+    for (uint32_t i = 0; i < m_batches.size(); i++) {
+        const auto &batch = m_batches[i];
+        if (batch.next < batch.count) {
+            uint64_t sid = getTraceSid(batch.traces[batch.next],
+                                       batch.sizes[batch.next]);
+            if (sid <= watermark) {
+                m_mergeHeap.emplace_back(sid, i);
             }
         }
-    } while (!finish);
+    }
+    std::make_heap(m_mergeHeap.begin(), m_mergeHeap.end(), comp);
+
+    while (!m_mergeHeap.empty()) {
+        std::pop_heap(m_mergeHeap.begin(), m_mergeHeap.end(), comp);
+        uint32_t subRing = m_mergeHeap.back().second;
+        m_mergeHeap.pop_back();
+
+        auto &batch = m_batches[subRing];
+        addTrace(batch.traces[batch.next], batch.sizes[batch.next]);
+        batch.next++;
+
+        if (batch.next < batch.count) {
+            uint64_t sid = getTraceSid(batch.traces[batch.next],
+                                       batch.sizes[batch.next]);
+            if (sid <= watermark) {
+                m_mergeHeap.emplace_back(sid, subRing);
+                std::push_heap(m_mergeHeap.begin(), m_mergeHeap.end(), comp);
+            }
+        }
+    }
+
+    if (m_conversionPool) {
+        serializeConverted();
+    }
+    buildParsedIo();
+}
+
+uint64_t TraceJob::getFetchedSize() const {
+    uint64_t size = 0;
+
+    for (const auto &batch : m_batches) {
+        for (uint32_t i = batch.next; i < batch.count; i++) {
+            size += batch.sizes[i];
+        }
+    }
+
+    return size;
+}
+
+void TraceJob::releaseTraces() {
+    for (uint32_t i = 0; i < m_traceConsumerHandles.size(); i++) {
+        auto &batch = m_batches[i];
+        if (!batch.count || batch.next < batch.count) {
+            continue;
+        }
+
+        batch.count = 0;
+        batch.next = 0;
+        int result = octf_trace_release_rd_batch(m_traceConsumerHandles[i],
+                                                 batch.handle);
+        if (result) {
+            throw Exception("Failed to release trace data, error: " +
+                            std::to_string(result));
+        }
+    }
 }
 
 void TraceJob::joinThread() {
@@ -9,12 +9,18 @@
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <thread>
+#include <utility>
+#include <vector>
 
 #include <octf/interface/IRingTraceProducer.h>
 #include <octf/interface/ITraceConverter.h>
 #include <octf/interface/ITraceSerializer.h>
 #include <octf/interface/TraceManager.h>
+#include <octf/interface/internal/ParsedIoBuilder.h>
+#include <octf/interface/internal/TraceConversionPool.h>
 #include <octf/proto/InterfaceTraceCreating.pb.h>
 #include <octf/trace/trace.h>
 #include <octf/utils/NonCopyable.h>
@@ -31,18 +37,32 @@ namespace octf {
 class TraceJob : public NonCopyable {
 public:
     TraceJob(ITraceExecutor *executor,
-             uint32_t maxDuration,
+             const TraceConfig &config,
              uint32_t queueId,
              const std::string &outputFileName,
              uint32_t memoryPoolSize,
-             SerializerType serializerType);
+             TraceConversionPool *conversionPool,
+             ParsedIoBuilder *parsedIoBuilder);
     virtual ~TraceJob();
 
     /**
-     * @brief Returns the written file size
+     * @brief Returns the written file size, in case of segmented trace file
+     * it's the total size of segments kept
      */
     int64_t getTraceSize() const;
 
+    /**
+     * @brief Appends segments of trace file kept in trace directory
+     */
+    void getSegments(google::protobuf::RepeatedPtrField<proto::TraceSegment>
+                             *segments) const;
+
+    /**
+     * @brief Returns number of changes of segments list, it's increased on
+     * each segment change
+     */
+    uint64_t getSegmentsVersion() const;
+
     /**
      * @brief Returns the amount of received traces
      */
@@ -73,6 +93,11 @@ public:
      * @brief Waits until job is ready to receive traces
      */
     void waitForJobInitialization();
+    /**
+     * @brief Requests saving traces kept in circular buffer, applies to flight
+     * recorder job only
+     */
+    void requestSnapshot();
     /**
      * @brief Pushes a trace to the given producer (if found)
      *
@@ -82,6 +107,33 @@ public:
      * @retval -ENOSPC No space in memory pool to store event
      */
     int pushTrace(const void *trace, const uint32_t traceSize);
+    /**
+     * @brief Pushes a batch of traces to the given producer (if found)
+     *
+     * @retval 0 All traces pushed successfully
+     * @retval -EINVAL Trace is invalid
+     * @retval -EPERM Invalid open mode, only producer can push events
+     * @retval -ENOSPC No space in memory pool to store some of events
+     */
+    int pushTraces(const void *const *traces,
+                   const uint32_t *traceSizes,
+                   uint32_t count);
+    /**
+     * @brief Reserves space for a trace in the producer's ring, the trace is
+     * written in place and then committed with this->commitTrace
+     *
+     * @retval 0 Space reserved successfully
+     * @retval -EINVAL Trace or its size is invalid
+     * @retval -ENOSPC No space in memory pool to store event
+     */
+    int reserveTrace(const uint32_t traceSize, TraceReservation &reservation);
+    /**
+     * @brief Commits trace written into space reserved by this->reserveTrace
+     *
+     * @retval 0 Trace committed successfully
+     * @retval -EINVAL Trace or reservation is invalid
+     */
+    int commitTrace(const TraceReservation &reservation);
 
 private:
     /**
@@ -89,15 +141,119 @@ private:
      * internal state based on results (endTime, TracingStatus)
      */
     void doWork();
+    /**
+     * @brief Runs the job thread on CPUs of the NUMA node where the
+     * producer's ring is placed
+     */
+    void setNumaAffinity();
     /**
      * @brief Serialize trace data
      */
     void serialize(const void *data, uint32_t size);
+    /**
+     * @brief Serializes trace, or queues it for conversion by the pool
+     */
+    void addTrace(const void *data, uint32_t size);
+    /**
+     * @brief Converts queued traces using the pool and serializes them in
+     * their order
+     */
+    void serializeConverted();
+    /**
+     * @brief Hands over copies of serialized traces to parsed IO builder
+     */
+    void buildParsedIo();
+    /**
+     * @brief Opens the next segment if the current one is closed
+     */
+    void prepareSegment();
+    /**
+     * @brief Accounts serialized trace
+     */
+    void onTraceSerialized(const void *data, uint32_t size);
+    /**
+     * @brief Returns path of file of given segment, or path of trace file if
+     * it's not segmented
+     */
+    std::string getSegmentFileName(uint32_t index) const;
+    /**
+     * @brief Creates serializer of given segment and opens its file
+     */
+    void openSegment(uint32_t index);
+    /**
+     * @brief Updates current segment with serialized trace, closes the
+     * segment once it reaches its size
+     */
+    void updateSegment(const void *trace, uint32_t size);
+    /**
+     * @brief Closes serializer of current segment, removes the oldest
+     * segments if there are more of them than the limit
+     *
+     * @param last Set if no segment follows
+     */
+    void closeSegment(bool last);
     /**
      * @brief Handles
      * consuming traces from the circular buffer into output file
      */
     void consumeTraces();
+    /**
+     * @brief Keeps traces in the circular buffer (flight recorder) and
+     * serializes them on snapshot request only
+     */
+    void recordTraces();
+    /**
+     * @brief Serializes traces kept in the circular buffer
+     */
+    void takeSnapshot();
+    /**
+     * @brief Takes a batch of ready traces from each sub-ring, which has no
+     * traces held back by this->serializeTraces
+     *
+     * @retval true At least one trace is taken or held back
+     * @retval false No trace is ready in any sub-ring
+     */
+    bool fetchTraces();
+    /**
+     * @brief Serializes fetched traces, merging sub-rings by sid
+     *
+     * Another sub-ring may still get traces of lower sid than the ones
+     * fetched, so traces above the lowest of sids fetched last from
+     * sub-rings are held back, until the other sub-rings catch up.
+     *
+     * @note Ordering is best effort, as it is with a single ring. Sub-ring
+     * which is empty at fetch doesn't bound the watermark, and a producer
+     * which has taken sid but hasn't reserved space yet isn't seen at all,
+     * so such trace may be serialized after traces of higher sids.
+     *
+     * @param flush Serialize all fetched traces, none of them is held back
+     */
+    void serializeTraces(bool flush = false);
+    /**
+     * @brief Returns total size of fetched traces not serialized yet
+     */
+    uint64_t getFetchedSize() const;
+    /**
+     * @brief Releases fetched traces in sub-rings, batches of traces held
+     * back are kept
+     */
+    void releaseTraces();
+    /**
+     * @brief Closes consumer handles of all sub-rings
+     */
+    void closeConsumers();
+
+    /**
+     * @brief Batch of traces read from single sub-ring, traces from index
+     * next on are not serialized yet
+     */
+    struct TraceBatch {
+        octf_trace_event_handle_t handle;
+        std::vector<void *> traces;
+        std::vector<uint32_t> sizes;
+        uint32_t count;
+        uint32_t next;
+    };
 
     std::thread m_thread;
     /**
@@ -124,9 +280,67 @@ private:
      */
     uint32_t m_maxDuration;
     /**
-     * @brief Handle for the circular buffer reader
+     * @brief Set if job runs as flight recorder
+     */
+    const bool m_flightRecorder;
+    /**
+     * @brief Mutex for snapshot request and stop of flight recorder
+     */
+    std::mutex m_snapshotMutex;
+    /**
+     * @brief Notified on snapshot request and stop of flight recorder
+     */
+    std::condition_variable m_snapshotTrigger;
+    /**
+     * @brief Set when snapshot is requested
+     */
+    bool m_snapshotRequested;
+    /**
+     * @brief Set when flight recorder is requested to stop
+     */
+    bool m_stopping;
+    /**
+     * @brief Handles for the circular buffer readers, one per sub-ring
+     */
+    std::vector<octf_trace_t> m_traceConsumerHandles;
+    /**
+     * @brief Batches of traces being consumed, one per sub-ring
+     */
+    std::vector<TraceBatch> m_batches;
+    /**
+     * @brief Heap of (sid, sub-ring) pairs used for merging sub-rings
+     */
+    std::vector<std::pair<uint64_t, uint32_t>> m_mergeHeap;
+    /**
+     * @brief Pool of threads converting traces, nullptr if traces are
+     * converted by job thread only
+     */
+    TraceConversionPool *m_conversionPool;
+    /**
+     * @brief Traces queued for conversion by the pool, in sid order
+     */
+    std::vector<const void *> m_queuedTraces;
+    /**
+     * @brief Sizes of traces queued for conversion by the pool
+     */
+    std::vector<uint32_t> m_queuedSizes;
+    /**
+     * @brief Chunks of queued traces converted in parallel
+     */
+    std::vector<TraceConversionChunk> m_chunks;
+    /**
+     * @brief Builder of parsed IO, nullptr if parsed IO isn't built while
+     * tracing
      */
-    octf_trace_t m_traceConsumerHandle;
+    ParsedIoBuilder *m_parsedIoBuilder;
+    /**
+     * @brief Copies of traces to be handed over to parsed IO builder
+     */
+    std::vector<uint8_t> m_parsedIoData;
+    /**
+     * @brief Sizes of traces to be handed over to parsed IO builder
+     */
+    std::vector<uint32_t> m_parsedIoSizes;
     /**
      * @brief Total amount of trace events
      */
@@ -136,6 +350,58 @@ private:
      * circular buffer
      */
     std::atomic<bool> m_processingTraces;
+    /**
+     * @brief Set if traces are converted to Google Protocol Buffers before
+     * serializing, otherwise they are serialized in their native format
+     */
+    bool m_convertTraces;
+    /**
+     * @brief Path to trace file, segment files are named after it
+     */
+    const std::string m_outputFileName;
+    /**
+     * @brief Describes the type of output for traces
+     */
+    const SerializerType m_serializerType;
+    /**
+     * @brief Set if trace files are compressed
+     */
+    const bool m_compression;
+    /**
+     * @brief Size of trace file segment (in bytes), 0 if trace file isn't
+     * segmented
+     */
+    const uint64_t m_segmentSize;
+    /**
+     * @brief Max number of segments kept, 0 - no limit
+     */
+    const uint32_t m_segmentCount;
+    /**
+     * @brief Current segment, updated by job thread only
+     */
+    proto::TraceSegment m_segment;
+    /**
+     * @brief Set when current segment is closed, the next one is opened once
+     * there is a trace to serialize
+     */
+    bool m_segmentClosed;
+    /**
+     * @brief Mutex for m_segments, m_segmentsSize and swapping m_serializer
+     */
+    mutable std::mutex m_segmentsMutex;
+    /**
+     * @brief Segments kept in trace directory, including the current one
+     * once it has any trace
+     */
+    std::deque<proto::TraceSegment> m_segments;
+    /**
+     * @brief Total size of closed segments kept in trace directory
+     */
+    int64_t m_segmentsSize;
+    /**
+     * @brief Number of changes of m_segments
+     */
+    std::atomic<uint64_t> m_segmentsVersion;
     /**
      * @brief Module that handles writing traces to a file
      */
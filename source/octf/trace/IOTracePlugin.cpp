@@ -5,18 +5,53 @@
 
 #include <octf/trace/IOTracePlugin.h>
 
+#include <algorithm>
 #include <octf/interface/InterfaceCliImpl.h>
 #include <octf/interface/InterfaceTraceCreatingImpl.h>
 #include <octf/interface/TraceConverter.h>
 #include <octf/interface/TraceProducerLocal.h>
+#include <octf/utils/Hash.h>
 
 namespace octf {
 
+/**
+ * Size of block (in sectors) which IOs are sampled by when sampled spatially
+ */
+static constexpr uint64_t SAMPLING_BLOCK_SIZE = 8;
+
+/**
+ * Number of buckets of IDs of IOs filtered out, each of them fills a cache
+ * line
+ */
+static constexpr uint64_t FILTERED_IO_BUCKET_COUNT = 1 << 13;
+
+static constexpr uint32_t FILTERED_IO_BUCKET_SIZE = 8;
+
+/**
+ * Maps IO operation to its protobuf type, which filter refers to
+ */
+static proto::trace::IoType getIoType(uint8_t operation) {
+    switch (operation) {
+    case iotrace_event_operation_rd:
+        return proto::trace::IoType::Read;
+    case iotrace_event_operation_wr:
+        return proto::trace::IoType::Write;
+    case iotrace_event_operation_discard:
+        return proto::trace::IoType::Discard;
+    default:
+        return proto::trace::IoType::UnknownIoType;
+    }
+}
+
 IOTracePlugin::IOTracePlugin(const std::string &pluginId, uint32_t queueCount)
         : NodePlugin(NodeId(pluginId))
         , ITraceExecutor()
         , m_tracing(nullptr)
-        , m_ioQueueCount(queueCount) {}
+        , m_ioQueueCount(queueCount)
+        , m_sampling(proto::TraceSampling::SAMPLING_NONE)
+        , m_samplingRate(1)
+        , m_filter(nullptr)
+        , m_filterOwner() {}
 
 IOTracePlugin::~IOTracePlugin() {}
 
@@ -53,10 +88,364 @@ std::unique_ptr<ITraceConverter> IOTracePlugin::createTraceConverter() {
     return std::unique_ptr<TraceConverter>(new TraceConverter());
 }
 
+bool IOTracePlugin::setSampling(proto::TraceSampling sampling,
+                                uint32_t rate) {
+    switch (sampling) {
+    case proto::TraceSampling::SAMPLING_NONE:
+        rate = 1;
+        break;
+    case proto::TraceSampling::SAMPLING_TEMPORAL:
+    case proto::TraceSampling::SAMPLING_SPATIAL:
+        if (!rate) {
+            return false;
+        }
+        break;
+    default:
+        return false;
+    }
+
+    m_samplingRate = rate;
+    m_sampling = sampling;
+    return true;
+}
+
+bool IOTracePlugin::setFilter(const proto::TraceFilter &filter) {
+    std::unique_ptr<const CompiledFilter> compiled;
+    if (filter.ByteSizeLong()) {
+        compiled.reset(new CompiledFilter(filter));
+    }
+
+    // No producer holds the previous filter, it's released at once
+    m_filter.store(compiled.get(), std::memory_order_release);
+    m_filterOwner = std::move(compiled);
+    return true;
+}
+
+IOTracePlugin::CompiledFilter::CompiledFilter(const proto::TraceFilter &filter)
+        : deviceIds(filter.deviceid().begin(), filter.deviceid().end())
+        , operationMask(0)
+        , minSize(filter.minsize())
+        , lbaRanges()
+        , filteredIds(new std::atomic<uint64_t>[FILTERED_IO_BUCKET_COUNT *
+                                                 FILTERED_IO_BUCKET_SIZE]) {
+    std::sort(deviceIds.begin(), deviceIds.end());
+
+    if (filter.operation_size()) {
+        for (auto type : filter.operation()) {
+            if (type >= 0 && type < 32) {
+                operationMask |= 1U << type;
+            }
+        }
+    } else {
+        operationMask = ~0U;
+    }
+
+    // Overlapping and adjacent ranges are merged, so that the range of IO
+    // is found by binary search
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    for (const auto &range : filter.lbarange()) {
+        ranges.emplace_back(range.first(), range.last());
+    }
+    std::sort(ranges.begin(), ranges.end());
+    for (const auto &range : ranges) {
+        if (!lbaRanges.empty() && lbaRanges.back().second != UINT64_MAX &&
+            range.first <= lbaRanges.back().second + 1) {
+            lbaRanges.back().second =
+                    std::max(lbaRanges.back().second, range.second);
+        } else {
+            lbaRanges.push_back(range);
+        }
+    }
+
+    for (uint64_t i = 0; i < FILTERED_IO_BUCKET_COUNT * FILTERED_IO_BUCKET_SIZE;
+         i++) {
+        filteredIds[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+bool IOTracePlugin::CompiledFilter::matches(iotrace_event_type type,
+                                            uint32_t devId,
+                                            uint64_t lba,
+                                            uint32_t len,
+                                            uint8_t operation) const {
+    if (!deviceIds.empty() &&
+        !std::binary_search(deviceIds.begin(), deviceIds.end(), devId)) {
+        return false;
+    }
+
+    if (type == iotrace_event_type_io &&
+        !(operationMask & (1U << getIoType(operation)))) {
+        return false;
+    }
+
+    if (type == iotrace_event_type_io_cmpl && !lba && !len) {
+        // Completions of discards in kernels < 4.10 don't carry address
+        return true;
+    }
+
+    if (len < minSize) {
+        return false;
+    }
+
+    if (!lbaRanges.empty()) {
+        // The first range not ending below IO has to start within it
+        uint64_t last = len ? lba + len - 1 : lba;
+        auto range = std::lower_bound(
+                lbaRanges.begin(), lbaRanges.end(), lba,
+                [](const std::pair<uint64_t, uint64_t> &range, uint64_t lba) {
+                    return range.second < lba;
+                });
+        return range != lbaRanges.end() && range->first <= last;
+    }
+
+    return true;
+}
+
+void IOTracePlugin::CompiledFilter::addFilteredIo(uint64_t id) const {
+    uint64_t hash = hashKey(id);
+    auto bucket = &filteredIds[(hash % FILTERED_IO_BUCKET_COUNT) *
+                               FILTERED_IO_BUCKET_SIZE];
+
+    for (uint32_t i = 0; i < FILTERED_IO_BUCKET_SIZE; i++) {
+        uint64_t expected = 0;
+        if (bucket[i].load(std::memory_order_relaxed) == 0 &&
+            bucket[i].compare_exchange_strong(expected, id,
+                                              std::memory_order_relaxed)) {
+            return;
+        }
+    }
+
+    // Bucket is full, e.g. of IOs whose completions were lost, so an ID is
+    // evicted. Completion of the evicted IO is traced and skipped by parser.
+    bucket[(hash / FILTERED_IO_BUCKET_COUNT) % FILTERED_IO_BUCKET_SIZE].store(
+            id, std::memory_order_relaxed);
+}
+
+bool IOTracePlugin::CompiledFilter::takeFilteredIo(uint64_t id) const {
+    auto bucket = &filteredIds[(hashKey(id) % FILTERED_IO_BUCKET_COUNT) *
+                               FILTERED_IO_BUCKET_SIZE];
+
+    for (uint32_t i = 0; i < FILTERED_IO_BUCKET_SIZE; i++) {
+        uint64_t expected = id;
+        if (bucket[i].load(std::memory_order_relaxed) == id &&
+            bucket[i].compare_exchange_strong(expected, 0,
+                                              std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool IOTracePlugin::isSampled(iotrace_event_type type,
+                              uint32_t devId,
+                              uint64_t id,
+                              uint64_t lba) const {
+    auto sampling = m_sampling.load(std::memory_order_relaxed);
+    if (sampling == proto::TraceSampling::SAMPLING_NONE) {
+        return true;
+    }
+
+    switch (type) {
+    case iotrace_event_type_io:
+    case iotrace_event_type_io_cmpl:
+        break;
+    case iotrace_event_type_fs_meta:
+        // Filesystem meta refers to IO by its ID only
+        if (sampling == proto::TraceSampling::SAMPLING_SPATIAL) {
+            return true;
+        }
+        break;
+    default:
+        // Device descriptions and file events are needed to parse any IO
+        return true;
+    }
+
+    uint64_t rate = m_samplingRate.load(std::memory_order_relaxed);
+
+    if (sampling == proto::TraceSampling::SAMPLING_SPATIAL) {
+        uint64_t block = lba / SAMPLING_BLOCK_SIZE;
+        return hashKey(hashKey(devId) ^ block) % rate == 0;
+    }
+
+    if (!id) {
+        // Completion can't be matched with IO without ID, so such IOs are
+        // just counted, per thread to avoid contention
+        static thread_local uint64_t unidentifiedCount = 0;
+        return ++unidentifiedCount % rate == 0;
+    }
+
+    return hashKey(id) % rate == 0;
+}
+
+bool IOTracePlugin::matchesFilter(iotrace_event_type type,
+                                  uint32_t devId,
+                                  uint64_t id,
+                                  uint64_t lba,
+                                  uint32_t len,
+                                  uint8_t operation) const {
+    auto filter = getFilter();
+    if (!filter) {
+        return true;
+    }
+
+    return matchesFilter(*filter, type, devId, id, lba, len, operation);
+}
+
+bool IOTracePlugin::matchesFilter(const CompiledFilter &filter,
+                                  iotrace_event_type type,
+                                  uint32_t devId,
+                                  uint64_t id,
+                                  uint64_t lba,
+                                  uint32_t len,
+                                  uint8_t operation) const {
+    switch (type) {
+    case iotrace_event_type_io:
+        if (filter.matches(type, devId, lba, len, operation)) {
+            return true;
+        }
+
+        if (id) {
+            filter.addFilteredIo(id);
+        }
+        return false;
+    case iotrace_event_type_io_cmpl:
+        if (id) {
+            return !filter.takeFilteredIo(id);
+        }
+
+        // Completion of IO without ID can't be told apart, it's matched by
+        // device, address and size
+        return filter.matches(type, devId, lba, len, 0);
+    default:
+        // Device descriptions and filesystem events are needed to parse any
+        // IO, filesystem meta refers to IO by its ID only
+        return true;
+    }
+}
+
+bool IOTracePlugin::isTraced(const void *trace, size_t size) const {
+    return isTraced(trace, size, getFilter());
+}
+
+bool IOTracePlugin::isTraced(const void *trace,
+                             size_t size,
+                             const CompiledFilter *filter) const {
+    auto sampling = m_sampling.load(std::memory_order_relaxed);
+    if ((sampling == proto::TraceSampling::SAMPLING_NONE && !filter) ||
+        size < sizeof(struct iotrace_event_hdr)) {
+        return true;
+    }
+
+    auto hdr = static_cast<const struct iotrace_event_hdr *>(trace);
+    switch (hdr->type) {
+    case iotrace_event_type_io:
+        if (size >= sizeof(struct iotrace_event)) {
+            auto io = static_cast<const struct iotrace_event *>(trace);
+            return (!filter ||
+                    matchesFilter(*filter, iotrace_event_type_io, io->dev_id,
+                                  io->id, io->lba, io->len, io->operation)) &&
+                   isSampled(iotrace_event_type_io, io->dev_id, io->id,
+                             io->lba);
+        }
+        break;
+    case iotrace_event_type_io_cmpl:
+        if (size >= sizeof(struct iotrace_event_completion)) {
+            auto cmpl =
+                    static_cast<const struct iotrace_event_completion *>(trace);
+
+            if (filter &&
+                !matchesFilter(*filter, iotrace_event_type_io_cmpl,
+                               cmpl->dev_id, cmpl->ref_id, cmpl->lba,
+                               cmpl->len, 0)) {
+                return false;
+            }
+
+            // Completions of discards in kernels < 4.10 don't carry address
+            if (!cmpl->lba && !cmpl->len &&
+                sampling == proto::TraceSampling::SAMPLING_SPATIAL) {
+                return true;
+            }
+
+            return isSampled(iotrace_event_type_io_cmpl, cmpl->dev_id,
+                             cmpl->ref_id, cmpl->lba);
+        }
+        break;
+    case iotrace_event_type_fs_meta:
+        if (size >= sizeof(struct iotrace_event_fs_meta)) {
+            auto meta =
+                    static_cast<const struct iotrace_event_fs_meta *>(trace);
+            return isSampled(iotrace_event_type_fs_meta, 0, meta->ref_id, 0);
+        }
+        break;
+    default:
+        break;
+    }
+
+    return true;
+}
+
 void octf::IOTracePlugin::push(uint32_t ioQueueId,
                                const void *trace,
                                size_t size) {
+    if (!isTraced(trace, size)) {
+        return;
+    }
+
     m_tracing->pushTrace(ioQueueId, trace, size);
 }
 
+void octf::IOTracePlugin::push(uint32_t ioQueueId,
+                               const void *const *traces,
+                               const uint32_t *sizes,
+                               uint32_t count) {
+    // The same filter applies to the whole batch
+    auto filter = getFilter();
+    if (m_sampling.load(std::memory_order_relaxed) ==
+                proto::TraceSampling::SAMPLING_NONE &&
+        !filter) {
+        m_tracing->pushTraces(ioQueueId, traces, sizes, count);
+        return;
+    }
+
+    // Push runs of events which are traced, so that no copy of the batch is
+    // needed
+    uint32_t first = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (isTraced(traces[i], sizes[i], filter)) {
+            continue;
+        }
+
+        if (i > first) {
+            m_tracing->pushTraces(ioQueueId, traces + first, sizes + first,
+                                  i - first);
+        }
+        first = i + 1;
+    }
+
+    if (count > first) {
+        m_tracing->pushTraces(ioQueueId, traces + first, sizes + first,
+                              count - first);
+    }
+}
+
+int octf::IOTracePlugin::reserve(uint32_t ioQueueId,
+                                 size_t size,
+                                 TraceReservation &reservation) {
+    if (size > UINT32_MAX) {
+        return -EINVAL;
+    }
+
+    return m_tracing->reserveTrace(ioQueueId, size, reservation);
+}
+
+void octf::IOTracePlugin::commit(uint32_t ioQueueId,
+                                 const TraceReservation &reservation) {
+    m_tracing->commitTrace(ioQueueId, reservation);
+}
+
+void octf::IOTracePlugin::reportIoLatency(uint64_t latencyNs) {
+    m_tracing->reportIoLatency(latencyNs);
+}
+
 }  // namespace octf
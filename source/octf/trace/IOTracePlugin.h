@@ -6,7 +6,10 @@
 #ifndef SOURCE_OCTF_TRACE_IOTRACEPLUGIN_H
 #define SOURCE_OCTF_TRACE_IOTRACEPLUGIN_H
 
+#include <atomic>
 #include <memory>
+#include <utility>
+#include <vector>
 #include <octf/interface/ITraceExecutor.h>
 #include <octf/plugin/NodePlugin.h>
 #include <octf/trace/iotrace_event.h>
@@ -14,6 +17,7 @@
 namespace octf {
 
 class InterfaceTraceCreatingImpl;
+struct TraceReservation;
 
 /**
  * @brief A OCTF plug-in with implementation of InterfaceTraceCreatingImpl
@@ -35,6 +39,73 @@ public:
 
     std::unique_ptr<ITraceConverter> createTraceConverter() override;
 
+    bool setSampling(proto::TraceSampling sampling, uint32_t rate) override;
+
+    /**
+     * @brief Sets filter of IOs, called before tracing starts
+     *
+     * No event shall be pushed or checked meanwhile, as the previous filter
+     * is released at once. Trace manager sets it before starting tracing,
+     * and producers of the C plug-in are drained when tracing stops.
+     */
+    bool setFilter(const proto::TraceFilter &filter) override;
+
+    /**
+     * @brief Checks if event is traced under sampling set at trace start
+     *
+     * Events pushed are checked by this->push. Space reserved by
+     * this->reserve is not checked, as the event isn't written yet, so trace
+     * producers writing events in place check them before reserving space.
+     *
+     * @param type Type of event
+     * @param devId Device ID of IO
+     * @param id ID of IO, or ID of IO referenced by the event
+     * @param lba Address of IO (in sectors)
+     *
+     * @retval true Event shall be traced
+     * @retval false Event is sampled out
+     */
+    bool isSampled(iotrace_event_type type,
+                   uint32_t devId,
+                   uint64_t id,
+                   uint64_t lba) const;
+
+    /**
+     * @brief Checks if event matches filter set at trace start
+     *
+     * Like sampling, filter is applied to pushed events only, trace
+     * producers writing events in place check them before reserving space.
+     * Completion is filtered out when its IO is, so each IO shall be checked
+     * once: ID of IO filtered out is remembered until its completion is
+     * checked, unless evicted by many more IOs filtered out meanwhile.
+     * Completion without IO ID is matched by device, address and size only.
+     *
+     * @param type Type of event
+     * @param devId Device ID of IO
+     * @param id ID of IO, or ID of IO referenced by the event
+     * @param lba Address of IO (in sectors)
+     * @param len Size of IO (in sectors)
+     * @param operation Operation of IO, iotrace_event_operation_t enumerator
+     *
+     * @retval true Event shall be traced
+     * @retval false Event is filtered out
+     */
+    bool matchesFilter(iotrace_event_type type,
+                       uint32_t devId,
+                       uint64_t id,
+                       uint64_t lba,
+                       uint32_t len,
+                       uint8_t operation) const;
+
+    /**
+     * @brief Checks if event is traced under filter and sampling set at trace
+     * start
+     *
+     * @param trace Trace event, one of defined in iotrace_event.h
+     * @param size Size of trace event
+     */
+    bool isTraced(const void *trace, size_t size) const;
+
     /**
      * @brief Pushes an event to be traced
      *
@@ -42,11 +113,158 @@ public:
      * @param trace trace event to be stored
      * @param size size of trace event to be stored
      *
-     * @note Events defined in iotrace_event.h are serialized only.
+     * @note Events defined in iotrace_event.h are serialized only. Events
+     * filtered or sampled out are dropped.
      */
     virtual void push(uint32_t ioQueueId, const void *trace, size_t size);
 
+    /**
+     * @brief Pushes a batch of events to be traced
+     *
+     * Space for events is reserved at once for the whole batch, which is
+     * cheaper than pushing events one by one.
+     *
+     * @param ioQueueId
+     * @param traces trace events to be stored
+     * @param sizes sizes of trace events to be stored
+     * @param count number of trace events to be stored
+     *
+     * @note Events defined in iotrace_event.h are serialized only. Events
+     * filtered or sampled out are dropped.
+     */
+    virtual void push(uint32_t ioQueueId,
+                      const void *const *traces,
+                      const uint32_t *sizes,
+                      uint32_t count);
+
+    /**
+     * @brief Reserves space for an event to be traced, the event is written
+     * in place and then committed with this->commit
+     *
+     * @param ioQueueId
+     * @param size size of trace event to be stored
+     * @param[out] reservation reserved space
+     *
+     * @retval 0 space reserved successfully
+     * @retval -EINVAL queue or size is invalid
+     * @retval -ENOSPC no space to store event
+     */
+    virtual int reserve(uint32_t ioQueueId,
+                        size_t size,
+                        TraceReservation &reservation);
+
+    /**
+     * @brief Commits event written into space reserved by this->reserve
+     *
+     * @param ioQueueId
+     * @param reservation space reserved by this->reserve
+     */
+    virtual void commit(uint32_t ioQueueId,
+                        const TraceReservation &reservation);
+
+    /**
+     * @brief Reports latency of completed IO
+     *
+     * When tracing runs as flight recorder and the latency exceeds the
+     * threshold given at start, snapshot of traces is taken.
+     *
+     * @param latencyNs IO latency (in nanoseconds)
+     */
+    virtual void reportIoLatency(uint64_t latencyNs);
+
 private:
+    /**
+     * @brief Filter of IOs compiled from proto::TraceFilter into flat fields,
+     * so that matching an event doesn't walk protobuf containers
+     *
+     * Criteria are immutable. IDs of IOs filtered out are kept in a table of
+     * cache line sized buckets, so that their completions are filtered out
+     * too. If bucket of IO is full, another ID is evicted, so that IOs whose
+     * completions are lost don't fill the table up. Completion of evicted IO
+     * is traced without its IO, parser skips such completions.
+     */
+    struct CompiledFilter {
+        explicit CompiledFilter(const proto::TraceFilter &filter);
+
+        /**
+         * @brief Checks if IO matches criteria of filter
+         *
+         * @param operation Operation of IO, ignored for completion
+         */
+        bool matches(iotrace_event_type type,
+                     uint32_t devId,
+                     uint64_t lba,
+                     uint32_t len,
+                     uint8_t operation) const;
+
+        /**
+         * @brief Remembers ID of IO filtered out, evicting another ID if
+         * bucket of the ID is full
+         */
+        void addFilteredIo(uint64_t id) const;
+
+        /**
+         * @brief Checks if IO of given ID has been filtered out, and forgets
+         * it
+         */
+        bool takeFilteredIo(uint64_t id) const;
+
+        /**
+         * @brief Sorted IDs of traced devices, empty if any device is traced
+         */
+        std::vector<uint32_t> deviceIds;
+
+        /**
+         * @brief Traced operations, bit per proto::trace::IoType
+         */
+        uint32_t operationMask;
+
+        /**
+         * @brief Min size of traced IOs (in sectors)
+         */
+        uint32_t minSize;
+
+        /**
+         * @brief Sorted disjoint ranges (first, last) of traced addresses,
+         * empty if any address is traced
+         */
+        std::vector<std::pair<uint64_t, uint64_t>> lbaRanges;
+
+        /**
+         * @brief IDs of IOs filtered out, 0 - free slot
+         */
+        std::unique_ptr<std::atomic<uint64_t>[]> filteredIds;
+    };
+
+    /**
+     * @brief Returns filter of IOs, nullptr if IOs aren't filtered
+     */
+    inline const CompiledFilter *getFilter() const {
+        return m_filter.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @copydoc matchesFilter
+     *
+     * @param filter Filter of IOs
+     */
+    bool matchesFilter(const CompiledFilter &filter,
+                       iotrace_event_type type,
+                       uint32_t devId,
+                       uint64_t id,
+                       uint64_t lba,
+                       uint32_t len,
+                       uint8_t operation) const;
+
+    /**
+     * @copydoc isTraced
+     *
+     * @param filter Filter of IOs, nullptr if IOs aren't filtered
+     */
+    bool isTraced(const void *trace,
+                  size_t size,
+                  const CompiledFilter *filter) const;
+
     /**
      * @brief Object implementing trace collecting interface
      */
@@ -57,6 +275,29 @@ private:
      * trace jobs
      */
     uint32_t m_ioQueueCount;
+
+    /**
+     * @brief Sampling of IOs, set before tracing starts
+     */
+    std::atomic<proto::TraceSampling> m_sampling;
+
+    /**
+     * @brief Events of one in this number of IOs are traced
+     */
+    std::atomic<uint32_t> m_samplingRate;
+
+    /**
+     * @brief Filter of IOs, nullptr if IOs aren't filtered
+     *
+     * Filter is published before tracing starts, while no event is pushed,
+     * so producers load it without taking a reference, see setFilter.
+     */
+    std::atomic<const CompiledFilter *> m_filter;
+
+    /**
+     * @brief Owner of m_filter
+     */
+    std::unique_ptr<const CompiledFilter> m_filterOwner;
 };
 
 }  // namespace octf
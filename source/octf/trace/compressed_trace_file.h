@@ -0,0 +1,89 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SOURCE_OCTF_TRACE_COMPRESSED_TRACE_FILE_H
+#define SOURCE_OCTF_TRACE_COMPRESSED_TRACE_FILE_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__KERNEL__)
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#endif
+
+/**
+ * Compressed trace file starts with "OCTFCMP" string
+ */
+#define OCTF_COMPRESSED_TRACE_MAGIC 0x00504d434654434fULL
+
+#define OCTF_COMPRESSED_TRACE_VERSION 1
+
+/**
+ * @brief Compression algorithm of trace file frames
+ */
+typedef enum {
+    /** zlib stream of deflate compressed data (RFC 1950) */
+    octf_compression_deflate = 1,
+} octf_compression_t;
+
+/**
+ * @brief Frame flags
+ */
+typedef enum {
+    /** Frame data stored uncompressed, as it doesn't compress */
+    octf_compressed_trace_frame_stored = 1 << 0,
+} octf_compressed_trace_frame_flag_t;
+
+/**
+ * @brief Header of compressed trace file
+ *
+ * Content of trace file (events serialized to protocol buffers, or raw trace
+ * file, see raw_trace_file.h) is split into blocks, each of them compressed
+ * independently and stored in frame. The header is followed by the frames.
+ * Events may span frames.
+ */
+struct octf_compressed_trace_file_hdr {
+    /** OCTF_COMPRESSED_TRACE_MAGIC */
+    uint64_t magic;
+
+    /** Version of compressed trace file format */
+    uint32_t version;
+
+    /** Size of this header, the first frame follows it */
+    uint32_t hdr_size;
+
+    /** Compression algorithm, octf_compression_t enumerator */
+    uint32_t compression;
+
+    /** Size of uncompressed data at which frame is closed, frame may be
+     * larger if it holds larger piece of data */
+    uint32_t block_size;
+} __attribute__((packed, aligned(8)));
+
+/**
+ * @brief Header of compressed trace file frame, followed by the compressed
+ * data
+ */
+struct octf_compressed_trace_frame_hdr {
+    /** Size of compressed data following this header */
+    uint32_t compressed_size;
+
+    /** Size of data after decompression */
+    uint32_t size;
+
+    /** CRC-32 of data after decompression */
+    uint32_t checksum;
+
+    /** Frame flags, octf_compressed_trace_frame_flag_t enumerators OR-ed */
+    uint32_t flags;
+} __attribute__((packed, aligned(8)));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SOURCE_OCTF_TRACE_COMPRESSED_TRACE_FILE_H
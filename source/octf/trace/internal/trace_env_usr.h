@@ -8,11 +8,17 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
 #include <pthread.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
 #include <third_party/safestringlib.h>
 
 #ifndef MIN
@@ -36,6 +42,22 @@
 #define likely(cond) __builtin_expect(!!(cond), 1)
 #define unlikely(cond) __builtin_expect(!!(cond), 0)
 
+typedef struct {
+    volatile int counter;
+} env_atomic;
+
+static inline int env_atomic_read(const env_atomic *a) {
+    return a->counter;
+}
+
+static inline void env_atomic_set(env_atomic *a, int i) {
+    a->counter = i;
+}
+
+static inline void env_atomic_inc(env_atomic *a) {
+    __sync_add_and_fetch(&a->counter, 1);
+}
+
 typedef struct {
     volatile long counter;
 } env_atomic64;
@@ -90,6 +112,63 @@ static inline int env_atomic64_add_unless(env_atomic64 *a, int i, int u) {
     return c != (u);
 }
 
+/**
+ * Orders stores issued before the barrier against stores issued after it
+ */
+static inline void env_smp_wmb(void) {
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * Orders loads issued before the barrier against loads issued after it
+ */
+static inline void env_smp_rmb(void) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+
+/**
+ * Orders all memory accesses issued before the barrier against all memory
+ * accesses issued after it
+ */
+static inline void env_smp_mb(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+#define ENV_NSEC_PER_SEC 1000000000ULL
+
+/**
+ * Returns monotonic time in nanoseconds
+ */
+static inline uint64_t env_get_time_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * ENV_NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * Sleeps while the atomic still holds the given value, until woken up by
+ * env_atomic_wake_up_all or until the timeout (in nanoseconds) expires. The
+ * atomic may reside in memory shared between processes.
+ */
+static inline void env_atomic_wait(env_atomic *a,
+                                   int val,
+                                   uint64_t timeout_ns) {
+    struct timespec ts;
+
+    ts.tv_sec = (time_t) (timeout_ns / ENV_NSEC_PER_SEC);
+    ts.tv_nsec = (long) (timeout_ns % ENV_NSEC_PER_SEC);
+
+    syscall(SYS_futex, &a->counter, FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+/**
+ * Wakes up all waiters sleeping in env_atomic_wait on the atomic
+ */
+static inline void env_atomic_wake_up_all(env_atomic *a) {
+    syscall(SYS_futex, &a->counter, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
 static inline void *env_zalloc(size_t size) {
     void *ptr = malloc(size);
 
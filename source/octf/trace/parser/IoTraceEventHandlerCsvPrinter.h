@@ -14,8 +14,10 @@ namespace octf {
 class IoTraceEventHandlerCsvPrinter
         : public TraceEventHandlerCsvPrinter<proto::trace::Event> {
 public:
-    IoTraceEventHandlerCsvPrinter(const std::string &tracePath)
-            : TraceEventHandlerCsvPrinter<proto::trace::Event>(tracePath){};
+    IoTraceEventHandlerCsvPrinter(const std::string &tracePath,
+                                  bool follow = false)
+            : TraceEventHandlerCsvPrinter<proto::trace::Event>(tracePath,
+                                                               follow){};
     virtual ~IoTraceEventHandlerCsvPrinter() = default;
 
     bool compareEvents(const proto::trace::Event *a,
@@ -14,8 +14,10 @@ namespace octf {
 class IoTraceEventHandlerJsonPrinter
         : public TraceEventHandlerJsonPrinter<proto::trace::Event> {
 public:
-    IoTraceEventHandlerJsonPrinter(const std::string &tracePath)
-            : TraceEventHandlerJsonPrinter<proto::trace::Event>(tracePath){};
+    IoTraceEventHandlerJsonPrinter(const std::string &tracePath,
+                                   bool follow = false)
+            : TraceEventHandlerJsonPrinter<proto::trace::Event>(tracePath,
+                                                                follow){};
     virtual ~IoTraceEventHandlerJsonPrinter() = default;
 
     bool compareEvents(const proto::trace::Event *a,
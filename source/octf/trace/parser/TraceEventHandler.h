@@ -6,8 +6,10 @@
 #ifndef SOURCE_OCTF_TRACE_PARSER_TRACEEVENTHANDLER_H
 #define SOURCE_OCTF_TRACE_PARSER_TRACEEVENTHANDLER_H
 
+#include <cstddef>
 #include <memory>
 #include <type_traits>
+#include <vector>
 #include <octf/trace/parser/TraceFileParser.h>
 #include <octf/utils/Exception.h>
 
@@ -27,12 +29,23 @@ class TraceEventHandler {
                   "Attempted to instantiate template with wrong event type.");
 
 public:
+    /**
+     * Maximum number of trace events parsed before they're handed over to
+     * handler at once
+     */
+    static constexpr size_t EVENT_BATCH_SIZE = 256;
+
     /**
      * @param  tracePath Path identifying trace (can consist of multiple CPU
      * traces, in particular can point to a set of files)
+     * @param follow Follow trace being captured, events are processed as
+     * they're written until the trace is complete
      */
-    TraceEventHandler(const std::string &tracePath)
+    TraceEventHandler(const std::string &tracePath, bool follow = false)
             : m_message(std::make_shared<EventType>())
+            // Trace being followed is handled event by event, events are not
+            // held back until a batch fills up
+            , m_batch(follow ? 1 : EVENT_BATCH_SIZE)
             , m_cancelRequested(false) {
         auto cmp = [this](google::protobuf::Message *a,
                           google::protobuf::Message *b) {
@@ -43,9 +56,13 @@ public:
         };
 
         m_parser = std::make_shared<TraceFileParser>(
-                tracePath, std::make_shared<EventType>(), cmp);
+                tracePath, std::make_shared<EventType>(), cmp, follow);
         m_parser->init();
 
+        for (auto &event : m_batch) {
+            event = std::make_shared<EventType>();
+        }
+
         // TODO (jstencel) Delegate parser creating to some outside class.
     }
 
@@ -58,6 +75,24 @@ public:
      */
     virtual void handleEvent(std::shared_ptr<EventType> traceEvent) = 0;
 
+    /**
+     * @brief Handles batch of trace events, in their order
+     *
+     * By default each event is handed to handleEvent() until cancel is
+     * requested. Handlers override it to process the whole batch at once,
+     * without virtual call and shared pointer copy per event. The events are
+     * valid until this method returns.
+     *
+     * @param traceEvents Trace events
+     * @param count Number of trace events
+     */
+    virtual void handleEvents(const std::shared_ptr<EventType> *traceEvents,
+                              size_t count) {
+        for (size_t i = 0; i < count && !isCancelRequested(); i++) {
+            handleEvent(traceEvents[i]);
+        }
+    }
+
     /**
      * @brief Processes all trace events.
      *
@@ -72,9 +107,12 @@ public:
         // TODO(jstencel) Start background thread with processing
         auto parser = getParser();
         while (!parser->isFinished() && !isCancelRequested()) {
-            auto eventMessage = getEventMessagePrototype();
-            parser->parseTraceEvent(eventMessage.get());
-            handleEvent(eventMessage);
+            size_t count = 0;
+            do {
+                parser->parseTraceEvent(m_batch[count++].get());
+            } while (count < m_batch.size() && !parser->isFinished());
+
+            handleEvents(m_batch.data(), count);
         }
     }
 
@@ -137,9 +175,18 @@ protected:
 
 private:
     std::shared_ptr<EventType> m_message;
+
+    /**
+     * @brief Messages trace events are parsed into, reused between batches
+     */
+    std::vector<std::shared_ptr<EventType>> m_batch;
     std::shared_ptr<ITraceParser> m_parser;
     bool m_cancelRequested;
 };
+
+template <typename EventType>
+constexpr size_t TraceEventHandler<EventType>::EVENT_BATCH_SIZE;
+
 }  // namespace octf
 
 #endif  // SOURCE_OCTF_TRACE_PARSER_TRACEEVENTHANDLER_H
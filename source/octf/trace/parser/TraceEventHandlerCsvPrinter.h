@@ -25,8 +25,9 @@ namespace octf {
 template <typename EventType>
 class TraceEventHandlerCsvPrinter : public TraceEventHandler<EventType> {
 public:
-    TraceEventHandlerCsvPrinter(const std::string &tracePath)
-            : TraceEventHandler<EventType>(tracePath)
+    TraceEventHandlerCsvPrinter(const std::string &tracePath,
+                                bool follow = false)
+            : TraceEventHandler<EventType>(tracePath, follow)
             , m_table() {}
 
     virtual ~TraceEventHandlerCsvPrinter() = default;
@@ -24,8 +24,9 @@ namespace octf {
 template <typename EventType>
 class TraceEventHandlerJsonPrinter : public octf::TraceEventHandler<EventType> {
 public:
-    TraceEventHandlerJsonPrinter(const std::string &tracePath)
-            : TraceEventHandler<EventType>(tracePath)
+    TraceEventHandlerJsonPrinter(const std::string &tracePath,
+                                 bool follow = false)
+            : TraceEventHandler<EventType>(tracePath, follow)
             , m_jsonOptions()
             , m_jsonTrace() {
         m_jsonOptions.always_print_primitive_fields = true;
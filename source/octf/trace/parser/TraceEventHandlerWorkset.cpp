@@ -21,6 +21,16 @@ void CasTraceEventHandlerWorkset::handleEvent(EventShRef traceEvent) {
     }
 }
 
+void CasTraceEventHandlerWorkset::handleEvents(const EventShRef *traceEvents,
+                                               size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const auto &event = *traceEvents[i];
+        if (event.has_io()) {
+            m_calc.insertRange(event.io().lba(), event.io().len());
+        }
+    }
+}
+
 uint64_t CasTraceEventHandlerWorkset::getWorkset() {
     return m_calc.getWorkset();
 }
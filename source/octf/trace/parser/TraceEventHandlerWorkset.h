@@ -30,6 +30,9 @@ public:
 
     virtual void handleEvent(EventShRef traceEvent) override;
 
+    virtual void handleEvents(const EventShRef *traceEvents,
+                              size_t count) override;
+
     uint64_t getWorkset();
 
     bool compareEvents(const Event *a, const Event *b) override {
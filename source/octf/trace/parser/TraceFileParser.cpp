@@ -4,8 +4,12 @@
  */
 #include <octf/trace/parser/TraceFileParser.h>
 
+#include <algorithm>
+#include <chrono>
 #include <sstream>
+#include <thread>
 #include <octf/interface/TraceManager.h>
+#include <octf/proto/trace.pb.h>
 #include <octf/proto/traceDefinitions.pb.h>
 #include <octf/trace/parser/TraceFileReader.h>
 #include <octf/utils/Exception.h>
@@ -17,19 +21,80 @@ namespace octf {
 
 using namespace std;
 
+/**
+ * Period of checking if trace being followed has grown
+ */
+static constexpr chrono::milliseconds FOLLOW_PERIOD(100);
+
+/**
+ * Time for which queue of trace being followed may have no event written,
+ * before other queues are merged without it. Trace files are written with at
+ * most one second delay.
+ */
+static constexpr chrono::seconds FOLLOW_IDLE_TIME(2);
+
+/**
+ * Max number of events decoded at once by decoder of queue
+ */
+static constexpr size_t DECODE_BATCH_SIZE = 256;
+
+/**
+ * Max number of batches decoded ahead by decoder of queue
+ */
+static constexpr size_t MAX_DECODED_BATCHES = 4;
+
+/**
+ * Orders events of trace in which sequence IDs were assigned per queue
+ */
+static bool compareTimestamps(google::protobuf::Message *a,
+                              google::protobuf::Message *b) {
+    const auto &hdrA = static_cast<proto::trace::Event *>(a)->header();
+    const auto &hdrB = static_cast<proto::trace::Event *>(b)->header();
+
+    if (hdrA.timestamp() != hdrB.timestamp()) {
+        return hdrA.timestamp() < hdrB.timestamp();
+    }
+
+    // Sequence ID carries queue id, so it is unique within trace
+    return hdrA.sid() < hdrB.sid();
+}
+
 TraceFileParser::~TraceFileParser() {
     deinit();
 }
 
 TraceFileParser::TraceFileParser(const string &tracePath,
                                  MessageShRef eventPrototype,
-                                 CompareFn comp)
+                                 CompareFn comp,
+                                 bool follow)
         : ITraceParser()
         , m_tracePath(tracePath)
+        , m_traceLocation()
         , m_compare(comp)
         , m_readers()
-        , m_events(Comparator(comp))
-        , m_eventPrototype(eventPrototype) {}
+        , m_files()
+        , m_segmented(false)
+        , m_readerSegments()
+        , m_listedSegments()
+        , m_closedSegments()
+        , m_follow(follow)
+        , m_complete(false)
+        , m_filesMutex()
+        , m_decoders()
+        , m_mutex()
+        , m_decoded()
+        , m_consumed()
+        , m_stopping(false)
+        , m_mergeCompare(comp)
+        , m_heads()
+        , m_idleCount(0)
+        , m_idleCheckTime()
+        , m_lastEvent()
+        , m_lastEventKept(false)
+        , m_mergeTree()
+        , m_eventPrototype(eventPrototype)
+        , m_renumberSids(false)
+        , m_sid(0) {}
 
 void TraceFileParser::init() {
     // Read summary in trace location
@@ -37,13 +102,18 @@ void TraceFileParser::init() {
     stringstream traceLocation;
     traceLocation << getFrameworkConfiguration().getTraceDir() << "/"
                   << m_tracePath;
-    ProtobufReaderWriter rw(traceLocation.str() + "/" + SUMMARY_FILE_NAME);
-    if (!rw.read(summary)) {
+    m_traceLocation = traceLocation.str();
+    if (!readSummary(summary)) {
         throw Exception(
                 "Could not parse specified trace. No summary file found.");
     }
 
-    if (summary.state() != proto::TraceState::COMPLETE) {
+    if (m_follow) {
+        // Trace being captured is parsed until it's complete
+        if (summary.state() == proto::TraceState::ERROR) {
+            throw Exception("Specified trace is in 'error' state.");
+        }
+    } else if (summary.state() != proto::TraceState::COMPLETE) {
         throw Exception("Specified trace is not in 'complete' state.");
     }
 
@@ -52,76 +122,478 @@ void TraceFileParser::init() {
         throw Exception("Trace summary contains invalid values.");
     }
 
-    string traceFilePath;
-    for (uint32_t queue = 0; queue < summary.queuecount(); queue++) {
-        traceFilePath = "";
-        traceFilePath = traceLocation.str() + "/" + TRACE_FILE_PREFIX +
-                        to_string(queue);
-        m_readers.push_back(unique_ptr<TraceFileReader>(
-                new TraceFileReader(traceFilePath, queue)));
+    // Queues assigned sequence IDs independently, restore the order of events
+    // using their timestamps
+    m_renumberSids =
+            summary.sidscheme() == proto::TraceSidScheme::SID_PER_QUEUE;
+    m_sid = 0;
+    if (m_renumberSids) {
+        if (m_eventPrototype->GetDescriptor() !=
+            proto::trace::Event::descriptor()) {
+            throw Exception(
+                    "Trace with per queue sequence IDs can be parsed into "
+                    "trace events only.");
+        }
+        m_mergeCompare = compareTimestamps;
+    } else {
+        m_mergeCompare = m_compare;
+    }
+
+    m_files.resize(summary.queuecount());
+    m_readers.resize(summary.queuecount());
+    m_readerSegments.assign(summary.queuecount(), 0);
+    m_listedSegments.assign(summary.queuecount(), 0);
+    m_closedSegments.assign(summary.queuecount(), 0);
+    m_segmented = summary.segmentsize() != 0;
+    {
+        lock_guard<mutex> lock(m_filesMutex);
+        if (!m_segmented) {
+            for (uint32_t queue = 0; queue < summary.queuecount(); queue++) {
+                string path = m_traceLocation + "/" + TRACE_FILE_PREFIX +
+                              to_string(queue);
+                m_files[queue].emplace_back(path, 0);
+            }
+        }
+        updateFiles(summary);
+    }
 
-        m_readers.back()->init();
+    // Start decoding all queues
+    m_stopping = false;
+    for (uint32_t i = 0; i < m_readers.size(); i++) {
+        m_decoders.emplace_back(new QueueDecoder());
+    }
+    for (uint32_t i = 0; i < m_readers.size(); i++) {
+        m_decoders[i]->thread = thread(&TraceFileParser::decodeQueue, this, i);
     }
 
-    // Initialize events container
+    // Take the first event of each queue, it's nullptr if trace file is
+    // empty, or the queue is idle
+    auto idleTime = chrono::steady_clock::now() + FOLLOW_IDLE_TIME;
+    m_heads.resize(m_readers.size());
+    m_idleCount = 0;
+    m_lastEvent.reset(m_eventPrototype->New());
+    m_lastEventKept = false;
     for (uint32_t i = 0; i < m_readers.size(); i++) {
-        if (m_readers[i]->isFinished()) {
-            // Trace file is empty
-            continue;
-        }
-        MessageShRef event(m_eventPrototype->New());
-        m_readers[i]->readTraceEvent(event);
-        m_events.insert(EventInfo(i, event));
+        m_heads[i] = takeEvent(i, idleTime);
     }
+    resumeIdleQueues();
+
+    // Merge tree is built when the first event is parsed, compare function
+    // may call a handler which is being constructed yet
 }
 
 void TraceFileParser::deinit() {
+    stopDecoders();
+
     // Close readers
     for (auto &reader : m_readers) {
-        reader->deinit();
+        if (reader) {
+            reader->deinit();
+        }
     }
     m_readers.clear();
-    m_events.clear();
+    m_files.clear();
+    m_readerSegments.clear();
+    m_listedSegments.clear();
+    m_closedSegments.clear();
+    m_heads.clear();
+    m_idleCount = 0;
+    m_lastEvent.reset();
+    m_lastEventKept = false;
+    m_mergeTree.clear();
+}
+
+void TraceFileParser::stopDecoders() {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_consumed.notify_all();
+
+    for (auto &decoder : m_decoders) {
+        if (decoder->thread.joinable()) {
+            decoder->thread.join();
+        }
+    }
+    m_decoders.clear();
+}
+
+void TraceFileParser::decodeQueue(uint32_t queue) {
+    auto &decoder = *m_decoders[queue];
+
+    try {
+        for (;;) {
+            // Take a batch consumed already, its messages are reused
+            EventBatch batch;
+            {
+                unique_lock<mutex> lock(m_mutex);
+                m_consumed.wait(lock, [this, &decoder]() {
+                    return m_stopping ||
+                           decoder.ready.size() < MAX_DECODED_BATCHES;
+                });
+                if (m_stopping) {
+                    break;
+                }
+                if (!decoder.free.empty()) {
+                    batch = move(decoder.free.back());
+                    decoder.free.pop_back();
+                }
+            }
+
+            if (!prepareReader(queue)) {
+                break;
+            }
+
+            // Decode events available at once, in follow mode the batch is
+            // handed over without waiting for more data
+            auto &reader = m_readers[queue];
+            size_t count = 0;
+            do {
+                if (count == batch.size()) {
+                    batch.emplace_back(m_eventPrototype->New());
+                }
+                reader->readTraceEvent(*batch[count++]);
+            } while (count < DECODE_BATCH_SIZE && reader->hasEvent());
+            batch.resize(count);
+
+            {
+                lock_guard<mutex> lock(m_mutex);
+                decoder.ready.push_back(move(batch));
+            }
+            m_decoded.notify_all();
+        }
+    } catch (Exception &e) {
+        lock_guard<mutex> lock(m_mutex);
+        decoder.error = e.getMessage();
+    } catch (std::exception &e) {
+        lock_guard<mutex> lock(m_mutex);
+        decoder.error = e.what();
+    }
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        decoder.finished = true;
+    }
+    m_decoded.notify_all();
+}
+
+google::protobuf::Message *TraceFileParser::takeEvent(
+        uint32_t queue,
+        chrono::steady_clock::time_point idleTime) {
+    auto &decoder = *m_decoders[queue];
+
+    if (decoder.idle) {
+        decoder.idle = false;
+        m_idleCount--;
+    }
+
+    if (decoder.next == decoder.current.size()) {
+        unique_lock<mutex> lock(m_mutex);
+
+        // Hand the batch consumed back to decoder
+        if (!decoder.current.empty()) {
+            decoder.free.push_back(move(decoder.current));
+            decoder.current.clear();
+            m_consumed.notify_all();
+        }
+        decoder.next = 0;
+
+        auto decoded = [&decoder]() {
+            return !decoder.ready.empty() || decoder.finished;
+        };
+        if (!m_follow) {
+            m_decoded.wait(lock, decoded);
+        } else if (!m_decoded.wait_until(lock, idleTime, decoded)) {
+            decoder.idle = true;
+            m_idleCount++;
+            return nullptr;
+        }
+        if (decoder.ready.empty()) {
+            if (!decoder.error.empty()) {
+                throw Exception(decoder.error);
+            }
+            return nullptr;
+        }
+
+        decoder.current = move(decoder.ready.front());
+        decoder.ready.pop_front();
+    }
+
+    return decoder.current[decoder.next++].get();
+}
+
+bool TraceFileParser::precedes(uint32_t a, uint32_t b) const {
+    if (!m_heads[a] || !m_heads[b]) {
+        return m_heads[a] != nullptr;
+    }
+
+    if (m_mergeCompare(m_heads[a], m_heads[b])) {
+        return true;
+    }
+    if (m_mergeCompare(m_heads[b], m_heads[a])) {
+        return false;
+    }
+
+    return a < b;
+}
+
+void TraceFileParser::buildMergeTree() {
+    uint32_t count = m_heads.size();
+    m_mergeTree.assign(count, 0);
+    if (count < 2) {
+        return;
+    }
+
+    // Play matches bottom-up, winners go up and losers stay in nodes
+    vector<uint32_t> winners(2 * count);
+    for (uint32_t i = 0; i < count; i++) {
+        winners[count + i] = i;
+    }
+    for (uint32_t node = count - 1; node > 0; node--) {
+        uint32_t left = winners[2 * node];
+        uint32_t right = winners[2 * node + 1];
+        if (precedes(left, right)) {
+            winners[node] = left;
+            m_mergeTree[node] = right;
+        } else {
+            winners[node] = right;
+            m_mergeTree[node] = left;
+        }
+    }
+    m_mergeTree[0] = winners[1];
+}
+
+void TraceFileParser::replayMergeTree(uint32_t queue) {
+    uint32_t winner = queue;
+    for (uint32_t node = (m_heads.size() + queue) / 2; node > 0; node /= 2) {
+        if (precedes(m_mergeTree[node], winner)) {
+            swap(m_mergeTree[node], winner);
+        }
+    }
+    m_mergeTree[0] = winner;
+}
+
+bool TraceFileParser::prepareReader(uint32_t queue) {
+    auto &reader = m_readers[queue];
+    auto &files = m_files[queue];
+
+    for (;;) {
+        if (m_stopping) {
+            return false;
+        }
+
+        if (reader) {
+            if (isFileComplete(queue)) {
+                reader->setComplete();
+            }
+
+            if (reader->hasEvent()) {
+                return true;
+            }
+        }
+
+        // Open the next file once the current one is read, skip a segment
+        // which has been removed before it was opened
+        if (!reader || reader->isFinished() || !reader->isOpen()) {
+            unique_lock<mutex> lock(m_filesMutex);
+            if (!files.empty()) {
+                TraceFile file = files.front();
+                files.pop_front();
+                lock.unlock();
+
+                if (reader) {
+                    reader->deinit();
+                }
+                reader.reset(new TraceFileReader(file.path, queue, m_follow));
+                m_readerSegments[queue] = file.segment;
+                reader->init();
+                continue;
+            }
+
+            if (m_complete) {
+                return false;
+            }
+        }
+
+        followTrace(queue);
+    }
+}
+
+bool TraceFileParser::readSummary(proto::TraceSummary &summary) const {
+    ProtobufReaderWriter rw(m_traceLocation + "/" + SUMMARY_FILE_NAME);
+
+    try {
+        return rw.read(summary);
+    } catch (Exception &) {
+        // Summary of trace being captured may be rewritten while reading
+        if (!m_follow) {
+            throw;
+        }
+        return false;
+    }
+}
+
+void TraceFileParser::updateFiles(const proto::TraceSummary &summary) {
+    m_complete = summary.state() == proto::TraceState::COMPLETE;
+
+    if (!m_segmented) {
+        return;
+    }
+
+    // Summary lists segments which are kept, in order of their indexes.
+    // Segments of trace being captured are listed once they have events, and
+    // get their size set once closed.
+    for (const auto &segment : summary.segments()) {
+        if (segment.queue() >= m_files.size()) {
+            throw Exception("Trace summary contains invalid values.");
+        }
+
+        uint32_t queue = segment.queue();
+        if (segment.index() >= m_listedSegments[queue]) {
+            string path = m_traceLocation + "/" + TRACE_FILE_PREFIX +
+                          to_string(queue) + "." + to_string(segment.index());
+            m_files[queue].emplace_back(path, segment.index());
+            m_listedSegments[queue] = segment.index() + 1;
+        }
+
+        if (segment.size()) {
+            m_closedSegments[queue] =
+                    max(m_closedSegments[queue], segment.index() + 1);
+        }
+    }
+}
+
+bool TraceFileParser::isFileComplete(uint32_t queue) const {
+    lock_guard<mutex> lock(m_filesMutex);
+
+    if (m_complete) {
+        return true;
+    }
+
+    return m_segmented && m_readerSegments[queue] < m_closedSegments[queue];
+}
+
+void TraceFileParser::followTrace(uint32_t queue) {
+    this_thread::sleep_for(FOLLOW_PERIOD);
+
+    proto::TraceSummary summary;
+    if (readSummary(summary)) {
+        if (summary.state() == proto::TraceState::ERROR) {
+            throw Exception("Capturing of followed trace has failed.");
+        }
+
+        lock_guard<mutex> lock(m_filesMutex);
+        updateFiles(summary);
+    }
+
+    if (m_readers[queue]) {
+        m_readers[queue]->refresh();
+    }
 }
 
 void TraceFileParser::parseTraceEvent(google::protobuf::Message *traceEvent) {
-    if (m_events.empty()) {
+    if (isFinished()) {
         throw Exception(
                 "Attempted to parse event using parser"
                 " which has finished or wasn't initialized");
     }
 
-    // Copy 'smallest' event
-    // [TODO] (trybicki) C++17 feature: std::extract to avoid copy
-    const EventInfo smallestEvent = *m_events.begin();
+    if (m_mergeTree.empty()) {
+        buildMergeTree();
+    }
 
-    // Copy values from smallest event to out parameter
-    traceEvent->CopyFrom(*smallestEvent.event);
+    // Hand the 'smallest' event over by swapping messages, the previous
+    // content of out parameter goes back to decoder with the message
+    uint32_t queue = m_mergeTree[0];
+    auto event = m_heads[queue];
+    event->GetReflection()->Swap(event, traceEvent);
 
-    // Erase smallest event from set
-    m_events.erase(m_events.begin());
+    // Take the next event of queue, and find the 'smallest' one again
+    chrono::steady_clock::time_point idleTime;
+    if (m_follow) {
+        idleTime = chrono::steady_clock::now() + FOLLOW_IDLE_TIME;
+    }
+    m_heads[queue] = takeEvent(queue, idleTime);
+    replayMergeTree(queue);
 
-    if (!m_readers[smallestEvent.queue]->isFinished()) {
-        // Get next event into the set
-        m_readers[smallestEvent.queue]->readTraceEvent(smallestEvent.event);
+    // Idle queue resumed later is checked against the last parsed event
+    m_lastEventKept = m_idleCount != 0;
+    if (m_lastEventKept) {
+        m_lastEvent->CopyFrom(*traceEvent);
+    }
+    resumeIdleQueues();
 
-        // Insert new event and rebalance set
-        m_events.insert(move(smallestEvent));
+    if (m_renumberSids) {
+        static_cast<proto::trace::Event *>(traceEvent)
+                ->mutable_header()
+                ->set_sid(++m_sid);
     }
 }
 
-bool TraceFileParser::isFinished() const {
-    for (const auto &reader : m_readers) {
-        if (!reader->isFinished()) {
-            return false;
+void TraceFileParser::resumeIdleQueues() {
+    if (!m_idleCount) {
+        return;
+    }
+
+    auto now = chrono::steady_clock::now();
+    if (hasNextEvent() && now < m_idleCheckTime) {
+        return;
+    }
+
+    for (;;) {
+        bool resumed = false;
+        for (uint32_t queue = 0; queue < m_decoders.size(); queue++) {
+            if (m_decoders[queue]->idle) {
+                m_heads[queue] = takeEvent(queue, now);
+                resumed |= !m_decoders[queue]->idle;
+
+                if (m_heads[queue] && m_lastEventKept &&
+                    m_mergeCompare(m_heads[queue], m_lastEvent.get())) {
+                    throw Exception("Events of idle queue " +
+                                    to_string(queue) +
+                                    " resumed out of order");
+                }
+            }
         }
+
+        // Queue which joins the merge doesn't replace the winner, the whole
+        // tree is played again
+        if (resumed && !m_mergeTree.empty()) {
+            buildMergeTree();
+        }
+
+        if (!m_idleCount || hasNextEvent()) {
+            break;
+        }
+
+        // Other queues are finished, wait for data of idle ones
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_decoded.wait_for(lock, FOLLOW_PERIOD);
+        }
+        now = chrono::steady_clock::now();
     }
-    // All readers have finished, but there still may be some events in set
-    if (m_events.empty()) {
-        return true;
-    } else {
-        return false;
+
+    m_idleCheckTime = now + FOLLOW_PERIOD;
+}
+
+bool TraceFileParser::hasNextEvent() const {
+    if (m_mergeTree.empty()) {
+        return std::any_of(m_heads.begin(), m_heads.end(),
+                           [](google::protobuf::Message *head) {
+                               return head != nullptr;
+                           });
     }
+
+    // Finished queues lose all matches, so the winner has no event only if
+    // none of queues has
+    return m_heads[m_mergeTree[0]] != nullptr;
+}
+
+bool TraceFileParser::isFinished() const {
+    // Parsing waits for idle queues when there is no other event, so no
+    // event is left only when all queues are finished
+    return !hasNextEvent();
 }
 
 }  // namespace octf
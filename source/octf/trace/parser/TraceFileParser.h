@@ -6,11 +6,18 @@
 #ifndef SOURCE_OCTF_TRACE_PARSER_TRACEFILEPARSER_H
 #define SOURCE_OCTF_TRACE_PARSER_TRACEFILEPARSER_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
 #include <functional>
 #include <memory>
-#include <set>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
+#include <octf/proto/traceDefinitions.pb.h>
 #include <octf/trace/parser/ITraceParser.h>
 
 namespace octf {
@@ -22,7 +29,34 @@ class TraceFileReader;
  *
  * This class assigns a TraceFileReader object for each trace file
  * to handle reading logic. Then it chooses from which Reader to read
- * next based on the supplied compare function.
+ * next based on the supplied compare function. If trace file of queue is
+ * split into segments, they are read one after another.
+ *
+ * If sequence IDs of trace events were assigned per queue, events are merged
+ * in order of their timestamps instead, and sequence IDs are assigned anew in
+ * that order.
+ *
+ * Trace files are decoded in parallel, each queue by its own decoder thread,
+ * which reads ahead into a bounded number of batches of decoded events. The
+ * merge takes decoded events only, so parsing throughput scales with the
+ * number of queues. Batches consumed are handed back to the decoder, which
+ * reuses their messages.
+ *
+ * Queues are merged by a loser tree, which takes log2 of number of queues
+ * comparisons per event, and events are handed over by swapping messages,
+ * so merging doesn't allocate memory.
+ *
+ * In follow mode the trace may be still being captured. Trace files are read
+ * as they grow, and new segments are opened once they're listed in the trace
+ * summary, until the trace is complete. Events are returned in the same order
+ * as when the complete trace is parsed, so the next event is returned once
+ * each of queues has an event written, or has been finished. A queue which
+ * has no event written for a while is left out of the merge until it has
+ * one, so that an idle queue holds parsing back for a bounded time only.
+ * If such a queue resumes with an event preceding ones returned already,
+ * parsing fails rather than returning events out of order. Parsing
+ * of an event takes the next one, so it waits until another event is written
+ * or the trace is complete.
  */
 class TraceFileParser : public ITraceParser {
 public:
@@ -39,10 +73,12 @@ public:
      * @param compareFn Pointer to function used to compare events.
      * Comparing events determines which events are returned first by parser.
      * 'Smaller' events are returned first.
+     * @param follow Follow trace being captured until it's complete
      */
     TraceFileParser(const std::string &tracePath,
                     MessageShRef eventPrototype,
-                    CompareFn compareFn);
+                    CompareFn compareFn,
+                    bool follow = false);
 
     void init() override;
 
@@ -54,28 +90,177 @@ public:
 
 private:
     /**
-     * @brief Set element containing pointer to event and its associated queue
+     * @brief Events decoded at once by decoder of queue
      */
-    struct EventInfo {
-        EventInfo(uint32_t queue, MessageShRef event)
-                : queue(queue)
-                , event(event) {}
-        uint32_t queue;
-        MessageShRef event;
+    typedef std::vector<std::unique_ptr<google::protobuf::Message>>
+            EventBatch;
+
+    /**
+     * @brief Decoder of events of one queue
+     */
+    struct QueueDecoder {
+        QueueDecoder()
+                : ready()
+                , free()
+                , finished(false)
+                , error()
+                , current()
+                , next(0)
+                , idle(false)
+                , thread() {}
+
+        /**
+         * @brief Batches of decoded events in their order, guarded by
+         * m_mutex
+         */
+        std::deque<EventBatch> ready;
+
+        /**
+         * @brief Batches consumed, to be reused by decoder, guarded by
+         * m_mutex
+         */
+        std::vector<EventBatch> free;
+
+        /**
+         * @brief Set once decoder has stopped, guarded by m_mutex
+         */
+        bool finished;
+
+        /**
+         * @brief Error which stopped decoder, guarded by m_mutex
+         */
+        std::string error;
+
+        /**
+         * @brief Batch being merged, used by parsing thread only
+         */
+        EventBatch current;
+
+        /**
+         * @brief Index of the next event of current batch
+         */
+        size_t next;
+
+        /**
+         * @brief Set if queue is left out of the merge, because it had no
+         * event written for a while, used by parsing thread only
+         */
+        bool idle;
+
+        std::thread thread;
     };
 
     /**
-     * @brief Adapter needed to allow using m_compare to sort m_events elements
+     * @brief Decoder thread routine, decodes events of given queue
+     */
+    void decodeQueue(uint32_t queue);
+
+    /**
+     * @brief Takes the next decoded event of given queue, waits for decoder
+     * if needed
+     *
+     * @param queue Queue
+     * @param idleTime In follow mode, time after which queue is considered
+     * idle, if it has no event
+     *
+     * @return Decoded event, owned by decoder until the next event of the
+     * queue is taken, nullptr if all events of the queue have been taken, or
+     * queue is idle
+     */
+    google::protobuf::Message *takeEvent(
+            uint32_t queue,
+            std::chrono::steady_clock::time_point idleTime);
+
+    /**
+     * @brief Takes events of idle queues which have one, so that they join
+     * the merge again (follow mode only)
+     *
+     * Idle queues are checked periodically, or once the other queues are
+     * finished. In the latter case it waits until an event is written, or
+     * idle queues are finished.
+     *
+     * @throws Exception if resumed queue has an event preceding the last
+     * parsed one
+     */
+    void resumeIdleQueues();
+
+    /**
+     * @brief Checks if any queue has the next event to be parsed
+     */
+    bool hasNextEvent() const;
+
+    /**
+     * @brief Checks if the next event of queue a precedes the one of queue b
+     *
+     * Finished queues follow all the other ones, events which compare equal
+     * are ordered by their queues.
+     */
+    bool precedes(uint32_t a, uint32_t b) const;
+
+    /**
+     * @brief Builds loser tree of all queues, once the first event is
+     * parsed
+     */
+    void buildMergeTree();
+
+    /**
+     * @brief Replays matches of given queue up to the root of loser tree,
+     * once its next event is taken
+     */
+    void replayMergeTree(uint32_t queue);
+
+    /**
+     * @brief Stops decoder threads
+     */
+    void stopDecoders();
+
+    /**
+     * @brief Makes sure that reader of given queue has an event to read,
+     * opening next segment of trace file if needed
+     *
+     * In follow mode waits until an event is written, or the queue is
+     * finished.
+     *
+     * @retval true Reader has an event to read
+     * @retval false All files of the queue have been read, or parsing is
+     * stopped
+     */
+    bool prepareReader(uint32_t queue);
+
+    /**
+     * @brief Reads trace summary
+     *
+     * @retval true Summary read
+     * @retval false Summary not found, or it's being written
+     */
+    bool readSummary(proto::TraceSummary &summary) const;
+
+    /**
+     * @brief Updates state of trace and lists of files to read according to
+     * trace summary, called under m_filesMutex
+     */
+    void updateFiles(const proto::TraceSummary &summary);
+
+    /**
+     * @brief Checks if the current file of given queue isn't written anymore
      */
-    struct Comparator {
-        Comparator(CompareFn compareFn)
-                : m_compare(compareFn){};
+    bool isFileComplete(uint32_t queue) const;
 
-        bool operator()(const EventInfo &left, const EventInfo &right) const {
-            return m_compare(left.event.get(), right.event.get());
-        }
+    /**
+     * @brief Waits for trace being followed to grow, and refreshes reader of
+     * given queue
+     */
+    void followTrace(uint32_t queue);
 
-        CompareFn m_compare;
+    /**
+     * @brief Trace file to be read
+     */
+    struct TraceFile {
+        TraceFile(const std::string &path, uint32_t segment)
+                : path(path)
+                , segment(segment) {}
+        std::string path;
+        uint32_t segment;
     };
 
     /**
@@ -83,6 +268,11 @@ private:
      */
     std::string m_tracePath;
 
+    /**
+     * @brief Absolute path to trace directory
+     */
+    std::string m_traceLocation;
+
     /**
      * @brief Function used to compare trace events from multiple queues to
      * determine returned events order.
@@ -95,19 +285,126 @@ private:
     std::vector<std::unique_ptr<TraceFileReader>> m_readers;
 
     /**
-     * @brief Set containing next event from each not finished reader
-     *
-     * We utilize set's internal ordering to sort it's elements using a custom
-     * comparator. This way set's first element is always
-     * the 'smallest'. However upon changing set's element's value we need to
-     * reinsert it so that the set remains ordered.
+     * @brief Files of each queue not opened yet, guarded by m_filesMutex
      */
-    std::set<EventInfo, Comparator> m_events;
+    std::vector<std::deque<TraceFile>> m_files;
+
+    /**
+     * @brief Set if trace files are split into segments
+     */
+    bool m_segmented;
+
+    /**
+     * @brief Index of segment read by reader of each queue
+     */
+    std::vector<uint32_t> m_readerSegments;
+
+    /**
+     * @brief Index of the next segment to be listed, for each queue, guarded
+     * by m_filesMutex
+     */
+    std::vector<uint32_t> m_listedSegments;
+
+    /**
+     * @brief Number of segments closed (the first ones), for each queue,
+     * guarded by m_filesMutex
+     */
+    std::vector<uint32_t> m_closedSegments;
+
+    /**
+     * @brief Set if trace being captured is followed
+     */
+    bool m_follow;
+
+    /**
+     * @brief Set once trace is complete, guarded by m_filesMutex
+     */
+    bool m_complete;
+
+    /**
+     * @brief Mutex for trace state and lists of files, which are updated by
+     * decoders of all queues when following trace
+     */
+    mutable std::mutex m_filesMutex;
+
+    /**
+     * @brief Decoder of each queue
+     */
+    std::vector<std::unique_ptr<QueueDecoder>> m_decoders;
+
+    /**
+     * @brief Mutex for batches of events exchanged with decoders
+     */
+    std::mutex m_mutex;
+
+    /**
+     * @brief Notified when decoder has decoded a batch or stopped
+     */
+    std::condition_variable m_decoded;
+
+    /**
+     * @brief Notified when batch has been consumed or decoders are stopped
+     */
+    std::condition_variable m_consumed;
+
+    /**
+     * @brief Set when decoders are requested to stop
+     */
+    std::atomic<bool> m_stopping;
+
+    /**
+     * @brief Function ordering events when merging queues
+     */
+    CompareFn m_mergeCompare;
+
+    /**
+     * @brief Next event of each queue, nullptr if queue is finished
+     */
+    std::vector<google::protobuf::Message *> m_heads;
+
+    /**
+     * @brief Number of idle queues, see QueueDecoder::idle
+     */
+    uint32_t m_idleCount;
+
+    /**
+     * @brief Time at which idle queues are checked the next time
+     */
+    std::chrono::steady_clock::time_point m_idleCheckTime;
+
+    /**
+     * @brief Copy of the last parsed event, kept while any queue is idle, so
+     * that a queue resumed with an event preceding it is detected
+     */
+    std::unique_ptr<google::protobuf::Message> m_lastEvent;
+
+    /**
+     * @brief Set if m_lastEvent holds the last parsed event
+     */
+    bool m_lastEventKept;
+
+    /**
+     * @brief Loser tree of queues, the first element is the queue of the
+     * next event, and each inner node (1 to number of queues - 1) keeps the
+     * queue which lost the match played in it. Queue i is leaf at number of
+     * queues + i.
+     */
+    std::vector<uint32_t> m_mergeTree;
 
     /**
      * @brief Message prototype for event
      */
     MessageShRef m_eventPrototype;
+
+    /**
+     * @brief Set if sequence IDs of parsed events are assigned anew
+     */
+    bool m_renumberSids;
+
+    /**
+     * @brief Sequence ID of the last parsed event, when assigned anew
+     */
+    uint64_t m_sid;
 };
 
 }  // namespace octf
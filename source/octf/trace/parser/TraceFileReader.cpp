@@ -4,16 +4,23 @@
  */
 #include <octf/trace/parser/TraceFileReader.h>
 
+#include <errno.h>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <zlib.h>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <octf/interface/TraceConverter.h>
 #include <octf/interface/TraceManager.h>
+#include <octf/trace/compressed_trace_file.h>
+#include <octf/trace/iotrace_event.h>
 #include <octf/trace/parser/TraceFileParser.h>
+#include <octf/trace/raw_trace_file.h>
 #include <octf/utils/Exception.h>
 #include <octf/utils/FrameworkConfiguration.h>
 #include <octf/utils/ProtoConverter.h>
@@ -24,53 +31,276 @@ TraceFileReader::~TraceFileReader() {
     deinit();
 }
 
-TraceFileReader::TraceFileReader(const std::string &filePath, uint32_t queue)
+TraceFileReader::TraceFileReader(const std::string &filePath,
+                                 uint32_t queue,
+                                 bool follow)
         : m_fd(-1)
         , m_size()
         , m_fileSize()
+        , m_mapping(nullptr)
         , m_addr(nullptr)
+        , m_frameAddr(nullptr)
+        , m_framesSize(0)
+        , m_compressed(false)
+        , m_block()
+        , m_converter()
+        , m_recordAlignment(0)
         , m_tracePath(filePath)
         , m_error(false)
-        , m_queue(queue) {}
+        , m_queue(queue)
+        , m_follow(follow)
+        , m_complete(!follow)
+        , m_compressionDetected(false)
+        , m_formatDetected(false) {}
 
 void TraceFileReader::init() {
     if (m_fd < 0) {
-        struct stat fileStats;
         int flags = O_RDONLY;
-        int proto = PROT_READ;
 
         m_fd = open(m_tracePath.c_str(), flags,
                     S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
         if (m_fd < 0) {
+            if (!m_complete && ENOENT == errno) {
+                // File is not created yet
+                return;
+            }
             throw Exception("Could not open trace file." + m_tracePath);
         }
 
-        if (fstat(m_fd, &fileStats)) {
-            close(m_fd);
-            throw Exception("Could not get trace file status." + m_tracePath);
+        try {
+            map();
+        } catch (Exception &) {
+            deinit();
+            throw;
         }
 
-        m_fileSize = m_size = fileStats.st_size;
-        if (!m_size) {
-            // Empty trace
-            return;
+        detectFormat();
+    }
+}
+
+void TraceFileReader::map() {
+    struct stat fileStats;
+    if (fstat(m_fd, &fileStats)) {
+        throw Exception("Could not get trace file status." + m_tracePath);
+    }
+
+    off_t fileSize = fileStats.st_size;
+    if (fileSize <= m_fileSize) {
+        // Nothing appended
+        return;
+    }
+
+    uint8_t *mapping = (uint8_t *) mmap(NULL, fileSize, PROT_READ, MAP_SHARED,
+                                        m_fd, 0);
+    if (MAP_FAILED == mapping) {
+        throw Exception("Could not map trace file.");
+    }
+
+    // Data not read yet is moved to the new mapping, unless it has been
+    // decompressed already
+    off_t appended = fileSize - m_fileSize;
+    if (m_compressed) {
+        m_frameAddr = mapping + (m_frameAddr - m_mapping);
+        m_framesSize += appended;
+    } else {
+        m_addr = mapping + (m_mapping ? m_addr - m_mapping : 0);
+        m_size += appended;
+    }
+
+    if (m_mapping) {
+        munmap(m_mapping, m_fileSize);
+    }
+    m_mapping = mapping;
+    m_fileSize = fileSize;
+}
+
+bool TraceFileReader::detectFormat() {
+    if (m_formatDetected) {
+        return true;
+    }
+
+    // Headers of file being written are recognized once they're written
+    if (!m_compressionDetected) {
+        if (!m_complete &&
+            static_cast<size_t>(m_size) <
+                    sizeof(struct octf_compressed_trace_file_hdr)) {
+            return false;
         }
 
-        m_addr = (uint8_t *) mmap(NULL, m_size, proto, MAP_SHARED, m_fd, 0);
-        if (MAP_FAILED == m_addr) {
-            m_addr = NULL;
-            close(m_fd);
-            throw Exception("Could not map trace file.");
+        initCompression();
+        m_compressionDetected = true;
+    }
+
+    if (!m_complete &&
+        !ensureAvailable(sizeof(struct octf_raw_trace_file_hdr))) {
+        return false;
+    }
+
+    initRawFormat();
+    m_formatDetected = true;
+
+    return true;
+}
+
+void TraceFileReader::initCompression() {
+    uint64_t magic = 0;
+    if (static_cast<size_t>(m_size) < sizeof(magic)) {
+        return;
+    }
+
+    memcpy(&magic, m_addr, sizeof(magic));
+    if (OCTF_COMPRESSED_TRACE_MAGIC != magic) {
+        return;
+    }
+
+    struct octf_compressed_trace_file_hdr hdr;
+    if (static_cast<size_t>(m_size) < sizeof(hdr)) {
+        deinit();
+        throw Exception("Invalid header of compressed trace file " +
+                        m_tracePath);
+    }
+    memcpy(&hdr, m_addr, sizeof(hdr));
+
+    if (hdr.version != OCTF_COMPRESSED_TRACE_VERSION ||
+        hdr.hdr_size < sizeof(hdr) || hdr.hdr_size > m_size ||
+        hdr.compression != octf_compression_deflate) {
+        deinit();
+        throw Exception("Unsupported compressed trace file " + m_tracePath);
+    }
+
+    // Frames are decompressed when their data is read
+    m_compressed = true;
+    m_frameAddr = m_addr + hdr.hdr_size;
+    m_framesSize = m_size - hdr.hdr_size;
+    m_addr = nullptr;
+    m_size = 0;
+}
+
+bool TraceFileReader::ensureAvailable(size_t size) {
+    while (static_cast<size_t>(m_size) < size && m_framesSize) {
+        if (!m_complete && !isFrameAvailable()) {
+            // Frame is being written
+            break;
         }
+        readFrame();
+    }
+
+    return static_cast<size_t>(m_size) >= size;
+}
+
+bool TraceFileReader::isFrameAvailable() const {
+    struct octf_compressed_trace_frame_hdr hdr;
+    if (static_cast<size_t>(m_framesSize) < sizeof(hdr)) {
+        return false;
+    }
+    memcpy(&hdr, m_frameAddr, sizeof(hdr));
+
+    return hdr.compressed_size <= m_framesSize - sizeof(hdr);
+}
+
+void TraceFileReader::readFrame() {
+    struct octf_compressed_trace_frame_hdr hdr;
+    if (static_cast<size_t>(m_framesSize) < sizeof(hdr)) {
+        m_error = true;
+        throw Exception("Couldn't parse frame of compressed trace file");
+    }
+    memcpy(&hdr, m_frameAddr, sizeof(hdr));
+
+    if (hdr.compressed_size > m_framesSize - sizeof(hdr)) {
+        m_error = true;
+        throw Exception("Couldn't parse frame of compressed trace file");
+    }
+
+    // Keep data not read yet, an event may span frames
+    size_t left = m_size;
+    if (left) {
+        memmove(m_block.data(), m_addr, left);
+    }
+    m_block.resize(left + hdr.size);
+
+    uint8_t *src = m_frameAddr + sizeof(hdr);
+    uint8_t *dst = m_block.data() + left;
+    if (hdr.flags & octf_compressed_trace_frame_stored) {
+        if (hdr.compressed_size != hdr.size) {
+            m_error = true;
+            throw Exception("Couldn't parse frame of compressed trace file");
+        }
+        memcpy(dst, src, hdr.size);
+    } else {
+        uLongf size = hdr.size;
+        int result = uncompress(dst, &size, src, hdr.compressed_size);
+        if (Z_OK != result || size != hdr.size) {
+            m_error = true;
+            throw Exception("Couldn't decompress frame of trace file");
+        }
+    }
+
+    if (crc32(0, dst, hdr.size) != hdr.checksum) {
+        m_error = true;
+        throw Exception("Corrupted frame of compressed trace file " +
+                        m_tracePath);
+    }
+
+    m_frameAddr += sizeof(hdr) + hdr.compressed_size;
+    m_framesSize -= sizeof(hdr) + hdr.compressed_size;
+    m_addr = m_block.data();
+    m_size = left + hdr.size;
+}
+
+void TraceFileReader::initRawFormat() {
+    uint64_t magic = 0;
+    if (!ensureAvailable(sizeof(magic))) {
+        return;
+    }
+
+    memcpy(&magic, m_addr, sizeof(magic));
+    if (OCTF_RAW_TRACE_MAGIC != magic) {
+        // Events serialized to protocol buffers
+        return;
     }
+
+    struct octf_raw_trace_file_hdr hdr;
+    if (!ensureAvailable(sizeof(hdr))) {
+        deinit();
+        throw Exception("Invalid header of raw trace file " + m_tracePath);
+    }
+    memcpy(&hdr, m_addr, sizeof(hdr));
+
+    if (hdr.version != OCTF_RAW_TRACE_VERSION ||
+        hdr.hdr_size < sizeof(hdr) || !ensureAvailable(hdr.hdr_size) ||
+        !hdr.record_alignment) {
+        deinit();
+        throw Exception("Unsupported raw trace file " + m_tracePath);
+    }
+
+    if (hdr.event_version_major != IOTRACE_EVENT_VERSION_MAJOR) {
+        deinit();
+        throw Exception("Unsupported version of trace events, file " +
+                        m_tracePath);
+    }
+
+    m_converter.reset(new TraceConverter());
+    m_recordAlignment = hdr.record_alignment;
+    m_addr += hdr.hdr_size;
+    m_size -= hdr.hdr_size;
 }
 
 void TraceFileReader::deinit() {
     if (m_fd >= 0) {
-        if (m_addr && MAP_FAILED != m_addr) {
-            munmap(m_addr, m_fileSize);
-            m_addr = nullptr;
+        if (m_mapping) {
+            munmap(m_mapping, m_fileSize);
+            m_mapping = nullptr;
         }
+        m_fileSize = 0;
+        m_addr = nullptr;
+        m_size = 0;
+        m_frameAddr = nullptr;
+        m_framesSize = 0;
+        m_compressed = false;
+        m_block.clear();
+        m_converter.reset();
+        m_compressionDetected = false;
+        m_formatDetected = false;
         close(m_fd);
         m_fd = -1;
     }
@@ -90,7 +320,13 @@ void TraceFileReader::readTraceEvent(google::protobuf::Message &traceEvent) {
         throw Exception("Attempted to read from fully parsed file");
     }
 
+    if (m_converter) {
+        readRawTraceEvent(traceEvent);
+        return;
+    }
+
     // Decode length of trace event
+    ensureAvailable(protoconverter::MAX_VARINT32_BYTES);
     int messageLength = 0;
     int bytesRead =
             protoconverter::decodeVarint32(m_addr, m_size, messageLength);
@@ -102,7 +338,7 @@ void TraceFileReader::readTraceEvent(google::protobuf::Message &traceEvent) {
     m_size -= bytesRead;
 
     // Parse trace event
-    if (messageLength > m_size || messageLength < 0 ||
+    if (messageLength < 0 || !ensureAvailable(messageLength) ||
         false == traceEvent.ParseFromArray(m_addr, messageLength)) {
         m_error = true;
         throw Exception("Couldn't parse valid trace event");
@@ -111,13 +347,119 @@ void TraceFileReader::readTraceEvent(google::protobuf::Message &traceEvent) {
     m_size -= messageLength;
 }
 
+void TraceFileReader::readRawTraceEvent(google::protobuf::Message &traceEvent) {
+    struct octf_raw_trace_record_hdr record;
+    if (!ensureAvailable(sizeof(record))) {
+        m_error = true;
+        throw Exception("Couldn't parse size of trace event");
+    }
+    memcpy(&record, m_addr, sizeof(record));
+
+    uint64_t recordSize = getRecordSize(record);
+    if (!ensureAvailable(recordSize)) {
+        m_error = true;
+        throw Exception("Couldn't parse valid trace event");
+    }
+
+    auto message = m_converter->convertTrace(m_addr + sizeof(record),
+                                             record.size);
+    if (!message || message->GetDescriptor() != traceEvent.GetDescriptor()) {
+        m_error = true;
+        throw Exception("Couldn't convert valid trace event");
+    }
+    traceEvent.CopyFrom(*message);
+
+    m_addr += recordSize;
+    m_size -= recordSize;
+}
+
+uint64_t TraceFileReader::getRecordSize(
+        const struct octf_raw_trace_record_hdr &record) const {
+    uint64_t recordSize = sizeof(record) + record.size;
+    recordSize += (m_recordAlignment - recordSize % m_recordAlignment) %
+                  m_recordAlignment;
+
+    return recordSize;
+}
+
 bool TraceFileReader::isFinished() const {
-    if (m_size) {
+    if (!m_complete) {
+        // More data may be written
+        return false;
+    }
+
+    if (m_size || m_framesSize) {
         return false;
     }
     return true;
 }
 
+bool TraceFileReader::hasEvent() {
+    if (m_error) {
+        throw Exception("Attempted to read from parser which had failed");
+    }
+
+    if (m_complete) {
+        return !isFinished();
+    }
+
+    if (m_fd < 0 || !detectFormat()) {
+        return false;
+    }
+
+    if (m_converter) {
+        struct octf_raw_trace_record_hdr record;
+        if (!ensureAvailable(sizeof(record))) {
+            return false;
+        }
+        memcpy(&record, m_addr, sizeof(record));
+
+        return ensureAvailable(getRecordSize(record));
+    }
+
+    ensureAvailable(protoconverter::MAX_VARINT32_BYTES);
+    int messageLength = 0;
+    int bytesRead =
+            protoconverter::decodeVarint32(m_addr, m_size, messageLength);
+    if (bytesRead <= 0) {
+        // Size of event is being written, unless it's invalid, then reading
+        // the event reports the error
+        return m_size >= protoconverter::MAX_VARINT32_BYTES;
+    }
+
+    return messageLength < 0 || ensureAvailable(bytesRead + messageLength);
+}
+
+void TraceFileReader::refresh() {
+    if (m_complete) {
+        return;
+    }
+
+    if (m_fd < 0) {
+        init();
+    } else {
+        map();
+    }
+}
+
+void TraceFileReader::setComplete() {
+    if (m_complete) {
+        return;
+    }
+
+    refresh();
+    m_complete = true;
+
+    if (m_fd < 0) {
+        throw Exception("Could not open trace file." + m_tracePath);
+    }
+    detectFormat();
+}
+
+bool TraceFileReader::isOpen() const {
+    return m_fd >= 0;
+}
+
 uint32_t TraceFileReader::getQueue() const {
     return m_queue;
 }
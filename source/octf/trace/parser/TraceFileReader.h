@@ -7,21 +7,39 @@
 #define SOURCE_OCTF_TRACE_PARSER_TRACEFILEREADER_H
 
 #include <fstream>
+#include <memory>
 #include <string>
+#include <vector>
+#include <octf/interface/ITraceConverter.h>
 #include <octf/trace/parser/TraceFileParser.h>
+#include <octf/trace/raw_trace_file.h>
 
 namespace octf {
 
 /**
  * @brief Helper class responsible for reading from one physical trace file
+ *
+ * File may keep events serialized to Google Protocol Buffers, or events in
+ * their native format (see octf/trace/raw_trace_file.h). The latter is
+ * recognized by its header, and the events are converted when read. Either of
+ * them may be compressed (see octf/trace/compressed_trace_file.h), frames of
+ * compressed file are decompressed one by one while reading.
+ *
+ * In follow mode the file may be still being written. Data appended to it is
+ * mapped on refresh, and an event (or frame) written partially is read once
+ * it's complete. The file is read to its end once it's marked complete.
  */
 class TraceFileReader {
 public:
     virtual ~TraceFileReader();
     /**
      * @param filePath Path to file with traces
+     * @param queue Queue id associated with this reader
+     * @param follow Follow file being written
      */
-    TraceFileReader(const std::string &filePath, uint32_t queue);
+    TraceFileReader(const std::string &filePath,
+                    uint32_t queue,
+                    bool follow = false);
 
     /**
      * @brief Opens file with trace events for reading.
@@ -52,12 +70,91 @@ public:
      */
     bool isFinished() const;
 
+    /**
+     * @brief Checks if the next event is available for reading
+     *
+     * In follow mode an event which isn't written entirely is not available.
+     */
+    bool hasEvent();
+
+    /**
+     * @brief Maps data appended to the file since the last refresh, opening
+     * the file if it hasn't existed before (follow mode only)
+     */
+    void refresh();
+
+    /**
+     * @brief Marks that the file isn't written anymore, and maps all its data
+     */
+    void setComplete();
+
+    /**
+     * @return Is file opened
+     */
+    bool isOpen() const;
+
     /**
      * @return Queue id associated with this reader
      */
     uint32_t getQueue() const;
 
 private:
+    /**
+     * @brief Maps the whole file, keeping position of data not read yet
+     */
+    void map();
+
+    /**
+     * @brief Recognizes format of file once its headers are written
+     *
+     * @retval true Format recognized
+     * @retval false Headers not written yet
+     */
+    bool detectFormat();
+
+    /**
+     * @brief Checks if file is compressed and if so, validates its header and
+     * skips it
+     */
+    void initCompression();
+
+    /**
+     * @brief Makes sure that data of given size is available for reading,
+     * decompressing subsequent frames if needed
+     *
+     * @retval true Data of given size available
+     * @retval false Less data left in the file
+     */
+    bool ensureAvailable(size_t size);
+
+    /**
+     * @brief Checks if the next frame of compressed file is written entirely
+     */
+    bool isFrameAvailable() const;
+
+    /**
+     * @brief Decompresses next frame, appending its data to data not read yet
+     */
+    void readFrame();
+
+    /**
+     * @brief Checks if file keeps events in native format and if so,
+     * validates its header and skips it
+     */
+    void initRawFormat();
+
+    /**
+     * @brief Reads event in native format and converts it into message
+     */
+    void readRawTraceEvent(google::protobuf::Message &traceEvent);
+
+    /**
+     * @brief Returns size of record of event in native format, including
+     * its header and alignment
+     */
+    uint64_t getRecordSize(
+            const struct octf_raw_trace_record_hdr &record) const;
+
     /**
      * @brief Input file descriptor
      */
@@ -76,8 +173,44 @@ private:
     /**
      * @brief Address of the mapped input file
      */
+    uint8_t *m_mapping;
+
+    /**
+     * @brief Address of the next event within mapped input file
+     */
     uint8_t *m_addr;
 
+    /**
+     * @brief Address of the next frame of compressed file
+     */
+    uint8_t *m_frameAddr;
+
+    /**
+     * @brief Size of frames of compressed file left to read
+     */
+    off_t m_framesSize;
+
+    /**
+     * @brief Set if file is compressed
+     */
+    bool m_compressed;
+
+    /**
+     * @brief Data decompressed from frames of compressed file
+     */
+    std::vector<uint8_t> m_block;
+
+    /**
+     * @brief Converter of events in native format, set if file keeps such
+     * events
+     */
+    std::unique_ptr<ITraceConverter> m_converter;
+
+    /**
+     * @brief Alignment of events in native format
+     */
+    uint32_t m_recordAlignment;
+
     /**
      * @brief Path to file
      */
@@ -92,6 +225,26 @@ private:
      * @brief Queue number
      */
     uint32_t m_queue;
+
+    /**
+     * @brief Set if file being written is followed
+     */
+    bool m_follow;
+
+    /**
+     * @brief Set if file isn't written anymore
+     */
+    bool m_complete;
+
+    /**
+     * @brief Set once compression of file has been checked
+     */
+    bool m_compressionDetected;
+
+    /**
+     * @brief Set once format of file has been recognized
+     */
+    bool m_formatDetected;
 };
 
 }  // namespace octf
@@ -0,0 +1,225 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <octf/trace/parser/v2/FileSystemTree.h>
+
+#include <limits.h>
+#include <cctype>
+#include <iterator>
+#include <octf/utils/Exception.h>
+#include <octf/utils/Log.h>
+
+namespace octf {
+namespace trace {
+namespace v2 {
+
+FileSystemViewer::FileSystemViewer(uint64_t partId)
+        : IFileSystemViewer()
+        , m_partId(partId)
+        , m_fileInfo() {}
+
+void FileSystemViewer::addFile(const FileId &id, const FileInfo &info) {
+    m_fileInfo[id] = info;
+}
+
+bool FileSystemViewer::hasFile(const FileId &id) {
+    auto iter = find(id, false);
+    return iter != m_fileInfo.end();
+}
+
+std::string FileSystemViewer::getFileNamePrefix(const FileId &id) const {
+    std::string basename = "";
+
+    auto iter = find(id);
+    if (iter != m_fileInfo.end()) {
+        auto i = iter->second.name.rfind('.');
+        if (i != std::string::npos) {
+            basename = iter->second.name.substr(0, i);
+        } else {
+            basename = iter->second.name;
+        }
+    }
+
+    while (basename.size()) {
+        if (std::isalpha(basename.back())) {
+            break;
+        } else {
+            basename.pop_back();
+        }
+    }
+
+    return basename;
+}
+
+std::string FileSystemViewer::getFileName(const FileId &id) const {
+    auto iter = find(id);
+    if (iter != m_fileInfo.end()) {
+        return iter->second.name;
+    }
+
+    return "";
+}
+
+std::string FileSystemViewer::getFileExtension(const FileId &id) const {
+    std::string extension = "";
+
+    auto iter = find(id);
+    if (iter != m_fileInfo.end()) {
+        auto i = iter->second.name.rfind('.');
+        if (i != std::string::npos) {
+            extension = iter->second.name.substr(i + 1);
+        }
+    }
+
+    return extension;
+}
+
+std::string FileSystemViewer::getDirPath(const FileId &id) const {
+    std::string dir = "";
+    uint64_t len = 0;
+
+    auto iter = find(id);
+    if (iter != m_fileInfo.end()) {
+        try {
+            getPath(iter->second.parent, dir, len);
+        } catch (MaxPathExceededException &e) {
+            log::cerr << e.getMessage() << std::endl;
+        }
+    }
+
+    return dir;
+}
+
+std::string FileSystemViewer::getFilePath(const FileId &id) const {
+    std::string path = "";
+
+    auto iter = find(id);
+    if (iter != m_fileInfo.end()) {
+        path = getDirPath(id);
+
+        if ("" == path) {
+            return "";
+        }
+
+        if (path != "/") {
+            path += "/";
+        }
+
+        path += iter->second.name;
+    }
+
+    return path;
+}
+
+FileId FileSystemViewer::getParentId(const FileId &id) const {
+    FileId parentId = FileId();
+
+    auto iter = find(id);
+    if (iter != m_fileInfo.end()) {
+        const auto &info = iter->second;
+        return info.parent;
+    }
+
+    return parentId;
+}
+
+bool FileSystemViewer::getPath(const FileId &id,
+                               std::string &path,
+                               uint64_t &len) const {
+    auto iter = find(id);
+    if (iter != m_fileInfo.end()) {
+        const auto &info = iter->second;
+        len += info.name.length();
+        if (len > PATH_MAX) {
+            throw MaxPathExceededException(id.id);
+        }
+        if (id != info.parent && info.name != "/") {
+            if (!getPath(info.parent, path, len)) {
+                path = "";
+                return false;
+            }
+
+            if (!path.empty() && '/' != path.back()) {
+                path += "/";
+            }
+        }
+
+        path += info.name;
+
+        return true;
+    } else {
+        path = "";
+        return false;
+    }
+}
+
+std::map<FileId, FileInfo>::const_iterator FileSystemViewer::find(
+        const FileId &id,
+        bool week) const {
+    auto iter = m_fileInfo.find(id);
+    if (iter != m_fileInfo.end()) {
+        return iter;
+    } else if (false == week) {
+        return m_fileInfo.end();
+    }
+
+    iter = m_fileInfo.lower_bound(id);
+    if (m_fileInfo.size() && iter != m_fileInfo.begin()) {
+        iter = std::prev(iter);
+
+        if (iter->first.id == id.id &&
+            iter->first.partitionId == id.partitionId) {
+            return iter;
+        }
+    }
+
+    return m_fileInfo.end();
+}
+
+FileSystemTree::FileSystemTree()
+        : NonCopyable()
+        , m_partitionFsViewers() {}
+
+bool FileSystemTree::addFile(
+        const proto::trace::EventIoFilesystemFileName &event) {
+    FileId id(event);
+    FileInfo info(event);
+
+    FileSystemViewer *viewer = getFileSystemViewer(id.partitionId);
+    bool added = !viewer->hasFile(id);
+    viewer->addFile(id, info);
+
+    return added;
+}
+
+FileSystemViewer *FileSystemTree::getFileSystemViewer(uint64_t partId) {
+    FileSystemViewer *viewer = NULL;
+
+    auto iter = m_partitionFsViewers.find(partId);
+    if (iter == m_partitionFsViewers.end()) {
+        // FS viewer has not be allocated yet.
+
+        // Create FS Viewer
+        auto pair = std::make_pair(partId, FileSystemViewer(partId));
+
+        // Insert pair into map
+        auto result = m_partitionFsViewers.emplace(pair);
+
+        if (!result.second || result.first == m_partitionFsViewers.end()) {
+            throw Exception(
+                    "Error during trace parsing, cannot create FS viewer");
+        }
+
+        viewer = &result.first->second;
+    } else {
+        viewer = &iter->second;
+    }
+
+    return viewer;
+}
+
+}  // namespace v2
+}  // namespace trace
+}  // namespace octf
@@ -0,0 +1,133 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SOURCE_OCTF_TRACE_PARSER_V2_FILESYSTEMTREE_H
+#define SOURCE_OCTF_TRACE_PARSER_V2_FILESYSTEMTREE_H
+
+#include <map>
+#include <string>
+#include <octf/fs/FileId.h>
+#include <octf/fs/IFileSystemViewer.h>
+#include <octf/proto/trace.pb.h>
+#include <octf/utils/NonCopyable.h>
+
+namespace octf {
+namespace trace {
+namespace v2 {
+
+/**
+ * Tiny structure of file info containing parent file id, last size of file,
+ * name, etc.
+ *
+ * To reduced memory overhead, we introduced own version of file info,
+ * instead of using protocol buffer one
+ */
+struct FileInfo {
+    FileId parent;
+    std::string name;
+
+    FileInfo()
+            : parent()
+            , name() {}
+
+    FileInfo(const proto::trace::EventIoFilesystemFileName &event)
+            : parent(event.fileparentid())
+            , name(event.filename()) {}
+
+    FileInfo(const FileInfo &other)
+            : parent(other.parent)
+            , name(other.name) {}
+
+    FileInfo &operator=(const FileInfo &other) {
+        if (this != &other) {
+            parent = other.parent;
+            name = other.name;
+        }
+
+        return *this;
+    }
+
+    bool operator==(const FileInfo &other) const {
+        return name == other.name && parent == other.parent;
+    }
+};
+
+/**
+ * @brief Filesystem viewer of a partition, built from file name events
+ */
+class FileSystemViewer : public IFileSystemViewer {
+public:
+    FileSystemViewer(uint64_t partId);
+    virtual ~FileSystemViewer() = default;
+
+    void addFile(const FileId &id, const FileInfo &info);
+
+    bool hasFile(const FileId &id);
+
+    std::string getFileNamePrefix(const FileId &id) const override;
+
+    std::string getFileName(const FileId &id) const override;
+
+    std::string getFileExtension(const FileId &id) const override;
+
+    std::string getDirPath(const FileId &id) const override;
+
+    std::string getFilePath(const FileId &id) const override;
+
+    FileId getParentId(const FileId &id) const override;
+
+private:
+    bool getPath(const FileId &id, std::string &path, uint64_t &len) const;
+
+    std::map<FileId, FileInfo>::const_iterator find(const FileId &id,
+                                                    bool week = true) const;
+
+private:
+    const uint64_t m_partId;
+    std::map<FileId, FileInfo> m_fileInfo;
+};
+
+/**
+ * @brief Filesystem tree of traced partitions
+ *
+ * The tree is built from file name events, and provides filesystem viewer
+ * for each partition.
+ */
+class FileSystemTree : public NonCopyable {
+public:
+    FileSystemTree();
+    virtual ~FileSystemTree() = default;
+
+    /**
+     * @brief Adds file described by file name event to the tree
+     *
+     * @param event File name event
+     *
+     * @retval true File added
+     * @retval false File already known, its info updated
+     */
+    bool addFile(const proto::trace::EventIoFilesystemFileName &event);
+
+    /**
+     * Gets filesystem viewer
+     *
+     * This interface is used to inspect and view filesystem on the basis
+     * of captured IO traces.
+     *
+     * @param partId Partition id of the requested viewer
+     *
+     * @return Filesystem viewer for specified partition
+     */
+    FileSystemViewer *getFileSystemViewer(uint64_t partId);
+
+private:
+    std::map<uint64_t, FileSystemViewer> m_partitionFsViewers;
+};
+
+}  // namespace v2
+}  // namespace trace
+}  // namespace octf
+
+#endif  // SOURCE_OCTF_TRACE_PARSER_V2_FILESYSTEMTREE_H
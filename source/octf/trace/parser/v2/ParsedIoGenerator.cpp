@@ -0,0 +1,394 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <octf/trace/parser/v2/ParsedIoGenerator.h>
+
+#include <octf/fs/FileId.h>
+
+namespace octf {
+namespace trace {
+namespace v2 {
+
+/**
+ * Number of parsed IOs allocated from single arena
+ */
+constexpr uint64_t ParsedIoGenerator_ArenaEvents = 256;
+
+/**
+ * Size of memory block arena starts from, it fits parsed IOs of the arena
+ * unless they have long strings
+ */
+constexpr size_t ParsedIoGenerator_ArenaBlockSize = 256 * 1024;
+
+ParsedIoGenerator::EventArena::EventArena()
+        : block(new char[ParsedIoGenerator_ArenaBlockSize])
+        , arena(block.get(), ParsedIoGenerator_ArenaBlockSize)
+        , allocated(0)
+        , released(0) {}
+
+ParsedIoGenerator::ParsedIoGenerator(
+        IParsedIoHandler &handler,
+        FileSystemTree &fsTree,
+        const google::protobuf::Map<std::string, std::string> &tags)
+        : NonCopyable()
+        , m_handler(handler)
+        , m_fsTree(fsTree)
+        , m_tags(tags)
+        , m_queue()
+        , m_arenas()
+        , m_freeArenas()
+        , m_refSid(0)
+        , m_idMapping()
+        , m_devices()
+        , m_timestampOffset(0)
+        , m_limit(ParsedIoGenerator_QueueLimit)
+        , m_subrangeStart(0)
+        , m_subrangeEnd(0)
+        , m_devIoQueueDepth() {}
+
+void ParsedIoGenerator::addEvent(const proto::trace::Event &traceEvent) {
+    using namespace proto::trace;
+    using octf::FileId;
+
+    if (!m_timestampOffset) {
+        // Parsed IO is presented from time '0', and SID '0', we remember
+        // the first event time stamp and SID and the subtract by those
+        // values for each event
+        if (Event::EventTypeCase::kDeviceDescription !=
+            traceEvent.EventType_case()) {
+            m_timestampOffset = traceEvent.header().timestamp();
+        }
+    }
+
+    switch (traceEvent.EventType_case()) {
+    case Event::EventTypeCase::kDeviceDescription: {
+        // Remember device
+        const auto &device = traceEvent.devicedescription();
+        m_devices[device.id()] = device;
+        m_limit = ParsedIoGenerator_QueueLimit * m_devices.size();
+        m_handler.handleDeviceDescription(device);
+    } break;
+
+    case Event::EventTypeCase::kIo: {
+        const auto &io = traceEvent.io();
+        auto deviceId = io.deviceid();
+
+        // If subrange is set, skip IO events which are outside of it
+        if (m_subrangeEnd != 0) {
+            if (io.lba() + io.len() < m_subrangeStart ||
+                io.lba() > m_subrangeEnd) {
+                return;
+            }
+        }
+
+        // Allocate new parsed IO event in the queue
+        auto &cachedEvent = allocateEvent();
+
+        // Setup parsed IO
+        cachedEvent.mutable_header()->CopyFrom(traceEvent.header());
+
+        auto &dst = *cachedEvent.mutable_io();
+        const auto &src = traceEvent.io();
+
+        dst.set_lba(src.lba());
+        dst.set_len(src.len());
+        dst.set_operation(src.operation());
+        dst.mutable_flags()->set_flush(src.flush());
+        dst.mutable_flags()->set_fua(src.fua());
+        dst.mutable_flags()->set_direct(src.direct());
+        dst.mutable_flags()->set_metadata(src.metadata());
+        dst.mutable_flags()->set_readahead(src.readahead());
+        dst.set_writehint(src.writehint());
+
+        auto &qd = m_devIoQueueDepth[deviceId];
+        qd.Value++;
+        dst.set_qd(qd.Value);
+
+        const auto &device = m_devices[deviceId];
+        auto *devInfo = cachedEvent.mutable_device();
+        devInfo->set_name(device.name());
+        devInfo->set_id(deviceId);
+        devInfo->set_partition(deviceId);
+        devInfo->set_model(device.model());
+
+        addMapping(traceEvent, cachedEvent);
+    } break;
+
+    case Event::EventTypeCase::kIoCompletion: {
+        auto devId = traceEvent.iocompletion().deviceid();
+        auto &hdr = traceEvent.header();
+        auto &cmpl = traceEvent.iocompletion();
+
+        // If subrange is set, skip events which are outside of it
+        if (m_subrangeEnd != 0) {
+            if (cmpl.lba() + cmpl.len() < m_subrangeStart ||
+                cmpl.lba() > m_subrangeEnd) {
+                return;
+            }
+        }
+
+        // Get queue depth
+        auto &qd = m_devIoQueueDepth[devId];
+
+        // Find in map which IO has been completed.
+        auto id = cmpl.refid();
+        auto event = getCachedEventById(id);
+
+        // If event is null, the submission event probably dropped during
+        // tracing
+        if (nullptr != event) {
+            delMapping(*event);
+
+            auto io = event->mutable_io();
+            uint64_t submissionTime = event->header().timestamp();
+            uint64_t completionTime = hdr.timestamp();
+
+            // If submission is after completion - IO probably dropped
+            if (completionTime >= submissionTime) {
+                auto latency = completionTime - submissionTime;
+
+                // IO found, set latency and result of IO
+                io->set_latency(latency);
+                io->set_error(cmpl.error());
+
+                // Only update these fields if valid - fixes behavior for
+                // discards in kernels < 4.10
+                if (cmpl.lba() != 0 && cmpl.len() != 0) {
+                    io->set_lba(cmpl.lba());
+                    io->set_len(cmpl.len());
+                }
+
+                // Update queue depth for device
+                if (qd.Value) {
+                    qd.Value--;
+                }
+            }
+        }
+
+        flushEvents(false);
+    } break;
+
+    case Event::kFilesystemMeta: {
+        auto id = traceEvent.filesystemmeta().refid();
+        auto cachedEvent = getCachedEventById(id);
+
+        if (cachedEvent) {
+            auto &dst = *cachedEvent->mutable_file();
+            const auto &src = traceEvent.filesystemmeta();
+            dst.set_id(src.fileid().id());
+            dst.set_offset(src.fileoffset());
+            dst.set_size(src.filesize());
+
+            // Update filesystem event type to just file access
+            dst.set_eventtype(proto::trace::FsEventType::Access);
+
+            // Fill creation event
+            dst.mutable_creationdate()->CopyFrom(src.fileid().creationdate());
+
+            // Set partition ID
+            auto partId = traceEvent.filesystemmeta().fileid().partitionid();
+            auto devInfo = cachedEvent->mutable_device();
+            devInfo->set_partition(partId);
+
+            // Add device description for given partition
+            if (!m_devices.find(partId)) {
+                // Copy the description first, adding partition may move it
+                auto device = m_devices[devInfo->id()];
+                m_devices[partId].Swap(&device);
+            }
+        }
+    } break;
+
+    case Event::EventTypeCase::kFilesystemFileEvent: {
+        const auto &fsEvent = traceEvent.filesystemfileevent();
+        auto partId = fsEvent.fileid().partitionid();
+
+        // Allocate new parsed IO event in the queue
+        auto &cachedEvent = allocateEvent();
+
+        // Setup parsed IO
+        cachedEvent.mutable_header()->CopyFrom(traceEvent.header());
+
+        // Setup file event type and parent id
+        auto &dstFileInfo = *cachedEvent.mutable_file();
+        dstFileInfo.set_eventtype(fsEvent.fseventtype());
+        dstFileInfo.set_id(fsEvent.fileid().id());
+        dstFileInfo.mutable_creationdate()->CopyFrom(
+                fsEvent.fileid().creationdate());
+
+        auto &destDevInfo = *cachedEvent.mutable_device();
+        const auto &srcDevInfo = m_devices[partId];
+        destDevInfo.set_name(srcDevInfo.name());
+        destDevInfo.set_id(srcDevInfo.id());
+        destDevInfo.set_partition(partId);
+        destDevInfo.set_model(srcDevInfo.model());
+    } break;
+
+    case Event::EventTypeCase::kFilesystemFileName: {
+    } break;
+
+    default:
+        break;
+    }
+}
+
+void ParsedIoGenerator::flushEvents(bool finished) {
+    while (m_queue.size()) {
+        if (m_queue.front()->io().latency()) {
+            pushOutEvent();
+        } else {
+            break;
+        }
+    }
+
+    if (m_queue.size() < m_limit && !finished) {
+        return;
+    }
+
+    // Cache exceeds some number,
+    // or every parser finished its job, then flush IOs
+    while (m_queue.size()) {
+        pushOutEvent();
+
+        if (!finished && m_queue.size() < m_limit) {
+            break;
+        }
+    }
+}
+
+void ParsedIoGenerator::setExclusiveSubrange(uint64_t start, uint64_t end) {
+    m_subrangeStart = start;
+    m_subrangeEnd = end;
+}
+
+uint64_t ParsedIoGenerator::getQueuedCount() const {
+    return m_queue.size();
+}
+
+proto::trace::ParsedEvent &ParsedIoGenerator::allocateEvent() {
+    if (m_arenas.empty() ||
+        m_arenas.back()->allocated == ParsedIoGenerator_ArenaEvents) {
+        if (m_freeArenas.empty()) {
+            m_arenas.emplace_back(new EventArena());
+        } else {
+            m_arenas.push_back(std::move(m_freeArenas.back()));
+            m_freeArenas.pop_back();
+        }
+    }
+
+    auto &arena = *m_arenas.back();
+    arena.allocated++;
+
+    auto event = google::protobuf::Arena::CreateMessage<
+            proto::trace::ParsedEvent>(&arena.arena);
+    m_queue.push_back(event);
+
+    return *event;
+}
+
+void ParsedIoGenerator::releaseEvent() {
+    m_queue.pop_front();
+
+    // IOs are released in order of allocation, so they come from the oldest
+    // arena. It's recycled once it's full and all of its IOs are released.
+    auto &arena = *m_arenas.front();
+    arena.released++;
+    if (arena.released == ParsedIoGenerator_ArenaEvents) {
+        arena.arena.Reset();
+        arena.allocated = 0;
+        arena.released = 0;
+
+        m_freeArenas.push_back(std::move(m_arenas.front()));
+        m_arenas.pop_front();
+    }
+}
+
+void ParsedIoGenerator::pushOutEvent() {
+    auto &event = *m_queue.front();
+
+    delMapping(event);
+
+    // Update SID
+    event.mutable_header()->set_sid(++m_refSid);
+
+    // Take into account IO queue depth adjustment
+    auto devId = event.device().id();
+    auto partId = event.device().partition();
+    auto &qd = m_devIoQueueDepth[devId];
+
+    if (event.has_io()) {
+        auto ioqd = event.io().qd();
+        ioqd -= qd.Adjustment;
+        event.mutable_io()->set_qd(ioqd);
+    }
+
+    // Update timestamp
+    auto timestamp = event.header().timestamp();
+    if (timestamp > m_timestampOffset) {
+        event.mutable_header()->set_timestamp(timestamp -= m_timestampOffset);
+    } else {
+        event.mutable_header()->set_timestamp(0);
+    }
+
+    if (event.has_file()) {
+        auto viewer = m_fsTree.getFileSystemViewer(partId);
+        event.mutable_file()->set_path(viewer->getFilePath(FileId(event)));
+    }
+
+    if (m_tags.size()) {
+        auto &tags = *event.mutable_extensions()->mutable_tags();
+        tags = m_tags;
+    }
+
+    // Call handler
+    m_handler.handleIO(event);
+
+    if (event.has_io() && 0 == event.io().latency()) {
+        // An IO completion lost, so the queue depth of next IOs are disrupted,
+        // Set queue depth adjustment
+        qd.Adjustment++;
+    }
+
+    releaseEvent();
+}
+
+void ParsedIoGenerator::addMapping(const proto::trace::Event &traceEvent,
+                                   proto::trace::ParsedEvent &cachedEvent) {
+    if (!traceEvent.has_io()) {
+        return;
+    }
+    auto id = traceEvent.io().id();
+
+    if (id) {
+        // If we dropped completion and had not deleted previous mapping,
+        // previous ID mapping is replaced with new one
+        m_idMapping[id] = &cachedEvent;
+
+        // Temporary store id in SID place
+        cachedEvent.mutable_header()->set_sid(id);
+    }
+}
+
+void ParsedIoGenerator::delMapping(proto::trace::ParsedEvent &cachedEvent) {
+    if (cachedEvent.has_io()) {
+        auto id = cachedEvent.header().sid();
+        m_idMapping.erase(id);
+        cachedEvent.mutable_header()->set_sid(0);
+    }
+}
+
+proto::trace::ParsedEvent *ParsedIoGenerator::getCachedEventById(uint64_t id) {
+    auto event = m_idMapping.find(id);
+
+    if (event) {
+        return *event;
+    } else {
+        return nullptr;
+    }
+}
+
+}  // namespace v2
+}  // namespace trace
+}  // namespace octf
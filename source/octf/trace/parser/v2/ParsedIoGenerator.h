@@ -0,0 +1,198 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SOURCE_OCTF_TRACE_PARSER_V2_PARSEDIOGENERATOR_H
+#define SOURCE_OCTF_TRACE_PARSER_V2_PARSEDIOGENERATOR_H
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <google/protobuf/arena.h>
+#include <google/protobuf/map.h>
+#include <octf/proto/parsedTrace.pb.h>
+#include <octf/proto/trace.pb.h>
+#include <octf/trace/parser/v2/FileSystemTree.h>
+#include <octf/utils/FlatHashMap.h>
+#include <octf/utils/NonCopyable.h>
+
+namespace octf {
+namespace trace {
+namespace v2 {
+
+/**
+ * Number of parsed IOs per device awaiting completion, above which the
+ * generator hands them over incomplete
+ */
+constexpr uint64_t ParsedIoGenerator_QueueLimit = 10000;
+
+/**
+ * @brief Handler of parsed IO created by ParsedIoGenerator
+ */
+class IParsedIoHandler {
+public:
+    virtual ~IParsedIoHandler() = default;
+
+    /**
+     * @brief Handles parsed IO
+     *
+     * @param io Parsed IO to be handled
+     */
+    virtual void handleIO(const proto::trace::ParsedEvent &io) = 0;
+
+    /**
+     * @brief Handles device description trace event
+     *
+     * @param devDesc Device description trace event
+     */
+    virtual void handleDeviceDescription(
+            const proto::trace::EventDeviceDescription &devDesc) = 0;
+};
+
+/**
+ * @brief Generator of parsed IO
+ *
+ * Trace events are put into the generator one by one, in order of their
+ * sequence ids. The parsed IO is created from multiple events (especially IO
+ * request and IO completion), supplemented by filesystem information, and
+ * handed over to the handler in the IOs queuing order.
+ *
+ * The generator doesn't depend on the source of events, so parsed IO can be
+ * created either from a trace stored on disk, or from events being captured.
+ *
+ * Parsed IOs are allocated from arenas, each one holds a fixed number of
+ * consecutive IOs. Once all IOs of an arena are handed over, the arena is
+ * reset and reused, so no memory is allocated per IO in a steady state.
+ * IOs awaiting completion, devices and their queue depths are kept in flat
+ * hash maps, so matching completion to its IO takes a constant time.
+ */
+class ParsedIoGenerator : public NonCopyable {
+public:
+    /**
+     * @param handler Handler of created parsed IO
+     * @param fsTree Filesystem tree used to resolve paths of files
+     * @param tags Tags to be attached to each parsed IO
+     */
+    ParsedIoGenerator(IParsedIoHandler &handler,
+                      FileSystemTree &fsTree,
+                      const google::protobuf::Map<std::string, std::string>
+                              &tags);
+    virtual ~ParsedIoGenerator() = default;
+
+    /**
+     * @brief Puts next trace event into the generator
+     *
+     * Parsed IOs which are complete get handled.
+     */
+    void addEvent(const proto::trace::Event &traceEvent);
+
+    /**
+     * @brief Hands over parsed IOs awaiting completion
+     *
+     * @param finished Set if there are no more events, then all parsed IOs
+     * are handled. Otherwise IOs are handled only if the number of waiting
+     * ones exceeds the limit.
+     */
+    void flushEvents(bool finished);
+
+    /**
+     * @brief Skip IO's outside of this defined subrange
+     * @param start LBA of subrange start
+     * @param end LBA of subrange end
+     *
+     * @note any IO's which overlap with this range will also be included
+     */
+    void setExclusiveSubrange(uint64_t start, uint64_t end);
+
+    /**
+     * @return Number of parsed IOs waiting for completion
+     */
+    uint64_t getQueuedCount() const;
+
+private:
+    struct IoQueueDepth {
+        uint64_t Value;
+        uint64_t Adjustment;
+    };
+
+    /**
+     * @brief Arena of parsed IOs, with memory block it starts from
+     */
+    struct EventArena {
+        EventArena();
+
+        /**
+         * @brief Memory block kept by arena when it's reset
+         */
+        std::unique_ptr<char[]> block;
+
+        google::protobuf::Arena arena;
+
+        /**
+         * @brief Number of parsed IOs allocated from arena
+         */
+        uint64_t allocated;
+
+        /**
+         * @brief Number of parsed IOs handed over
+         */
+        uint64_t released;
+    };
+
+    /**
+     * @brief Allocates new parsed IO at the end of the queue
+     */
+    proto::trace::ParsedEvent &allocateEvent();
+
+    /**
+     * @brief Removes parsed IO from the front of the queue, and recycles its
+     * arena once all IOs of it are removed
+     */
+    void releaseEvent();
+
+    void pushOutEvent();
+
+    void addMapping(const proto::trace::Event &traceEvent,
+                    proto::trace::ParsedEvent &cachedEvent);
+
+    void delMapping(proto::trace::ParsedEvent &cachedEvent);
+
+    proto::trace::ParsedEvent *getCachedEventById(uint64_t id);
+
+private:
+    IParsedIoHandler &m_handler;
+    FileSystemTree &m_fsTree;
+    const google::protobuf::Map<std::string, std::string> m_tags;
+    std::deque<proto::trace::ParsedEvent *> m_queue;
+
+    /**
+     * @brief Arenas of queued parsed IOs, the oldest ones first
+     */
+    std::deque<std::unique_ptr<EventArena>> m_arenas;
+
+    /**
+     * @brief Arenas reset and ready to be reused
+     */
+    std::vector<std::unique_ptr<EventArena>> m_freeArenas;
+    uint64_t m_refSid;
+
+    /**
+     * @brief IOs awaiting completion by their ids, IOs don't move as they're
+     * allocated from arenas
+     */
+    FlatHashMap<proto::trace::ParsedEvent *> m_idMapping;
+    FlatHashMap<proto::trace::EventDeviceDescription> m_devices;
+    uint64_t m_timestampOffset;
+    uint64_t m_limit;
+    uint64_t m_subrangeStart;
+    uint64_t m_subrangeEnd;
+    FlatHashMap<IoQueueDepth> m_devIoQueueDepth;
+};
+
+}  // namespace v2
+}  // namespace trace
+}  // namespace octf
+
+#endif  // SOURCE_OCTF_TRACE_PARSER_V2_PARSEDIOGENERATOR_H
@@ -6,11 +6,7 @@
 #ifndef SOURCE_OCTF_TRACE_PARSER_V2_PARSEDIOTRACEEVENTHANDLER_H
 #define SOURCE_OCTF_TRACE_PARSER_V2_PARSEDIOTRACEEVENTHANDLER_H
 
-#include <map>
 #include <memory>
-#include <queue>
-#include <set>
-#include <octf/fs/FileId.h>
 #include <octf/fs/IFileSystemViewer.h>
 #include <octf/interface/internal/IoTraceParser.h>
 #include <octf/proto/parsedTrace.pb.h>
@@ -18,6 +14,7 @@
 #include <octf/trace/TraceLibrary.h>
 #include <octf/trace/parser/ParsedIoTraceEventHandler.h>
 #include <octf/trace/parser/TraceEventHandler.h>
+#include <octf/trace/parser/v2/ParsedIoGenerator.h>
 
 namespace octf {
 namespace trace {
@@ -32,7 +29,8 @@ namespace v2 {
  *
  * @note The order of handled IO respect the IOs queuing order
  */
-class ParsedIoTraceEventHandler : public IoTraceParser {
+class ParsedIoTraceEventHandler : public IoTraceParser,
+                                  public IParsedIoHandler {
 public:
     ParsedIoTraceEventHandler(octf::ParsedIoTraceEventHandler *parentHandler,
                               const std::string &tracePath);
@@ -77,33 +75,19 @@ private:
 
     void handleEvent(std::shared_ptr<proto::trace::Event> traceEvent) override;
 
-    void pushOutEvent();
+    void handleEvents(const std::shared_ptr<proto::trace::Event> *traceEvents,
+                      size_t count) override;
 
-    void addMapping(const proto::trace::Event &traceEvent,
-                    proto::trace::ParsedEvent &cachedEvent);
+    void handleIO(const proto::trace::ParsedEvent &io) override;
 
-    void delMapping(proto::trace::ParsedEvent &cachedEvent);
-
-    proto::trace::ParsedEvent *getCachedEventById(uint64_t id);
-
-    void flushEvents();
+    void handleDeviceDescription(
+            const proto::trace::EventDeviceDescription &devDesc) override;
 
 private:
     TraceExtensionShRef m_extTrace;
-    struct IoQueueDepth;
-    struct FileInfo;
-    class FileSystemViewer;
     class TraceEventHandlerFilesystemTree;
-    std::queue<proto::trace::ParsedEvent> m_queue;
-    uint64_t m_refSid;
-    std::map<uint64_t, proto::trace::ParsedEvent *> m_idMapping;
-    std::map<uint64_t, proto::trace::EventDeviceDescription> m_devices;
     std::unique_ptr<TraceEventHandlerFilesystemTree> m_fsTree;
-    uint64_t m_timestampOffset;
-    uint64_t m_limit;
-    uint64_t m_subrangeStart;
-    uint64_t m_subrangeEnd;
-    std::map<uint64_t, IoQueueDepth> m_devIoQueueDepth;
+    std::unique_ptr<ParsedIoGenerator> m_generator;
     octf::ParsedIoTraceEventHandler *m_parentHandler;
 };
 
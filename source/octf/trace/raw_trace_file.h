@@ -0,0 +1,78 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SOURCE_OCTF_TRACE_RAW_TRACE_FILE_H
+#define SOURCE_OCTF_TRACE_RAW_TRACE_FILE_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__KERNEL__)
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#endif
+
+/**
+ * Raw trace file starts with "OCTFRAW" string, reading the magic on host of
+ * different byte order gives different value
+ */
+#define OCTF_RAW_TRACE_MAGIC 0x005741524654434fULL
+
+#define OCTF_RAW_TRACE_VERSION 1
+
+/**
+ * Each record of raw trace file starts at offset aligned to this value
+ */
+#define OCTF_RAW_TRACE_RECORD_ALIGNMENT 8
+
+/**
+ * @brief Header of raw trace file
+ *
+ * Raw trace file keeps trace events in the native format of iotrace events
+ * (see iotrace_event.h), exactly as they were pushed by the traced
+ * application. The header is followed by the records of the events.
+ */
+struct octf_raw_trace_file_hdr {
+    /** OCTF_RAW_TRACE_MAGIC */
+    uint64_t magic;
+
+    /** Version of raw trace file format */
+    uint32_t version;
+
+    /** Size of this header, the first record follows it */
+    uint32_t hdr_size;
+
+    /** Major version of iotrace events stored in the file */
+    uint32_t event_version_major;
+
+    /** Minor version of iotrace events stored in the file */
+    uint32_t event_version_minor;
+
+    /** Alignment of records */
+    uint32_t record_alignment;
+
+    /** Reserved for future use */
+    uint32_t reserved;
+} __attribute__((packed, aligned(8)));
+
+/**
+ * @brief Header of raw trace file record
+ *
+ * Header is followed by the event, padded with zeros to the record alignment.
+ */
+struct octf_raw_trace_record_hdr {
+    /** Size of the event following this header (without padding) */
+    uint32_t size;
+
+    /** Reserved for future use */
+    uint32_t reserved;
+} __attribute__((packed, aligned(8)));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SOURCE_OCTF_TRACE_RAW_TRACE_FILE_H
@@ -11,7 +11,7 @@
 #include "trace_env_kernel.h"
 #endif
 
-#define TRACE_VER 1
+#define TRACE_VER 2
 
 #define TRACE_MAGIC(a, b, c, d)                                       \
     ((UINT64_C(a) << 24) | (UINT64_C(b) << 16) | (UINT64_C(c) << 8) | \
@@ -22,6 +22,16 @@
  */
 #define TRACE_MAGIC_BUFFER TRACE_MAGIC(0x1410, 0x1683, 0x1920, 0x1989)
 
+/**
+ * Waiting producers recheck trace state at least this often (in nanoseconds)
+ */
+#define TRACE_WAIT_SLICE_NS (10ULL * 1000ULL * 1000ULL)
+
+/**
+ * Maximum number of events of a batch for which space is reserved at once
+ */
+#define TRACE_PUSH_BATCH_MAX 32
+
 struct octf_trace {
     octf_trace_open_mode_t mode;
     struct trace_producer_hdr *phdr;
@@ -29,14 +39,20 @@ struct octf_trace {
     void *ring_buffer;
     uint64_t ring_size;
     uint64_t ring_size_almost_empty;
+    octf_trace_full_policy_t full_policy;
+    uint64_t full_timeout_ns;
 };
 
 struct trace_producer_hdr {
     env_atomic64 magic;
     env_atomic64 version;
     env_atomic64 closed;
+    /**
+     * Write position, lower 32 bits keep the offset in the ring buffer, upper
+     * 32 bits keep the reservation generation protecting against ABA when
+     * producers reserve space concurrently
+     */
     env_atomic64 wr_ptr;
-    env_atomic64 wr_lock;
     env_atomic64 lost;
     env_atomic64 has_chdr;
 };
@@ -46,6 +62,18 @@ struct trace_consumer_hdr {
         struct {
             env_atomic64 rd_ptr;
             env_atomic64 rd_lock;
+            /**
+             * Number of producers waiting for free space
+             */
+            env_atomic64 space_waiters;
+            /**
+             * Bumped by consumer when it releases space for waiting producers
+             */
+            env_atomic space_seq;
+            /**
+             * Set when consumer closes trace, waiting producers give up then
+             */
+            env_atomic64 closed;
         };
         octf_trace_hdr_t alignment;
     };
@@ -53,9 +81,11 @@ struct trace_consumer_hdr {
 
 struct trace_event_hdr {
     /**
-     * Bit indicates event ready and data has been copied
+     * Indicates event ready and data has been copied. Ring space not occupied
+     * by events is kept zeroed, so header of an event being reserved is never
+     * seen ready before the producer commits it.
      */
-    uint32_t ready : 1;
+    volatile uint32_t ready;
 
     /**
      * Size of data
@@ -88,6 +118,16 @@ static bool _is_trace_valid(octf_trace_t trace) {
     return true;
 }
 
+static void _wake_up_space_waiters(octf_trace_t trace) {
+    env_atomic_inc(&trace->chdr->space_seq);
+#ifndef __KERNEL__
+    env_atomic_wake_up_all(&trace->chdr->space_seq);
+#else
+    // No waking up in kernel environment, waiters of userspace producers
+    // notice the bumped sequence once their wait slice expires
+#endif
+}
+
 static int _init_ring(octf_trace_t trace,
                       void *mempool,
                       size_t size,
@@ -167,6 +207,7 @@ static int _init_consumer(struct octf_trace *trace,
     }
 
     trace->mode = octf_trace_open_mode_consumer;
+    env_atomic64_set(&trace->chdr->closed, 0);
     return 0;
 }
 
@@ -216,6 +257,13 @@ void octf_trace_close(octf_trace_t *trace) {
         if (_is_trace_valid(_trace)) {
             env_atomic64_set(&_trace->phdr->closed, 1);
         }
+    } else if (_trace->mode == octf_trace_open_mode_consumer) {
+        if (_is_trace_valid(_trace)) {
+            // Nobody is going to release space, wake up waiting producers
+            env_atomic64_set(&_trace->chdr->closed, 1);
+            env_smp_mb();
+            _wake_up_space_waiters(_trace);
+        }
     }
 
     env_free(_trace);
@@ -226,6 +274,19 @@ void octf_trace_close(octf_trace_t *trace) {
 // Internal auxiliary functions
 //******************************************************************************
 
+static inline uint64_t _wr_ptr_offset(uint64_t wr_ptr) {
+    return wr_ptr & UINT32_MAX;
+}
+
+static inline uint64_t _wr_ptr_next(uint64_t wr_ptr, uint64_t offset) {
+    // Bump generation on each reservation
+    return (((wr_ptr >> 32) + 1) << 32) | offset;
+}
+
+static inline uint64_t _get_wr_ptr(struct octf_trace *trace) {
+    return _wr_ptr_offset(env_atomic64_read(&trace->phdr->wr_ptr));
+}
+
 static inline bool _integrity_check(struct octf_trace *trace,
                                     uint64_t ptr,
                                     uint64_t count) {
@@ -299,64 +360,49 @@ static uint64_t _move_ptr(struct octf_trace *trace, uint64_t ptr, uint64_t mv) {
 // PUSH
 //******************************************************************************
 
-static int _try_lock_wr(octf_trace_t trace) {
-    long lock = -1;
-    uint32_t retry = 0;
-
-    do {
-        if (retry++ > 128) {
-            return -EBUSY;
-        }
-
-        // Try lock for reading event
-        lock = env_atomic64_cmpxchg(&trace->phdr->wr_lock, 0, 1);
-    } while (lock != 0);
-
-    return 0;
-}
-
-static void _unlock_wr(octf_trace_t trace) {
-    env_atomic64_set(&trace->phdr->wr_lock, 0);
-}
-
 static uint64_t _is_wrap(uint64_t rdp, uint64_t wrp) {
     return wrp > rdp;
 }
 
-static struct trace_event_hdr *_allocate_event(struct octf_trace *trace,
-                                               const uint32_t size) {
-    uint32_t _size;
-    uint64_t wrp, rdp, continuous;
-    struct trace_event_hdr *hdr = NULL, *result = NULL;
-
-    if (_try_lock_wr(trace)) {
-        return NULL;
-    }
-
-    // Check if ring buffer has enough space for writing this event (event
-    // header + event data)
-
-    wrp = env_atomic64_read(&trace->phdr->wr_ptr);
-    rdp = env_atomic64_read(&trace->chdr->rd_ptr);
+/**
+ * @brief Computes placement of event header and event data for given read and
+ * write pointers
+ *
+ * @param[in] trace Trace handle
+ * @param[in] rdp Read pointer
+ * @param[in] wrp Write pointer (offset only)
+ * @param[in] size Aligned size of event data
+ * @param[out] data_ptr Position of event data
+ * @param[out] next_wrp Write pointer after allocating the event
+ *
+ * @retval true Event fits into ring buffer
+ * @retval false Not enough space for the event
+ */
+static bool _calculate_event_space(struct octf_trace *trace,
+                                   uint64_t rdp,
+                                   uint64_t wrp,
+                                   uint32_t size,
+                                   uint64_t *data_ptr,
+                                   uint64_t *next_wrp) {
+    uint64_t continuous;
 
     // First allocate space for trace header
-    if (sizeof(*hdr) > _get_continuous_space(trace, rdp, wrp)) {
-        goto END;
+    if (sizeof(struct trace_event_hdr) >
+        _get_continuous_space(trace, rdp, wrp)) {
+        return false;
     }
 
     // Check if header doesn't exceed ring buffer
-    if (wrp + sizeof(*hdr) > trace->ring_size) {
+    if (wrp + sizeof(struct trace_event_hdr) > trace->ring_size) {
         ENV_BUG();
-        goto END;
+        return false;
     }
 
-    hdr = (struct trace_event_hdr *) (trace->ring_buffer + wrp);
-    wrp = _move_ptr(trace, wrp, sizeof(*hdr));
+    wrp = _move_ptr(trace, wrp, sizeof(struct trace_event_hdr));
 
     // Allocate continuous space for trace data
-    _size = TRACE_ALIGN(size);
     continuous = _get_continuous_space(trace, rdp, wrp);
-    if (_size > continuous) {
+    if (size > continuous) {
         if (_is_wrap(rdp, wrp) && (rdp != 0)) {
             // We are at the end of circular buffer and not able to find enough
             // space in it. So we will move pointer at the beginning of ring
@@ -365,35 +411,262 @@ static struct trace_event_hdr *_allocate_event(struct octf_trace *trace,
             // Now write pointer pointer has to be zero
             ENV_BUG_ON(0 != wrp);
 
-            if (_size > _get_continuous_space(trace, rdp, wrp)) {
+            if (size > _get_continuous_space(trace, rdp, wrp)) {
                 // Still not enough space for trace data
-                goto END;
+                return false;
             }
         } else {
             // Not enough space for trace data, fail trace allocation
-            goto END;
+            return false;
         }
     }
 
     // Check if data buffer
-    if (wrp + _size > trace->ring_size) {
+    if (wrp + size > trace->ring_size) {
         ENV_BUG();
-        goto END;
+        return false;
     }
 
-    // Prepare header
-    hdr->ready = false;
-    hdr->data_ptr = wrp;
+    *data_ptr = wrp;
+    *next_wrp = _move_ptr(trace, wrp, size);
+    return true;
+}
+
+static struct trace_event_hdr *_allocate_event(struct octf_trace *trace,
+                                               const uint32_t size) {
+    const uint32_t _size = TRACE_ALIGN(size);
+    uint64_t wr_ptr, rdp, wrp, data_ptr, next_wrp;
+    struct trace_event_hdr *hdr;
+
+    // Producers reserve space concurrently by moving the write pointer with
+    // compare and exchange. The loser of a race recalculates its event
+    // placement against the new write pointer.
+    do {
+        wr_ptr = env_atomic64_read(&trace->phdr->wr_ptr);
+        rdp = env_atomic64_read(&trace->chdr->rd_ptr);
+        wrp = _wr_ptr_offset(wr_ptr);
+
+        if (!_calculate_event_space(trace, rdp, wrp, _size, &data_ptr,
+                                    &next_wrp)) {
+            return NULL;
+        }
+    } while ((uint64_t) env_atomic64_cmpxchg(&trace->phdr->wr_ptr, wr_ptr,
+                                             _wr_ptr_next(wr_ptr, next_wrp)) !=
+             wr_ptr);
+
+    // Prepare header, the ready flag stays cleared until event is committed
+    hdr = (struct trace_event_hdr *) (trace->ring_buffer + wrp);
+    hdr->data_ptr = data_ptr;
     hdr->data_size = size;
-    result = hdr;
 
-    // Update write pointer pointer
-    wrp = _move_ptr(trace, wrp, _size);
-    env_atomic64_set(&trace->phdr->wr_ptr, wrp);
+    return hdr;
+}
 
-END:
-    _unlock_wr(trace);
-    return result;
+/**
+ * @brief Allocates space for leading events of a batch at once
+ *
+ * @param[in] trace Trace handle
+ * @param[in] sizes Sizes of the batch events
+ * @param[in] count Number of the batch events
+ * @param[out] hdrs Headers of allocated events, there is space for
+ * TRACE_PUSH_BATCH_MAX of them
+ *
+ * @return Number of allocated events, they are the leading ones
+ */
+static uint32_t _allocate_event_batch(struct octf_trace *trace,
+                                      const uint32_t *sizes,
+                                      uint32_t count,
+                                      struct trace_event_hdr **hdrs) {
+    uint64_t hdr_ptr[TRACE_PUSH_BATCH_MAX], data_ptr[TRACE_PUSH_BATCH_MAX];
+    uint64_t wr_ptr, rdp, wrp;
+    uint32_t i;
+
+    count = MIN(count, (uint32_t) TRACE_PUSH_BATCH_MAX);
+
+    // Place as many events as fit one after another, then reserve space for
+    // all of them with a single move of the write pointer
+    do {
+        wr_ptr = env_atomic64_read(&trace->phdr->wr_ptr);
+        rdp = env_atomic64_read(&trace->chdr->rd_ptr);
+        wrp = _wr_ptr_offset(wr_ptr);
+
+        for (i = 0; i < count; i++) {
+            hdr_ptr[i] = wrp;
+            if (!_calculate_event_space(trace, rdp, wrp, TRACE_ALIGN(sizes[i]),
+                                        &data_ptr[i], &wrp)) {
+                break;
+            }
+        }
+
+        if (!i) {
+            return 0;
+        }
+    } while ((uint64_t) env_atomic64_cmpxchg(&trace->phdr->wr_ptr, wr_ptr,
+                                             _wr_ptr_next(wr_ptr, wrp)) !=
+             wr_ptr);
+
+    // Prepare headers, the ready flags stay cleared until events are committed
+    count = i;
+    for (i = 0; i < count; i++) {
+        hdrs[i] = (struct trace_event_hdr *) (trace->ring_buffer + hdr_ptr[i]);
+        hdrs[i]->data_ptr = data_ptr[i];
+        hdrs[i]->data_size = sizes[i];
+    }
+
+    return count;
+}
+
+static bool _fits_empty_ring(struct octf_trace *trace, const uint32_t size) {
+    // Check if event fits into the empty ring, wherever the read pointer is
+    return TRACE_ALIGN(size) + 2 * sizeof(struct trace_event_hdr) <=
+           trace->ring_size / 2;
+}
+
+#ifndef __KERNEL__
+static struct trace_event_hdr *_allocate_event_wait(struct octf_trace *trace,
+                                                    const uint32_t size) {
+    struct trace_event_hdr *hdr;
+    uint64_t deadline = 0, timeout, now;
+    int seq;
+
+    if (trace->full_policy == octf_trace_full_policy_wait_bounded) {
+        deadline = env_get_time_ns() + trace->full_timeout_ns;
+    }
+
+    // Register as waiter before sampling the wake up sequence, consumer
+    // checks waiters after moving the read pointer
+    env_atomic64_inc(&trace->chdr->space_waiters);
+
+    for (;;) {
+        seq = env_atomic_read(&trace->chdr->space_seq);
+        // Read pointer can't be older than the sampled sequence
+        env_smp_rmb();
+
+        hdr = _allocate_event(trace, size);
+        if (hdr) {
+            break;
+        }
+
+        if (env_atomic64_read(&trace->chdr->closed) ||
+            !_is_trace_valid(trace)) {
+            break;
+        }
+
+        timeout = TRACE_WAIT_SLICE_NS;
+        if (trace->full_policy == octf_trace_full_policy_wait_bounded) {
+            now = env_get_time_ns();
+            if (now >= deadline) {
+                break;
+            }
+            timeout = MIN(timeout, deadline - now);
+        }
+
+        env_atomic_wait(&trace->chdr->space_seq, seq, timeout);
+    }
+
+    env_atomic64_dec(&trace->chdr->space_waiters);
+
+    return hdr;
+}
+#else
+static struct trace_event_hdr *_allocate_event_wait(struct octf_trace *trace,
+                                                    const uint32_t size) {
+    // Kernel environment doesn't provide waiting, the policies of waiting
+    // are rejected by octf_trace_set_full_policy
+    (void) trace;
+    (void) size;
+    return NULL;
+}
+#endif
+
+static int _try_lock_rd(octf_trace_t trace);
+static void _unlock_rd(octf_trace_t trace);
+static struct trace_event_hdr *_get_rd_hdr(struct octf_trace *trace);
+static void _move_rd_ptr(struct octf_trace *trace, struct trace_event_hdr *hdr);
+
+static struct trace_event_hdr *_allocate_event_overwrite(
+        struct octf_trace *trace,
+        const uint32_t size) {
+    struct trace_event_hdr *hdr, *oldest;
+
+    while (!(hdr = _allocate_event(trace, size))) {
+        // Drop the oldest event on behalf of consumer
+        if (_try_lock_rd(trace)) {
+            // Consumer is reading events in place, they can't be overwritten
+            break;
+        }
+
+        oldest = _get_rd_hdr(trace);
+        if (oldest) {
+            _move_rd_ptr(trace, oldest);
+        }
+
+        _unlock_rd(trace);
+
+        if (!oldest) {
+            // The oldest event is still being written
+            break;
+        }
+    }
+
+    return hdr;
+}
+
+static struct trace_event_hdr *_allocate_event_policy(struct octf_trace *trace,
+                                                      const uint32_t size) {
+    struct trace_event_hdr *hdr = _allocate_event(trace, size);
+
+    if (hdr || trace->full_policy == octf_trace_full_policy_drop) {
+        return hdr;
+    }
+
+    if (!_fits_empty_ring(trace, size)) {
+        // Event would wait or overwrite other events in vain
+        return NULL;
+    }
+
+    if (trace->full_policy == octf_trace_full_policy_overwrite) {
+        return _allocate_event_overwrite(trace, size);
+    }
+
+    return _allocate_event_wait(trace, size);
+}
+
+static void _commit_event(struct trace_event_hdr *hdr) {
+    // Make event data visible before marking it ready
+    env_smp_wmb();
+    hdr->ready = true;
+}
+
+int octf_trace_set_full_policy(octf_trace_t trace,
+                               octf_trace_full_policy_t policy,
+                               uint64_t timeout_us) {
+    if (!_is_trace_valid(trace)) {
+        return -EINVAL;
+    }
+
+    if (trace->mode != octf_trace_open_mode_producer) {
+        return -EPERM;
+    }
+
+    switch (policy) {
+    case octf_trace_full_policy_drop:
+    case octf_trace_full_policy_overwrite:
+        break;
+    case octf_trace_full_policy_wait_bounded:
+    case octf_trace_full_policy_wait:
+#ifdef __KERNEL__
+        return -EOPNOTSUPP;
+#else
+        break;
+#endif
+    default:
+        return -EINVAL;
+    }
+
+    trace->full_policy = policy;
+    trace->full_timeout_ns = timeout_us * 1000ULL;
+    return 0;
 }
 
 int octf_trace_push(octf_trace_t trace,
@@ -410,7 +683,7 @@ int octf_trace_push(octf_trace_t trace,
     }
 
     // Allocate trace
-    hdr = _allocate_event(trace, size);
+    hdr = _allocate_event_policy(trace, size);
     if (!hdr) {
         // Not enough space for storing trace event
         env_atomic64_inc(&trace->phdr->lost);
@@ -429,11 +702,71 @@ int octf_trace_push(octf_trace_t trace,
     memcpy_s(trace->ring_buffer + hdr->data_ptr, hdr->data_size, event, size);
 
     // Commit event
-    hdr->ready = true;
+    _commit_event(hdr);
 
     return 0;
 }
 
+int octf_trace_push_batch(octf_trace_t trace,
+                          const void *const *events,
+                          const uint32_t *sizes,
+                          uint32_t count) {
+    struct trace_event_hdr *hdrs[TRACE_PUSH_BATCH_MAX];
+    uint32_t allocated, i;
+    int result = 0, status;
+
+    if (!_is_trace_valid(trace)) {
+        return -EINVAL;
+    }
+
+    // Same error as of single event push
+    if (trace->mode != octf_trace_open_mode_producer) {
+        return -EINVAL;
+    }
+
+    while (count) {
+        allocated = _allocate_event_batch(trace, sizes, count, hdrs);
+
+        if (!allocated) {
+            // Trace is full, the event is pushed according to full policy
+            status = octf_trace_push(trace, events[0], sizes[0]);
+            if (status == -ENOSPC) {
+                result = -ENOSPC;
+            } else if (status) {
+                return status;
+            }
+
+            allocated = 1;
+        } else {
+            for (i = 0; i < allocated; i++) {
+                if (!_integrity_check(trace, hdrs[i]->data_ptr,
+                                      hdrs[i]->data_size)) {
+                    // Inconsistent trace state, trying to access out of ring
+                    // buffer. Invalidate trace and stop pushing and popping
+                    env_atomic64_set(&trace->phdr->magic, 0);
+                    ENV_BUG();
+                    return -EINVAL;
+                }
+
+                memcpy_s(trace->ring_buffer + hdrs[i]->data_ptr,
+                         hdrs[i]->data_size, events[i], sizes[i]);
+            }
+
+            // Commit events, data of all of them is made visible at once
+            env_smp_wmb();
+            for (i = 0; i < allocated; i++) {
+                hdrs[i]->ready = true;
+            }
+        }
+
+        events += allocated;
+        sizes += allocated;
+        count -= allocated;
+    }
+
+    return result;
+}
+
 int octf_trace_get_wr_buffer(octf_trace_t trace,
                              octf_trace_event_handle_t *ev_hndl,
                              void **event,
@@ -451,7 +784,7 @@ int octf_trace_get_wr_buffer(octf_trace_t trace,
     }
 
     // Allocate trace
-    hdr = _allocate_event(trace, size);
+    hdr = _allocate_event_policy(trace, size);
     if (!hdr) {
         // Not enough space for storing trace event
         env_atomic64_inc(&trace->phdr->lost);
@@ -476,7 +809,7 @@ int octf_trace_commit_wr_buffer(octf_trace_t trace,
                                 octf_trace_event_handle_t ev_hndl) {
     struct trace_event_hdr *hdr = ev_hndl;
 
-    if (!_is_trace_valid(trace)) {
+    if (!_is_trace_valid(trace) || !hdr) {
         return -EINVAL;
     }
 
@@ -492,7 +825,7 @@ int octf_trace_commit_wr_buffer(octf_trace_t trace,
         return -EINVAL;
     }
 
-    hdr->ready = true;
+    _commit_event(hdr);
 
     return 0;
 }
@@ -505,9 +838,9 @@ bool _is_empty(uint64_t rdp, uint64_t wrp) {
     return rdp == wrp;
 }
 
-static struct trace_event_hdr *_get_rd_hdr(struct octf_trace *trace) {
-    uint64_t ptr_rd = env_atomic64_read(&trace->chdr->rd_ptr);
-    uint64_t ptr_wr = env_atomic64_read(&trace->phdr->wr_ptr);
+static struct trace_event_hdr *_get_ready_hdr(struct octf_trace *trace,
+                                              uint64_t ptr_rd,
+                                              uint64_t ptr_wr) {
     struct trace_event_hdr *hdr;
 
     // Check if trace is empty
@@ -529,16 +862,49 @@ static struct trace_event_hdr *_get_rd_hdr(struct octf_trace *trace) {
         return NULL;
     }
 
+    // Don't read event data ahead of the ready flag
+    env_smp_rmb();
+
     return hdr;
 }
 
+static struct trace_event_hdr *_get_rd_hdr(struct octf_trace *trace) {
+    uint64_t ptr_rd = env_atomic64_read(&trace->chdr->rd_ptr);
+    uint64_t ptr_wr = _get_wr_ptr(trace);
+
+    return _get_ready_hdr(trace, ptr_rd, ptr_wr);
+}
+
+static uint64_t _get_next_rd_ptr(struct octf_trace *trace,
+                                 struct trace_event_hdr *hdr) {
+    return _move_ptr(trace, hdr->data_ptr, TRACE_ALIGN(hdr->data_size));
+}
+
 static void _move_rd_ptr(struct octf_trace *trace,
                          struct trace_event_hdr *hdr) {
+    uint64_t rd_ptr = env_atomic64_read(&trace->chdr->rd_ptr);
+
     // Move pointer to next event which will be read
-    uint64_t rd_ptr =
-            _move_ptr(trace, hdr->data_ptr, TRACE_ALIGN(hdr->data_size));
+    uint64_t next_rd_ptr = _get_next_rd_ptr(trace, hdr);
+
+    // Zero released space (it may consist of many events), producers
+    // reserving it rely on cleared ready flags
+    if (next_rd_ptr > rd_ptr) {
+        memset_s(trace->ring_buffer + rd_ptr, next_rd_ptr - rd_ptr, 0);
+    } else {
+        memset_s(trace->ring_buffer + rd_ptr, trace->ring_size - rd_ptr, 0);
+        memset_s(trace->ring_buffer, next_rd_ptr, 0);
+    }
+    env_smp_wmb();
+
+    env_atomic64_set(&trace->chdr->rd_ptr, next_rd_ptr);
 
-    env_atomic64_set(&trace->chdr->rd_ptr, rd_ptr);
+    // Wake up producers waiting for free space, if any. Moving the read
+    // pointer has to be visible before checking waiters.
+    env_smp_mb();
+    if (env_atomic64_read(&trace->chdr->space_waiters)) {
+        _wake_up_space_waiters(trace);
+    }
 }
 
 static int _try_lock_rd(octf_trace_t trace) {
@@ -691,10 +1057,91 @@ int octf_trace_release_rd_buffer(octf_trace_t trace,
     return 0;
 }
 
+int octf_trace_get_rd_batch(octf_trace_t trace,
+                            octf_trace_event_handle_t *ev_hndl,
+                            void **events,
+                            uint32_t *sizes,
+                            uint32_t *count) {
+    int result = -1;
+    uint32_t max_count = *count, i = 0;
+    uint64_t ptr_rd, ptr_wr;
+    struct trace_event_hdr *hdr, *last = NULL;
+
+    *count = 0;
+
+    if (!_is_trace_valid(trace)) {
+        return -EINVAL;
+    }
+
+    if (trace->mode != octf_trace_open_mode_consumer) {
+        return -EPERM;
+    }
+
+    if (!max_count) {
+        return -EINVAL;
+    }
+
+    // Try lock for reading event
+    if (_try_lock_rd(trace)) {
+        // Other thread took lock, return
+        return -EBUSY;
+    }
+
+    // Collect run of ready events, producers may keep on committing events
+    // behind the write pointer read here, they will be taken in next batch
+    ptr_rd = env_atomic64_read(&trace->chdr->rd_ptr);
+    ptr_wr = _get_wr_ptr(trace);
+
+    while (i < max_count) {
+        hdr = _get_ready_hdr(trace, ptr_rd, ptr_wr);
+        if (!hdr) {
+            break;
+        }
+
+        if (!_integrity_check(trace, hdr->data_ptr, hdr->data_size)) {
+            // Inconsistent trace state, trying to access out of ring buffer
+            result = -EINVAL;
+            ENV_BUG();
+            goto END;
+        }
+
+        events[i] = trace->ring_buffer + hdr->data_ptr;
+        sizes[i] = hdr->data_size;
+        i++;
+
+        last = hdr;
+        ptr_rd = _get_next_rd_ptr(trace, hdr);
+    }
+
+    if (!last) {
+        // No event to be read
+        if (env_atomic64_read(&trace->phdr->closed)) {
+            result = -EBADF;
+        } else {
+            result = -EAGAIN;
+        }
+        goto END;
+    }
+
+    *count = i;
+    *ev_hndl = last;
+    return 0;
+
+END:
+    _unlock_rd(trace);
+    return result;
+}
+
+int octf_trace_release_rd_batch(octf_trace_t trace,
+                                octf_trace_event_handle_t ev_hndl) {
+    // Releasing the last event of the run releases all preceding ones
+    return octf_trace_release_rd_buffer(trace, ev_hndl);
+}
+
 int octf_trace_is_empty(const octf_trace_t trace) {
     if (_is_trace_valid(trace)) {
         uint64_t ptr_rd = env_atomic64_read(&trace->chdr->rd_ptr);
-        uint64_t ptr_wr = env_atomic64_read(&trace->phdr->wr_ptr);
+        uint64_t ptr_wr = _get_wr_ptr(trace);
 
         if (_is_empty(ptr_rd, ptr_wr)) {
             return 1;
@@ -709,7 +1156,7 @@ int octf_trace_is_empty(const octf_trace_t trace) {
 
 int octf_trace_is_almost_full(const octf_trace_t trace) {
     if (_is_trace_valid(trace)) {
-        uint64_t ptr_wr = env_atomic64_read(&trace->phdr->wr_ptr);
+        uint64_t ptr_wr = _get_wr_ptr(trace);
         uint64_t ptr_rd = env_atomic64_read(&trace->chdr->rd_ptr);
         uint64_t free_space = _get_free_space(trace, ptr_rd, ptr_wr);
 
@@ -758,7 +1205,7 @@ void octf_trace_add_lost(octf_trace_t trace, uint64_t lost) {
 
 int64_t octf_trace_get_free_space(const octf_trace_t trace) {
     if (_is_trace_valid(trace)) {
-        uint64_t ptr_wr = env_atomic64_read(&trace->phdr->wr_ptr);
+        uint64_t ptr_wr = _get_wr_ptr(trace);
         uint64_t ptr_rd = env_atomic64_read(&trace->chdr->rd_ptr);
         return _get_free_space(trace, ptr_rd, ptr_wr);
     } else {
@@ -17,6 +17,21 @@ extern "C" {
 #include <stdint.h>
 #endif
 
+/*
+ * Besides 64-bit atomics and allocation, the trace library requires from its
+ * environment (trace_env_usr.h or trace_env_kernel.h):
+ * - env_atomic (32-bit, shared with other processes) with env_atomic_read,
+ *   env_atomic_set and env_atomic_inc, and env_atomic64_dec
+ * - memory barriers env_smp_wmb, env_smp_rmb and env_smp_mb
+ *
+ * Userspace environment provides also env_get_time_ns, env_atomic_wait and
+ * env_atomic_wake_up_all, which back the policies of waiting for free space.
+ * In kernel builds these policies are not supported.
+ *
+ * Trace buffers of different versions of the library are not compatible,
+ * producer and consumer have to be built from the same version.
+ */
+
 /**
  * Defines minimum memory buffer size required to create trace
  */
@@ -50,6 +65,35 @@ typedef enum {
 
 } octf_trace_open_mode_t;
 
+/**
+ * Behavior of producer when there is no space in trace for the pushed event
+ */
+typedef enum {
+    /**
+     * Event is dropped and accounted as lost
+     */
+    octf_trace_full_policy_drop,
+
+    /**
+     * Producer waits for free space up to the specified timeout, then the
+     * event is dropped and accounted as lost
+     */
+    octf_trace_full_policy_wait_bounded,
+
+    /**
+     * Producer waits until there is free space for the event or until the
+     * consumer closes the trace
+     */
+    octf_trace_full_policy_wait,
+
+    /**
+     * The oldest events are dropped to make space for the new one, unless
+     * the consumer is reading events at the moment
+     */
+    octf_trace_full_policy_overwrite,
+
+} octf_trace_full_policy_t;
+
 /**
  * @brief Checks if trace is empty
  *
@@ -87,8 +131,10 @@ int octf_trace_is_closed(octf_trace_t trace);
  * First one is able to write into trace only. Second one may read from trace
  * only.
  *
- * This trace library is thread safe. However due to performance reason, single
- * producer and single consumer is recommended.
+ * This trace library is thread safe. Producers reserve space in the trace
+ * concurrently without taking a lock and the consumer reads events in the
+ * order of reservation, once each of them is committed. Consumers are
+ * serialized, thus single consumer is recommended.
  *
  * @param[in] mempool Memory pool (buffer) for trace where events will be stored
  * @param[in] size Size of memory buffer
@@ -136,6 +182,31 @@ int64_t octf_trace_get_lost_count(octf_trace_t trace);
  */
 void octf_trace_add_lost(octf_trace_t trace, uint64_t lost);
 
+/**
+ * @brief Sets behavior of the producer when trace is full
+ *
+ * By default events which don't fit into trace are dropped. Waiting producers
+ * are woken up as soon as the consumer releases space. Events which can't fit
+ * even into the empty trace (larger than half of its size) are never waited
+ * for and never overwrite other events.
+ *
+ * @note Only producer may set the policy, it applies to the given trace handle
+ * only.
+ *
+ * @param[in] trace Trace handle
+ * @param[in] policy Full trace policy
+ * @param[in] timeout_us Maximum time of waiting for free space (in
+ * microseconds), used by octf_trace_full_policy_wait_bounded only
+ *
+ * @retval 0 Policy set successfully
+ * @retval -EINVAL Trace or policy is invalid
+ * @retval -EPERM Invalid open mode, only producer can set policy
+ * @retval -EOPNOTSUPP Policy of waiting set in kernel build
+ */
+int octf_trace_set_full_policy(octf_trace_t trace,
+                               octf_trace_full_policy_t policy,
+                               uint64_t timeout_us);
+
 /**
  * @brief Pushes event to the trace
  *
@@ -146,12 +217,37 @@ void octf_trace_add_lost(octf_trace_t trace, uint64_t lost);
  * @param[in] size Event size
  *
  * @retval 0 Event stored successfully
- * @retval -EINVAL Trace is invalid
- * @retval -EPERM Invalid open mode, only producer can push events
+ * @retval -EINVAL Trace is invalid, or it's not open by producer
  * @retval -ENOSPC Event lost because no space in memory pool to store event
+ * (after waiting for it, if the full trace policy requires so)
  */
 int octf_trace_push(octf_trace_t trace, const void *event, const uint32_t size);
 
+/**
+ * @brief Pushes batch of events to the trace
+ *
+ * Space for consecutive events of the batch is reserved at once, so pushing
+ * the batch costs less than pushing each of its events. Events which don't
+ * fit into the trace are pushed one by one according to the full trace
+ * policy.
+ *
+ * @note Only producer may push events to the trace.
+ *
+ * @param[in] trace Trace handle
+ * @param[in] events Array of pointers at events to be written to the trace
+ * @param[in] sizes Array of event sizes
+ * @param[in] count Number of events
+ *
+ * @retval 0 All events stored successfully
+ * @retval -EINVAL Trace is invalid, or it's not open by producer
+ * @retval -ENOSPC Some events lost because no space in memory pool to store
+ * them (after waiting for it, if the full trace policy requires so)
+ */
+int octf_trace_push_batch(octf_trace_t trace,
+                          const void *const *events,
+                          const uint32_t *sizes,
+                          uint32_t count);
+
 /**
  * @brief Allocates event buffer
  *
@@ -166,6 +262,7 @@ int octf_trace_push(octf_trace_t trace, const void *event, const uint32_t size);
  * @retval -EINVAL Trace is invalid
  * @retval -EPERM Invalid open mode, only producer can allocate write events
  * @retval -ENOSPC Event lost because no space in memory pool to allocate event
+ * (after waiting for it, if the full trace policy requires so)
  */
 int octf_trace_get_wr_buffer(octf_trace_t trace,
                              octf_trace_event_handle_t *ev_hndl,
@@ -240,6 +337,48 @@ int octf_trace_get_rd_buffer(octf_trace_t trace,
 int octf_trace_release_rd_buffer(octf_trace_t trace,
                                  octf_trace_event_handle_t ev_hndl);
 
+/**
+ * @brief Gets a run of consecutive ready events
+ *
+ * Events are not copied, the consumer accesses them in place. All of them are
+ * released with a single call of octf_trace_release_rd_batch.
+ *
+ * @note Only consumer may get the batch of events.
+ *
+ * @param[in] trace Trace handle
+ * @param[out] ev_hndl Handle to the batch of events
+ * @param[out] events Array to be filled with pointers to the events
+ * @param[out] sizes Array to be filled with sizes of the events
+ * @param[in,out] count For input value, it is capacity of events and sizes
+ * arrays. After successful read, value indicates number of read events
+ *
+ * @retval 0 Events read successfully
+ * @retval -EINVAL Trace is invalid or count is zero
+ * @retval -EPERM Invalid open mode, only consumer can read events
+ * @retval -EBUSY Pop/get_rd_buffer operation already in progress
+ * @retval -EBADF Trace empty and already closed
+ * @retval -EAGAIN Trace empty, try again
+ */
+int octf_trace_get_rd_batch(octf_trace_t trace,
+                            octf_trace_event_handle_t *ev_hndl,
+                            void **events,
+                            uint32_t *sizes,
+                            uint32_t *count);
+
+/**
+ * @brief Marks all events of the batch as read
+ *
+ * @note Only consumer may mark the events.
+ *
+ * @param[in] trace Trace handle
+ * @param[in] ev_hndl Handle to the batch of events
+ *
+ * @retval 0 Events released successfully
+ * @retval -EINVAL Trace or handle is invalid
+ */
+int octf_trace_release_rd_batch(octf_trace_t trace,
+                                octf_trace_event_handle_t ev_hndl);
+
 /**
  * @brief Retrieves current free space of the circular buffer in bytes
  *
@@ -0,0 +1,404 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <octf/utils/AsyncFileWriter.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <octf/utils/Exception.h>
+
+namespace octf {
+
+/**
+ * Size of each of buffers
+ */
+static constexpr size_t BUFFER_SIZE = 4 * 1024 * 1024;
+
+static constexpr uint32_t BUFFER_COUNT = 2;
+
+/**
+ * Alignment of buffers, offsets and sizes of writes required by direct IO
+ */
+static constexpr size_t IO_ALIGNMENT = 4096;
+
+/**
+ * File space is preallocated in steps of this size
+ */
+static constexpr uint64_t PREALLOCATION_SIZE = 16 * 1024 * 1024;
+
+AsyncFileWriter::AsyncFileWriter(const std::string &filePath,
+                                 std::chrono::milliseconds flushPeriod)
+        : NonCopyable()
+        , m_filePath(filePath)
+        , m_flushPeriod(flushPeriod)
+        , m_fd(-1)
+        , m_direct(false)
+        , m_buffers()
+        , m_current(0)
+        , m_committed(0)
+        , m_size(0)
+        , m_allocated(0)
+        , m_writebackOffset(0)
+        , m_flushedOffset(0)
+        , m_queue()
+        , m_mutex()
+        , m_cv()
+        , m_stop(false)
+        , m_error(false)
+        , m_thread() {}
+
+AsyncFileWriter::~AsyncFileWriter() {
+    close();
+}
+
+bool AsyncFileWriter::open() {
+    if (m_fd >= 0) {
+        return true;
+    }
+
+    int flags = O_CREAT | O_WRONLY | O_TRUNC;
+    mode_t mode = S_IRUSR | S_IWUSR;
+
+    // Written data is not read back, avoid keeping it in page cache
+    m_direct = true;
+    m_fd = ::open(m_filePath.c_str(), flags | O_DIRECT, mode);
+    if (m_fd < 0 && EINVAL == errno) {
+        // File system doesn't support direct IO
+        m_direct = false;
+        m_fd = ::open(m_filePath.c_str(), flags, mode);
+    }
+    if (m_fd < 0) {
+        return false;
+    }
+
+    m_buffers.assign(BUFFER_COUNT, Buffer());
+    for (auto &buffer : m_buffers) {
+        void *data = nullptr;
+        if (posix_memalign(&data, IO_ALIGNMENT, BUFFER_SIZE)) {
+            for (auto &allocated : m_buffers) {
+                free(allocated.data);
+            }
+            m_buffers.clear();
+            ::close(m_fd);
+            m_fd = -1;
+            return false;
+        }
+
+        buffer.data = static_cast<uint8_t *>(data);
+        buffer.capacity = BUFFER_SIZE;
+    }
+
+    m_current = 0;
+    m_committed = 0;
+    m_size = 0;
+    m_allocated = 0;
+    m_writebackOffset = 0;
+    m_flushedOffset = 0;
+    m_queue.clear();
+    m_stop = false;
+    m_error = false;
+    m_thread = std::thread(&AsyncFileWriter::writeBuffers, this);
+
+    return true;
+}
+
+bool AsyncFileWriter::close() {
+    if (m_fd < 0) {
+        return false;
+    }
+
+    // Write the rest of data and stop the writer thread
+    switchBuffer(true);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+
+    bool success = !m_error;
+
+    // Release space preallocated beyond written data
+    success &= ::ftruncate(m_fd, m_size) == 0 ? true : false;
+
+    // Most of data is already on disk, thanks to direct IO or writeback
+    // started by the writer thread
+    success &= ::fsync(m_fd) == 0 ? true : false;
+    success &= ::close(m_fd) == 0 ? true : false;
+    m_fd = -1;
+
+    for (auto &buffer : m_buffers) {
+        free(buffer.data);
+    }
+    m_buffers.clear();
+
+    return success;
+}
+
+bool AsyncFileWriter::isOpen() const {
+    return m_fd >= 0;
+}
+
+uint8_t *AsyncFileWriter::getBuffer(size_t size) {
+    checkError();
+
+    Buffer *buffer = &m_buffers[m_current];
+    if (buffer->used + size > buffer->capacity) {
+        switchBuffer(false);
+
+        buffer = &m_buffers[m_current];
+        if (buffer->used + size > buffer->capacity) {
+            // Data is never split, buffer grows if it doesn't fit
+            growBuffer(*buffer, buffer->used + size);
+        }
+    }
+
+    return buffer->data + buffer->used;
+}
+
+void AsyncFileWriter::commit(size_t size) {
+    auto &buffer = m_buffers[m_current];
+    buffer.used += size;
+    m_size += size;
+
+    // Data is complete, writer thread may flush it
+    m_committed.store(buffer.used, std::memory_order_release);
+}
+
+int64_t AsyncFileWriter::getSize() const {
+    return m_size;
+}
+
+void AsyncFileWriter::switchBuffer(bool final) {
+    Buffer &current = m_buffers[m_current];
+    uint32_t next = (m_current + 1) % m_buffers.size();
+
+    if (!final) {
+        waitForBuffer(next);
+
+        // Direct IO requires aligned writes, unaligned tail of data is moved
+        // to the next buffer and written with it
+        Buffer &nextBuffer = m_buffers[next];
+        size_t aligned = current.used - current.used % IO_ALIGNMENT;
+
+        nextBuffer.used = current.used - aligned;
+        nextBuffer.fileOffset = current.fileOffset + aligned;
+        memcpy(nextBuffer.data, current.data + aligned, nextBuffer.used);
+        current.used = aligned;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (current.used) {
+            current.busy = true;
+            m_queue.push_back(m_current);
+        }
+        m_current = next;
+        m_committed = m_buffers[next].used;
+    }
+    m_cv.notify_all();
+}
+
+void AsyncFileWriter::waitForBuffer(uint32_t index) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this, index] { return !m_buffers[index].busy; });
+}
+
+void AsyncFileWriter::growBuffer(Buffer &buffer, size_t capacity) {
+    capacity = (capacity + IO_ALIGNMENT - 1) / IO_ALIGNMENT * IO_ALIGNMENT;
+
+    void *data = nullptr;
+    if (posix_memalign(&data, IO_ALIGNMENT, capacity)) {
+        throw Exception("Cannot allocate write buffer, file " + m_filePath);
+    }
+
+    // Writer thread may be flushing data of the buffer
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [&buffer] { return !buffer.flushing; });
+
+    memcpy(data, buffer.data, buffer.used);
+    free(buffer.data);
+    buffer.data = static_cast<uint8_t *>(data);
+    buffer.capacity = capacity;
+}
+
+void AsyncFileWriter::writeBuffers() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;) {
+        bool woken = m_cv.wait_for(lock, m_flushPeriod, [this] {
+            return m_stop || !m_queue.empty();
+        });
+        if (!woken) {
+            // No buffer handed over for a while, don't let data committed
+            // to the current one wait longer
+            if (!m_error && !flushBuffer(lock)) {
+                m_error = true;
+            }
+            continue;
+        }
+
+        if (m_queue.empty()) {
+            break;
+        }
+
+        uint32_t index = m_queue.front();
+        m_queue.pop_front();
+
+        lock.unlock();
+        const auto &buffer = m_buffers[index];
+        if (!m_error && !writeBuffer(buffer, buffer.used, false)) {
+            m_error = true;
+        }
+        lock.lock();
+
+        m_buffers[index].busy = false;
+        m_cv.notify_all();
+    }
+}
+
+bool AsyncFileWriter::flushBuffer(std::unique_lock<std::mutex> &lock) {
+    // The caller only appends to the current buffer, and it doesn't resize
+    // the buffer being flushed, so committed data is read without the lock.
+    // The buffer isn't reused before it's handed over to this thread.
+    auto &buffer = m_buffers[m_current];
+    size_t used = m_committed.load(std::memory_order_acquire);
+    if (buffer.fileOffset + used <= m_flushedOffset) {
+        return true;
+    }
+
+    buffer.flushing = true;
+    lock.unlock();
+    bool result = writeBuffer(buffer, used, true);
+    lock.lock();
+    buffer.flushing = false;
+    m_cv.notify_all();
+
+    return result;
+}
+
+bool AsyncFileWriter::writeBuffer(const Buffer &buffer,
+                                  size_t used,
+                                  bool filling) {
+    uint64_t end = buffer.fileOffset + used;
+
+    // Skip data flushed already
+    uint64_t start = std::max(buffer.fileOffset, m_flushedOffset);
+    if (start >= end) {
+        return true;
+    }
+    const uint8_t *data = buffer.data + (start - buffer.fileOffset);
+
+    // Allocate file space ahead, so that file system doesn't need to do it
+    // on each write. File size is kept, so that it covers data written so
+    // far, and the file can be read while it's being written.
+    if (end > m_allocated) {
+        uint64_t size = std::max(end - m_allocated, PREALLOCATION_SIZE);
+        if (fallocate(m_fd, FALLOC_FL_KEEP_SIZE, m_allocated, size) &&
+            EOPNOTSUPP != errno) {
+            // Preallocation not supported by file system is skipped
+            return false;
+        }
+        m_allocated += size;
+    }
+
+    size_t size = end - start;
+    size_t aligned = size;
+    if (m_direct) {
+        aligned -= size % IO_ALIGNMENT;
+    }
+
+    if (!writeData(data, aligned, start)) {
+        return false;
+    }
+    m_flushedOffset = start + aligned;
+
+    if (aligned < size) {
+        // Unaligned end of data can't be written with direct IO. If the
+        // buffer is still being filled, direct IO is resumed, and the end
+        // is written again with data following it.
+        int flags = fcntl(m_fd, F_GETFL);
+        if (flags < 0 || fcntl(m_fd, F_SETFL, flags & ~O_DIRECT)) {
+            return false;
+        }
+
+        bool written = writeData(data + aligned, size - aligned,
+                                 start + aligned);
+        if (!filling) {
+            m_direct = false;
+            m_flushedOffset = end;
+        } else if (fcntl(m_fd, F_SETFL, flags)) {
+            return false;
+        } else if (written) {
+            sync_file_range(m_fd, start + aligned, size - aligned,
+                            SYNC_FILE_RANGE_WRITE);
+        }
+        if (!written) {
+            return false;
+        }
+    }
+
+    if (!m_direct) {
+        // Start writeback of just written data, and wait for writeback of
+        // data written before, so that dirty pages don't pile up until close
+        sync_file_range(m_fd, start, size, SYNC_FILE_RANGE_WRITE);
+        if (start > m_writebackOffset) {
+            sync_file_range(m_fd, m_writebackOffset,
+                            start - m_writebackOffset,
+                            SYNC_FILE_RANGE_WAIT_BEFORE |
+                                    SYNC_FILE_RANGE_WRITE |
+                                    SYNC_FILE_RANGE_WAIT_AFTER);
+            m_writebackOffset = start;
+        }
+    }
+
+    return true;
+}
+
+bool AsyncFileWriter::writeData(const uint8_t *data,
+                                size_t size,
+                                uint64_t offset) {
+    while (size) {
+        ssize_t result = pwrite(m_fd, data, size, offset);
+        if (result < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+
+            if (EINVAL == errno && m_direct) {
+                // File system accepted direct IO flag, but doesn't support
+                // it, fall back to buffered IO
+                int flags = fcntl(m_fd, F_GETFL);
+                if (flags < 0 || fcntl(m_fd, F_SETFL, flags & ~O_DIRECT)) {
+                    return false;
+                }
+                m_direct = false;
+                continue;
+            }
+
+            return false;
+        }
+
+        data += result;
+        size -= result;
+        offset += result;
+    }
+
+    return true;
+}
+
+void AsyncFileWriter::checkError() const {
+    if (m_error) {
+        throw Exception("Cannot write file " + m_filePath);
+    }
+}
+
+}  // namespace octf
@@ -0,0 +1,242 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SOURCE_OCTF_UTILS_ASYNCFILEWRITER_H
+#define SOURCE_OCTF_UTILS_ASYNCFILEWRITER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <octf/utils/NonCopyable.h>
+
+namespace octf {
+
+/**
+ * @brief Sequential file writer, which writes data in background
+ *
+ * Data is put into one of two large buffers. Once the buffer is full, it's
+ * handed over to the writer thread and filling of the other one starts, so
+ * the caller waits only if the storage can't keep up with it. The writer
+ * thread preallocates file space ahead of writing, and starts writeback of
+ * written data right away, so that little data is left to be synchronized
+ * when the file is closed.
+ *
+ * If no buffer is handed over for a while, the writer thread writes data
+ * committed to the buffer being filled, so that data reaches the disk with
+ * bounded delay, even if it's written slowly. Such data is not written again
+ * with the rest of the buffer, except the unaligned end of it when direct IO
+ * is used.
+ *
+ * File is written with direct IO when the file system supports it.
+ *
+ * @note Not thread safe, single caller is expected
+ */
+class AsyncFileWriter : public NonCopyable {
+public:
+    /**
+     * @param filePath Path to file, created if doesn't exist, overwritten
+     * otherwise
+     * @param flushPeriod Max time data committed to buffer waits for being
+     * written
+     */
+    AsyncFileWriter(const std::string &filePath,
+                    std::chrono::milliseconds flushPeriod =
+                            std::chrono::milliseconds(1000));
+    virtual ~AsyncFileWriter();
+
+    /**
+     * @brief Opens file and starts the writer thread
+     *
+     * @retval true File opened successfully or it's already open
+     * @retval false File can't be opened
+     */
+    bool open();
+
+    /**
+     * @brief Writes remaining data, synchronizes and closes file
+     *
+     * @retval true File written successfully
+     * @retval false Error occurred
+     */
+    bool close();
+
+    /**
+     * @brief Checks if the file is open
+     */
+    bool isOpen() const;
+
+    /**
+     * @brief Returns buffer into which data of given size is written
+     *
+     * @note Throws exception if background writing has failed
+     */
+    uint8_t *getBuffer(size_t size);
+
+    /**
+     * @brief Marks data of given size as written into buffer returned by
+     * this->getBuffer
+     */
+    void commit(size_t size);
+
+    /**
+     * @brief Returns number of bytes written so far
+     */
+    int64_t getSize() const;
+
+private:
+    /**
+     * @brief Buffer of data to be written at given file offset
+     */
+    struct Buffer {
+        uint8_t *data;
+        size_t capacity;
+        size_t used;
+        uint64_t fileOffset;
+        bool busy;
+
+        /**
+         * @brief Set while writer thread flushes data of the buffer being
+         * filled
+         */
+        bool flushing;
+    };
+
+    /**
+     * @brief Hands the current buffer over to the writer thread and switches
+     * to the next one
+     *
+     * @param final Set if it's the last buffer of the file
+     */
+    void switchBuffer(bool final);
+
+    /**
+     * @brief Waits until given buffer is written by the writer thread
+     */
+    void waitForBuffer(uint32_t index);
+
+    /**
+     * @brief Resizes buffer keeping its data, once it's not being flushed
+     */
+    void growBuffer(Buffer &buffer, size_t capacity);
+
+    /**
+     * @brief Writer thread routine
+     */
+    void writeBuffers();
+
+    /**
+     * @brief Writes data of buffer the caller is filling, called by writer
+     * thread under m_mutex
+     */
+    bool flushBuffer(std::unique_lock<std::mutex> &lock);
+
+    /**
+     * @brief Writes data of buffer to file, skipping data written already
+     *
+     * @param buffer Buffer
+     * @param used Size of data in buffer
+     * @param filling Set if the buffer is still being filled, so that its
+     * unaligned end is going to be written again
+     */
+    bool writeBuffer(const Buffer &buffer, size_t used, bool filling);
+
+    /**
+     * @brief Writes data to file at given offset, retrying partial writes
+     */
+    bool writeData(const uint8_t *data, size_t size, uint64_t offset);
+
+    /**
+     * @brief Throws exception if background writing has failed
+     */
+    void checkError() const;
+
+    const std::string m_filePath;
+
+    /**
+     * @brief Max time data committed to buffer waits for being written
+     */
+    const std::chrono::milliseconds m_flushPeriod;
+
+    /**
+     * @brief File descriptor
+     */
+    int m_fd;
+
+    /**
+     * @brief Set if file is opened for direct IO
+     */
+    bool m_direct;
+
+    /**
+     * @brief Double buffer
+     */
+    std::vector<Buffer> m_buffers;
+
+    /**
+     * @brief Index of the buffer being filled, changed under m_mutex
+     */
+    uint32_t m_current;
+
+    /**
+     * @brief Size of data committed to the buffer being filled
+     */
+    std::atomic<size_t> m_committed;
+
+    /**
+     * @brief Number of bytes written so far
+     */
+    int64_t m_size;
+
+    /**
+     * @brief Size of file space allocated so far, used by writer thread only
+     */
+    uint64_t m_allocated;
+
+    /**
+     * @brief Offset up to which writeback of written data has completed,
+     * used by writer thread only
+     */
+    uint64_t m_writebackOffset;
+
+    /**
+     * @brief Offset up to which data has been written by flushBuffer
+     * already, used by writer thread only
+     */
+    uint64_t m_flushedOffset;
+
+    /**
+     * @brief Indexes of buffers to be written by writer thread
+     */
+    std::deque<uint32_t> m_queue;
+
+    std::mutex m_mutex;
+
+    /**
+     * @brief Notified when buffer is queued or written
+     */
+    std::condition_variable m_cv;
+
+    /**
+     * @brief Set when writer thread shall exit
+     */
+    bool m_stop;
+
+    /**
+     * @brief Set if writer thread failed to write data
+     */
+    std::atomic<bool> m_error;
+
+    std::thread m_thread;
+};
+
+}  // namespace octf
+
+#endif  // SOURCE_OCTF_UTILS_ASYNCFILEWRITER_H
@@ -0,0 +1,102 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <octf/utils/CycleClock.h>
+
+#include <time.h>
+#include <thread>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+namespace octf {
+
+/**
+ * Cycle counter is calibrated against the system clock over this period
+ */
+static constexpr std::chrono::milliseconds CALIBRATION_PERIOD(20);
+
+static constexpr uint64_t NSEC_PER_SEC = 1000000000ULL;
+
+static uint64_t getMonotonicTimestamp() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+CycleClock::CycleClock()
+        : m_frequency(0)
+        , m_mult(0)
+        , m_calibrationCycles(0)
+        , m_calibrationTimestamp(0) {
+    if (!isCycleCounterInvariant()) {
+        return;
+    }
+
+    uint64_t startCycles = readCycles();
+    uint64_t startNs = getMonotonicTimestamp();
+
+    std::this_thread::sleep_for(CALIBRATION_PERIOD);
+
+    uint64_t endCycles = readCycles();
+    uint64_t endNs = getMonotonicTimestamp();
+
+    if (endCycles <= startCycles || endNs <= startNs) {
+        return;
+    }
+
+    m_frequency = static_cast<uint64_t>(
+            static_cast<unsigned __int128>(endCycles - startCycles) *
+            NSEC_PER_SEC / (endNs - startNs));
+    if (!m_frequency) {
+        return;
+    }
+
+    m_mult = static_cast<uint64_t>(
+            (static_cast<unsigned __int128>(NSEC_PER_SEC) << MULT_SHIFT) /
+            m_frequency);
+
+    // Bind cycle counter to the system time
+    m_calibrationTimestamp = getSystemTimestamp();
+    m_calibrationCycles = readCycles();
+}
+
+bool CycleClock::isCycleCounter() const {
+    return m_frequency != 0;
+}
+
+std::string CycleClock::getSource() const {
+    return isCycleCounter() ? "tsc" : "system";
+}
+
+uint64_t CycleClock::getFrequency() const {
+    return m_frequency;
+}
+
+uint64_t CycleClock::getCalibrationCycles() const {
+    return m_calibrationCycles;
+}
+
+uint64_t CycleClock::getCalibrationTimestamp() const {
+    return m_calibrationTimestamp;
+}
+
+bool CycleClock::isCycleCounterInvariant() {
+#if defined(__x86_64__)
+    unsigned int eax, ebx, ecx, edx;
+
+    // Invariant TSC is reported in advanced power management leaf
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+
+    return edx & (1U << 8);
+#else
+    return false;
+#endif
+}
+
+}  // namespace octf
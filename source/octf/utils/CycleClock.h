@@ -0,0 +1,139 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SOURCE_OCTF_UTILS_CYCLECLOCK_H
+#define SOURCE_OCTF_UTILS_CYCLECLOCK_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+namespace octf {
+
+/**
+ * @brief Clock based on CPU cycle counter, cheap enough to stamp every trace
+ * event
+ *
+ * Cycles are converted to nanoseconds since epoch using calibration against
+ * the system clock, done when the clock is created. If the CPU doesn't provide
+ * invariant cycle counter, the system clock is read directly.
+ */
+class CycleClock {
+public:
+    CycleClock();
+    virtual ~CycleClock() = default;
+
+    /**
+     * @brief Gets current time in nanoseconds since epoch
+     */
+    inline uint64_t now() const {
+        if (m_frequency) {
+            // Cycle counter of another CPU may be marginally behind the one
+            // read at calibration
+            int64_t delta = static_cast<int64_t>(readCycles() -
+                                                 m_calibrationCycles);
+            if (delta < 0) {
+                return m_calibrationTimestamp;
+            }
+
+            unsigned __int128 cycles = static_cast<uint64_t>(delta);
+            return m_calibrationTimestamp + ((cycles * m_mult) >> MULT_SHIFT);
+        }
+
+        return getSystemTimestamp();
+    }
+
+    /**
+     * @brief Checks if time is read from CPU cycle counter
+     */
+    bool isCycleCounter() const;
+
+    /**
+     * @brief Gets name of clock source
+     */
+    std::string getSource() const;
+
+    /**
+     * @brief Gets calibrated frequency of cycle counter (in Hz), zero if
+     * the system clock is used
+     */
+    uint64_t getFrequency() const;
+
+    /**
+     * @brief Gets cycle counter value taken at calibration
+     */
+    uint64_t getCalibrationCycles() const;
+
+    /**
+     * @brief Gets time (in nanoseconds since epoch) corresponding to the
+     * calibration cycle counter value
+     */
+    uint64_t getCalibrationTimestamp() const;
+
+private:
+    /**
+     * @brief Reads cycle counter
+     *
+     * RDTSC isn't serializing, it may be executed before preceding loads or
+     * after following stores. Fences keep it in program order, so that
+     * timestamp taken between reading and updating a counter (e.g. SID of IO
+     * queue) follows the order of the counter.
+     */
+    static inline uint64_t readCycles() {
+#if defined(__x86_64__)
+        _mm_lfence();
+        uint64_t cycles = __rdtsc();
+        _mm_lfence();
+        return cycles;
+#else
+        return 0;
+#endif
+    }
+
+    static inline uint64_t getSystemTimestamp() {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(
+                       system_clock::now().time_since_epoch())
+                .count();
+    }
+
+    /**
+     * @brief Checks if CPU provides cycle counter running at constant rate
+     * in all power states
+     */
+    static bool isCycleCounterInvariant();
+
+    /**
+     * @brief Fixed point shift of cycles to nanoseconds multiplier
+     */
+    static constexpr uint32_t MULT_SHIFT = 32;
+
+    /**
+     * @brief Cycle counter frequency (in Hz)
+     */
+    uint64_t m_frequency;
+
+    /**
+     * @brief Nanoseconds per cycle, shifted left by MULT_SHIFT
+     */
+    uint64_t m_mult;
+
+    /**
+     * @brief Cycle counter value at calibration
+     */
+    uint64_t m_calibrationCycles;
+
+    /**
+     * @brief System time at calibration (in nanoseconds since epoch)
+     */
+    uint64_t m_calibrationTimestamp;
+};
+
+}  // namespace octf
+
+#endif  // SOURCE_OCTF_UTILS_CYCLECLOCK_H
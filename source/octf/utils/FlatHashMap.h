@@ -0,0 +1,204 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SOURCE_OCTF_UTILS_FLATHASHMAP_H
+#define SOURCE_OCTF_UTILS_FLATHASHMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <octf/utils/Hash.h>
+
+namespace octf {
+
+/**
+ * @brief Hash map of 64 bit integer keys, with entries stored in a single
+ * array
+ *
+ * Collisions are resolved by linear probing, and entries following a removed
+ * one are shifted back, so there are no tombstones and lookups touch a few
+ * adjacent slots only. The array grows twice when it's half full, and never
+ * shrinks, so a map of steady size doesn't allocate memory.
+ *
+ * @note Inserting may move entries, references to values are valid until the
+ * next insertion only
+ *
+ * @tparam Value Type of values, default constructible and movable
+ */
+template <typename Value>
+class FlatHashMap {
+public:
+    /**
+     * Minimum number of slots
+     */
+    static constexpr size_t MIN_CAPACITY = 16;
+
+    /**
+     * @param capacity Initial number of slots, rounded up to power of two
+     */
+    explicit FlatHashMap(size_t capacity = MIN_CAPACITY)
+            : m_slots()
+            , m_mask(0)
+            , m_size(0) {
+        size_t slots = MIN_CAPACITY;
+        while (slots < capacity) {
+            slots *= 2;
+        }
+        m_slots.resize(slots);
+        m_mask = slots - 1;
+    }
+
+    /**
+     * @brief Returns value of given key, value initialized one is inserted
+     * if the key is not in the map
+     */
+    Value &operator[](uint64_t key) {
+        size_t index = findIndex(key);
+        if (m_slots[index].used) {
+            return m_slots[index].value;
+        }
+
+        if (2 * (m_size + 1) > m_slots.size()) {
+            grow();
+            index = findIndex(key);
+        }
+
+        auto &slot = m_slots[index];
+        slot.key = key;
+        slot.value = Value();
+        slot.used = true;
+        m_size++;
+
+        return slot.value;
+    }
+
+    /**
+     * @brief Finds value of given key
+     *
+     * @return Value, or nullptr if the key is not in the map
+     */
+    Value *find(uint64_t key) {
+        auto &slot = m_slots[findIndex(key)];
+        return slot.used ? &slot.value : nullptr;
+    }
+
+    /**
+     * @copydoc find
+     */
+    const Value *find(uint64_t key) const {
+        const auto &slot = m_slots[findIndex(key)];
+        return slot.used ? &slot.value : nullptr;
+    }
+
+    /**
+     * @brief Removes key from the map
+     *
+     * @retval true Key removed
+     * @retval false Key is not in the map
+     */
+    bool erase(uint64_t key) {
+        size_t hole = findIndex(key);
+        if (!m_slots[hole].used) {
+            return false;
+        }
+
+        // Shift back entries of the probe sequence, unless the hole precedes
+        // their home slot
+        for (size_t index = (hole + 1) & m_mask; m_slots[index].used;
+             index = (index + 1) & m_mask) {
+            auto &slot = m_slots[index];
+            size_t home = hashKey(slot.key) & m_mask;
+            if (((index - home) & m_mask) >= ((index - hole) & m_mask)) {
+                m_slots[hole].key = slot.key;
+                m_slots[hole].value = std::move(slot.value);
+                hole = index;
+            }
+        }
+
+        m_slots[hole].value = Value();
+        m_slots[hole].used = false;
+        m_size--;
+
+        return true;
+    }
+
+    /**
+     * @return Number of keys in the map
+     */
+    size_t size() const {
+        return m_size;
+    }
+
+    bool empty() const {
+        return m_size == 0;
+    }
+
+    /**
+     * @brief Removes all keys, slots are kept
+     */
+    void clear() {
+        for (auto &slot : m_slots) {
+            if (slot.used) {
+                slot.value = Value();
+                slot.used = false;
+            }
+        }
+        m_size = 0;
+    }
+
+private:
+    struct Slot {
+        Slot()
+                : key(0)
+                , value()
+                , used(false) {}
+
+        uint64_t key;
+        Value value;
+        bool used;
+    };
+
+    /**
+     * @brief Returns slot of given key, or the free slot ending its probe
+     * sequence if the key is not in the map
+     */
+    size_t findIndex(uint64_t key) const {
+        size_t index = hashKey(key) & m_mask;
+        while (m_slots[index].used && m_slots[index].key != key) {
+            index = (index + 1) & m_mask;
+        }
+        return index;
+    }
+
+    /**
+     * @brief Doubles number of slots, and inserts entries again
+     */
+    void grow() {
+        std::vector<Slot> slots(2 * m_slots.size());
+        m_slots.swap(slots);
+        m_mask = m_slots.size() - 1;
+
+        for (auto &slot : slots) {
+            if (slot.used) {
+                auto &dst = m_slots[findIndex(slot.key)];
+                dst.key = slot.key;
+                dst.value = std::move(slot.value);
+                dst.used = true;
+            }
+        }
+    }
+
+    std::vector<Slot> m_slots;
+    size_t m_mask;
+    size_t m_size;
+};
+
+template <typename Value>
+constexpr size_t FlatHashMap<Value>::MIN_CAPACITY;
+
+}  // namespace octf
+
+#endif  // SOURCE_OCTF_UTILS_FLATHASHMAP_H
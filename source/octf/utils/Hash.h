@@ -0,0 +1,28 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SOURCE_OCTF_UTILS_HASH_H
+#define SOURCE_OCTF_UTILS_HASH_H
+
+#include <cstdint>
+
+namespace octf {
+
+/**
+ * @brief Mixes bits of 64-bit key (finalizer of SplitMix64), it spreads
+ * sequential keys (IO IDs, LBAs) evenly
+ */
+inline uint64_t hashKey(uint64_t key) {
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return key;
+}
+
+}  // namespace octf
+
+#endif  // SOURCE_OCTF_UTILS_HASH_H
@@ -0,0 +1,111 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <octf/utils/Numa.h>
+
+#include <dirent.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace octf {
+namespace numautils {
+
+/**
+ * Memory policy mode of mbind system call, as defined in linux/mempolicy.h
+ */
+static constexpr int MPOL_PREFERRED_MODE = 1;
+
+static constexpr size_t BITS_PER_LONG = sizeof(unsigned long) * CHAR_BIT;
+
+int getCpuNode(uint32_t cpu) {
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR *dir = opendir(path.c_str());
+    if (!dir) {
+        return NO_NUMA_NODE;
+    }
+
+    // CPU directory contains link named after the node, e.g. 'node0'
+    int node = NO_NUMA_NODE;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *name = entry->d_name;
+        if (strncmp(name, "node", 4) || !isdigit(name[4])) {
+            continue;
+        }
+
+        node = atoi(name + 4);
+        break;
+    }
+
+    closedir(dir);
+    return node;
+}
+
+bool getNodeCpus(int node, std::vector<uint32_t> &cpus) {
+    cpus.clear();
+    if (node < 0) {
+        return false;
+    }
+
+    std::ifstream file("/sys/devices/system/node/node" +
+                       std::to_string(node) + "/cpulist");
+    std::string list;
+    if (!std::getline(file, list)) {
+        return false;
+    }
+
+    // CPU list has format of comma separated ranges, e.g. '0-3,8-11'
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        if (range.empty()) {
+            continue;
+        }
+
+        char *end;
+        unsigned long first = strtoul(range.c_str(), &end, 10);
+        unsigned long last = first;
+        if ('-' == *end) {
+            last = strtoul(end + 1, &end, 10);
+        }
+
+        for (unsigned long cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+
+    return !cpus.empty();
+}
+
+bool setPreferredNode(void *addr, size_t size, int node) {
+#ifdef SYS_mbind
+    if (node < 0) {
+        return false;
+    }
+
+    std::vector<unsigned long> nodeMask(node / BITS_PER_LONG + 1, 0);
+    nodeMask[node / BITS_PER_LONG] |= 1UL << (node % BITS_PER_LONG);
+
+    long result = syscall(SYS_mbind, addr, size, MPOL_PREFERRED_MODE,
+                          nodeMask.data(), nodeMask.size() * BITS_PER_LONG + 1,
+                          0);
+    return 0 == result;
+#else
+    (void) addr;
+    (void) size;
+    (void) node;
+    return false;
+#endif
+}
+
+}  // namespace numautils
+}  // namespace octf
@@ -0,0 +1,60 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SOURCE_OCTF_UTILS_NUMA_H
+#define SOURCE_OCTF_UTILS_NUMA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace octf {
+namespace numautils {
+
+/**
+ * Node id returned when NUMA topology is not known
+ */
+constexpr int NO_NUMA_NODE = -1;
+
+/**
+ * @brief Gets NUMA node of given CPU
+ *
+ * Topology is read from sysfs, thus no NUMA library is required.
+ *
+ * @param cpu CPU id
+ *
+ * @return NUMA node id, or NO_NUMA_NODE if node of the CPU is not known
+ */
+int getCpuNode(uint32_t cpu);
+
+/**
+ * @brief Gets CPUs belonging to given NUMA node
+ *
+ * @param node NUMA node id
+ * @param[out] cpus List of CPU ids of the node
+ *
+ * @retval true CPUs of the node retrieved successfully
+ * @retval false Node doesn't exist or its CPU list can't be read
+ */
+bool getNodeCpus(int node, std::vector<uint32_t> &cpus);
+
+/**
+ * @brief Sets preferred NUMA node of memory range, pages are allocated on
+ * this node when they are touched for the first time
+ *
+ * @param addr Page aligned start of the memory range
+ * @param size Size of the memory range
+ * @param node NUMA node id
+ *
+ * @retval true Memory policy set successfully
+ * @retval false Memory policy can't be set, memory is allocated according to
+ * the default policy
+ */
+bool setPreferredNode(void *addr, size_t size, int node);
+
+}  // namespace numautils
+}  // namespace octf
+
+#endif  // SOURCE_OCTF_UTILS_NUMA_H
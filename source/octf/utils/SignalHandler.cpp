@@ -7,6 +7,7 @@
 
 #include <algorithm>
 #include <csignal>
+#include <string>
 #include <octf/utils/Exception.h>
 
 namespace octf {
@@ -14,9 +15,15 @@ namespace octf {
 SignalHandler::SignalHandler()
         : NonCopyable()
         , m_signalList()
+        , m_mutex()
+        , m_signalUsers()
+        , m_oldHandlers()
         , m_sigset()
         , m_wait()
         , m_error(0) {
+    for (auto &count : m_signalCount) {
+        count = 0;
+    }
     sigemptyset(&m_sigset);
     sem_init(&m_wait, 0, 0);
 }
@@ -34,43 +41,66 @@ SignalHandler &SignalHandler::get() {
 }
 
 void SignalHandler::registerSignal(int sig) {
-    if (std::find(m_signalList.begin(), m_signalList.end(), sig) ==
-        m_signalList.end()) {
-        if (SIG_ERR == std::signal(sig, SignalHandler::onSignal)) {
-            throw Exception("Cannot register signal handler");
-        }
+    if (sig <= 0 || sig >= NSIG) {
+        throw Exception("Invalid signal " + std::to_string(sig));
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
 
-        m_signalList.push_back(sig);
+    if (m_signalUsers[sig]++) {
+        return;
     }
+
+    auto oldHandler = std::signal(sig, SignalHandler::onSignal);
+    if (SIG_ERR == oldHandler) {
+        m_signalUsers.erase(sig);
+        throw Exception("Cannot register signal handler");
+    }
+
+    m_oldHandlers[sig] = oldHandler;
+    m_signalList.push_back(sig);
 }
 
 void SignalHandler::unregisterSignal(int sig) {
-    auto iter = std::find(m_signalList.begin(), m_signalList.end(), sig);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto users = m_signalUsers.find(sig);
+    if (users == m_signalUsers.end()) {
+        return;
+    }
 
-    if (iter != m_signalList.end()) {
-        if (SIG_ERR == std::signal(sig, SIG_DFL)) {
-            // According to documentation SIG_ERR indicates an error
-            throw Exception("Cannot unregister signal handler");
-        }
+    if (--users->second) {
+        return;
+    }
+    m_signalUsers.erase(users);
 
+    auto iter = std::find(m_signalList.begin(), m_signalList.end(), sig);
+    if (iter != m_signalList.end()) {
         m_signalList.erase(iter);
     }
+
+    sighandler_t oldHandler = m_oldHandlers[sig];
+    m_oldHandlers.erase(sig);
+    if (SIG_ERR == std::signal(sig, oldHandler)) {
+        // According to documentation SIG_ERR indicates an error
+        throw Exception("Cannot unregister signal handler");
+    }
 }
 
 void SignalHandler::clearAllSignals() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
     bool failure = false;
 
     for (auto iter = m_signalList.begin(); iter != m_signalList.end();) {
-        if (SIG_ERR == std::signal(*iter, SIG_DFL)) {
+        if (SIG_ERR == std::signal(*iter, m_oldHandlers[*iter])) {
             // According to documentation SIG_ERR indicates an error
             failure = true;
-
-            iter = m_signalList.erase(iter);
-
-        } else {
-            iter++;
         }
+
+        iter = m_signalList.erase(iter);
     }
+    m_signalUsers.clear();
+    m_oldHandlers.clear();
 
     if (failure) {
         throw Exception("Cannot unregister signal handler");
@@ -111,6 +141,10 @@ int SignalHandler::wait() {
 void SignalHandler::onSignal(int sig) {
     SignalHandler &handler = get();
 
+    if (sig > 0 && sig < NSIG) {
+        handler.m_signalCount[sig]++;
+    }
+
     // Keep information in signal set which signals have been received.
     // Program's thread will scan signal set to find out which ones were
     // received.
@@ -127,4 +161,12 @@ void SignalHandler::sendSignal(int sig) {
     onSignal(sig);
 }
 
+uint64_t SignalHandler::getSignalCount(int sig) const {
+    if (sig <= 0 || sig >= NSIG) {
+        return 0;
+    }
+
+    return m_signalCount[sig];
+}
+
 }  // namespace octf
@@ -10,6 +10,8 @@
 #include <signal.h>
 #include <atomic>
 #include <list>
+#include <map>
+#include <mutex>
 #include <octf/utils/NonCopyable.h>
 
 namespace octf {
@@ -27,6 +29,9 @@ public:
     /**
      * @brief Registers signal to handle by application
      *
+     * Signal may be registered by many users, the handler is installed on
+     * the first registration.
+     *
      * @param sig Signal to register
      */
     void registerSignal(int sig);
@@ -34,6 +39,9 @@ public:
     /**
      * @brief Unregisters signal handled by application
      *
+     * Handler which was replaced by registration is restored once the last
+     * user unregisters the signal.
+     *
      * @param sig Signal to unregister
      */
     void unregisterSignal(int sig);
@@ -61,6 +69,16 @@ public:
      */
     void sendSignal(int sig);
 
+    /**
+     * @brief Returns number of times the signal has been received
+     *
+     * Unlike this->wait, it doesn't consume the signal, so that many users
+     * may poll for it by comparing the count with the one seen before.
+     *
+     * @param sig Signal
+     */
+    uint64_t getSignalCount(int sig) const;
+
 private:
     SignalHandler();
 
@@ -73,6 +91,26 @@ private:
      */
     std::list<int> m_signalList;
 
+    /**
+     * @brief Protects registration of signals
+     */
+    std::mutex m_mutex;
+
+    /**
+     * @brief Number of users of each registered signal
+     */
+    std::map<int, uint32_t> m_signalUsers;
+
+    /**
+     * @brief Handlers replaced by handlers of registered signals
+     */
+    std::map<int, sighandler_t> m_oldHandlers;
+
+    /**
+     * @brief Number of times each signal has been received
+     */
+    std::atomic<uint64_t> m_signalCount[NSIG];
+
     /**
      * @brief Set of already raised signals
      */
@@ -0,0 +1,246 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <sched.h>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <thread>
+#include <vector>
+#include <octf/c/iotrace_plugin.h>
+#include <octf/communication/RpcControllerImpl.h>
+#include <octf/interface/InterfaceTraceCreatingImpl.h>
+#include <octf/octf.h>
+#include <octf/trace/IOTracePlugin.h>
+#include <octf/trace/iotrace_event.h>
+#include <octf/utils/FileOperations.h>
+
+#include <octf/UtilsTest.h>
+
+using namespace octf;
+using namespace std;
+
+static constexpr uint32_t IO_QUEUE_COUNT = 2;
+static constexpr uint32_t SUB_RING_COUNT = 2;
+static constexpr uint64_t EVENT_COUNT = 3000;
+static constexpr uint32_t BATCH_SIZE = 8;
+
+static void doNothing() {}
+
+static shared_ptr<InterfaceTraceCreatingImpl> getTracingInterface(
+        octf_iotrace_plugin_context_t context) {
+    auto plugin = static_cast<IOTracePlugin *>(context->plugin);
+    return plugin->findInterface<InterfaceTraceCreatingImpl>();
+}
+
+static bool startTracing(octf_iotrace_plugin_context_t context) {
+    auto interface = getTracingInterface(context);
+
+    proto::StartTraceRequest request;
+    request.set_maxduration(100);
+    request.set_maxsize(100);
+    request.set_circbuffersize(SUB_RING_COUNT);
+    request.set_subrings(SUB_RING_COUNT);
+    request.set_fullpolicy(proto::TraceFullPolicy::WAIT);
+    proto::Void response;
+    RpcControllerImpl controller;
+    interface->StartTracing(&controller, &request, &response,
+                            google::protobuf::NewCallback(doNothing));
+    if (controller.Failed()) {
+        return false;
+    }
+
+    for (uint32_t retry = 100; retry; retry--) {
+        proto::Void empty;
+        proto::TraceSummary summary;
+        RpcControllerImpl summaryController;
+        interface->GetTraceSummary(&summaryController, &empty, &summary,
+                                   google::protobuf::NewCallback(doNothing));
+        if (summary.state() == proto::TraceState::RUNNING) {
+            return true;
+        }
+
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+
+    return false;
+}
+
+static proto::TraceSummary stopTracing(octf_iotrace_plugin_context_t context) {
+    proto::Void empty;
+    proto::TraceSummary summary;
+    RpcControllerImpl controller;
+    getTracingInterface(context)->StopTracing(
+            &controller, &empty, &summary,
+            google::protobuf::NewCallback(doNothing));
+    return summary;
+}
+
+/**
+ * @brief Moves the calling thread to a CPU of sub-ring other than the first
+ * one, if there is such CPU, so that reservations don't land in sub-ring 0
+ */
+static void moveToLastSubRing() {
+    cpu_set_t cpus;
+    if (sched_getaffinity(0, sizeof(cpus), &cpus)) {
+        return;
+    }
+
+    for (int cpu = CPU_SETSIZE - 1; cpu >= 0; cpu--) {
+        if (CPU_ISSET(cpu, &cpus) && cpu % SUB_RING_COUNT) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            sched_setaffinity(0, sizeof(set), &set);
+            return;
+        }
+    }
+}
+
+static struct iotrace_event makeIo(octf_iotrace_plugin_context_t context,
+                                   uint32_t ioQueue,
+                                   uint64_t id) {
+    struct iotrace_event io = {};
+    octf_iotrace_plugin_init_queue_trace_header(
+            context, ioQueue, &io.hdr, iotrace_event_type_io, sizeof(io));
+    io.id = id;
+    io.lba = id * 8;
+    io.len = id % 256;
+    io.operation = id % 2 ? iotrace_event_operation_rd
+                          : iotrace_event_operation_wr;
+    return io;
+}
+
+TEST(IOTracePluginCTest, ReserveCommitAndPushTraces) {
+    SetupTestOutput(test_info_);
+
+    cpu_set_t cpus;
+    ASSERT_EQ(0, sched_getaffinity(0, sizeof(cpus), &cpus));
+
+    struct octf_iotrace_plugin_cnfg cnfg = {};
+    cnfg.id = "IOTracePluginCTest";
+    cnfg.io_queue_count = IO_QUEUE_COUNT;
+    octf_iotrace_plugin_context_t context = nullptr;
+    ASSERT_EQ(0, octf_iotrace_plugin_create(&cnfg, &context));
+
+    struct octf_iotrace_plugin_reservation reservation = {};
+    list<struct iotrace_event> expected;
+
+    // Space can't be reserved without valid plug-in nor while not tracing
+    EXPECT_EQ(-EINVAL,
+              octf_iotrace_plugin_reserve_trace(nullptr, 0, 64, &reservation));
+    EXPECT_EQ(-EINVAL, octf_iotrace_plugin_reserve_trace(context, 0, 64,
+                                                         nullptr));
+    EXPECT_EQ(-EPERM,
+              octf_iotrace_plugin_reserve_trace(context, 0, 64, &reservation));
+
+    ASSERT_TRUE(startTracing(context));
+    ASSERT_TRUE(octf_iotrace_plugin_is_tracing_active(context));
+    moveToLastSubRing();
+
+    // Size of event has to be set and it has to fit in sub-ring
+    EXPECT_EQ(-EINVAL,
+              octf_iotrace_plugin_reserve_trace(context, 0, 0, &reservation));
+    EXPECT_EQ(-EINVAL, octf_iotrace_plugin_reserve_trace(
+                               context, 0, 1ULL << 32, &reservation));
+    EXPECT_EQ(-ENOSPC, octf_iotrace_plugin_reserve_trace(
+                               context, 0, 1ULL << 30, &reservation));
+
+    // Events written in place into reserved space, of both IO queues
+    for (uint64_t id = 1; id <= EVENT_COUNT; id++) {
+        uint32_t ioQueue = id % IO_QUEUE_COUNT;
+        auto io = makeIo(context, ioQueue, id);
+
+        ASSERT_EQ(0, octf_iotrace_plugin_reserve_trace(context, ioQueue,
+                                                       sizeof(io),
+                                                       &reservation));
+        ASSERT_EQ(ioQueue, reservation.io_queue);
+        memcpy(reservation.trace, &io, sizeof(io));
+        octf_iotrace_plugin_commit_trace(context, &reservation);
+
+        expected.push_back(io);
+    }
+
+    // Events pushed in batches
+    for (uint64_t id = EVENT_COUNT + 1; id <= 2 * EVENT_COUNT;
+         id += BATCH_SIZE) {
+        uint32_t ioQueue = (id / BATCH_SIZE) % IO_QUEUE_COUNT;
+        vector<struct iotrace_event> batch;
+        vector<const void *> traces;
+        vector<uint32_t> sizes;
+        for (uint64_t i = id; i < id + BATCH_SIZE; i++) {
+            batch.push_back(makeIo(context, ioQueue, i));
+        }
+        for (const auto &io : batch) {
+            traces.push_back(&io);
+            sizes.push_back(sizeof(io));
+            expected.push_back(io);
+        }
+
+        octf_iotrace_plugin_push_traces(context, ioQueue, traces.data(),
+                                        sizes.data(), BATCH_SIZE);
+
+        // Batch isn't pushed without valid plug-in, empty batch is ignored
+        octf_iotrace_plugin_push_traces(nullptr, ioQueue, traces.data(),
+                                        sizes.data(), BATCH_SIZE);
+        octf_iotrace_plugin_push_traces(context, ioQueue, traces.data(),
+                                        sizes.data(), 0);
+    }
+
+    // Events pushed one by one
+    for (uint64_t id = 2 * EVENT_COUNT + 1; id <= 3 * EVENT_COUNT; id++) {
+        uint32_t ioQueue = id % IO_QUEUE_COUNT;
+        auto io = makeIo(context, ioQueue, id);
+        octf_iotrace_plugin_push_trace(context, ioQueue, &io, sizeof(io));
+        expected.push_back(io);
+    }
+
+    sched_setaffinity(0, sizeof(cpus), &cpus);
+
+    // Producers left all sub-rings, otherwise tracing wouldn't stop
+    auto summary = stopTracing(context);
+    ASSERT_FALSE(octf_iotrace_plugin_is_tracing_active(context));
+    ASSERT_EQ(static_cast<int64_t>(expected.size()), summary.tracedevents());
+    ASSERT_EQ(0, summary.droppedevents());
+
+    // Events are neither reserved nor pushed once tracing stops
+    EXPECT_EQ(-EPERM,
+              octf_iotrace_plugin_reserve_trace(context, 0, 64, &reservation));
+    auto io = makeIo(context, 0, 1);
+    const void *trace = &io;
+    uint32_t size = sizeof(io);
+    octf_iotrace_plugin_push_traces(context, 0, &trace, &size, 1);
+    octf_iotrace_plugin_push_trace(context, 0, &io, sizeof(io));
+
+    try {
+        ParsedIoTraceEventQueue queue(summary.tracepath());
+        while (!expected.empty()) {
+            ASSERT_FALSE(queue.empty());
+
+            const auto &io = queue.front().io();
+            ASSERT_EQ(expected.front().lba, io.lba());
+            ASSERT_EQ(expected.front().len, io.len());
+
+            expected.pop_front();
+            queue.pop();
+        }
+        ASSERT_TRUE(queue.empty());
+
+    } catch (Exception &e) {
+        log::cerr << e.getMessage() << std::endl;
+        FAIL();
+    }
+
+    auto plugin = static_cast<IOTracePlugin *>(context->plugin);
+    const auto &configuration = getFrameworkConfiguration();
+    fsutils::removeFile(
+            configuration.getNodeTraceDirectoryPath(plugin->getNodePath()));
+
+    octf_iotrace_plugin_destroy(&context);
+    ASSERT_EQ(nullptr, context);
+}
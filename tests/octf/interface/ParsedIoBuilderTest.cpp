@@ -0,0 +1,212 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <octf/interface/IRingTraceProducer.h>
+#include <octf/interface/TraceConverter.h>
+#include <octf/interface/internal/ParsedIoBuilder.h>
+#include <octf/proto/trace.pb.h>
+#include <octf/trace/iotrace_event.h>
+
+using namespace octf;
+using namespace std;
+
+static constexpr uint32_t QUEUE_COUNT = 3;
+static constexpr uint64_t IO_COUNT = 5000;
+
+/**
+ * @brief Executor providing trace converter only
+ */
+class ConverterExecutor : public ITraceExecutor {
+public:
+    bool startTrace() override {
+        return true;
+    }
+
+    bool stopTrace() override {
+        return true;
+    }
+
+    uint32_t getTraceQueueCount() override {
+        return QUEUE_COUNT;
+    }
+
+    unique_ptr<IRingTraceProducer> createProducer(uint32_t queueId) override {
+        (void) queueId;
+        return nullptr;
+    }
+
+    unique_ptr<ITraceConverter> createTraceConverter() override {
+        return unique_ptr<ITraceConverter>(new TraceConverter());
+    }
+};
+
+/**
+ * @brief Builder recording parsed IO it creates
+ */
+class RecordingParsedIoBuilder : public ParsedIoBuilder {
+public:
+    RecordingParsedIoBuilder(ITraceExecutor *executor)
+            : ParsedIoBuilder(executor,
+                              "",
+                              QUEUE_COUNT,
+                              false,
+                              map<string, string>(),
+                              false,
+                              false)
+            , m_ios() {}
+
+    void handleIO(const proto::trace::ParsedEvent &io) override {
+        m_ios.push_back(io);
+        ParsedIoBuilder::handleIO(io);
+    }
+
+    const vector<proto::trace::ParsedEvent> &getIos() const {
+        return m_ios;
+    }
+
+private:
+    vector<proto::trace::ParsedEvent> m_ios;
+};
+
+/**
+ * @brief Traces of queue, laid out as trace jobs hand them over
+ */
+struct QueueTraces {
+    vector<uint8_t> data;
+    vector<uint32_t> sizes;
+
+    template <typename Trace>
+    void append(const Trace &trace) {
+        auto bytes = reinterpret_cast<const uint8_t *>(&trace);
+        data.insert(data.end(), bytes, bytes + sizeof(trace));
+        sizes.push_back(sizeof(trace));
+    }
+};
+
+static void addDevice(QueueTraces &traces, uint64_t sid) {
+    struct iotrace_event_device_desc desc = {};
+    iotrace_event_init_hdr(&desc.hdr, iotrace_event_type_device_desc, sid,
+                           sid * 10, sizeof(desc));
+    desc.id = 1;
+    desc.device_size = 1 << 30;
+    strncpy(desc.device_name, "dev", sizeof(desc.device_name) - 1);
+    traces.append(desc);
+}
+
+static void addIo(QueueTraces &traces, uint64_t sid, uint64_t io) {
+    struct iotrace_event event = {};
+    iotrace_event_init_hdr(&event.hdr, iotrace_event_type_io, sid, sid * 10,
+                           sizeof(event));
+    event.id = io + 1;
+    event.lba = io * 8;
+    event.len = 8;
+    event.dev_id = 1;
+    event.operation = iotrace_event_operation_wr;
+    traces.append(event);
+}
+
+static void addCompletion(QueueTraces &traces, uint64_t sid, uint64_t io) {
+    struct iotrace_event_completion event = {};
+    iotrace_event_init_hdr(&event.hdr, iotrace_event_type_io_cmpl, sid,
+                           sid * 10, sizeof(event));
+    event.ref_id = io + 1;
+    event.lba = io * 8;
+    event.len = 8;
+    event.dev_id = 1;
+    traces.append(event);
+}
+
+TEST(ParsedIoBuilderTest, MergeQueuesWithCompletions) {
+    ConverterExecutor executor;
+    RecordingParsedIoBuilder builder(&executor);
+
+    // IOs and their completions go to queues at random, and IOs complete
+    // out of order
+    mt19937 generator(0);
+    vector<QueueTraces> traces(QUEUE_COUNT);
+    vector<uint64_t> ioSids(IO_COUNT);
+    vector<uint64_t> latencies(IO_COUNT);
+    vector<uint64_t> inFlight;
+    uint64_t sid = 1;
+    addDevice(traces[0], sid++);
+    for (uint64_t io = 0; io < IO_COUNT || !inFlight.empty();) {
+        if (io < IO_COUNT && (inFlight.size() < 32 || generator() % 2)) {
+            ioSids[io] = sid;
+            addIo(traces[generator() % QUEUE_COUNT], sid++, io);
+            inFlight.push_back(io++);
+        } else {
+            auto iter = inFlight.begin() + generator() % inFlight.size();
+            latencies[*iter] = (sid - ioSids[*iter]) * 10;
+            addCompletion(traces[generator() % QUEUE_COUNT], sid++, *iter);
+            inFlight.erase(iter);
+        }
+    }
+
+    // Queues hand over chunks of different sizes in turns, so the builder
+    // waits for queues lagging behind
+    vector<QueueTraces> chunks(QUEUE_COUNT);
+    vector<size_t> next(QUEUE_COUNT, 0);
+    vector<size_t> offsets(QUEUE_COUNT, 0);
+    for (bool pending = true; pending;) {
+        pending = false;
+        for (uint32_t queue = 0; queue < QUEUE_COUNT; queue++) {
+            auto &src = traces[queue];
+            auto &chunk = chunks[queue];
+            for (uint32_t count = generator() % 200;
+                 count && next[queue] < src.sizes.size(); count--) {
+                uint32_t size = src.sizes[next[queue]++];
+                chunk.data.insert(chunk.data.end(),
+                                  src.data.begin() + offsets[queue],
+                                  src.data.begin() + offsets[queue] + size);
+                chunk.sizes.push_back(size);
+                offsets[queue] += size;
+            }
+            builder.addTraces(queue, chunk.data, chunk.sizes);
+            pending |= next[queue] < src.sizes.size();
+        }
+    }
+    ASSERT_TRUE(builder.finish());
+
+    // IOs come in submission order, each of them matched with its completion
+    const auto &ios = builder.getIos();
+    ASSERT_EQ(IO_COUNT, ios.size());
+    for (uint64_t io = 0; io < IO_COUNT; io++) {
+        ASSERT_EQ(io + 1, ios[io].header().sid());
+        ASSERT_EQ(io * 8, ios[io].io().lba());
+        ASSERT_EQ(latencies[io], ios[io].io().latency());
+        ASSERT_EQ("dev", ios[io].device().name());
+    }
+}
+
+TEST(ParsedIoBuilderTest, GiveUpOnTracesOutOfOrder) {
+    ConverterExecutor executor;
+    RecordingParsedIoBuilder builder(&executor);
+
+    QueueTraces first;
+    addDevice(first, 1);
+    for (uint64_t io = 0; io < 10; io++) {
+        addIo(first, io + 3, io);
+    }
+    builder.addTraces(0, first.data, first.sizes);
+
+    // Other queues are silent for longer than the builder waits for them,
+    // then one of them hands over a trace preceding merged ones
+    this_thread::sleep_for(chrono::milliseconds(500));
+    QueueTraces late;
+    addCompletion(late, 2, 0);
+    builder.addTraces(1, late.data, late.sizes);
+
+    ASSERT_FALSE(builder.finish());
+    ASSERT_TRUE(builder.isFailed());
+}
@@ -0,0 +1,637 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <signal.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <octf/communication/RpcControllerImpl.h>
+#include <octf/interface/InterfaceTraceCreatingImpl.h>
+#include <octf/interface/TraceConverter.h>
+#include <octf/interface/TraceManager.h>
+#include <octf/interface/internal/TraceJob.h>
+#include <octf/octf.h>
+#include <octf/trace/iotrace_event.h>
+#include <octf/trace/parser/TraceFileReader.h>
+#include <octf/utils/FileOperations.h>
+#include <octf/utils/SizeConversion.h>
+
+#include <octf/UtilsTest.h>
+
+using namespace octf;
+using namespace std;
+
+static constexpr uint32_t SUB_RING_COUNT = 4;
+static constexpr uint64_t EVENT_COUNT = 200000;
+
+/**
+ * @brief Producer of sub-rings chosen by the caller, so that traces are
+ * spread over sub-rings regardless of CPUs they're pushed on
+ */
+class SubRingTraceProducer : public IRingTraceProducer {
+public:
+    SubRingTraceProducer()
+            : m_rings(SUB_RING_COUNT)
+            , m_handles(SUB_RING_COUNT, nullptr)
+            , m_stop(false) {}
+
+    virtual ~SubRingTraceProducer() {
+        deinitRing();
+    }
+
+    char *getBuffer(void) override {
+        return getSubRingBuffer(0);
+    }
+
+    size_t getSize(void) const override {
+        return getSubRingSize(0) * SUB_RING_COUNT;
+    }
+
+    octf_trace_hdr_t *getConsumerHeader(void) override {
+        return nullptr;
+    }
+
+    uint32_t getSubRingCount(void) const override {
+        return SUB_RING_COUNT;
+    }
+
+    char *getSubRingBuffer(uint32_t subRing) override {
+        return reinterpret_cast<char *>(m_rings[subRing].data());
+    }
+
+    size_t getSubRingSize(uint32_t subRing) const override {
+        return m_rings[subRing].size() * sizeof(uint64_t);
+    }
+
+    octf_trace_hdr_t *getSubRingConsumerHeader(uint32_t subRing) override {
+        (void) subRing;
+        return nullptr;
+    }
+
+    bool wait(std::chrono::time_point<std::chrono::steady_clock> &endTime)
+            override {
+        // Traces are picked up periodically
+        this_thread::sleep_for(chrono::milliseconds(1));
+        return !m_stop && chrono::steady_clock::now() < endTime;
+    }
+
+    void stop(void) override {
+        m_stop = true;
+    }
+
+    int getCpuAffinity(void) override {
+        return NO_CPU_AFFINITY;
+    }
+
+    void initRing(uint32_t memoryPoolSize, uint32_t subRingCount) override {
+        (void) subRingCount;
+
+        for (uint32_t i = 0; i < SUB_RING_COUNT; i++) {
+            m_rings[i].resize(memoryPoolSize / SUB_RING_COUNT /
+                              sizeof(uint64_t));
+            if (octf_trace_open(getSubRingBuffer(i), getSubRingSize(i), NULL,
+                                octf_trace_open_mode_producer, &m_handles[i])) {
+                throw Exception("Failed to initialize trace producer");
+            }
+        }
+    }
+
+    void deinitRing() override {
+        for (auto &handle : m_handles) {
+            octf_trace_close(&handle);
+        }
+    }
+
+    void setFullPolicy(octf_trace_full_policy_t policy,
+                       uint64_t timeoutUs) override {
+        for (const auto &handle : m_handles) {
+            octf_trace_set_full_policy(handle, policy, timeoutUs);
+        }
+    }
+
+    int pushTrace(const void *trace, const uint32_t traceSize) override {
+        return pushTrace(0, trace, traceSize);
+    }
+
+    int pushTraces(const void *const *traces,
+                   const uint32_t *traceSizes,
+                   uint32_t count) override {
+        return octf_trace_push_batch(m_handles[0], traces, traceSizes, count);
+    }
+
+    int reserveTrace(const uint32_t traceSize,
+                     TraceReservation &reservation) override {
+        (void) traceSize;
+        (void) reservation;
+        return -ENOSPC;
+    }
+
+    int commitTrace(const TraceReservation &reservation) override {
+        (void) reservation;
+        return -EINVAL;
+    }
+
+    int32_t getQueueId() override {
+        return 0;
+    }
+
+    /**
+     * @brief Pushes trace to given sub-ring
+     */
+    int pushTrace(uint32_t subRing, const void *trace, uint32_t traceSize) {
+        return octf_trace_push(m_handles[subRing], trace, traceSize);
+    }
+
+private:
+    vector<vector<uint64_t>> m_rings;
+    vector<octf_trace_t> m_handles;
+    atomic<bool> m_stop;
+};
+
+/**
+ * @brief Executor of single queue backed by SubRingTraceProducer
+ */
+class SubRingTraceExecutor : public ITraceExecutor {
+public:
+    SubRingTraceExecutor()
+            : m_producer(nullptr) {}
+
+    bool startTrace() override {
+        return true;
+    }
+
+    bool stopTrace() override {
+        return true;
+    }
+
+    uint32_t getTraceQueueCount() override {
+        return 1;
+    }
+
+    unique_ptr<IRingTraceProducer> createProducer(uint32_t queueId) override {
+        (void) queueId;
+        m_producer = new SubRingTraceProducer();
+        return unique_ptr<IRingTraceProducer>(m_producer);
+    }
+
+    unique_ptr<ITraceConverter> createTraceConverter() override {
+        return unique_ptr<ITraceConverter>(new TraceConverter());
+    }
+
+    SubRingTraceProducer *getProducer() {
+        return m_producer;
+    }
+
+private:
+    SubRingTraceProducer *m_producer;
+};
+
+TEST(TraceJobTest, MergeSubRingsOfManyProducers) {
+    try {
+        SetupTestOutput(test_info_);
+
+        const string traceDir =
+                getFrameworkConfiguration().getTraceDir() + "/Test/TraceJob";
+        fsutils::removeFile(traceDir);
+        ASSERT_TRUE(fsutils::createDirectory(traceDir));
+        const string traceFile = traceDir + "/" + TRACE_FILE_PREFIX + "0";
+
+        TraceConfig config;
+        config.maxDuration = 100;
+        // No event is dropped, unless the job fails to consume them
+        config.fullPolicy = octf_trace_full_policy_wait_bounded;
+        config.fullTimeoutUs = 1000000;
+
+        SubRingTraceExecutor executor;
+        unique_ptr<TraceJob> job(new TraceJob(&executor, config, 0, traceFile,
+                                              MiBToBytes(SUB_RING_COUNT),
+                                              nullptr, nullptr));
+        job->startJobThread();
+        job->waitForJobInitialization();
+
+        // Each thread pushes to its own sub-ring, bursts of random length
+        // make sub-rings fill up unevenly. Sid is assigned and the event is
+        // pushed at once, so each sub-ring is ordered by sid.
+        mutex sidMutex;
+        uint64_t nextSid = 1;
+        bool failed = false;
+        auto push = [&executor, &sidMutex, &nextSid, &failed](
+                            uint32_t subRing) {
+            mt19937 generator(subRing);
+            for (bool pushing = true; pushing;) {
+                lock_guard<mutex> lock(sidMutex);
+                for (uint32_t burst = generator() % 512; burst; burst--) {
+                    if (nextSid > EVENT_COUNT || failed) {
+                        pushing = false;
+                        break;
+                    }
+
+                    struct iotrace_event io = {};
+                    iotrace_event_init_hdr(&io.hdr, iotrace_event_type_io,
+                                           nextSid, nextSid, sizeof(io));
+                    io.id = nextSid;
+                    io.lba = nextSid * 8;
+                    io.len = 8;
+                    io.operation = iotrace_event_operation_wr;
+                    if (executor.getProducer()->pushTrace(subRing, &io,
+                                                          sizeof(io))) {
+                        failed = true;
+                    }
+                    nextSid++;
+                }
+            }
+        };
+
+        vector<thread> producers;
+        for (uint32_t subRing = 0; subRing < SUB_RING_COUNT; subRing++) {
+            producers.emplace_back(push, subRing);
+        }
+        for (auto &producer : producers) {
+            producer.join();
+        }
+
+        job->stopJobThread();
+        job->joinThread();
+        job.reset();
+        ASSERT_FALSE(failed);
+
+        // Events of all sub-rings are merged into the trace file in sid order
+        TraceFileReader reader(traceFile, 0);
+        reader.init();
+        proto::trace::Event event;
+        uint64_t sid = 0;
+        while (!reader.isFinished()) {
+            reader.readTraceEvent(event);
+            ASSERT_EQ(sid + 1, event.header().sid());
+            sid = event.header().sid();
+        }
+        reader.deinit();
+        fsutils::removeFile(traceDir);
+
+        ASSERT_EQ(EVENT_COUNT, sid);
+
+    } catch (Exception &e) {
+        log::cerr << e.getMessage() << std::endl;
+        FAIL();
+    }
+}
+
+/**
+ * @brief Pushes IO events of given sids, spread over sub-rings in turn
+ */
+static bool pushEvents(SubRingTraceProducer *producer,
+                       uint64_t firstSid,
+                       uint64_t lastSid) {
+    for (uint64_t sid = firstSid; sid <= lastSid; sid++) {
+        struct iotrace_event io = {};
+        iotrace_event_init_hdr(&io.hdr, iotrace_event_type_io, sid, sid,
+                               sizeof(io));
+        io.id = sid;
+        io.lba = sid * 8;
+        io.len = 8;
+        io.operation = iotrace_event_operation_wr;
+        if (producer->pushTrace(sid % SUB_RING_COUNT, &io, sizeof(io))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Reads sids of events of the trace file
+ */
+static vector<uint64_t> readSids(const string &traceFile) {
+    vector<uint64_t> sids;
+
+    TraceFileReader reader(traceFile, 0);
+    reader.init();
+    proto::trace::Event event;
+    while (!reader.isFinished()) {
+        reader.readTraceEvent(event);
+        sids.push_back(event.header().sid());
+    }
+    reader.deinit();
+
+    return sids;
+}
+
+/**
+ * @brief Polls the condition until it's met or the timeout passes
+ */
+template <typename Condition>
+static bool waitFor(Condition condition) {
+    auto endTime = chrono::steady_clock::now() + chrono::seconds(10);
+
+    while (!condition()) {
+        if (chrono::steady_clock::now() > endTime) {
+            return false;
+        }
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+
+    return true;
+}
+
+TEST(TraceJobTest, FlightRecorderSnapshotKeepsLatestEvents) {
+    try {
+        SetupTestOutput(test_info_);
+
+        const string traceDir =
+                getFrameworkConfiguration().getTraceDir() + "/Test/TraceJob";
+        fsutils::removeFile(traceDir);
+        ASSERT_TRUE(fsutils::createDirectory(traceDir));
+        const string traceFile = traceDir + "/" + TRACE_FILE_PREFIX + "0";
+
+        TraceConfig config;
+        config.fullPolicy = octf_trace_full_policy_overwrite;
+
+        SubRingTraceExecutor executor;
+        unique_ptr<TraceJob> job(new TraceJob(&executor, config, 0, traceFile,
+                                              MiBToBytes(SUB_RING_COUNT),
+                                              nullptr, nullptr));
+        job->startJobThread();
+        job->waitForJobInitialization();
+        auto bufferSize = executor.getProducer()->getSize();
+
+        // Many times more events than the buffer keeps, nothing is saved
+        // until snapshot
+        ASSERT_TRUE(pushEvents(executor.getProducer(), 1, EVENT_COUNT));
+        ASSERT_EQ(0, job->getTraceCount());
+
+        // Snapshot requested before stop is taken anyway
+        job->requestSnapshot();
+        job->stopJobThread();
+        job->joinThread();
+        job.reset();
+
+        auto sids = readSids(traceFile);
+        fsutils::removeFile(traceDir);
+
+        // The latest events are saved in sid order, the oldest ones are
+        // overwritten
+        ASSERT_FALSE(sids.empty());
+        ASSERT_EQ(EVENT_COUNT, sids.back());
+        ASSERT_GT(sids.front(), 1);
+        ASSERT_TRUE(is_sorted(sids.begin(), sids.end()));
+        ASSERT_LE(sids.size() * sizeof(struct iotrace_event), bufferSize);
+
+    } catch (Exception &e) {
+        log::cerr << e.getMessage() << std::endl;
+        FAIL();
+    }
+}
+
+TEST(TraceJobTest, FlightRecorderSnapshotTakesOneBufferAtMost) {
+    try {
+        SetupTestOutput(test_info_);
+
+        const string traceDir =
+                getFrameworkConfiguration().getTraceDir() + "/Test/TraceJob";
+        fsutils::removeFile(traceDir);
+        ASSERT_TRUE(fsutils::createDirectory(traceDir));
+        const string traceFile = traceDir + "/" + TRACE_FILE_PREFIX + "0";
+
+        TraceConfig config;
+        config.fullPolicy = octf_trace_full_policy_overwrite;
+
+        SubRingTraceExecutor executor;
+        unique_ptr<TraceJob> job(new TraceJob(&executor, config, 0, traceFile,
+                                              MiBToBytes(SUB_RING_COUNT),
+                                              nullptr, nullptr));
+        job->startJobThread();
+        job->waitForJobInitialization();
+        auto bufferSize = executor.getProducer()->getSize();
+
+        // Producers keep on pushing while the snapshot is taken, each one to
+        // its own sub-ring
+        atomic<bool> pushing(true);
+        atomic<uint64_t> pushed(0);
+        auto push = [&executor, &pushing, &pushed](uint32_t subRing) {
+            for (uint64_t sid = subRing + 1; pushing;
+                 sid += SUB_RING_COUNT) {
+                struct iotrace_event io = {};
+                iotrace_event_init_hdr(&io.hdr, iotrace_event_type_io, sid,
+                                       sid, sizeof(io));
+                io.id = sid;
+                io.len = 8;
+                io.operation = iotrace_event_operation_rd;
+                executor.getProducer()->pushTrace(subRing, &io, sizeof(io));
+                pushed++;
+            }
+        };
+
+        vector<thread> producers;
+        for (uint32_t subRing = 0; subRing < SUB_RING_COUNT; subRing++) {
+            producers.emplace_back(push, subRing);
+        }
+
+        ASSERT_TRUE(waitFor([&pushed, bufferSize] {
+            return pushed * sizeof(struct iotrace_event) > 2 * bufferSize;
+        }));
+        job->requestSnapshot();
+        this_thread::sleep_for(chrono::milliseconds(300));
+
+        pushing = false;
+        for (auto &producer : producers) {
+            producer.join();
+        }
+        job->stopJobThread();
+        job->joinThread();
+        job.reset();
+
+        auto sids = readSids(traceFile);
+        fsutils::removeFile(traceDir);
+
+        // Snapshot ends after one buffer's worth of events, plus the batches
+        // fetched at last
+        uint64_t batchesSize =
+                SUB_RING_COUNT * 256 * sizeof(struct iotrace_event);
+        ASSERT_FALSE(sids.empty());
+        ASSERT_LE(sids.size() * sizeof(struct iotrace_event),
+                  bufferSize + batchesSize);
+        ASSERT_GT(pushed * sizeof(struct iotrace_event),
+                  4 * (bufferSize + batchesSize));
+
+    } catch (Exception &e) {
+        log::cerr << e.getMessage() << std::endl;
+        FAIL();
+    }
+}
+
+/**
+ * @brief Starts flight recorder of TraceManager and waits until it's running
+ */
+static void startFlightRecorder(TraceManager &manager, TraceConfig config) {
+    config.maxFileSizeMiB = 100;
+    config.circBufferSizeMiB = SUB_RING_COUNT;
+    config.fullPolicy = octf_trace_full_policy_overwrite;
+    manager.startJobs(config);
+
+    ASSERT_TRUE(waitFor([&manager] {
+        return manager.getState() == TracingState::RUNNING;
+    }));
+}
+
+TEST(TraceManagerTest, FlightRecorderSnapshotTriggers) {
+    try {
+        SetupTestOutput(test_info_);
+
+        TraceConfig config;
+        config.snapshotLatencyUs = 1000;
+        config.snapshotSignal = SIGUSR2;
+
+        SubRingTraceExecutor executor;
+        const NodePath nodePath = {NodeId("FlightRecorderSnapshotTriggers")};
+        TraceManager manager(nodePath, &executor);
+        startFlightRecorder(manager, config);
+        ASSERT_EQ(0, manager.getSnapshotCount());
+
+        manager.requestSnapshot();
+        ASSERT_TRUE(waitFor([&manager] {
+            return manager.getSnapshotCount() == 1;
+        }));
+
+        // IO latency below the threshold doesn't trigger snapshot
+        manager.reportIoLatency(999999);
+        this_thread::sleep_for(chrono::milliseconds(200));
+        ASSERT_EQ(1, manager.getSnapshotCount());
+
+        manager.reportIoLatency(1000000);
+        ASSERT_TRUE(waitFor([&manager] {
+            return manager.getSnapshotCount() == 2;
+        }));
+
+        ASSERT_EQ(0, raise(SIGUSR2));
+        ASSERT_TRUE(waitFor([&manager] {
+            return manager.getSnapshotCount() == 3;
+        }));
+
+        manager.stopJobs();
+        ASSERT_EQ(3, manager.getSnapshotCount());
+
+        // Handler replaced by the snapshot signal's one is restored
+        struct sigaction action = {};
+        ASSERT_EQ(0, sigaction(SIGUSR2, nullptr, &action));
+        ASSERT_EQ(SIG_DFL, action.sa_handler);
+        const auto &configuration = getFrameworkConfiguration();
+        fsutils::removeFile(configuration.getNodeTraceDirectoryPath(nodePath));
+
+    } catch (Exception &e) {
+        log::cerr << e.getMessage() << std::endl;
+        FAIL();
+    }
+}
+
+TEST(TraceManagerTest, FlightRecorderSnapshotHoldOff) {
+    try {
+        SetupTestOutput(test_info_);
+
+        TraceConfig config;
+        config.snapshotIntervalMs = 300;
+
+        SubRingTraceExecutor executor;
+        const NodePath nodePath = {NodeId("FlightRecorderSnapshotHoldOff")};
+        TraceManager manager(nodePath, &executor);
+        startFlightRecorder(manager, config);
+
+        // The first snapshot isn't delayed
+        auto startTime = chrono::steady_clock::now();
+        manager.requestSnapshot();
+        ASSERT_TRUE(waitFor([&manager] {
+            return manager.getSnapshotCount() == 1;
+        }));
+
+        // Requests within the interval are merged into one delayed snapshot
+        manager.requestSnapshot();
+        manager.reportIoLatency(UINT64_MAX);
+        manager.requestSnapshot();
+        ASSERT_TRUE(waitFor([&manager] {
+            return manager.getSnapshotCount() == 2;
+        }));
+        ASSERT_GE(chrono::steady_clock::now() - startTime,
+                  chrono::milliseconds(300));
+
+        this_thread::sleep_for(chrono::milliseconds(400));
+        ASSERT_EQ(2, manager.getSnapshotCount());
+
+        manager.stopJobs();
+        const auto &configuration = getFrameworkConfiguration();
+        fsutils::removeFile(configuration.getNodeTraceDirectoryPath(nodePath));
+
+    } catch (Exception &e) {
+        log::cerr << e.getMessage() << std::endl;
+        FAIL();
+    }
+}
+
+static void doNothing() {}
+
+TEST(TraceManagerTest, FlightRecorderSnapshotRpc) {
+    try {
+        SetupTestOutput(test_info_);
+
+        SubRingTraceExecutor executor;
+        const NodePath nodePath = {NodeId("FlightRecorderSnapshotRpc")};
+        InterfaceTraceCreatingImpl interface(nodePath, &executor);
+
+        proto::StartTraceRequest request;
+        request.set_maxduration(3600);
+        request.set_maxsize(100);
+        request.set_circbuffersize(SUB_RING_COUNT);
+        request.set_fullpolicy(proto::TraceFullPolicy::FLIGHT_RECORDER);
+        proto::Void response;
+        RpcControllerImpl startController;
+        interface.StartTracing(&startController, &request, &response,
+                               google::protobuf::NewCallback(doNothing));
+        ASSERT_FALSE(startController.Failed())
+                << startController.ErrorText();
+
+        proto::TraceSummary summary;
+        proto::Void empty;
+        ASSERT_TRUE(waitFor([&interface, &summary, &empty] {
+            RpcControllerImpl controller;
+            interface.GetTraceSummary(&controller, &empty, &summary,
+                                      google::protobuf::NewCallback(doNothing));
+            return summary.state() == proto::TraceState::RUNNING;
+        }));
+
+        // Events are saved on snapshot only
+        ASSERT_TRUE(pushEvents(executor.getProducer(), 1, EVENT_COUNT));
+
+        RpcControllerImpl snapshotController;
+        interface.TakeTraceSnapshot(&snapshotController, &empty, &empty,
+                                    google::protobuf::NewCallback(doNothing));
+        ASSERT_FALSE(snapshotController.Failed())
+                << snapshotController.ErrorText();
+
+        RpcControllerImpl stopController;
+        interface.StopTracing(&stopController, &empty, &summary,
+                              google::protobuf::NewCallback(doNothing));
+        ASSERT_FALSE(stopController.Failed()) << stopController.ErrorText();
+        ASSERT_GT(summary.tracedevents(), 0);
+        ASSERT_LT(summary.tracedevents(), EVENT_COUNT);
+
+        // Snapshot can't be taken once flight recorder is stopped
+        interface.TakeTraceSnapshot(&snapshotController, &empty, &empty,
+                                    google::protobuf::NewCallback(doNothing));
+        ASSERT_TRUE(snapshotController.Failed());
+
+        const auto &configuration = getFrameworkConfiguration();
+        fsutils::removeFile(configuration.getNodeTraceDirectoryPath(nodePath));
+
+    } catch (Exception &e) {
+        log::cerr << e.getMessage() << std::endl;
+        FAIL();
+    }
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <sys/sysinfo.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <octf/interface/TraceProducerLocal.h>
+#include <octf/utils/Numa.h>
+#include <octf/utils/SizeConversion.h>
+
+using namespace octf;
+using namespace std;
+
+TEST(TraceProducerLocal, DeinitRingWithProducerWaiting) {
+    TraceProducerLocal producer(0);
+    producer.initRing(MiBToBytes(1), 0);
+    producer.setFullPolicy(octf_trace_full_policy_wait, 0);
+
+    vector<octf_trace_t> consumers(producer.getSubRingCount());
+    for (uint32_t i = 0; i < consumers.size(); i++) {
+        ASSERT_EQ(0, octf_trace_open(producer.getSubRingBuffer(i),
+                                     producer.getSubRingSize(i),
+                                     producer.getSubRingConsumerHeader(i),
+                                     octf_trace_open_mode_consumer,
+                                     &consumers[i]));
+    }
+
+    // Nobody reads traces, so the producer ends up waiting for free space
+    atomic<uint64_t> pushed(0);
+    int result = 0;
+    thread pusher([&producer, &pushed, &result]() {
+        vector<char> trace(4096, 'x');
+        while (!(result = producer.pushTrace(trace.data(), trace.size()))) {
+            pushed++;
+        }
+    });
+
+    uint64_t count;
+    do {
+        count = pushed;
+        this_thread::sleep_for(chrono::milliseconds(100));
+    } while (count != pushed);
+
+    // Closing consumers gets the producer out of the ring, and the ring is
+    // unmapped once it leaves
+    for (auto &consumer : consumers) {
+        octf_trace_close(&consumer);
+    }
+    producer.deinitRing();
+    pusher.join();
+
+    EXPECT_GT(pushed, 0U);
+    EXPECT_EQ(-ENOSPC, result);
+}
+
+TEST(TraceProducerLocal, HugePageRingSplitIntoSubRings) {
+    TraceProducerLocal producer(0);
+    const uint32_t cpuCount = get_nprocs_conf();
+
+    // Pool of huge pages, sub-rings no more than CPUs nor MiBs of the pool
+    producer.initRing(MiBToBytes(8), 0);
+    const uint32_t subRingCount = producer.getSubRingCount();
+    EXPECT_GE(subRingCount, 1U);
+    EXPECT_LE(subRingCount, cpuCount);
+    EXPECT_LE(subRingCount, 8U);
+
+    size_t size = 0;
+    for (uint32_t i = 0; i < subRingCount; i++) {
+        if (subRingCount > 1) {
+            EXPECT_EQ(0U, producer.getSubRingSize(i) % 4096);
+        }
+        EXPECT_GE(producer.getSubRingSize(i), MiBToBytes(1));
+        size += producer.getSubRingSize(i);
+    }
+    EXPECT_LE(size, MiBToBytes(8));
+
+    // Ring is placed on node of some CPU, if NUMA topology is known
+    int node = producer.getNumaNode();
+    if (node != numautils::NO_NUMA_NODE) {
+        vector<uint32_t> cpus;
+        EXPECT_TRUE(numautils::getNodeCpus(node, cpus));
+        EXPECT_FALSE(cpus.empty());
+    }
+
+    // Traces are pushed and reserved in the sub-ring of the current CPU
+    vector<char> trace(64, 'x');
+    EXPECT_EQ(0, producer.pushTrace(trace.data(), trace.size()));
+    TraceReservation reservation;
+    ASSERT_EQ(0, producer.reserveTrace(trace.size(), reservation));
+    EXPECT_LT(reservation.subRing, subRingCount);
+    EXPECT_EQ(0, producer.commitTrace(reservation));
+
+    // Trace doesn't fit in sub-ring
+    vector<char> hugeTrace(MiBToBytes(8) + 1, 'x');
+    EXPECT_EQ(-ENOSPC, producer.pushTrace(hugeTrace.data(), hugeTrace.size()));
+    EXPECT_EQ(-ENOSPC, producer.reserveTrace(hugeTrace.size(), reservation));
+
+    // Small pool isn't split, and nothing is traced once it's deinitialized
+    producer.deinitRing();
+    EXPECT_EQ(-ENOSPC, producer.pushTrace(trace.data(), trace.size()));
+    producer.initRing(MiBToBytes(1), cpuCount);
+    EXPECT_EQ(1U, producer.getSubRingCount());
+    EXPECT_EQ(0, producer.pushTrace(trace.data(), trace.size()));
+}
+
+TEST(TraceProducerLocal, PushWhileRingReinitialized) {
+    TraceProducerLocal producer(0);
+
+    // Traces are dropped when ring is full, as nobody reads them
+    atomic<bool> stop(false);
+    atomic<uint64_t> pushed(0);
+    atomic<int> unexpected(0);
+    thread pusher([&]() {
+        vector<char> trace(256, 'x');
+        while (!stop) {
+            int result = producer.pushTrace(trace.data(), trace.size());
+            TraceReservation reservation;
+            if (!result) {
+                result = producer.reserveTrace(trace.size(), reservation);
+            }
+            if (!result) {
+                result = producer.commitTrace(reservation);
+            }
+
+            if (!result) {
+                pushed++;
+            } else if (-ENOSPC != result) {
+                unexpected = result;
+            }
+        }
+    });
+
+    // Producer races with the ring being closed and re-opened with different
+    // number of sub-rings
+    for (uint32_t i = 0; i < 200; i++) {
+        producer.initRing(MiBToBytes(1 + i % 4), 1 + i % 4);
+        this_thread::sleep_for(chrono::microseconds(500));
+        producer.deinitRing();
+    }
+
+    stop = true;
+    pusher.join();
+
+    EXPECT_EQ(0, unexpected);
+    EXPECT_GT(pushed, 0U);
+}
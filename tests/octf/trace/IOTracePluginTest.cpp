@@ -0,0 +1,242 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <octf/octf.h>
+#include <octf/trace/IOTracePlugin.h>
+#include <octf/trace/iotrace_event.h>
+
+#include <octf/UtilsTest.h>
+
+using namespace octf;
+using namespace std;
+
+static struct iotrace_event makeIo(uint64_t id,
+                                   uint32_t devId,
+                                   uint64_t lba,
+                                   uint32_t len,
+                                   uint8_t operation) {
+    struct iotrace_event io = {};
+    iotrace_event_init_hdr(&io.hdr, iotrace_event_type_io, id, id,
+                           sizeof(io));
+    io.id = id;
+    io.dev_id = devId;
+    io.lba = lba;
+    io.len = len;
+    io.operation = operation;
+    return io;
+}
+
+static struct iotrace_event_completion makeCompletion(
+        const struct iotrace_event &io) {
+    struct iotrace_event_completion cmpl = {};
+    iotrace_event_init_hdr(&cmpl.hdr, iotrace_event_type_io_cmpl, io.id,
+                           io.id, sizeof(cmpl));
+    cmpl.ref_id = io.id;
+    cmpl.dev_id = io.dev_id;
+    cmpl.lba = io.lba;
+    cmpl.len = io.len;
+    return cmpl;
+}
+
+/**
+ * @brief Checks if IO is traced, and that its completion is traced the same
+ */
+static bool isIoTraced(const IOTracePlugin &plugin,
+                       const struct iotrace_event &io) {
+    bool traced = plugin.isTraced(&io, sizeof(io));
+
+    auto cmpl = makeCompletion(io);
+    EXPECT_EQ(traced, plugin.isTraced(&cmpl, sizeof(cmpl)))
+            << "Completion of IO " << io.id << " isn't traced the same";
+
+    return traced;
+}
+
+TEST(IOTracePluginTest, FilterIosAndTheirCompletions) {
+    SetupTestOutput(test_info_);
+
+    IOTracePlugin plugin("Test", 1);
+
+    proto::TraceFilter filter;
+    filter.add_deviceid(7);
+    filter.add_deviceid(3);
+    filter.add_operation(proto::trace::IoType::Write);
+    filter.add_operation(proto::trace::IoType::Discard);
+    auto range = filter.add_lbarange();
+    range->set_first(1000);
+    range->set_last(1999);
+    range = filter.add_lbarange();
+    range->set_first(100);
+    range->set_last(199);
+    range = filter.add_lbarange();
+    range->set_first(150);
+    range->set_last(299);
+    filter.set_minsize(8);
+    ASSERT_TRUE(plugin.setFilter(filter));
+
+    const uint8_t rd = iotrace_event_operation_rd;
+    const uint8_t wr = iotrace_event_operation_wr;
+    const uint8_t discard = iotrace_event_operation_discard;
+
+    // Each criterion on its own
+    EXPECT_TRUE(isIoTraced(plugin, makeIo(1, 3, 100, 8, wr)));
+    EXPECT_TRUE(isIoTraced(plugin, makeIo(2, 7, 1000, 8, discard)));
+    EXPECT_FALSE(isIoTraced(plugin, makeIo(3, 5, 100, 8, wr)));
+    EXPECT_FALSE(isIoTraced(plugin, makeIo(4, 3, 100, 8, rd)));
+    EXPECT_FALSE(isIoTraced(plugin, makeIo(5, 3, 100, 4, wr)));
+    EXPECT_FALSE(isIoTraced(plugin, makeIo(6, 3, 500, 8, wr)));
+
+    // Overlapping ranges are merged, IOs overlapping their ends are traced
+    EXPECT_TRUE(isIoTraced(plugin, makeIo(7, 3, 250, 8, wr)));
+    EXPECT_TRUE(isIoTraced(plugin, makeIo(8, 3, 296, 8, wr)));
+    EXPECT_TRUE(isIoTraced(plugin, makeIo(9, 3, 92, 9, wr)));
+    EXPECT_FALSE(isIoTraced(plugin, makeIo(10, 3, 300, 8, wr)));
+    EXPECT_FALSE(isIoTraced(plugin, makeIo(11, 3, 92, 8, wr)));
+    EXPECT_TRUE(isIoTraced(plugin, makeIo(12, 3, 1999, 8, wr)));
+    EXPECT_FALSE(isIoTraced(plugin, makeIo(13, 3, 2000, 8, wr)));
+
+    // Operation of IO isn't known to completion, it follows the IO
+    auto io = makeIo(14, 3, 100, 8, rd);
+    auto cmpl = makeCompletion(io);
+    ASSERT_FALSE(plugin.isTraced(&io, sizeof(io)));
+    ASSERT_FALSE(plugin.isTraced(&cmpl, sizeof(cmpl)));
+
+    // Completion of IO not filtered out, e.g. issued before the filter was
+    // set, is traced
+    io = makeIo(15, 3, 100, 8, rd);
+    cmpl = makeCompletion(io);
+    ASSERT_TRUE(plugin.isTraced(&cmpl, sizeof(cmpl)));
+
+    // Completion without IO ID is matched by device, address and size
+    io = makeIo(0, 3, 100, 8, rd);
+    ASSERT_FALSE(plugin.isTraced(&io, sizeof(io)));
+    cmpl = makeCompletion(io);
+    ASSERT_TRUE(plugin.isTraced(&cmpl, sizeof(cmpl)));
+    cmpl.dev_id = 5;
+    ASSERT_FALSE(plugin.isTraced(&cmpl, sizeof(cmpl)));
+
+    // The same applies to pushed events checked by the C plug-in
+    ASSERT_FALSE(plugin.matchesFilter(iotrace_event_type_io, 3, 16, 100, 8,
+                                      rd));
+    ASSERT_FALSE(plugin.matchesFilter(iotrace_event_type_io_cmpl, 3, 16, 100,
+                                      8, 0));
+    ASSERT_TRUE(plugin.matchesFilter(iotrace_event_type_io, 3, 17, 100, 8,
+                                     wr));
+    ASSERT_TRUE(plugin.matchesFilter(iotrace_event_type_io_cmpl, 3, 17, 100,
+                                     8, 0));
+
+    // Empty filter matches all IOs
+    ASSERT_TRUE(plugin.setFilter(proto::TraceFilter()));
+    EXPECT_TRUE(isIoTraced(plugin, makeIo(18, 5, 500, 1, rd)));
+}
+
+TEST(IOTracePluginTest, FilterCompletionsOfIosEvicted) {
+    SetupTestOutput(test_info_);
+
+    IOTracePlugin plugin("Test", 1);
+
+    proto::TraceFilter filter;
+    filter.add_operation(proto::trace::IoType::Write);
+    ASSERT_TRUE(plugin.setFilter(filter));
+
+    // More IOs are filtered out before they complete than IDs fit in the
+    // table, all of them are filtered out still
+    const uint64_t count = 200000;
+    for (uint64_t id = 1; id <= count; id++) {
+        auto io = makeIo(id, 0, id * 8, 8, iotrace_event_operation_rd);
+        ASSERT_FALSE(plugin.isTraced(&io, sizeof(io)));
+    }
+
+    // Completions of IOs evicted from the table are traced, the latest IOs
+    // are remembered mostly
+    uint64_t tracedCompletions = 0;
+    uint64_t tracedLatestCompletions = 0;
+    for (uint64_t id = 1; id <= count; id++) {
+        auto io = makeIo(id, 0, id * 8, 8, iotrace_event_operation_rd);
+        auto cmpl = makeCompletion(io);
+        bool traced = plugin.isTraced(&cmpl, sizeof(cmpl));
+        tracedCompletions += traced;
+        tracedLatestCompletions += traced && id > count - 1000;
+    }
+    EXPECT_GE(tracedCompletions, count - 65536);
+    EXPECT_LT(tracedCompletions, count);
+    EXPECT_LT(tracedLatestCompletions, 100);
+
+    // IDs are forgotten on completion, so there's room for them again
+    for (uint64_t id = 1; id <= 1000; id++) {
+        EXPECT_FALSE(isIoTraced(
+                plugin, makeIo(id, 0, id * 8, 8, iotrace_event_operation_rd)));
+    }
+}
+
+TEST(IOTracePluginTest, SampleIosAndTheirCompletions) {
+    SetupTestOutput(test_info_);
+
+    IOTracePlugin plugin("Test", 1);
+    const uint64_t count = 100000;
+    const uint32_t rate = 4;
+
+    for (auto sampling : {proto::TraceSampling::SAMPLING_TEMPORAL,
+                          proto::TraceSampling::SAMPLING_SPATIAL}) {
+        ASSERT_TRUE(plugin.setSampling(sampling, rate));
+
+        uint64_t traced = 0;
+        for (uint64_t id = 1; id <= count; id++) {
+            traced += isIoTraced(plugin, makeIo(id, id % 3, id * 8, 8,
+                                                iotrace_event_operation_wr));
+        }
+
+        // One in rate IOs is traced, give or take
+        EXPECT_GT(traced, count / rate * 9 / 10);
+        EXPECT_LT(traced, count / rate * 11 / 10);
+    }
+
+    // IOs of a sampled block are all traced with spatial sampling
+    for (uint64_t lba = 0; lba < 8 * 1000; lba += 8) {
+        bool traced = isIoTraced(
+                plugin, makeIo(lba + 1, 1, lba, 8, iotrace_event_operation_wr));
+        for (uint64_t i = 1; i < 8; i++) {
+            ASSERT_EQ(traced,
+                      isIoTraced(plugin, makeIo(lba * 8 + i, 1, lba + i, 1,
+                                                iotrace_event_operation_rd)));
+        }
+    }
+
+    // Rate is required by sampling
+    ASSERT_FALSE(plugin.setSampling(proto::TraceSampling::SAMPLING_TEMPORAL,
+                                    0));
+    ASSERT_TRUE(plugin.setSampling(proto::TraceSampling::SAMPLING_NONE, 0));
+    EXPECT_TRUE(isIoTraced(plugin, makeIo(1, 0, 0, 8,
+                                          iotrace_event_operation_wr)));
+}
+
+TEST(IOTracePluginTest, FilterAndSampleIos) {
+    SetupTestOutput(test_info_);
+
+    IOTracePlugin plugin("Test", 1);
+
+    proto::TraceFilter filter;
+    filter.add_operation(proto::trace::IoType::Read);
+    ASSERT_TRUE(plugin.setFilter(filter));
+    ASSERT_TRUE(
+            plugin.setSampling(proto::TraceSampling::SAMPLING_TEMPORAL, 2));
+
+    // Writes are filtered out, reads are sampled, completions follow IOs
+    uint64_t traced = 0;
+    for (uint64_t id = 1; id <= 10000; id++) {
+        uint8_t operation = id % 2 ? iotrace_event_operation_rd
+                                   : iotrace_event_operation_wr;
+        bool ioTraced =
+                isIoTraced(plugin, makeIo(id, 0, id * 8, 8, operation));
+        if (operation == iotrace_event_operation_wr) {
+            ASSERT_FALSE(ioTraced);
+        }
+        traced += ioTraced;
+    }
+    EXPECT_GT(traced, 2000);
+    EXPECT_LT(traced, 3000);
+}
@@ -17,19 +17,61 @@ public:
     constexpr static uint32_t IO_QUEUE_COUNT = 1;
     typedef std::list<octf::proto::trace::ParsedEvent> IoList;
 
-    TestTrace(uint32_t eventNumber)
+    /**
+     * @brief Settings of test trace, the same as of trace command
+     */
+    struct Options {
+        Options()
+                : format(octf::proto::PROTOBUF)
+                , compress(false)
+                , segmentSize(0)
+                , segmentCount(0)
+                , conversionThreads(0)
+                , parsedIo(false)
+                , liveStatistics(false)
+                , liveStatisticsEvents(0) {}
+
+        octf::proto::TraceFormat format;
+        bool compress;
+        uint32_t segmentSize;
+        uint32_t segmentCount;
+        uint32_t conversionThreads;
+        bool parsedIo;
+        bool liveStatistics;
+
+        /**
+         * Number of events after which live statistics are read while
+         * tracing, zero if they're read after tracing only
+         */
+        uint32_t liveStatisticsEvents;
+    };
+
+    TestTrace(uint32_t eventNumber, const Options &options = Options())
             : m_pluginSrv("Test", IO_QUEUE_COUNT)
             , m_pluginClnt()
             , m_traceSummary()
+            , m_liveStatistics()
+            , m_partialLiveStatistics()
             , m_ioList() {
         m_pluginSrv.createInterface<octf::InterfaceTraceManagementImpl>("Test");
         m_pluginSrv.init();
         m_pluginClnt.init();
 
         removeTraces();
-        startTracing();
-        fillTrace(eventNumber);
+        startTracing(options);
+        if (options.liveStatistics && options.liveStatisticsEvents &&
+            options.liveStatisticsEvents < eventNumber) {
+            fillTrace(1, options.liveStatisticsEvents);
+            waitForLiveStatistics();
+            fillTrace(options.liveStatisticsEvents + 1, eventNumber);
+        } else {
+            fillTrace(1, eventNumber);
+        }
         stopTracing();
+
+        if (options.liveStatistics) {
+            m_liveStatistics = readLiveStatistics();
+        }
     }
 
     virtual ~TestTrace() {
@@ -44,8 +86,52 @@ public:
         return m_ioList;
     }
 
+    const octf::proto::LiveStatistics &getLiveStatistics() const {
+        return m_liveStatistics;
+    }
+
+    /**
+     * @brief Returns live statistics read while tracing, once they counted
+     * some of IOs traced before
+     */
+    const octf::proto::LiveStatistics &getPartialLiveStatistics() const {
+        return m_partialLiveStatistics;
+    }
+
+    /**
+     * @brief Returns number of IOs counted by live statistics
+     */
+    static uint64_t getIoCount(const octf::proto::LiveStatistics &live) {
+        uint64_t count = 0;
+        for (const auto &stats : live.statistics().statistics()) {
+            count += stats.total().count();
+        }
+        return count;
+    }
+
+    /**
+     * @brief Pops traced IOs and IOs of the parsed trace, checking that
+     * they're the same, and that no other IOs are parsed
+     */
+    void popIos(octf::ParsedIoTraceEventQueue &queue) {
+        while (!m_ioList.empty()) {
+            ASSERT_FALSE(queue.empty());
+
+            const auto &io1 = m_ioList.front().io();
+            const auto &io2 = queue.front().io();
+
+            ASSERT_EQ(io1.lba(), io2.lba());
+            ASSERT_EQ(io1.len(), io2.len());
+            ASSERT_EQ(io1.operation(), io2.operation());
+
+            m_ioList.pop_front();
+            queue.pop();
+        }
+        ASSERT_TRUE(queue.empty());
+    }
+
 private:
-    void startTracing() {
+    void startTracing(const Options &options) {
         octf::Call<octf::proto::StartTraceRequest, octf::proto::Void> call(
                 &m_pluginClnt);
 
@@ -53,6 +139,15 @@ private:
         input->set_circbuffersize(1);
         input->set_maxsize(100);
         input->set_maxduration(100);
+        input->set_format(options.format);
+        input->set_compress(options.compress);
+        input->set_segmentsize(options.segmentSize);
+        input->set_segmentcount(options.segmentCount);
+        input->set_conversionthreads(options.conversionThreads);
+        input->set_parsedio(options.parsedIo);
+        input->set_livestatistics(options.liveStatistics);
+        // Test compares all traced events, none of them can be dropped
+        input->set_fullpolicy(octf::proto::TraceFullPolicy::WAIT);
 
         m_pluginClnt.getTraceCreatingInterface()->StartTracing(
                 &call, call.getInput().get(), call.getOutput().get(), &call);
@@ -108,6 +203,37 @@ private:
         m_traceSummary = *call.getOutput().get();
     }
 
+    octf::proto::LiveStatistics readLiveStatistics() {
+        octf::Call<const octf::proto::Void, octf::proto::LiveStatistics> call(
+                &m_pluginClnt);
+        m_pluginClnt.getTraceCreatingInterface()->GetLiveStatistics(
+                &call, call.getInput().get(), call.getOutput().get(), &call);
+
+        std::chrono::milliseconds timeout(1000);
+        call.waitFor(timeout);
+        if (call.Failed()) {
+            throw octf::Exception("Cannot get live statistics, " +
+                                  call.ErrorText());
+        }
+
+        return *call.getOutput().get();
+    }
+
+    void waitForLiveStatistics() {
+        // Traces are handed over to parsed IO builder in background
+        for (uint32_t retry = 50; retry; retry--) {
+            m_partialLiveStatistics = readLiveStatistics();
+            if (getIoCount(m_partialLiveStatistics)) {
+                return;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
+        stopTracing();
+        throw octf::Exception("Live statistics are not updated while tracing");
+    }
+
     void removeTraces() {
         octf::Call<octf::proto::RemoveTracesRequest, octf::proto::TraceList>
                 call(&m_pluginClnt);
@@ -144,23 +270,28 @@ private:
         }
     }
 
-    void fillTrace(uint32_t eventNumber) {
-        if (!eventNumber) {
-            return;
-        }
-
+    void fillTrace(uint32_t first, uint32_t last) {
         // Inserting IO
-        for (uint32_t i = 1; i <= eventNumber; i++) {
-            struct iotrace_event io;
+        for (uint32_t i = first; i <= last; i++) {
+            struct iotrace_event io = {};
             iotrace_event_init_hdr(&io.hdr, iotrace_event_type_io, i, i,
                                    sizeof(io));
 
+            io.id = i;
             io.lba = rand() % std::numeric_limits<decltype(io.lba)>::max();
             io.len = rand() % 256;
             io.operation = rand() % 2 ? iotrace_event_operation_rd
                                       : iotrace_event_operation_wr;
 
-            m_pluginSrv.push(0, &io, sizeof(io));
+            if (i % 2) {
+                m_pluginSrv.push(0, &io, sizeof(io));
+            } else {
+                // Write every other event in place into the trace ring
+                octf::TraceReservation reservation;
+                ASSERT_EQ(0, m_pluginSrv.reserve(0, sizeof(io), reservation));
+                memcpy_s(reservation.trace, sizeof(io), &io, sizeof(io));
+                m_pluginSrv.commit(0, reservation);
+            }
             pushIo(io);
         }
     }
@@ -220,6 +351,8 @@ private:
     octf::IOTracePlugin m_pluginSrv;
     IOTracePluginShadow m_pluginClnt;
     octf::proto::TraceSummary m_traceSummary;
+    octf::proto::LiveStatistics m_liveStatistics;
+    octf::proto::LiveStatistics m_partialLiveStatistics;
     IoList m_ioList;
 };
 
@@ -4,6 +4,8 @@
  */
 
 #include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <list>
 #include <map>
@@ -433,6 +435,392 @@ TEST_F(TracingTest, ZcopyManyPopMany) {
     }
 }
 
+/**
+ * @test This test first push events until traces is full. Then reads events
+ * in batches until trace is empty. This procedure is repeated few times.
+ * At the end of test test checks if written events are equal read ones.
+ */
+TEST_F(TracingTest, PushManyBatchMany) {
+    constexpr uint32_t batchSize = 16;
+    int result;
+    int i = 0;
+
+    list<Event> pushedEvents, poppedEvents;
+
+    for (i = 0; i < 2048; i++) {
+        // fill log
+        do {
+            uint32_t size =
+                    generateSize(Event::getMinEventSize(), MAX_EVENT_SIZE);
+            Event e(size);
+
+            result = octf_trace_push(m_traceProducer, e.getBuffer(),
+                                     e.getBufferSize());
+            if (0 == result) {
+                pushedEvents.push_back(e);
+            }
+
+        } while (!result);
+
+        // read log
+        do {
+            octf_trace_event_handle_t ev_hndl;
+            void *events[batchSize];
+            uint32_t sizes[batchSize];
+            uint32_t count = batchSize;
+
+            result = octf_trace_get_rd_batch(m_traceConsumer, &ev_hndl, events,
+                                             sizes, &count);
+            if (0 == result) {
+                ASSERT_LT(0U, count);
+                ASSERT_GE(batchSize, count);
+
+                for (uint32_t j = 0; j < count; j++) {
+                    Event e(events[j], sizes[j], false);
+                    poppedEvents.push_back(e);
+                }
+
+                ASSERT_EQ(0, octf_trace_release_rd_batch(m_traceConsumer,
+                                                         ev_hndl));
+            }
+
+        } while (!result);
+
+        // Check if number events is equal in input and output list
+        ASSERT_EQ(pushedEvents.size(), poppedEvents.size());
+
+        EXPECT_TRUE(pushedEvents == poppedEvents);
+
+        EXPECT_EQ(1, octf_trace_is_empty(m_traceProducer));
+        EXPECT_EQ(1, octf_trace_is_empty(m_traceConsumer));
+
+        pushedEvents.clear();
+        poppedEvents.clear();
+    }
+}
+
+/**
+ * @test This test case checks if batch of events ends at the first event which
+ * is not committed yet.
+ */
+TEST_F(TracingTest, BatchStopsAtNotCommitted) {
+    octf_trace_event_handle_t wr_hndl, rd_hndl;
+    void *buffer;
+    void *events[4];
+    uint32_t sizes[4];
+    uint32_t count = 4;
+
+    Event first(MAX_EVENT_SIZE);
+    ASSERT_EQ(0, octf_trace_push(m_traceProducer, first.getBuffer(),
+                                 first.getBufferSize()));
+
+    ASSERT_EQ(0, octf_trace_get_wr_buffer(m_traceProducer, &wr_hndl, &buffer,
+                                          MAX_EVENT_SIZE));
+    Event second(buffer, MAX_EVENT_SIZE, true);
+
+    Event third(MAX_EVENT_SIZE);
+    ASSERT_EQ(0, octf_trace_push(m_traceProducer, third.getBuffer(),
+                                 third.getBufferSize()));
+
+    // Only the first event is ready
+    ASSERT_EQ(0, octf_trace_get_rd_batch(m_traceConsumer, &rd_hndl, events,
+                                         sizes, &count));
+    ASSERT_EQ(1U, count);
+    EXPECT_TRUE(first == Event(events[0], sizes[0], false));
+    ASSERT_EQ(0, octf_trace_release_rd_batch(m_traceConsumer, rd_hndl));
+
+    count = 4;
+    ASSERT_EQ(-EAGAIN, octf_trace_get_rd_batch(m_traceConsumer, &rd_hndl,
+                                               events, sizes, &count));
+
+    // Commit second event, the rest of the trace becomes ready
+    ASSERT_EQ(0, octf_trace_commit_wr_buffer(m_traceProducer, wr_hndl));
+
+    count = 4;
+    ASSERT_EQ(0, octf_trace_get_rd_batch(m_traceConsumer, &rd_hndl, events,
+                                         sizes, &count));
+    ASSERT_EQ(2U, count);
+    EXPECT_TRUE(second == Event(events[0], sizes[0], false));
+    EXPECT_TRUE(third == Event(events[1], sizes[1], false));
+    ASSERT_EQ(0, octf_trace_release_rd_batch(m_traceConsumer, rd_hndl));
+
+    EXPECT_EQ(1, octf_trace_is_empty(m_traceConsumer));
+}
+
+/**
+ * @test This test case pushes batches of events of different counts and sizes
+ * and pops them. Then it pushes a batch larger than the trace can hold and
+ * checks that the leading events of the batch are stored and the remaining
+ * ones are lost.
+ */
+TEST_F(TracingTest, PushBatchPopMany) {
+    constexpr uint32_t maxBatch = 100;
+    int result;
+
+    for (uint32_t round = 0; round < 256; round++) {
+        uint32_t count = generateSize(1, maxBatch);
+        list<Event> pushedEvents, popEvents;
+        vector<const void *> events;
+        vector<uint32_t> sizes;
+
+        for (uint32_t i = 0; i < count; i++) {
+            pushedEvents.emplace_back(
+                    generateSize(Event::getMinEventSize(), MAX_EVENT_SIZE));
+            events.push_back(pushedEvents.back().getBuffer());
+            sizes.push_back(pushedEvents.back().getBufferSize());
+        }
+
+        ASSERT_EQ(0, octf_trace_push_batch(m_traceProducer, events.data(),
+                                           sizes.data(), count));
+
+        do {
+            char content[MAX_EVENT_SIZE];
+            uint32_t size = sizeof(content);
+
+            result = octf_trace_pop(m_traceConsumer, content, &size);
+            if (0 == result) {
+                popEvents.emplace_back(content, size, false);
+            }
+        } while (!result);
+
+        ASSERT_EQ(pushedEvents.size(), popEvents.size());
+        EXPECT_TRUE(pushedEvents == popEvents);
+    }
+    EXPECT_EQ(0, octf_trace_get_lost_count(m_traceConsumer));
+
+    // Push batch which doesn't fit into trace
+    constexpr uint32_t count = BUFFER_SIZE / MAX_EVENT_SIZE;
+    list<Event> pushedEvents, popEvents;
+    vector<const void *> events;
+    vector<uint32_t> sizes;
+
+    for (uint32_t i = 0; i < count; i++) {
+        pushedEvents.push_back(Event(MAX_EVENT_SIZE));
+        events.push_back(pushedEvents.back().getBuffer());
+        sizes.push_back(pushedEvents.back().getBufferSize());
+    }
+
+    EXPECT_EQ(-ENOSPC, octf_trace_push_batch(m_traceProducer, events.data(),
+                                             sizes.data(), count));
+
+    do {
+        char content[MAX_EVENT_SIZE];
+        uint32_t size = sizeof(content);
+
+        result = octf_trace_pop(m_traceConsumer, content, &size);
+        if (0 == result) {
+            popEvents.emplace_back(content, size, false);
+        }
+    } while (!result);
+
+    ASSERT_GT(popEvents.size(), 0U);
+    EXPECT_EQ(count - popEvents.size(),
+              octf_trace_get_lost_count(m_traceConsumer));
+    pushedEvents.resize(popEvents.size());
+    EXPECT_TRUE(pushedEvents == popEvents);
+
+    // Consumer can push neither single event nor batch
+    EXPECT_EQ(-EINVAL, octf_trace_push(m_traceConsumer, events[0], sizes[0]));
+    EXPECT_EQ(-EINVAL, octf_trace_push_batch(m_traceConsumer, events.data(),
+                                             sizes.data(), count));
+}
+
+/**
+ * @test This test case pushes events from many threads concurrently into
+ * trace which has enough space for all of them. Producers reserve space
+ * without locking, so no event can be lost. At the end of test all events are
+ * popped and checked against the pushed ones.
+ */
+TEST_F(TracingTest, ConcurrentPushNoLost) {
+    constexpr uint32_t threadsNo = 16;
+    constexpr uint32_t eventsPerThread = 32;
+    vector<thread> threads;
+    vector<list<Event>> pushedEvents(threadsNo);
+    map<uint64_t, Event> expectedEvents;
+
+    for (uint32_t i = 0; i < threadsNo; i++) {
+        threads.emplace_back([this, i, &pushedEvents]() {
+            for (uint32_t j = 0; j < eventsPerThread; j++) {
+                Event e(MAX_EVENT_SIZE);
+                if (!octf_trace_push(m_traceProducer, e.getBuffer(),
+                                     e.getBufferSize())) {
+                    pushedEvents[i].push_back(e);
+                }
+            }
+        });
+    }
+
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    EXPECT_EQ(0, octf_trace_get_lost_count(m_traceConsumer));
+
+    for (auto &events : pushedEvents) {
+        ASSERT_EQ(eventsPerThread, events.size());
+        for (auto &e : events) {
+            expectedEvents[e.getSeqId()] = e;
+        }
+    }
+
+    int result;
+    do {
+        char content[MAX_EVENT_SIZE];
+        uint32_t size = sizeof(content);
+
+        result = octf_trace_pop(m_traceConsumer, content, &size);
+        if (0 == result) {
+            Event e(content, size, false);
+            auto iter = expectedEvents.find(e.getSeqId());
+            ASSERT_NE(expectedEvents.end(), iter);
+            EXPECT_TRUE(e == iter->second);
+            expectedEvents.erase(iter);
+        }
+    } while (!result);
+
+    EXPECT_TRUE(expectedEvents.empty());
+    EXPECT_EQ(1, octf_trace_is_empty(m_traceConsumer));
+}
+
+/**
+ * @test This test case pushes into trace many times more events than it can
+ * hold while the consumer pops them slowly. Producer waits for free space, so
+ * no event can be lost.
+ */
+TEST_F(TracingTest, FullPolicyWaitNoLost) {
+    constexpr uint32_t eventsNo = BUFFER_SIZE / MAX_EVENT_SIZE * 8;
+    list<Event> pushedEvents, popEvents;
+
+    ASSERT_EQ(0, octf_trace_set_full_policy(m_traceProducer,
+                                            octf_trace_full_policy_wait, 0));
+    ASSERT_EQ(-EPERM, octf_trace_set_full_policy(
+                              m_traceConsumer, octf_trace_full_policy_wait, 0));
+
+    atomic<bool> producing(true);
+    thread consumer([this, &popEvents, &producing]() {
+        bool finished;
+        int result;
+        do {
+            char content[MAX_EVENT_SIZE];
+            uint32_t size = sizeof(content);
+
+            // All events are pushed before the producer finishes
+            finished = !producing;
+            result = octf_trace_pop(m_traceConsumer, content, &size);
+            if (0 == result) {
+                popEvents.emplace_back(content, size, false);
+            } else {
+                this_thread::sleep_for(chrono::microseconds(100));
+            }
+        } while (0 == result || !finished);
+    });
+
+    for (uint32_t i = 0; i < eventsNo; i++) {
+        Event e(MAX_EVENT_SIZE);
+        if (0 == octf_trace_push(m_traceProducer, e.getBuffer(),
+                                 e.getBufferSize())) {
+            pushedEvents.push_back(e);
+        }
+    }
+
+    producing = false;
+    consumer.join();
+
+    EXPECT_EQ(0, octf_trace_get_lost_count(m_traceConsumer));
+    ASSERT_EQ(eventsNo, pushedEvents.size());
+    ASSERT_EQ(pushedEvents.size(), popEvents.size());
+    EXPECT_TRUE(pushedEvents == popEvents);
+}
+
+/**
+ * @test This test case fills the trace and checks if producer, waiting for
+ * free space with timeout, drops the event once the timeout expires.
+ */
+TEST_F(TracingTest, FullPolicyWaitBoundedTimeout) {
+    constexpr uint64_t timeoutUs = 20000;
+    Event e(MAX_EVENT_SIZE);
+
+    // Fill trace
+    while (!octf_trace_push(m_traceProducer, e.getBuffer(),
+                            e.getBufferSize())) {
+    }
+    EXPECT_EQ(1, octf_trace_get_lost_count(m_traceConsumer));
+
+    ASSERT_EQ(0, octf_trace_set_full_policy(m_traceProducer,
+                                            octf_trace_full_policy_wait_bounded,
+                                            timeoutUs));
+
+    auto start = chrono::steady_clock::now();
+    EXPECT_EQ(-ENOSPC, octf_trace_push(m_traceProducer, e.getBuffer(),
+                                       e.getBufferSize()));
+    auto waited = chrono::steady_clock::now() - start;
+
+    EXPECT_GE(waited, chrono::microseconds(timeoutUs));
+    EXPECT_EQ(2, octf_trace_get_lost_count(m_traceConsumer));
+
+    // Drain trace
+    int result;
+    do {
+        char content[MAX_EVENT_SIZE];
+        uint32_t size = sizeof(content);
+        result = octf_trace_pop(m_traceConsumer, content, &size);
+    } while (!result);
+}
+
+/**
+ * @test This test case pushes into trace many times more events than it can
+ * hold without consuming them. Producer overwrites the oldest events, so the
+ * trace keeps the latest ones. Events are not overwritten while the consumer
+ * reads them.
+ */
+TEST_F(TracingTest, FullPolicyOverwriteKeepsLatest) {
+    constexpr uint32_t eventsNo = BUFFER_SIZE / MAX_EVENT_SIZE * 4;
+    list<Event> pushedEvents, popEvents;
+
+    ASSERT_EQ(0, octf_trace_set_full_policy(
+                         m_traceProducer, octf_trace_full_policy_overwrite, 0));
+
+    for (uint32_t i = 0; i < eventsNo; i++) {
+        Event e(MAX_EVENT_SIZE);
+        ASSERT_EQ(0, octf_trace_push(m_traceProducer, e.getBuffer(),
+                                     e.getBufferSize()));
+        pushedEvents.push_back(e);
+    }
+    EXPECT_EQ(0, octf_trace_get_lost_count(m_traceConsumer));
+
+    // Consumer reads the oldest event, it can't be overwritten now
+    octf_trace_event_handle_t hndl;
+    void *buffer;
+    uint32_t size;
+    ASSERT_EQ(0, octf_trace_get_rd_buffer(m_traceConsumer, &hndl, &buffer,
+                                          &size));
+    Event e(MAX_EVENT_SIZE);
+    EXPECT_EQ(-ENOSPC, octf_trace_push(m_traceProducer, e.getBuffer(),
+                                       e.getBufferSize()));
+    EXPECT_EQ(1, octf_trace_get_lost_count(m_traceConsumer));
+    popEvents.emplace_back(buffer, size, false);
+    ASSERT_EQ(0, octf_trace_release_rd_buffer(m_traceConsumer, hndl));
+
+    int result;
+    do {
+        char content[MAX_EVENT_SIZE];
+        size = sizeof(content);
+
+        result = octf_trace_pop(m_traceConsumer, content, &size);
+        if (0 == result) {
+            popEvents.emplace_back(content, size, false);
+        }
+    } while (!result);
+
+    // Trace keeps the latest events
+    ASSERT_LT(popEvents.size(), pushedEvents.size());
+    ASSERT_GT(popEvents.size(), 0U);
+    while (pushedEvents.size() > popEvents.size()) {
+        pushedEvents.pop_front();
+    }
+    EXPECT_TRUE(pushedEvents == popEvents);
+}
+
 class TestEventLog {
 public:
     TestEventLog()
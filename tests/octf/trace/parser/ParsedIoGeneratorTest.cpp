@@ -0,0 +1,161 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+#include <octf/proto/parsedTrace.pb.h>
+#include <octf/proto/trace.pb.h>
+#include <octf/trace/parser/v2/FileSystemTree.h>
+#include <octf/trace/parser/v2/ParsedIoGenerator.h>
+
+using namespace octf;
+using namespace octf::trace::v2;
+using namespace std;
+
+/**
+ * @brief Handler keeping copies of parsed IO, the generator reuses memory
+ * of IOs handed over
+ */
+class RecordingParsedIoHandler : public IParsedIoHandler {
+public:
+    RecordingParsedIoHandler()
+            : IParsedIoHandler()
+            , m_ios() {}
+
+    void handleIO(const proto::trace::ParsedEvent &io) override {
+        m_ios.push_back(io);
+    }
+
+    void handleDeviceDescription(
+            const proto::trace::EventDeviceDescription &devDesc) override {
+        (void) devDesc;
+    }
+
+    const vector<proto::trace::ParsedEvent> &getIos() const {
+        return m_ios;
+    }
+
+private:
+    vector<proto::trace::ParsedEvent> m_ios;
+};
+
+static void addDevice(ParsedIoGenerator &generator, uint64_t sid) {
+    proto::trace::Event event;
+    event.mutable_header()->set_sid(sid);
+    event.mutable_header()->set_timestamp(sid * 10);
+
+    auto device = event.mutable_devicedescription();
+    device->set_id(1);
+    device->set_name("dev");
+    device->set_model("model");
+    device->set_size(1 << 30);
+
+    generator.addEvent(event);
+}
+
+static void addIo(ParsedIoGenerator &generator, uint64_t sid, uint64_t io) {
+    proto::trace::Event event;
+    event.mutable_header()->set_sid(sid);
+    event.mutable_header()->set_timestamp(sid * 10);
+
+    auto dst = event.mutable_io();
+    dst->set_id(io + 1);
+    dst->set_lba(io * 8);
+    dst->set_len(8);
+    dst->set_deviceid(1);
+    dst->set_operation(io % 2 ? proto::trace::IoType::Read
+                              : proto::trace::IoType::Write);
+
+    generator.addEvent(event);
+}
+
+static void addCompletion(ParsedIoGenerator &generator,
+                          uint64_t sid,
+                          uint64_t io,
+                          bool error) {
+    proto::trace::Event event;
+    event.mutable_header()->set_sid(sid);
+    event.mutable_header()->set_timestamp(sid * 10);
+
+    auto dst = event.mutable_iocompletion();
+    dst->set_refid(io + 1);
+    dst->set_lba(io * 8);
+    dst->set_len(8);
+    dst->set_deviceid(1);
+    dst->set_error(error);
+
+    generator.addEvent(event);
+}
+
+TEST(ParsedIoGeneratorTest, RecycleArenasOfParsedIo) {
+    // Far more IOs than fit into single arena and than the generator keeps
+    // queued, so arenas get reset and reused many times
+    constexpr uint64_t IO_COUNT = 30100;
+    constexpr uint64_t LOST_COMPLETION_PERIOD = 500;
+
+    RecordingParsedIoHandler handler;
+    FileSystemTree fsTree;
+    google::protobuf::Map<string, string> tags;
+    tags["test"] = "arenas";
+    ParsedIoGenerator generator(handler, fsTree, tags);
+
+    // IOs complete out of order, and some completions are lost, so the IO
+    // at the front of the queue waits until the queue limit is exceeded.
+    // IOs which lost completion come out without latency, even though they
+    // reuse memory of completed ones.
+    mt19937 random(0);
+    vector<uint64_t> ioSids(IO_COUNT);
+    vector<uint64_t> latencies(IO_COUNT, 0);
+    vector<bool> errors(IO_COUNT, false);
+    vector<uint64_t> inFlight;
+    uint64_t sid = 1;
+    addDevice(generator, sid++);
+    for (uint64_t io = 0; io < IO_COUNT || !inFlight.empty();) {
+        if (io < IO_COUNT && (inFlight.size() < 32 || random() % 2)) {
+            ioSids[io] = sid;
+            addIo(generator, sid++, io);
+            if (io % LOST_COMPLETION_PERIOD) {
+                inFlight.push_back(io);
+            }
+            io++;
+        } else {
+            auto iter = inFlight.begin() + random() % inFlight.size();
+            latencies[*iter] = (sid - ioSids[*iter]) * 10;
+            errors[*iter] = *iter % 7 == 0;
+            addCompletion(generator, sid++, *iter, errors[*iter]);
+            inFlight.erase(iter);
+        }
+    }
+
+    // IOs with lost completion are held back until the queue limit is hit
+    ASSERT_GT(generator.getQueuedCount(), 0ULL);
+    generator.flushEvents(true);
+    ASSERT_EQ(0ULL, generator.getQueuedCount());
+
+    // Each IO comes in submission order, made of its own events only
+    const auto &ios = handler.getIos();
+    ASSERT_EQ(IO_COUNT, ios.size());
+    for (uint64_t io = 0; io < IO_COUNT; io++) {
+        const auto &parsed = ios[io];
+
+        ASSERT_EQ(io + 1, parsed.header().sid());
+        ASSERT_EQ((ioSids[io] - ioSids[0]) * 10, parsed.header().timestamp());
+        ASSERT_EQ(io * 8, parsed.io().lba());
+        ASSERT_EQ(8u, parsed.io().len());
+        ASSERT_EQ(io % 2 ? proto::trace::IoType::Read
+                         : proto::trace::IoType::Write,
+                  parsed.io().operation());
+        ASSERT_EQ(latencies[io], parsed.io().latency());
+        ASSERT_EQ(errors[io], parsed.io().error());
+        ASSERT_EQ(1u, parsed.device().id());
+        ASSERT_EQ("dev", parsed.device().name());
+        ASSERT_EQ("model", parsed.device().model());
+        ASSERT_FALSE(parsed.has_file());
+        ASSERT_EQ(1, parsed.extensions().tags_size());
+        ASSERT_EQ("arenas", parsed.extensions().tags().at("test"));
+    }
+}
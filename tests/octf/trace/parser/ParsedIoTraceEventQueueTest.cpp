@@ -8,6 +8,8 @@
 #include <limits>
 #include <memory>
 #include <octf/octf.h>
+#include <octf/trace/parser/ParsedIoTraceEventHandlerStatistics.h>
+#include <octf/trace/parser/v2/ParsedIoGenerator.h>
 
 #include <octf/UtilsTest.h>
 #include <octf/trace/TraceUtilsTest.h>
@@ -75,6 +77,99 @@ TEST(ParsedIoTraceEventQueueTest, PopTraces) {
     }
 }
 
+/**
+ * @brief Traces of various settings are popped the same
+ */
+class PopTracesTest : public ::testing::TestWithParam<TestTrace::Options> {};
+
+static TestTrace::Options getOptions(proto::TraceFormat format,
+                                     bool compress,
+                                     uint32_t segmentSize,
+                                     uint32_t segmentCount,
+                                     uint32_t conversionThreads,
+                                     bool parsedIo) {
+    TestTrace::Options options;
+    options.format = format;
+    options.compress = compress;
+    options.segmentSize = segmentSize;
+    options.segmentCount = segmentCount;
+    options.conversionThreads = conversionThreads;
+    options.parsedIo = parsedIo;
+    return options;
+}
+
+INSTANTIATE_TEST_CASE_P(
+        ParsedIoTraceEventQueueTest,
+        PopTracesTest,
+        ::testing::Values(
+                getOptions(proto::TraceFormat::RAW, false, 0, 0, 0, false),
+                getOptions(proto::TraceFormat::PROTOBUF, true, 0, 0, 0, false),
+                getOptions(proto::TraceFormat::RAW, true, 0, 0, 0, false),
+                getOptions(proto::TraceFormat::RAW, false, 1, 0, 0, false),
+                getOptions(proto::TraceFormat::RAW, false, 1, 1, 0, false),
+                getOptions(proto::TraceFormat::PROTOBUF, false, 0, 0, 3, false),
+                getOptions(proto::TraceFormat::PROTOBUF, false, 1, 0, 3, false),
+                getOptions(proto::TraceFormat::PROTOBUF, false, 0, 0, 0, true),
+                getOptions(proto::TraceFormat::RAW, false, 0, 0, 0, true)));
+
+TEST_P(PopTracesTest, PopTraces) {
+    try {
+        SetupTestOutput(
+                ::testing::UnitTest::GetInstance()->current_test_info());
+        const auto &options = GetParam();
+
+        // Segmented traces span several segments of 1 MiB
+        uint64_t length = options.segmentSize ? 5 * TRACE_LENGTH : TRACE_LENGTH;
+        TestTrace trace(length, options);
+        const auto &summary = trace.getTraceSummary();
+        ASSERT_EQ(options.format, summary.format());
+        ASSERT_EQ(options.compress, summary.compressed());
+        ASSERT_EQ(length, summary.tracedevents());
+
+        if (options.parsedIo) {
+            // Parsed IO is ready once tracing stops
+            auto ext = TraceLibrary::get()
+                               .getTrace(summary.tracepath())
+                               ->getExtension(".ParsedIO");
+            ASSERT_TRUE(ext->isReady());
+        }
+
+        if (options.segmentSize) {
+            ASSERT_EQ(options.segmentSize, summary.segmentsize());
+
+            uint64_t eventCount = 0;
+            for (const auto &segment : summary.segments()) {
+                ASSERT_EQ(0U, segment.queue());
+                ASSERT_LE(segment.firstsid(), segment.lastsid());
+                ASSERT_LE(segment.firsttimestamp(), segment.lasttimestamp());
+                eventCount += segment.eventcount();
+            }
+
+            if (options.segmentCount) {
+                ASSERT_EQ(options.segmentCount, summary.segments_size());
+                ASSERT_LT(eventCount, length);
+            } else {
+                ASSERT_LT(1, summary.segments_size());
+                ASSERT_EQ(length, eventCount);
+                ASSERT_EQ(0U, summary.segments(0).index());
+            }
+
+            // Removed segments kept the oldest events
+            auto &lst = trace.getIoList();
+            while (lst.size() > eventCount) {
+                lst.pop_front();
+            }
+        }
+
+        ParsedIoTraceEventQueue queue(summary.tracepath());
+        ASSERT_NO_FATAL_FAILURE(trace.popIos(queue));
+
+    } catch (Exception &e) {
+        log::cerr << e.getMessage() << std::endl;
+        FAIL();
+    }
+}
+
 TEST(ParsedIoTraceEventQueueTest, Cancel) {
     try {
         SetupTestOutput(test_info_);
@@ -132,3 +227,51 @@ TEST(ParsedIoTraceEventQueueTest, AccessOnEmpty) {
         FAIL();
     }
 }
+
+TEST(ParsedIoTraceEventQueueTest, LiveStatistics) {
+    try {
+        SetupTestOutput(test_info_);
+
+        // Traced IOs don't complete, so while tracing parsed IO generator
+        // holds back as many of them as stay below its queue limit
+        TestTrace::Options options;
+        options.liveStatistics = true;
+        options.liveStatisticsEvents = 2 * TRACE_LENGTH;
+        TestTrace trace(3 * TRACE_LENGTH, options);
+        const auto &live = trace.getLiveStatistics().statistics();
+
+        // Statistics read while tracing count some of IOs traced so far
+        uint64_t partialCount =
+                TestTrace::getIoCount(trace.getPartialLiveStatistics());
+        ASSERT_GT(partialCount, 0ULL);
+        ASSERT_LE(partialCount,
+                  options.liveStatisticsEvents -
+                          (trace::v2::ParsedIoGenerator_QueueLimit - 1));
+
+        // Statistics gathered while tracing are the same as the ones of
+        // parsed trace
+        ParsedIoTraceEventHandlerStatistics handler(
+                trace.getTraceSummary().tracepath());
+        handler.processEvents();
+        proto::IoStatisticsSet parsed;
+        handler.getStatisticsSet().getIoStatisticsSet(&parsed);
+
+        ASSERT_EQ(parsed.statistics_size(), live.statistics_size());
+        uint64_t count = 0;
+        for (int i = 0; i < live.statistics_size(); i++) {
+            const auto &stats1 = parsed.statistics(i);
+            const auto &stats2 = live.statistics(i);
+
+            ASSERT_EQ(stats1.read().count(), stats2.read().count());
+            ASSERT_EQ(stats1.write().count(), stats2.write().count());
+            ASSERT_EQ(stats1.total().count(), stats2.total().count());
+            count += stats2.total().count();
+        }
+        ASSERT_EQ(3 * TRACE_LENGTH, count);
+        ASSERT_EQ(count, TestTrace::getIoCount(trace.getLiveStatistics()));
+
+    } catch (Exception &e) {
+        log::cerr << e.getMessage() << std::endl;
+        FAIL();
+    }
+}
@@ -0,0 +1,559 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <octf/interface/TraceManager.h>
+#include <octf/octf.h>
+#include <octf/trace/parser/TraceEventHandler.h>
+#include <octf/trace/parser/TraceFileParser.h>
+#include <octf/utils/FileOperations.h>
+#include <octf/utils/ProtoConverter.h>
+#include <octf/utils/ProtobufReaderWriter.h>
+
+#include <octf/UtilsTest.h>
+
+using namespace octf;
+using namespace std;
+
+static constexpr uint32_t QUEUE_COUNT = 2;
+static constexpr uint64_t EVENT_COUNT = 10000;
+
+/**
+ * Size of data appended to trace file at once, it doesn't match boundaries of
+ * events
+ */
+static constexpr size_t CHUNK_SIZE = 777;
+
+static void writeSummary(
+        const string &traceDir,
+        proto::TraceState state,
+        uint32_t queueCount = QUEUE_COUNT,
+        proto::TraceSidScheme sidScheme = proto::TraceSidScheme::SID_GLOBAL) {
+    proto::TraceSummary summary;
+    summary.set_state(state);
+    summary.set_queuecount(queueCount);
+    summary.set_sidscheme(sidScheme);
+
+    ProtobufReaderWriter rw(traceDir + "/" + SUMMARY_FILE_NAME);
+    if (!rw.write(summary)) {
+        throw Exception("Cannot write trace summary");
+    }
+}
+
+/**
+ * @brief Appends length delimited event to data of queue
+ */
+static void appendEvent(vector<uint8_t> &queueData,
+                        const proto::trace::Event &event) {
+    string message = event.SerializeAsString();
+    uint8_t length[protoconverter::MAX_VARINT32_BYTES];
+    int lengthSize = protoconverter::encodeVarint32(length, sizeof(length),
+                                                    message.size());
+    queueData.insert(queueData.end(), length, length + lengthSize);
+    queueData.insert(queueData.end(), message.begin(), message.end());
+}
+
+/**
+ * @brief Serializes events the way they're written by trace jobs, queues get
+ * events in turns
+ */
+static vector<vector<uint8_t>> serializeEvents(uint32_t queueCount,
+                                               uint64_t eventCount) {
+    vector<vector<uint8_t>> data(queueCount);
+    for (uint64_t sid = 1; sid <= eventCount; sid++) {
+        proto::trace::Event event;
+        event.mutable_header()->set_sid(sid);
+        event.mutable_header()->set_timestamp(sid);
+        event.mutable_io()->set_lba(sid * 8);
+        event.mutable_io()->set_len(8);
+
+        appendEvent(data[sid % queueCount], event);
+    }
+
+    return data;
+}
+
+/**
+ * @brief Writes trace files of queues at once
+ */
+static void writeQueueFiles(const string &traceDir,
+                            const vector<vector<uint8_t>> &data) {
+    for (uint32_t queue = 0; queue < data.size(); queue++) {
+        ofstream file(traceDir + "/" + TRACE_FILE_PREFIX + to_string(queue),
+                      ios::binary);
+        file.write(reinterpret_cast<const char *>(data[queue].data()),
+                   data[queue].size());
+    }
+}
+
+/**
+ * @brief Handler collecting sequence IDs of events
+ */
+class SidHandler : public TraceEventHandler<proto::trace::Event> {
+public:
+    SidHandler(const string &tracePath, bool batches, uint64_t cancelAfter)
+            : TraceEventHandler<proto::trace::Event>(tracePath)
+            , m_batches(batches)
+            , m_cancelAfter(cancelAfter)
+            , m_sids()
+            , m_batchCount(0) {}
+
+    void handleEvent(shared_ptr<proto::trace::Event> traceEvent) override {
+        m_sids.push_back(traceEvent->header().sid());
+        if (m_sids.size() == m_cancelAfter) {
+            cancel();
+        }
+    }
+
+    void handleEvents(const shared_ptr<proto::trace::Event> *traceEvents,
+                      size_t count) override {
+        m_batchCount++;
+        if (!m_batches) {
+            TraceEventHandler<proto::trace::Event>::handleEvents(traceEvents,
+                                                                 count);
+            return;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            m_sids.push_back(traceEvents[i]->header().sid());
+        }
+    }
+
+    bool compareEvents(const proto::trace::Event *a,
+                       const proto::trace::Event *b) override {
+        return a->header().sid() < b->header().sid();
+    }
+
+    const vector<uint64_t> &getSids() const {
+        return m_sids;
+    }
+
+    uint64_t getBatchCount() const {
+        return m_batchCount;
+    }
+
+private:
+    const bool m_batches;
+    const uint64_t m_cancelAfter;
+    vector<uint64_t> m_sids;
+    uint64_t m_batchCount;
+};
+
+/**
+ * @brief Parses trace and returns sequence IDs of its events
+ */
+static vector<uint64_t> parseSids(const string &tracePath, bool follow) {
+    auto compare = [](google::protobuf::Message *a,
+                      google::protobuf::Message *b) {
+        return static_cast<proto::trace::Event *>(a)->header().sid() <
+               static_cast<proto::trace::Event *>(b)->header().sid();
+    };
+    TraceFileParser parser(tracePath, make_shared<proto::trace::Event>(),
+                           compare, follow);
+    parser.init();
+
+    vector<uint64_t> sids;
+    proto::trace::Event event;
+    while (!parser.isFinished()) {
+        parser.parseTraceEvent(&event);
+        sids.push_back(event.header().sid());
+    }
+
+    return sids;
+}
+
+TEST(TraceFileParserTest, MergeQueuesDecodedInParallel) {
+    try {
+        SetupTestOutput(test_info_);
+
+        // Queues of different lengths, each longer than decoders read ahead
+        const uint32_t queueCount = 7;
+        const uint64_t eventCount = 50000;
+        const string tracePath = "Test/TraceFileParserTest";
+        const string traceDir =
+                getFrameworkConfiguration().getTraceDir() + "/" + tracePath;
+        fsutils::removeFile(traceDir);
+        ASSERT_TRUE(fsutils::createDirectory(traceDir));
+
+        writeQueueFiles(traceDir, serializeEvents(queueCount, eventCount));
+        writeSummary(traceDir, proto::TraceState::COMPLETE, queueCount);
+
+        auto sids = parseSids(tracePath, false);
+        fsutils::removeFile(traceDir);
+
+        ASSERT_EQ(eventCount, sids.size());
+        for (uint64_t i = 0; i < sids.size(); i++) {
+            ASSERT_EQ(i + 1, sids[i]);
+        }
+
+    } catch (Exception &e) {
+        log::cerr << e.getMessage() << std::endl;
+        FAIL();
+    }
+}
+
+TEST(TraceFileParserTest, MergeEventsComparingEqual) {
+    try {
+        SetupTestOutput(test_info_);
+
+        // Each queue has the same events, none of them is lost in merge
+        const uint32_t queueCount = 3;
+        const uint64_t eventCount = 1000;
+        const string tracePath = "Test/TraceFileParserTest";
+        const string traceDir =
+                getFrameworkConfiguration().getTraceDir() + "/" + tracePath;
+        fsutils::removeFile(traceDir);
+        ASSERT_TRUE(fsutils::createDirectory(traceDir));
+
+        auto data = serializeEvents(1, eventCount);
+        for (uint32_t queue = 0; queue < queueCount; queue++) {
+            ofstream file(traceDir + "/" + TRACE_FILE_PREFIX + to_string(queue),
+                          ios::binary);
+            file.write(reinterpret_cast<const char *>(data[0].data()),
+                       data[0].size());
+        }
+        writeSummary(traceDir, proto::TraceState::COMPLETE, queueCount);
+
+        auto sids = parseSids(tracePath, false);
+        fsutils::removeFile(traceDir);
+
+        ASSERT_EQ(queueCount * eventCount, sids.size());
+        for (uint64_t i = 0; i < sids.size(); i++) {
+            ASSERT_EQ(i / queueCount + 1, sids[i]);
+        }
+
+    } catch (Exception &e) {
+        log::cerr << e.getMessage() << std::endl;
+        FAIL();
+    }
+}
+
+TEST(TraceFileParserTest, HandleEventsInBatches) {
+    try {
+        SetupTestOutput(test_info_);
+
+        const string tracePath = "Test/TraceFileParserTest";
+        const string traceDir =
+                getFrameworkConfiguration().getTraceDir() + "/" + tracePath;
+        fsutils::removeFile(traceDir);
+        ASSERT_TRUE(fsutils::createDirectory(traceDir));
+        writeQueueFiles(traceDir, serializeEvents(QUEUE_COUNT, EVENT_COUNT));
+        writeSummary(traceDir, proto::TraceState::COMPLETE);
+
+        const uint64_t batchSize =
+                TraceEventHandler<proto::trace::Event>::EVENT_BATCH_SIZE;
+        SidHandler batchHandler(tracePath, true, 0);
+        batchHandler.processEvents();
+
+        // Handler processing single events stops as soon as it cancels,
+        // even in the middle of a batch
+        const uint64_t cancelAfter = batchSize + batchSize / 2;
+        SidHandler eventHandler(tracePath, false, cancelAfter);
+        eventHandler.processEvents();
+        fsutils::removeFile(traceDir);
+
+        const auto &sids = batchHandler.getSids();
+        ASSERT_EQ(EVENT_COUNT, sids.size());
+        for (uint64_t i = 0; i < sids.size(); i++) {
+            ASSERT_EQ(i + 1, sids[i]);
+        }
+        ASSERT_EQ((EVENT_COUNT + batchSize - 1) / batchSize,
+                  batchHandler.getBatchCount());
+
+        ASSERT_EQ(cancelAfter, eventHandler.getSids().size());
+        ASSERT_EQ(2, eventHandler.getBatchCount());
+        for (uint64_t i = 0; i < cancelAfter; i++) {
+            ASSERT_EQ(i + 1, eventHandler.getSids()[i]);
+        }
+
+    } catch (Exception &e) {
+        log::cerr << e.getMessage() << std::endl;
+        FAIL();
+    }
+}
+
+TEST(TraceFileParserTest, FollowTraceBeingCaptured) {
+    try {
+        SetupTestOutput(test_info_);
+
+        const string tracePath = "Test/TraceFileParserTest";
+        const string traceDir =
+                getFrameworkConfiguration().getTraceDir() + "/" + tracePath;
+        fsutils::removeFile(traceDir);
+        ASSERT_TRUE(fsutils::createDirectory(traceDir));
+        writeSummary(traceDir, proto::TraceState::RUNNING);
+
+        auto data = serializeEvents(QUEUE_COUNT, EVENT_COUNT);
+
+        // Parse trace while it's being written
+        vector<uint64_t> sids;
+        string error;
+        thread follower([&tracePath, &sids, &error]() {
+            try {
+                sids = parseSids(tracePath, true);
+            } catch (Exception &e) {
+                error = e.getMessage();
+            }
+        });
+
+        // Files are created while the trace is running, and appended in
+        // chunks splitting events
+        vector<ofstream> files(QUEUE_COUNT);
+        vector<size_t> written(QUEUE_COUNT, 0);
+        for (bool pending = true; pending;) {
+            pending = false;
+            for (uint32_t queue = 0; queue < QUEUE_COUNT; queue++) {
+                auto &queueData = data[queue];
+                size_t size =
+                        min(CHUNK_SIZE, queueData.size() - written[queue]);
+                if (!size) {
+                    continue;
+                }
+
+                auto &file = files[queue];
+                if (!file.is_open()) {
+                    file.open(traceDir + "/" + TRACE_FILE_PREFIX +
+                                      to_string(queue),
+                              ios::binary);
+                }
+                file.write(reinterpret_cast<const char *>(queueData.data() +
+                                                          written[queue]),
+                           size);
+                file.flush();
+                written[queue] += size;
+                pending = true;
+            }
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        for (auto &file : files) {
+            file.close();
+        }
+
+        writeSummary(traceDir, proto::TraceState::COMPLETE);
+        follower.join();
+        fsutils::removeFile(traceDir);
+
+        ASSERT_EQ("", error);
+        ASSERT_EQ(EVENT_COUNT, sids.size());
+        for (uint64_t i = 0; i < sids.size(); i++) {
+            ASSERT_EQ(i + 1, sids[i]);
+        }
+
+    } catch (Exception &e) {
+        log::cerr << e.getMessage() << std::endl;
+        FAIL();
+    }
+}
+
+TEST(TraceFileParserTest, MergeQueuesOfPerQueueSids) {
+    try {
+        SetupTestOutput(test_info_);
+
+        const uint32_t queueCount = 5;
+        const uint64_t eventCount = 20000;
+        const string tracePath = "Test/TraceFileParserTest";
+        const string traceDir =
+                getFrameworkConfiguration().getTraceDir() + "/" + tracePath;
+        fsutils::removeFile(traceDir);
+        ASSERT_TRUE(fsutils::createDirectory(traceDir));
+
+        // Events go to queues at random, and each queue numbers its events
+        // from 1 with queue id in upper bits. Timestamps grow every few
+        // events, so queues have events of equal timestamps too.
+        mt19937 generator(0);
+        vector<vector<uint8_t>> data(queueCount);
+        vector<uint64_t> queueSids(queueCount, 0);
+        vector<tuple<uint64_t, uint64_t, uint64_t>> expected;
+        uint64_t timestamp = 0;
+        for (uint64_t i = 0; i < eventCount; i++) {
+            if (generator() % 3 == 0) {
+                timestamp++;
+            }
+            uint32_t queue = generator() % queueCount;
+
+            proto::trace::Event event;
+            event.mutable_header()->set_sid(
+                    (static_cast<uint64_t>(queue) << 48) | ++queueSids[queue]);
+            event.mutable_header()->set_timestamp(timestamp);
+            event.mutable_io()->set_lba(i * 8);
+            event.mutable_io()->set_len(8);
+            appendEvent(data[queue], event);
+            expected.emplace_back(timestamp, event.header().sid(), i * 8);
+        }
+        writeQueueFiles(traceDir, data);
+        writeSummary(traceDir, proto::TraceState::COMPLETE, queueCount,
+                     proto::TraceSidScheme::SID_PER_QUEUE);
+
+        auto compare = [](google::protobuf::Message *a,
+                          google::protobuf::Message *b) {
+            return static_cast<proto::trace::Event *>(a)->header().sid() <
+                   static_cast<proto::trace::Event *>(b)->header().sid();
+        };
+        TraceFileParser parser(tracePath, make_shared<proto::trace::Event>(),
+                               compare, false);
+        parser.init();
+
+        vector<proto::trace::Event> events;
+        proto::trace::Event event;
+        while (!parser.isFinished()) {
+            parser.parseTraceEvent(&event);
+            events.push_back(event);
+        }
+        parser.deinit();
+        fsutils::removeFile(traceDir);
+
+        // Events are ordered by timestamps, events of equal timestamps by
+        // queue, keeping order within queue, and sids are assigned anew
+        sort(expected.begin(), expected.end());
+        ASSERT_EQ(eventCount, events.size());
+        for (uint64_t i = 0; i < events.size(); i++) {
+            ASSERT_EQ(i + 1, events[i].header().sid());
+            ASSERT_EQ(get<0>(expected[i]), events[i].header().timestamp());
+            ASSERT_EQ(get<2>(expected[i]), events[i].io().lba());
+        }
+
+    } catch (Exception &e) {
+        log::cerr << e.getMessage() << std::endl;
+        FAIL();
+    }
+}
+
+/**
+ * @brief Follows trace of two queues, the second one has no event written
+ * until the other one is parsed, and it resumes with an event of given sid
+ *
+ * @return Number of events parsed while the second queue was idle
+ */
+static uint64_t followTraceWithIdleQueue(const string &tracePath,
+                                         uint64_t resumedSid,
+                                         vector<uint64_t> &sids,
+                                         string &error) {
+    const string traceDir =
+            getFrameworkConfiguration().getTraceDir() + "/" + tracePath;
+    writeSummary(traceDir, proto::TraceState::RUNNING);
+
+    // The second queue has no event written until the end of trace
+    auto data = serializeEvents(1, EVENT_COUNT);
+    data.emplace_back();
+    proto::trace::Event resumed;
+    resumed.mutable_header()->set_sid(resumedSid);
+    resumed.mutable_header()->set_timestamp(resumedSid);
+    vector<uint8_t> resumedData;
+    appendEvent(resumedData, resumed);
+    writeQueueFiles(traceDir, data);
+
+    atomic<uint64_t> parsed(0);
+    thread follower([&tracePath, &parsed, &sids, &error]() {
+        try {
+            auto compare = [](google::protobuf::Message *a,
+                              google::protobuf::Message *b) {
+                return static_cast<proto::trace::Event *>(a)->header().sid() <
+                       static_cast<proto::trace::Event *>(b)->header().sid();
+            };
+            TraceFileParser parser(tracePath,
+                                   make_shared<proto::trace::Event>(),
+                                   compare, true);
+            parser.init();
+
+            proto::trace::Event event;
+            while (!parser.isFinished()) {
+                parser.parseTraceEvent(&event);
+                sids.push_back(event.header().sid());
+                parsed++;
+            }
+        } catch (Exception &e) {
+            error = e.getMessage();
+        }
+    });
+
+    // Events of the first queue are parsed while the other one is idle.
+    // Parsing of an event takes the next one of its queue, so the call
+    // returning the last event waits for more of them.
+    auto timeout = chrono::steady_clock::now() + chrono::seconds(30);
+    while (parsed < EVENT_COUNT - 1 && chrono::steady_clock::now() < timeout) {
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    uint64_t parsedWhileIdle = parsed;
+
+    // Idle queue joins the merge once it has an event
+    {
+        ofstream file(traceDir + "/" + TRACE_FILE_PREFIX + "1",
+                      ios::binary | ios::app);
+        file.write(reinterpret_cast<const char *>(resumedData.data()),
+                   resumedData.size());
+    }
+    writeSummary(traceDir, proto::TraceState::COMPLETE);
+    follower.join();
+
+    return parsedWhileIdle;
+}
+
+TEST(TraceFileParserTest, FollowTraceWithIdleQueue) {
+    try {
+        SetupTestOutput(test_info_);
+
+        const string tracePath = "Test/TraceFileParserTest";
+        const string traceDir =
+                getFrameworkConfiguration().getTraceDir() + "/" + tracePath;
+        fsutils::removeFile(traceDir);
+        ASSERT_TRUE(fsutils::createDirectory(traceDir));
+
+        vector<uint64_t> sids;
+        string error;
+        uint64_t parsedWhileIdle = followTraceWithIdleQueue(
+                tracePath, EVENT_COUNT + 1, sids, error);
+        fsutils::removeFile(traceDir);
+
+        ASSERT_EQ("", error);
+        ASSERT_EQ(EVENT_COUNT - 1, parsedWhileIdle);
+        ASSERT_EQ(EVENT_COUNT + 1, sids.size());
+        for (uint64_t i = 0; i < sids.size(); i++) {
+            ASSERT_EQ(i + 1, sids[i]);
+        }
+
+    } catch (Exception &e) {
+        log::cerr << e.getMessage() << std::endl;
+        FAIL();
+    }
+}
+
+TEST(TraceFileParserTest, FollowTraceWithIdleQueueResumedOutOfOrder) {
+    try {
+        SetupTestOutput(test_info_);
+
+        const string tracePath = "Test/TraceFileParserTest";
+        const string traceDir =
+                getFrameworkConfiguration().getTraceDir() + "/" + tracePath;
+        fsutils::removeFile(traceDir);
+        ASSERT_TRUE(fsutils::createDirectory(traceDir));
+
+        // Idle queue resumes with an event preceding ones parsed already
+        vector<uint64_t> sids;
+        string error;
+        uint64_t parsedWhileIdle = followTraceWithIdleQueue(
+                tracePath, EVENT_COUNT / 2, sids, error);
+        fsutils::removeFile(traceDir);
+
+        ASSERT_EQ(EVENT_COUNT - 1, parsedWhileIdle);
+        ASSERT_NE(string::npos, error.find("out of order"));
+
+        // No event is returned out of order
+        ASSERT_TRUE(is_sorted(sids.begin(), sids.end()));
+
+    } catch (Exception &e) {
+        log::cerr << e.getMessage() << std::endl;
+        FAIL();
+    }
+}
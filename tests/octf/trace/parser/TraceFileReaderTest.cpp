@@ -0,0 +1,119 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstddef>
+#include <string>
+#include <octf/interface/TraceManager.h>
+#include <octf/octf.h>
+#include <octf/trace/compressed_trace_file.h>
+#include <octf/trace/parser/TraceFileReader.h>
+
+#include <octf/UtilsTest.h>
+#include <octf/trace/TraceUtilsTest.h>
+
+using namespace octf;
+using namespace std;
+
+static constexpr uint64_t TRACE_LENGTH = 10000;
+
+/**
+ * @brief Reads all events of trace file
+ *
+ * @return Error reported by the reader, empty if none
+ */
+static string readTraceFile(const string &path) {
+    try {
+        TraceFileReader reader(path, 0);
+        reader.init();
+        proto::trace::Event event;
+        while (!reader.isFinished()) {
+            reader.readTraceEvent(event);
+        }
+        reader.deinit();
+    } catch (Exception &e) {
+        return e.getMessage();
+    }
+
+    return "";
+}
+
+/**
+ * @brief Creates compressed trace and returns path to its file
+ */
+static string createCompressedTrace(unique_ptr<TestTrace> &trace) {
+    TestTrace::Options options;
+    options.compress = true;
+    trace.reset(new TestTrace(TRACE_LENGTH, options));
+
+    const auto &summary = trace->getTraceSummary();
+    return getFrameworkConfiguration().getTraceDir() + "/" +
+           summary.tracepath() + "/" + TRACE_FILE_PREFIX + "0";
+}
+
+TEST(TraceFileReaderTest, CompressedTraceFrameCorrupted) {
+    try {
+        SetupTestOutput(test_info_);
+
+        unique_ptr<TestTrace> trace;
+        auto path = createCompressedTrace(trace);
+        ASSERT_EQ("", readTraceFile(path));
+
+        int fd = open(path.c_str(), O_RDWR);
+        ASSERT_GE(fd, 0);
+
+        // Checksum of the first frame doesn't match its data
+        struct octf_compressed_trace_file_hdr hdr;
+        ASSERT_EQ(sizeof(hdr), pread(fd, &hdr, sizeof(hdr), 0));
+        off_t offset = hdr.hdr_size +
+                       offsetof(struct octf_compressed_trace_frame_hdr,
+                                checksum);
+        uint32_t checksum;
+        ASSERT_EQ(sizeof(checksum),
+                  pread(fd, &checksum, sizeof(checksum), offset));
+        checksum ^= 1;
+        ASSERT_EQ(sizeof(checksum),
+                  pwrite(fd, &checksum, sizeof(checksum), offset));
+        close(fd);
+
+        auto error = readTraceFile(path);
+        ASSERT_NE(string::npos,
+                  error.find("Corrupted frame of compressed trace file"))
+                << error;
+
+    } catch (Exception &e) {
+        log::cerr << e.getMessage() << std::endl;
+        FAIL();
+    }
+}
+
+TEST(TraceFileReaderTest, CompressedTraceTruncated) {
+    try {
+        SetupTestOutput(test_info_);
+
+        unique_ptr<TestTrace> trace;
+        auto path = createCompressedTrace(trace);
+        ASSERT_EQ("", readTraceFile(path));
+
+        // The last frame is cut short
+        int fd = open(path.c_str(), O_RDWR);
+        ASSERT_GE(fd, 0);
+        off_t size = lseek(fd, 0, SEEK_END);
+        ASSERT_GT(size, 0);
+        ASSERT_EQ(0, ftruncate(fd, size - 1));
+        close(fd);
+
+        auto error = readTraceFile(path);
+        ASSERT_NE(string::npos,
+                  error.find("Couldn't parse frame of compressed trace file"))
+                << error;
+
+    } catch (Exception &e) {
+        log::cerr << e.getMessage() << std::endl;
+        FAIL();
+    }
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <thread>
+#include <vector>
+#include <octf/utils/AsyncFileWriter.h>
+
+using namespace octf;
+using namespace std;
+
+TEST(AsyncFileWriter, WritesDataInOrder) {
+    char path[] = "/tmp/octf-async-file-writer-XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+
+    mt19937 generator(0);
+    vector<uint8_t> expected;
+
+    {
+        AsyncFileWriter writer(path);
+        ASSERT_TRUE(writer.open());
+
+        // Chunks of random size, and one larger than the writer's buffer
+        vector<size_t> sizes;
+        for (size_t total = 0; total < 20 * 1024 * 1024;) {
+            size_t size = generator() % (64 * 1024) + 1;
+            sizes.push_back(size);
+            total += size;
+        }
+        sizes.push_back(6 * 1024 * 1024 + 7);
+        sizes.push_back(13);
+
+        for (auto size : sizes) {
+            uint8_t *buffer = writer.getBuffer(size);
+            ASSERT_NE(nullptr, buffer);
+
+            for (size_t i = 0; i < size; i++) {
+                buffer[i] = static_cast<uint8_t>(generator());
+            }
+            expected.insert(expected.end(), buffer, buffer + size);
+
+            writer.commit(size);
+            EXPECT_EQ(static_cast<int64_t>(expected.size()), writer.getSize());
+        }
+
+        EXPECT_TRUE(writer.close());
+        EXPECT_FALSE(writer.isOpen());
+    }
+
+    ifstream file(path, ios::binary);
+    vector<uint8_t> actual((istreambuf_iterator<char>(file)),
+                           istreambuf_iterator<char>());
+    unlink(path);
+
+    ASSERT_EQ(expected.size(), actual.size());
+    EXPECT_TRUE(expected == actual);
+}
+
+TEST(AsyncFileWriter, FlushesDataWrittenSlowly) {
+    char path[] = "/tmp/octf-async-file-writer-XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+
+    auto readFile = [&path]() {
+        ifstream file(path, ios::binary);
+        return vector<uint8_t>((istreambuf_iterator<char>(file)),
+                               istreambuf_iterator<char>());
+    };
+
+    mt19937 generator(0);
+    vector<uint8_t> expected;
+
+    AsyncFileWriter writer(path, chrono::milliseconds(10));
+    ASSERT_TRUE(writer.open());
+
+    // Data far from filling the buffer, and of unaligned size, reaches the
+    // file while it's open. Data following it is flushed too.
+    for (size_t size : {5000, 3, 9000}) {
+        uint8_t *buffer = writer.getBuffer(size);
+        for (size_t i = 0; i < size; i++) {
+            buffer[i] = static_cast<uint8_t>(generator());
+        }
+        expected.insert(expected.end(), buffer, buffer + size);
+        writer.commit(size);
+
+        // Data is flushed within the flush period, given longer if the
+        // machine is busy
+        auto actual = readFile();
+        for (int retry = 1000; retry && actual.size() != expected.size();
+             retry--) {
+            this_thread::sleep_for(chrono::milliseconds(10));
+            actual = readFile();
+        }
+        ASSERT_EQ(expected.size(), actual.size());
+        ASSERT_TRUE(expected == actual);
+    }
+
+    EXPECT_TRUE(writer.close());
+    auto actual = readFile();
+    unlink(path);
+
+    ASSERT_EQ(expected.size(), actual.size());
+    EXPECT_TRUE(expected == actual);
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright(c) 2012-2018 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+#include <octf/utils/CycleClock.h>
+
+using namespace octf;
+using namespace std;
+
+static uint64_t getSystemTimestamp() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+                   chrono::system_clock::now().time_since_epoch())
+            .count();
+}
+
+TEST(CycleClock, FollowsSystemClock) {
+    constexpr uint64_t toleranceNs = 5 * 1000 * 1000;
+    CycleClock clock;
+
+    if (clock.isCycleCounter()) {
+        EXPECT_GT(clock.getFrequency(), 0U);
+        EXPECT_EQ("tsc", clock.getSource());
+    } else {
+        EXPECT_EQ(0U, clock.getFrequency());
+        EXPECT_EQ("system", clock.getSource());
+    }
+
+    for (int i = 0; i < 10; i++) {
+        uint64_t before = getSystemTimestamp();
+        uint64_t now = clock.now();
+        uint64_t after = getSystemTimestamp();
+
+        EXPECT_GE(now + toleranceNs, before);
+        EXPECT_LE(now, after + toleranceNs);
+
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+}
+
+TEST(CycleClock, Monotonic) {
+    CycleClock clock;
+    uint64_t last = clock.now();
+
+    for (int i = 0; i < 1000000; i++) {
+        uint64_t now = clock.now();
+        ASSERT_GE(now, last);
+        last = now;
+    }
+}
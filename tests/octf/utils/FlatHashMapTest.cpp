@@ -0,0 +1,68 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <gtest/gtest.h>
+#include <map>
+#include <random>
+#include <string>
+#include <octf/utils/FlatHashMap.h>
+
+using namespace octf;
+using namespace std;
+
+TEST(FlatHashMap, MatchesOrderedMap) {
+    mt19937_64 generator(0);
+    FlatHashMap<uint64_t> map;
+    std::map<uint64_t, uint64_t> expected;
+
+    // Keys from a small range, so they're inserted and removed repeatedly,
+    // and key 0 is among them
+    for (uint64_t i = 0; i < 200000; i++) {
+        uint64_t key = generator() % 5000;
+        switch (generator() % 3) {
+        case 0:
+            map[key] = i;
+            expected[key] = i;
+            break;
+        case 1:
+            ASSERT_EQ(expected.erase(key) != 0, map.erase(key));
+            break;
+        default: {
+            auto value = map.find(key);
+            auto iter = expected.find(key);
+            if (iter == expected.end()) {
+                ASSERT_EQ(nullptr, value);
+            } else {
+                ASSERT_NE(nullptr, value);
+                ASSERT_EQ(iter->second, *value);
+            }
+        } break;
+        }
+        ASSERT_EQ(expected.size(), map.size());
+    }
+
+    for (const auto &entry : expected) {
+        ASSERT_NE(nullptr, map.find(entry.first));
+        ASSERT_EQ(entry.second, *map.find(entry.first));
+    }
+
+    map.clear();
+    ASSERT_TRUE(map.empty());
+    ASSERT_EQ(nullptr, map.find(expected.begin()->first));
+}
+
+TEST(FlatHashMap, InsertsValueInitialized) {
+    FlatHashMap<string> map(4);
+
+    ASSERT_EQ("", map[7]);
+    map[7] = "seven";
+    ASSERT_EQ("seven", map[7]);
+
+    // Removed value doesn't come back when the key is inserted again
+    ASSERT_TRUE(map.erase(7));
+    ASSERT_FALSE(map.erase(7));
+    ASSERT_EQ("", map[7]);
+    ASSERT_EQ(1U, map.size());
+}
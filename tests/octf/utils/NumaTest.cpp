@@ -0,0 +1,60 @@
+/*
+ * Copyright(c) 2012-2020 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <gtest/gtest.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <vector>
+#include <octf/utils/Numa.h>
+
+using namespace octf;
+using namespace std;
+
+TEST(NumaTest, CpuBelongsToItsNode) {
+    int cpu = sched_getcpu();
+    ASSERT_GE(cpu, 0);
+
+    // Topology may be not known, e.g. in containers without sysfs
+    int node = numautils::getCpuNode(cpu);
+    if (numautils::NO_NUMA_NODE == node) {
+        return;
+    }
+    ASSERT_GE(node, 0);
+
+    vector<uint32_t> cpus;
+    ASSERT_TRUE(numautils::getNodeCpus(node, cpus));
+    EXPECT_NE(cpus.end(), find(cpus.begin(), cpus.end(), cpu));
+}
+
+TEST(NumaTest, UnknownCpuAndNode) {
+    EXPECT_EQ(numautils::NO_NUMA_NODE, numautils::getCpuNode(UINT32_MAX));
+
+    vector<uint32_t> cpus(1, 0);
+    EXPECT_FALSE(numautils::getNodeCpus(numautils::NO_NUMA_NODE, cpus));
+    EXPECT_TRUE(cpus.empty());
+    EXPECT_FALSE(numautils::getNodeCpus(INT32_MAX, cpus));
+    EXPECT_TRUE(cpus.empty());
+}
+
+TEST(NumaTest, SetPreferredNode) {
+    const size_t size = 4 * 4096;
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT_NE(MAP_FAILED, addr);
+
+    EXPECT_FALSE(
+            numautils::setPreferredNode(addr, size, numautils::NO_NUMA_NODE));
+
+    // Policy may be not supported by the kernel, memory stays usable anyway
+    int node = numautils::getCpuNode(sched_getcpu());
+    if (numautils::NO_NUMA_NODE != node) {
+        numautils::setPreferredNode(addr, size, node);
+    }
+    static_cast<char *>(addr)[size - 1] = 'x';
+    EXPECT_EQ('x', static_cast<char *>(addr)[size - 1]);
+
+    munmap(addr, size);
+}